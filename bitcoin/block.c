@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <bitcoin/block.h>
 #include <bitcoin/chainparams.h>
+#include <bitcoin/script.h>
 #include <bitcoin/tx.h>
 #include <ccan/mem/mem.h>
 #include <ccan/str/hex/hex.h>
@@ -135,90 +136,434 @@ static void bitcoin_block_pull_dynafed_details(const u8 **cursor, size_t *len, s
 	}
 }
 
-/* Encoding is <blockhdr> <varint-num-txs> <tx>... */
-struct bitcoin_block *
-bitcoin_block_from_hex(const tal_t *ctx, const struct chainparams *chainparams,
-		       const char *hex, size_t hexlen)
+static void pull_block_header(const struct chainparams *chainparams,
+			      const u8 **p, size_t *len,
+			      struct bitcoin_block_hdr *hdr)
 {
-	struct bitcoin_block *b;
-	u8 *linear_tx;
-	const u8 *p;
-	size_t len, i, num, templen;
 	struct sha256_ctx shactx;
+	size_t templen;
 	bool is_dynafed;
 	u32 height;
 
-	if (hexlen && hex[hexlen-1] == '\n')
-		hexlen--;
-
-	/* Set up the block for success. */
-	b = tal(ctx, struct bitcoin_block);
-
-	/* De-hex the array. */
-	len = hex_data_size(hexlen);
-	p = linear_tx = tal_arr(ctx, u8, len);
-	if (!hex_decode(hex, hexlen, linear_tx, len))
-		return tal_free(b);
-
 	sha256_init(&shactx);
 
-	b->hdr.version = pull_le32(&p, &len);
-	sha256_le32(&shactx, b->hdr.version);
+	hdr->version = pull_le32(p, len);
+	sha256_le32(&shactx, hdr->version);
 
-	pull(&p, &len, &b->hdr.prev_hash, sizeof(b->hdr.prev_hash));
-	sha256_update(&shactx, &b->hdr.prev_hash, sizeof(b->hdr.prev_hash));
+	pull(p, len, &hdr->prev_hash, sizeof(hdr->prev_hash));
+	sha256_update(&shactx, &hdr->prev_hash, sizeof(hdr->prev_hash));
 
-	pull(&p, &len, &b->hdr.merkle_hash, sizeof(b->hdr.merkle_hash));
-	sha256_update(&shactx, &b->hdr.merkle_hash, sizeof(b->hdr.merkle_hash));
+	pull(p, len, &hdr->merkle_hash, sizeof(hdr->merkle_hash));
+	sha256_update(&shactx, &hdr->merkle_hash, sizeof(hdr->merkle_hash));
 
-	b->hdr.timestamp = pull_le32(&p, &len);
-	sha256_le32(&shactx, b->hdr.timestamp);
+	hdr->timestamp = pull_le32(p, len);
+	sha256_le32(&shactx, hdr->timestamp);
 
 	if (is_elements(chainparams)) {
 		/* A dynafed block is signalled by setting the MSB of the version. */
-		is_dynafed = (b->hdr.version >> 31 == 1);
+		is_dynafed = (hdr->version >> 31 == 1);
 
 		/* elements_header.height */
-		height = pull_le32(&p, &len);
+		height = pull_le32(p, len);
 		sha256_le32(&shactx, height);
 
 		if (is_dynafed) {
-			bitcoin_block_pull_dynafed_details(&p, &len, &shactx);
+			bitcoin_block_pull_dynafed_details(p, len, &shactx);
 		} else {
 			/* elemens_header.challenge */
-			templen = pull_varint(&p, &len);
+			templen = pull_varint(p, len);
 			sha256_varint(&shactx, templen);
-			sha256_update(&shactx, p, templen);
-			pull(&p, &len, NULL, templen);
+			sha256_update(&shactx, *p, templen);
+			pull(p, len, NULL, templen);
 
 			/* elements_header.solution. Not hashed since it'd be
 			 * a circular dependency. */
-			templen = pull_varint(&p, &len);
-			pull(&p, &len, NULL, templen);
+			templen = pull_varint(p, len);
+			pull(p, len, NULL, templen);
 		}
 
 	} else {
-		b->hdr.target = pull_le32(&p, &len);
-		sha256_le32(&shactx, b->hdr.target);
+		hdr->target = pull_le32(p, len);
+		sha256_le32(&shactx, hdr->target);
+
+		hdr->nonce = pull_le32(p, len);
+		sha256_le32(&shactx, hdr->nonce);
+	}
+	sha256_double_done(&shactx, &hdr->hash.shad);
+}
+
+/* Smallest possible serializations, so a bad count can't make us
+ * allocate more than the block could hold. */
+#define MIN_TX_LEN (4 + 1 + 1 + 4)
+#define MIN_TXIN_LEN (36 + 1 + 4)
+#define MIN_TXOUT_LEN (8 + 1)
+
+/* Make room for @extra more members of a malloc'd array. */
+static bool reserve(void **arr, size_t *alloced, size_t used,
+		    size_t extra, size_t elemsize)
+{
+	size_t want;
+	void *p;
+
+	if (used + extra <= *alloced)
+		return true;
+	want = *alloced * 2;
+	if (want < used + extra)
+		want = used + extra;
+	p = realloc(*arr, want * elemsize);
+	if (!p)
+		return false;
+	*arr = p;
+	*alloced = want;
+	return true;
+}
+
+struct scan_alloced {
+	size_t ins, outs, p2wsh;
+};
+
+/* Like is_p2wsh(), but @script isn't a tal object. */
+static bool script_is_p2wsh(const u8 *script, size_t script_len)
+{
+	return script_len == BITCOIN_SCRIPTPUBKEY_P2WSH_LEN
+		&& script[0] == OP_0
+		&& script[1] == sizeof(struct sha256);
+}
+
+/* Encoding is <version> [<0> <flag>] <varint-num-ins> <in>...
+ * <varint-num-outs> <out>... [<witness>...] <locktime>, and the txid is
+ * the double-sha of all but the optional parts. */
+static bool scan_tx(struct block_scan *scan, struct scan_alloced *alloced,
+		    size_t txindex, const u8 **p, size_t *len)
+{
+	struct block_scan_tx *stx = &scan->txs[txindex];
+	struct sha256_ctx shactx;
+	const u8 *body;
+	bool segwit;
+	u64 n;
+
+	stx->raw = *p;
+	sha256_init(&shactx);
+
+	if (!pull(p, len, NULL, 4))
+		return false;
+	sha256_update(&shactx, stx->raw, 4);
+
+	/* BIP144: no inputs is really the segwit marker, then a flag. */
+	segwit = (*len >= 2 && (*p)[0] == 0);
+	if (segwit)
+		pull(p, len, NULL, 2);
+
+	body = *p;
+	n = pull_varint(p, len);
+	if (!*p || n > *len / MIN_TXIN_LEN)
+		return false;
+	if (!reserve((void **)&scan->ins, &alloced->ins, scan->num_ins, n,
+		     sizeof(*scan->ins)))
+		return false;
+	stx->first_in = scan->num_ins;
+	stx->num_ins = n;
+	for (size_t i = 0; i < stx->num_ins; i++) {
+		struct block_txin *in = &scan->ins[scan->num_ins++];
+
+		in->txindex = txindex;
+		pull(p, len, &in->prevout.txid, sizeof(in->prevout.txid));
+		in->prevout.n = pull_le32(p, len);
+		/* scriptSig */
+		n = pull_varint(p, len);
+		if (!*p || !pull(p, len, NULL, n))
+			return false;
+		/* nSequence */
+		if (!pull(p, len, NULL, 4))
+			return false;
+	}
+
+	n = pull_varint(p, len);
+	if (!*p || n > *len / MIN_TXOUT_LEN)
+		return false;
+	if (!reserve((void **)&scan->outs, &alloced->outs, scan->num_outs, n,
+		     sizeof(*scan->outs)))
+		return false;
+	stx->first_out = scan->num_outs;
+	stx->num_outs = n;
+	for (size_t i = 0; i < stx->num_outs; i++) {
+		struct block_txout *out = &scan->outs[scan->num_outs];
+		le64 amount;
+
+		out->txindex = txindex;
+		out->outnum = i;
+		out->amount_is_main = true;
+		pull(p, len, &amount, sizeof(amount));
+		out->amount.satoshis = le64_to_cpu(amount); /* Raw: from wire */
+		out->script_len = pull_varint(p, len);
+		if (!*p)
+			return false;
+		out->script = pull(p, len, NULL, out->script_len);
+		if (!*p)
+			return false;
+
+		if (script_is_p2wsh(out->script, out->script_len)) {
+			if (!reserve((void **)&scan->p2wsh, &alloced->p2wsh,
+				     scan->num_p2wsh, 1, sizeof(*scan->p2wsh)))
+				return false;
+			scan->p2wsh[scan->num_p2wsh++] = scan->num_outs;
+		}
+		scan->num_outs++;
+	}
+	sha256_update(&shactx, body, *p - body);
+
+	if (segwit) {
+		for (size_t i = 0; i < stx->num_ins; i++) {
+			u64 items = pull_varint(p, len);
+			for (u64 j = 0; *p && j < items; j++) {
+				n = pull_varint(p, len);
+				if (!*p || !pull(p, len, NULL, n))
+					return false;
+			}
+			if (!*p)
+				return false;
+		}
+	}
+
+	/* nLocktime */
+	if (!pull(p, len, NULL, 4))
+		return false;
+	sha256_update(&shactx, *p - 4, 4);
+	sha256_double_done(&shactx, &stx->txid.shad);
+	stx->rawlen = *p - stx->raw;
+	return true;
+}
+
+struct block_scan *block_scan(const struct chainparams *chainparams,
+			      u8 *raw, size_t len)
+{
+	struct block_scan *scan;
+	struct scan_alloced alloced = { 0, 0, 0 };
+	const u8 *p = raw;
+	u64 num;
+
+	assert(!is_elements(chainparams));
+	scan = calloc(1, sizeof(*scan));
+	if (!scan) {
+		free(raw);
+		return NULL;
+	}
+	scan->chainparams = chainparams;
+	scan->raw = raw;
+
+	pull_block_header(chainparams, &p, &len, &scan->hdr);
+	num = pull_varint(&p, &len);
+	if (!p || num > len / MIN_TX_LEN)
+		goto fail;
+
+	/* calloc(0) may give NULL */
+	scan->txs = calloc(num + 1, sizeof(*scan->txs));
+	if (!scan->txs)
+		goto fail;
+	for (scan->num_txs = 0; scan->num_txs < num; scan->num_txs++) {
+		if (!scan_tx(scan, &alloced, scan->num_txs, &p, &len))
+			goto fail;
+	}
+
+	/* We should end up not overrunning, nor have extra */
+	if (!p || len)
+		goto fail;
+
+	return scan;
 
-		b->hdr.nonce = pull_le32(&p, &len);
-		sha256_le32(&shactx, b->hdr.nonce);
+fail:
+	block_scan_free(scan);
+	return NULL;
+}
+
+void block_scan_free(struct block_scan *scan)
+{
+	if (!scan)
+		return;
+	free(scan->raw);
+	free(scan->txs);
+	free(scan->ins);
+	free(scan->outs);
+	free(scan->p2wsh);
+	free(scan);
+}
+
+static void destroy_bitcoin_block(struct bitcoin_block *b)
+{
+	block_scan_free(b->scan);
+}
+
+struct bitcoin_block *bitcoin_block_from_scan(const tal_t *ctx,
+					      struct block_scan *scan)
+{
+	struct bitcoin_block *b = tal(ctx, struct bitcoin_block);
+
+	b->hdr = scan->hdr;
+	b->scan = scan;
+	b->tx = tal_arrz(b, struct bitcoin_tx *, scan->num_txs);
+	tal_add_destructor(b, destroy_bitcoin_block);
+	return b;
+}
+
+/* Elements outputs can be blinded, so we let libwally parse them all and
+ * describe what it found. */
+static struct block_scan *block_scan_of_txs(const struct bitcoin_block *b,
+					    const struct chainparams *chainparams)
+{
+	struct block_scan *scan = calloc(1, sizeof(*scan));
+	struct scan_alloced alloced = { 0, 0, 0 };
+
+	if (!scan)
+		abort();
+	scan->chainparams = chainparams;
+	scan->hdr = b->hdr;
+	scan->num_txs = tal_count(b->tx);
+	scan->txs = calloc(scan->num_txs + 1, sizeof(*scan->txs));
+	if (!scan->txs)
+		abort();
+	for (size_t i = 0; i < scan->num_txs; i++) {
+		const struct bitcoin_tx *tx = b->tx[i];
+		struct block_scan_tx *stx = &scan->txs[i];
+
+		bitcoin_txid(tx, &stx->txid);
+		stx->first_in = scan->num_ins;
+		stx->num_ins = tx->wtx->num_inputs;
+		if (!reserve((void **)&scan->ins, &alloced.ins,
+			     scan->num_ins, stx->num_ins, sizeof(*scan->ins)))
+			abort();
+		for (size_t j = 0; j < stx->num_ins; j++) {
+			struct block_txin *in = &scan->ins[scan->num_ins++];
+			in->txindex = i;
+			bitcoin_tx_input_get_outpoint(tx, j, &in->prevout);
+		}
+
+		stx->first_out = scan->num_outs;
+		stx->num_outs = tx->wtx->num_outputs;
+		if (!reserve((void **)&scan->outs, &alloced.outs,
+			     scan->num_outs, stx->num_outs, sizeof(*scan->outs)))
+			abort();
+		for (size_t j = 0; j < stx->num_outs; j++) {
+			struct block_txout *out = &scan->outs[scan->num_outs];
+			struct amount_asset amt
+				= bitcoin_tx_output_get_amount(tx, j);
+
+			out->txindex = i;
+			out->outnum = j;
+			out->amount_is_main = amount_asset_is_main(&amt);
+			if (out->amount_is_main)
+				out->amount = amount_asset_to_sat(&amt);
+			else
+				out->amount = AMOUNT_SAT(0);
+			out->script = tx->wtx->outputs[j].script;
+			out->script_len = tx->wtx->outputs[j].script_len;
+			if (out->amount_is_main
+			    && script_is_p2wsh(out->script, out->script_len)) {
+				if (!reserve((void **)&scan->p2wsh,
+					     &alloced.p2wsh, scan->num_p2wsh,
+					     1, sizeof(*scan->p2wsh)))
+					abort();
+				scan->p2wsh[scan->num_p2wsh++] = scan->num_outs;
+			}
+			scan->num_outs++;
+		}
 	}
-	sha256_double_done(&shactx, &b->hdr.hash.shad);
+	return scan;
+}
+
+/* Encoding is <blockhdr> <varint-num-txs> <tx>... */
+struct bitcoin_block *
+bitcoin_block_from_bytes(const tal_t *ctx,
+			 const struct chainparams *chainparams,
+			 const u8 *p, size_t len)
+{
+	struct bitcoin_block *b;
+	struct block_scan *scan;
+	size_t i, num;
+	u8 *raw;
+
+	if (!is_elements(chainparams)) {
+		/* malloc(0) may give NULL */
+		raw = malloc(len + 1);
+		if (!raw)
+			return NULL;
+		memcpy(raw, p, len);
+		scan = block_scan(chainparams, raw, len);
+		if (!scan)
+			return NULL;
+		return bitcoin_block_from_scan(ctx, scan);
+	}
+
+	/* Set up the block for success. */
+	b = tal(ctx, struct bitcoin_block);
+	b->scan = NULL;
+	pull_block_header(chainparams, &p, &len, &b->hdr);
 
 	num = pull_varint(&p, &len);
+	if (!p || num > len / MIN_TX_LEN)
+		return tal_free(b);
 	b->tx = tal_arr(b, struct bitcoin_tx *, num);
-	b->txids = tal_arr(b, struct bitcoin_txid, num);
 	for (i = 0; i < num; i++) {
-		b->tx[i] = pull_bitcoin_tx(b->tx, &p, &len);
+		b->tx[i] = pull_bitcoin_tx_only(b->tx, &p, &len);
+		if (!b->tx[i])
+			return tal_free(b);
 		b->tx[i]->chainparams = chainparams;
-		bitcoin_txid(b->tx[i], &b->txids[i]);
 	}
 
 	/* We should end up not overrunning, nor have extra */
 	if (!p || len)
 		return tal_free(b);
 
+	b->scan = block_scan_of_txs(b, chainparams);
+	tal_add_destructor(b, destroy_bitcoin_block);
+	return b;
+}
+
+struct bitcoin_tx *bitcoin_block_tx(struct bitcoin_block *b, size_t txindex)
+{
+	assert(txindex < tal_count(b->tx));
+	if (!b->tx[txindex]) {
+		const u8 *p = b->scan->txs[txindex].raw;
+		size_t len = b->scan->txs[txindex].rawlen;
+
+		struct bitcoin_tx *tx;
+
+		tx = pull_bitcoin_tx_only(b->tx, &p, &len);
+		if (!tx)
+			return NULL;
+		if (len) {
+			tal_free(tx);
+			return NULL;
+		}
+		tx->chainparams = b->scan->chainparams;
+		b->tx[txindex] = tx;
+	}
+
+	/* The watchers may keep it, so it needs its psbt. */
+	bitcoin_tx_add_psbt(b->tx[txindex]);
+	if (!b->tx[txindex]->psbt)
+		return NULL;
+	return b->tx[txindex];
+}
+
+struct bitcoin_block *
+bitcoin_block_from_hex(const tal_t *ctx, const struct chainparams *chainparams,
+		       const char *hex, size_t hexlen)
+{
+	struct bitcoin_block *b;
+	u8 *linear_tx;
+	size_t len;
+
+	if (hexlen && hex[hexlen-1] == '\n')
+		hexlen--;
+
+	/* De-hex the array. */
+	len = hex_data_size(hexlen);
+	linear_tx = tal_arr(NULL, u8, len);
+	if (!hex_decode(hex, hexlen, linear_tx, len))
+		b = NULL;
+	else
+		b = bitcoin_block_from_bytes(ctx, chainparams, linear_tx, len);
+
 	tal_free(linear_tx);
 	return b;
 }
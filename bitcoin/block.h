@@ -2,6 +2,7 @@
 #define LIGHTNING_BITCOIN_BLOCK_H
 #include "config.h"
 #include "bitcoin/shadouble.h"
+#include <bitcoin/tx.h>
 #include <ccan/endian/endian.h>
 #include <ccan/structeq/structeq.h>
 #include <ccan/tal/tal.h>
@@ -30,17 +31,91 @@ struct bitcoin_block_hdr {
 	struct bitcoin_blkid hash;
 };
 
+/* An input of a block's transaction: what it spends. */
+struct block_txin {
+	size_t txindex;
+	struct bitcoin_outpoint prevout;
+};
+
+/* An output of a block's transaction. */
+struct block_txout {
+	size_t txindex;
+	u32 outnum;
+	/* False for Elements outputs with a blinded or non-main asset. */
+	bool amount_is_main;
+	struct amount_sat amount;
+	const u8 *script;
+	size_t script_len;
+};
+
+/* A transaction in a block, and where its inputs and outputs are. */
+struct block_scan_tx {
+	struct bitcoin_txid txid;
+	/* Its serialization, within block_scan's raw (NULL for Elements). */
+	const u8 *raw;
+	size_t rawlen;
+	size_t first_in, num_ins;
+	size_t first_out, num_outs;
+};
+
+/* What we need to know about a block, mostly without parsing its
+ * transactions.  block_scan() uses neither tal nor libwally (which
+ * allocates using tal), so it can run in another thread: so everything
+ * here is malloc'd.  Free with block_scan_free(). */
+struct block_scan {
+	const struct chainparams *chainparams;
+	struct bitcoin_block_hdr hdr;
+	/* The raw block, which the txs and scripts point into. */
+	u8 *raw;
+	size_t num_txs, num_ins, num_outs, num_p2wsh;
+	struct block_scan_tx *txs;
+	struct block_txin *ins;
+	struct block_txout *outs;
+	/* Which outs are P2WSH (the candidates for the utxoset). */
+	size_t *p2wsh;
+};
+
 struct bitcoin_block {
 	struct bitcoin_block_hdr hdr;
-	/* tal_count shows now many */
+	/* Every tx, input and output (freed with the block). */
+	struct block_scan *scan;
+	/* tal_count shows now many, but they're only parsed when
+	 * bitcoin_block_tx() is asked for one: most we never need. */
 	struct bitcoin_tx **tx;
-	struct bitcoin_txid *txids;
 };
 
 struct bitcoin_block *
 bitcoin_block_from_hex(const tal_t *ctx, const struct chainparams *chainparams,
 		       const char *hex, size_t hexlen);
 
+/* Same, but for a block already in its raw (serialized) form. */
+struct bitcoin_block *
+bitcoin_block_from_bytes(const tal_t *ctx,
+			 const struct chainparams *chainparams,
+			 const u8 *p, size_t len);
+
+/**
+ * block_scan - find the txs, inputs, outputs and txids of a raw block.
+ * @chainparams: must not be Elements.
+ * @raw: the malloc'd block, which this takes (and frees on failure).
+ * @len: its length.
+ *
+ * Thread-safe.  Returns NULL if the block is malformed.
+ */
+struct block_scan *block_scan(const struct chainparams *chainparams,
+			      u8 *raw, size_t len);
+
+/* Free a block_scan (and its raw block). */
+void block_scan_free(struct block_scan *scan);
+
+/* Make a block of a block_scan (which the block now owns). */
+struct bitcoin_block *bitcoin_block_from_scan(const tal_t *ctx,
+					      struct block_scan *scan);
+
+/* Parse tx @txindex (with its psbt) if we haven't already.  NULL if
+ * libwally won't have it. */
+struct bitcoin_tx *bitcoin_block_tx(struct bitcoin_block *b, size_t txindex);
+
 /* Compute the double SHA block ID from the block header. */
 void bitcoin_block_blkid(const struct bitcoin_block *block,
 			 struct bitcoin_blkid *out);
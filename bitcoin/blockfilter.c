@@ -0,0 +1,138 @@
+#include "config.h"
+#include <bitcoin/block.h>
+#include <bitcoin/blockfilter.h>
+#include <bitcoin/script.h>
+#include <bitcoin/varint.h>
+#include <ccan/crypto/siphash24/siphash24.h>
+#include <ccan/endian/endian.h>
+#include <ccan/tal/tal.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Bits are packed most-significant first. */
+struct bitreader {
+	const u8 *p;
+	size_t len;
+	size_t bitpos;
+};
+
+static bool read_bits(struct bitreader *br, size_t nbits, u64 *val)
+{
+	*val = 0;
+	while (nbits--) {
+		size_t byte = br->bitpos / 8;
+
+		if (byte >= br->len)
+			return false;
+		*val <<= 1;
+		*val |= (br->p[byte] >> (7 - br->bitpos % 8)) & 1;
+		br->bitpos++;
+	}
+	return true;
+}
+
+/* Unary quotient, then BASIC_FILTER_P bits of remainder. */
+static bool golomb_rice_decode(struct bitreader *br, u64 *val)
+{
+	u64 q = 0, bit, r;
+
+	for (;;) {
+		if (!read_bits(br, 1, &bit))
+			return false;
+		if (!bit)
+			break;
+		q++;
+	}
+	if (!read_bits(br, BASIC_FILTER_P, &r))
+		return false;
+	*val = (q << BASIC_FILTER_P) + r;
+	return true;
+}
+
+/* High 64 bits of the 128-bit product. */
+static u64 mul_high64(u64 a, u64 b)
+{
+	u64 a_lo = (u32)a, a_hi = a >> 32, b_lo = (u32)b, b_hi = b >> 32;
+	u64 lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+	u64 lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+	u64 cross = (lo_lo >> 32) + (u32)hi_lo + lo_hi;
+
+	return (hi_lo >> 32) + (cross >> 32) + hi_hi;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	const u64 *ua = a, *ub = b;
+
+	if (*ua < *ub)
+		return -1;
+	return *ua > *ub;
+}
+
+bool blockfilter_script_excluded(const u8 *script, size_t len)
+{
+	return len == 0 || script[0] == OP_RETURN;
+}
+
+bool blockfilter_match_any(const struct bitcoin_blkid *blkid,
+			   const u8 *filter, size_t filterlen,
+			   const u8 *const *scripts, size_t num_scripts)
+{
+	struct siphash_seed key;
+	struct bitreader br;
+	varint_t n;
+	size_t off, nq, qi;
+	u64 *queries, val;
+	le64 k[2];
+	bool match;
+
+	off = varint_get(filter, filterlen, &n);
+	if (off == 0)
+		return true;
+	/* Each entry takes at least BASIC_FILTER_P + 1 bits. */
+	if (n > (filterlen - off) * 8 / (BASIC_FILTER_P + 1))
+		return true;
+	if (n == 0)
+		return false;
+
+	/* The key is the first 16 bytes of the block hash. */
+	memcpy(k, blkid->shad.sha.u.u8, sizeof(k));
+	key.u.u64[0] = le64_to_cpu(k[0]);
+	key.u.u64[1] = le64_to_cpu(k[1]);
+
+	queries = tal_arr(NULL, u64, num_scripts);
+	nq = 0;
+	for (size_t i = 0; i < num_scripts; i++) {
+		if (!scripts[i])
+			continue;
+		queries[nq++] = mul_high64(siphash24(&key, scripts[i],
+						     tal_bytelen(scripts[i])),
+					   n * BASIC_FILTER_M);
+	}
+	qsort(queries, nq, sizeof(queries[0]), cmp_u64);
+
+	/* Walk both sorted sets together. */
+	br.p = filter + off;
+	br.len = filterlen - off;
+	br.bitpos = 0;
+	val = 0;
+	qi = 0;
+	match = false;
+	for (u64 i = 0; i < n && qi < nq; i++) {
+		u64 delta;
+
+		if (!golomb_rice_decode(&br, &delta)) {
+			match = true;
+			break;
+		}
+		val += delta;
+		while (qi < nq && queries[qi] < val)
+			qi++;
+		if (qi < nq && queries[qi] == val) {
+			match = true;
+			break;
+		}
+	}
+	tal_free(queries);
+	return match;
+}
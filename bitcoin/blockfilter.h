@@ -0,0 +1,37 @@
+/* BIP158 "basic" compact block filters: a Golomb-Rice coded set of every
+ * scriptPubKey a block creates or spends. */
+#ifndef LIGHTNING_BITCOIN_BLOCKFILTER_H
+#define LIGHTNING_BITCOIN_BLOCKFILTER_H
+#include "config.h"
+#include <ccan/short_types/short_types.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct bitcoin_blkid;
+
+/* BIP158 parameters for the basic filter type. */
+#define BASIC_FILTER_P 19
+#define BASIC_FILTER_M 784931
+
+/**
+ * blockfilter_match_any - might this block touch any of these scripts?
+ * @blkid: the block the filter is for (it keys the hashes).
+ * @filter: the serialized filter (as returned by bitcoind's getblockfilter).
+ * @filterlen: length of @filter.
+ * @scripts: the scriptPubKeys (tal arrays) we're interested in; NULL
+ *	entries are ignored.
+ * @num_scripts: number of entries in @scripts.
+ *
+ * If this returns false, no output in the block pays to, and no input
+ * spends, any of @scripts.  It returns true on a match (which is wrong
+ * about 1 time in BASIC_FILTER_M per script), and if @filter is
+ * malformed, since we then can't rule anything out.
+ */
+bool blockfilter_match_any(const struct bitcoin_blkid *blkid,
+			   const u8 *filter, size_t filterlen,
+			   const u8 *const *scripts, size_t num_scripts);
+
+/* BIP158 leaves these out of filters: don't expect to find them. */
+bool blockfilter_script_excluded(const u8 *script, size_t len);
+
+#endif /* LIGHTNING_BITCOIN_BLOCKFILTER_H */
@@ -177,24 +177,69 @@ int main(int argc, const char *argv[])
 	assert(b->hdr.nonce == CPU_TO_LE32(1226407989));
 
 	assert(tal_count(b->tx) == 3);
-	bitcoin_txid(b->tx[0], &txid);
+	assert(b->scan->num_txs == 3);
+
+	/* No tx parsed until asked for. */
+	for (size_t i = 0; i < tal_count(b->tx); i++)
+		assert(!b->tx[i]);
+
+	bitcoin_txid(bitcoin_block_tx(b, 0), &txid);
 	bitcoin_txid_from_hex("14d86acd2158acd1f59ab77ab251e3f5073db905a7b2aed25d3ba7780c3d790c",
 			      strlen("14d86acd2158acd1f59ab77ab251e3f5073db905a7b2aed25d3ba7780c3d790c"),
 			      &expected_txid);
 	assert(bitcoin_txid_eq(&txid, &expected_txid));
 
-	bitcoin_txid(b->tx[1], &txid);
+	bitcoin_txid(bitcoin_block_tx(b, 1), &txid);
 	bitcoin_txid_from_hex("c261a53121cc9841f843e2e6e0cff337e4f3c5eee788c982a0bffe771ce69919",
 			      strlen("c261a53121cc9841f843e2e6e0cff337e4f3c5eee788c982a0bffe771ce69919"),
 			      &expected_txid);
 	assert(bitcoin_txid_eq(&txid, &expected_txid));
 
-	bitcoin_txid(b->tx[2], &txid);
+	bitcoin_txid(bitcoin_block_tx(b, 2), &txid);
 	bitcoin_txid_from_hex("80cea306607b708a03a1854520729da884e4317b7b51f3d4a622f88176f5e034",
 			      strlen("80cea306607b708a03a1854520729da884e4317b7b51f3d4a622f88176f5e034"),
 			      &expected_txid);
 	assert(bitcoin_txid_eq(&txid, &expected_txid));
 
+	/* The scan agrees with libwally. */
+	for (size_t i = 0; i < tal_count(b->tx); i++) {
+		const struct block_scan_tx *stx = &b->scan->txs[i];
+		const struct bitcoin_tx *tx = b->tx[i];
+
+		assert(tx->psbt);
+		bitcoin_txid(tx, &txid);
+		assert(bitcoin_txid_eq(&txid, &stx->txid));
+
+		assert(stx->num_ins == tx->wtx->num_inputs);
+		for (size_t j = 0; j < stx->num_ins; j++) {
+			const struct block_txin *in
+				= &b->scan->ins[stx->first_in + j];
+			struct bitcoin_outpoint outpoint;
+
+			assert(in->txindex == i);
+			bitcoin_tx_input_get_outpoint(tx, j, &outpoint);
+			assert(bitcoin_outpoint_eq(&outpoint, &in->prevout));
+		}
+
+		assert(stx->num_outs == tx->wtx->num_outputs);
+		for (size_t j = 0; j < stx->num_outs; j++) {
+			const struct block_txout *out
+				= &b->scan->outs[stx->first_out + j];
+
+			assert(out->txindex == i);
+			assert(out->outnum == j);
+			assert(out->amount.satoshis /* Raw: test code */
+			       == tx->wtx->outputs[j].satoshi);
+			assert(memeq(out->script, out->script_len,
+				     tx->wtx->outputs[j].script,
+				     tx->wtx->outputs[j].script_len));
+		}
+	}
+
+	/* A block which stops short is rejected. */
+	assert(!bitcoin_block_from_hex(NULL, chainparams,
+				       block, strlen(block) - 2));
+
 	tal_free(b);
 	common_shutdown();
 	return 0;
@@ -0,0 +1,81 @@
+#include "config.h"
+#include "../blockfilter.c"
+#include "../varint.c"
+#include <assert.h>
+#include <ccan/array_size/array_size.h>
+#include <ccan/str/hex/hex.h>
+#include <common/setup.h>
+#include <common/utils.h>
+#include <stdio.h>
+
+/* AUTOGENERATED MOCKS START */
+/* AUTOGENERATED MOCKS END */
+
+static u8 *from_hex(const tal_t *ctx, const char *hex)
+{
+	u8 *ret = tal_hexdata(ctx, hex, strlen(hex));
+	assert(ret);
+	return ret;
+}
+
+static bool match(const struct bitcoin_blkid *blkid,
+		  const char *filterhex, const u8 *script)
+{
+	const u8 *filter = from_hex(tmpctx, filterhex);
+	const u8 *scripts[] = { NULL, script };
+
+	return blockfilter_match_any(blkid, filter, tal_bytelen(filter),
+				     scripts, ARRAY_SIZE(scripts));
+}
+
+int main(int argc, const char *argv[])
+{
+	struct bitcoin_blkid genesis;
+	u8 *genesis_out, *other;
+
+	common_setup(argv[0]);
+
+	/* From the BIP158 test vectors: testnet genesis block. */
+	assert(hex_decode("000000000933ea01ad0ee984209779baaec3ced90fa3f408719526f8d77f4943",
+			  64, &genesis, sizeof(genesis)));
+	/* Block ids are displayed backwards. */
+	for (size_t i = 0; i < sizeof(genesis) / 2; i++) {
+		u8 tmp = genesis.shad.sha.u.u8[i];
+		genesis.shad.sha.u.u8[i] = genesis.shad.sha.u.u8[sizeof(genesis) - 1 - i];
+		genesis.shad.sha.u.u8[sizeof(genesis) - 1 - i] = tmp;
+	}
+	genesis_out = from_hex(tmpctx, "4104678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61deb649f6bc3f4cef38c4f35504e51ec112de5c384df7ba0b8d578a4c702b6bf11d5fac");
+	other = from_hex(tmpctx, "00141111111111111111111111111111111111111111");
+
+	assert(match(&genesis, "019dfca8", genesis_out));
+	assert(!match(&genesis, "019dfca8", other));
+	assert(!match(&genesis, "019dfca8", NULL));
+
+	/* Several at once */
+	{
+		const u8 *filter = from_hex(tmpctx, "019dfca8");
+		const u8 *scripts[] = { other, genesis_out, other };
+		assert(blockfilter_match_any(&genesis, filter,
+					     tal_bytelen(filter),
+					     scripts, ARRAY_SIZE(scripts)));
+		assert(!blockfilter_match_any(&genesis, filter,
+					      tal_bytelen(filter),
+					      scripts, 1));
+	}
+
+	/* Empty filter matches nothing. */
+	assert(!match(&genesis, "00", genesis_out));
+
+	/* Malformed ones could match anything. */
+	assert(match(&genesis, "", other));
+	assert(match(&genesis, "01", other));
+	assert(match(&genesis, "019d", other));
+	assert(match(&genesis, "029dfca8", other));
+
+	assert(blockfilter_script_excluded(NULL, 0));
+	assert(blockfilter_script_excluded(from_hex(tmpctx, "6a0100"), 3));
+	assert(!blockfilter_script_excluded(other, tal_bytelen(other)));
+
+	common_shutdown();
+	return 0;
+}
@@ -586,8 +586,8 @@ static struct wally_tx *pull_wtx(const tal_t *ctx,
 	return wtx;
 }
 
-struct bitcoin_tx *pull_bitcoin_tx(const tal_t *ctx, const u8 **cursor,
-				   size_t *max)
+struct bitcoin_tx *pull_bitcoin_tx_only(const tal_t *ctx, const u8 **cursor,
+					size_t *max)
 {
 	struct bitcoin_tx *tx = tal(ctx, struct bitcoin_tx);
 	tx->wtx = pull_wtx(tx, cursor, max);
@@ -596,7 +596,24 @@ struct bitcoin_tx *pull_bitcoin_tx(const tal_t *ctx, const u8 **cursor,
 
 	tal_add_destructor(tx, bitcoin_tx_destroy);
 	tx->chainparams = chainparams;
-	tx->psbt = new_psbt(tx, tx->wtx);
+	tx->psbt = NULL;
+	return tx;
+}
+
+void bitcoin_tx_add_psbt(struct bitcoin_tx *tx)
+{
+	if (!tx->psbt)
+		tx->psbt = new_psbt(tx, tx->wtx);
+}
+
+struct bitcoin_tx *pull_bitcoin_tx(const tal_t *ctx, const u8 **cursor,
+				   size_t *max)
+{
+	struct bitcoin_tx *tx = pull_bitcoin_tx_only(ctx, cursor, max);
+	if (!tx)
+		return NULL;
+
+	bitcoin_tx_add_psbt(tx);
 	if (!tx->psbt)
 		return tal_free(tx);
 
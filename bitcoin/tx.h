@@ -88,6 +88,14 @@ struct bitcoin_tx *bitcoin_tx_with_psbt(const tal_t *ctx, struct wally_psbt *psb
 struct bitcoin_tx *pull_bitcoin_tx(const tal_t *ctx,
 				   const u8 **cursor, size_t *max);
 
+/* Same, but leaves tx->psbt NULL: building it copies the whole tx, which
+ * is wasted on the (many) block txs we don't keep. */
+struct bitcoin_tx *pull_bitcoin_tx_only(const tal_t *ctx,
+					const u8 **cursor, size_t *max);
+
+/* Fill in tx->psbt, if pull_bitcoin_tx_only() left it NULL. */
+void bitcoin_tx_add_psbt(struct bitcoin_tx *tx);
+
 /* Helper to create a wally_tx_output: make sure to wally_tx_output_free!
  * Returns NULL if amount is extreme (wally doesn't like).
  */
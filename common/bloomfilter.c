@@ -0,0 +1,62 @@
+#include "config.h"
+#include <ccan/build_assert/build_assert.h>
+#include <common/bloomfilter.h>
+#include <string.h>
+
+struct bloomfilter *bloomfilter_new(const tal_t *ctx, size_t capacity)
+{
+	struct bloomfilter *bf = tal(ctx, struct bloomfilter);
+	size_t bits = capacity * BLOOMFILTER_BITS_PER_ENTRY;
+
+	bf->capacity = capacity;
+	bf->count = 0;
+	bf->nblocks = bits / (BLOOMFILTER_BLOCK_WORDS * 64) + 1;
+
+	/* tal doesn't give us cache-line alignment, so over-allocate. */
+	bf->raw = tal_arrz(bf, u64,
+			   bf->nblocks * BLOOMFILTER_BLOCK_WORDS
+			   + BLOOMFILTER_BLOCK_WORDS - 1);
+	bf->words = (u64 *)(((uintptr_t)bf->raw + 63) & ~(uintptr_t)63);
+	return bf;
+}
+
+/* Which block, and which bits within it, does @hash select? */
+static const u64 *bloom_probe(const struct bloomfilter *bf, u64 hash,
+			      u64 mask[BLOOMFILTER_BLOCK_WORDS])
+{
+	/* Top half picks the block (without a division)... */
+	size_t block = ((hash >> 32) * bf->nblocks) >> 32;
+	/* ... and we stir the whole thing to pick bits: 9 bits each. */
+	u64 bits = hash * 0x9E3779B97F4A7C15ULL;
+
+	BUILD_ASSERT(BLOOMFILTER_BLOCK_WORDS * 64 == 512);
+	BUILD_ASSERT(BLOOMFILTER_K * 9 <= 64);
+
+	memset(mask, 0, sizeof(u64) * BLOOMFILTER_BLOCK_WORDS);
+	for (size_t i = 0; i < BLOOMFILTER_K; i++) {
+		mask[(bits >> 6) & 7] |= (u64)1 << (bits & 63);
+		bits >>= 9;
+	}
+	return bf->words + block * BLOOMFILTER_BLOCK_WORDS;
+}
+
+void bloomfilter_add(struct bloomfilter *bf, u64 hash)
+{
+	u64 mask[BLOOMFILTER_BLOCK_WORDS];
+	u64 *block = (u64 *)bloom_probe(bf, hash, mask);
+
+	for (size_t i = 0; i < BLOOMFILTER_BLOCK_WORDS; i++)
+		block[i] |= mask[i];
+	bf->count++;
+}
+
+bool bloomfilter_maybe(const struct bloomfilter *bf, u64 hash)
+{
+	u64 mask[BLOOMFILTER_BLOCK_WORDS], missing = 0;
+	const u64 *block = bloom_probe(bf, hash, mask);
+
+	/* No early exit: compilers turn this into a few vector ops. */
+	for (size_t i = 0; i < BLOOMFILTER_BLOCK_WORDS; i++)
+		missing |= mask[i] & ~block[i];
+	return missing == 0;
+}
@@ -0,0 +1,83 @@
+/* A small "blocked" Bloom filter, for cheaply ruling things out before we
+ * do an exact (hash table) lookup. */
+#ifndef LIGHTNING_COMMON_BLOOMFILTER_H
+#define LIGHTNING_COMMON_BLOOMFILTER_H
+#include "config.h"
+#include <ccan/short_types/short_types.h>
+#include <ccan/tal/tal.h>
+
+/* Each entry sets BLOOMFILTER_K bits, all within one 64-byte block (one
+ * cache line), so a lookup touches only one line of memory. */
+#define BLOOMFILTER_BLOCK_WORDS 8
+#define BLOOMFILTER_K 7
+
+/* With this many bits per entry, less than 1 in 1000 misses gets through. */
+#define BLOOMFILTER_BITS_PER_ENTRY 24
+
+struct bloomfilter {
+	/* Number of blocks (BLOOMFILTER_BLOCK_WORDS u64s each) */
+	size_t nblocks;
+	/* Cache-line aligned, within @raw. */
+	u64 *words;
+	u64 *raw;
+	/* How many entries we've added, and how many we're sized for. */
+	size_t count, capacity;
+};
+
+/* How well is a prefilter doing?  @passed - @matched were false
+ * positives. */
+struct bloomfilter_stats {
+	u64 checked, passed, matched;
+};
+
+/**
+ * bloomfilter_new - create an empty Bloom filter
+ * @ctx: tal context to allocate off.
+ * @capacity: how many entries it can hold before bloomfilter_full().
+ */
+struct bloomfilter *bloomfilter_new(const tal_t *ctx, size_t capacity);
+
+/**
+ * bloomfilter_add - add an entry
+ * @bf: the filter
+ * @hash: a (keyed, well-distributed) 64-bit hash of the entry.
+ *
+ * Entries can't be removed, so owners usually rebuild the filter (from
+ * what they're really tracking) once bloomfilter_full().
+ */
+void bloomfilter_add(struct bloomfilter *bf, u64 hash);
+
+/**
+ * bloomfilter_maybe - could this entry have been added?
+ * @bf: the filter
+ * @hash: the 64-bit hash of the entry.
+ *
+ * If this returns false, it definitely was not.
+ */
+bool bloomfilter_maybe(const struct bloomfilter *bf, u64 hash);
+
+/* bloomfilter_maybe(), counting in @stats (caller counts stats->matched) */
+static inline bool bloomfilter_check(const struct bloomfilter *bf,
+				     struct bloomfilter_stats *stats,
+				     u64 hash)
+{
+	stats->checked++;
+	if (!bloomfilter_maybe(bf, hash))
+		return false;
+	stats->passed++;
+	return true;
+}
+
+/* When rebuilding a filter for @count entries: leave room to grow. */
+static inline size_t bloomfilter_rebuild_capacity(size_t count)
+{
+	return count * 2 > 1024 ? count * 2 : 1024;
+}
+
+/* Has it had more entries added than it was sized for? */
+static inline bool bloomfilter_full(const struct bloomfilter *bf)
+{
+	return bf->count >= bf->capacity;
+}
+
+#endif /* LIGHTNING_COMMON_BLOOMFILTER_H */
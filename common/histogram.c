@@ -0,0 +1,52 @@
+#include "config.h"
+#include <ccan/tal/str/str.h>
+#include <common/histogram.h>
+#include <common/json_stream.h>
+#include <common/utils.h>
+#include <inttypes.h>
+
+void json_add_histogram(struct json_stream *js, const char *fieldname,
+			const struct histogram *h)
+{
+	json_object_start(js, fieldname);
+	json_add_u64(js, "count", h->count);
+	json_add_u64(js, "total_usec", h->sum_usec);
+	json_array_start(js, "buckets");
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		if (!h->buckets[i])
+			continue;
+		json_object_start(js, NULL);
+		/* Last bucket is "everything larger" */
+		if (i != HISTOGRAM_BUCKETS - 1)
+			json_add_u64(js, "max_usec", histogram_bucket_max(i));
+		json_add_u64(js, "count", h->buckets[i]);
+		json_object_end(js);
+	}
+	json_array_end(js);
+	json_object_end(js);
+}
+
+void histogram_prometheus(char **out, const char *name, const char *labels,
+			  const struct histogram *h)
+{
+	/* "le" goes after any other labels, and _sum/_count only get
+	 * braces if there are labels. */
+	const char *le_prefix = labels ? tal_fmt(tmpctx, "%s,", labels) : "";
+	const char *braced = labels ? tal_fmt(tmpctx, "{%s}", labels) : "";
+	u64 cumulative = 0;
+
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS - 1; i++) {
+		u64 max = histogram_bucket_max(i);
+		cumulative += h->buckets[i];
+		tal_append_fmt(out, "%s_bucket{%sle=\"%"PRIu64".%06"PRIu64"\"} %"PRIu64"\n",
+			       name, le_prefix,
+			       max / 1000000, max % 1000000, cumulative);
+	}
+	tal_append_fmt(out, "%s_bucket{%sle=\"+Inf\"} %"PRIu64"\n",
+		       name, le_prefix, h->count);
+	tal_append_fmt(out, "%s_sum%s %"PRIu64".%06"PRIu64"\n",
+		       name, braced,
+		       h->sum_usec / 1000000, h->sum_usec % 1000000);
+	tal_append_fmt(out, "%s_count%s %"PRIu64"\n",
+		       name, braced, h->count);
+}
@@ -0,0 +1,73 @@
+/* Cheap fixed-size latency histograms, for metrics. */
+#ifndef LIGHTNING_COMMON_HISTOGRAM_H
+#define LIGHTNING_COMMON_HISTOGRAM_H
+#include "config.h"
+#include <ccan/ilog/ilog.h>
+#include <ccan/short_types/short_types.h>
+#include <ccan/tal/tal.h>
+#include <ccan/time/time.h>
+
+struct json_stream;
+
+/* Bucket i counts samples <= 2^i usec; the last bucket is unbounded
+ * (so the largest bounded one is 2^22 usec, a little over 4 seconds). */
+#define HISTOGRAM_BUCKETS 24
+
+struct histogram {
+	u64 count;
+	u64 sum_usec;
+	u64 buckets[HISTOGRAM_BUCKETS];
+};
+
+/* Which bucket does a sample of @usec go in? */
+static inline size_t histogram_bucket(u64 usec)
+{
+	size_t b = ilog64(usec ? usec - 1 : 0);
+
+	if (b > HISTOGRAM_BUCKETS - 1)
+		b = HISTOGRAM_BUCKETS - 1;
+	return b;
+}
+
+/* This is called on hot paths (every db commit, every command), so it's
+ * inline and never allocates. */
+static inline void histogram_add(struct histogram *h, struct timerel t)
+{
+	u64 usec = time_to_usec(t);
+
+	h->count++;
+	h->sum_usec += usec;
+	h->buckets[histogram_bucket(usec)]++;
+}
+
+/* Upper bound of bucket @b in usec (not valid for the last bucket!) */
+static inline u64 histogram_bucket_max(size_t b)
+{
+	return (u64)1 << b;
+}
+
+/**
+ * json_add_histogram - add a histogram as a JSON object.
+ * @js: the json_stream.
+ * @fieldname: the field name (or NULL if in an array).
+ * @h: the histogram.
+ *
+ * Only non-empty buckets are shown.
+ */
+void json_add_histogram(struct json_stream *js, const char *fieldname,
+			const struct histogram *h);
+
+/**
+ * histogram_prometheus - append a histogram in Prometheus text format.
+ * @out: tal string to append to.
+ * @name: the metric name (eg. "lightningd_rpc_duration_seconds").
+ * @labels: extra labels (eg. "method=\"getinfo\""), or NULL.
+ * @h: the histogram.
+ *
+ * Buckets are cumulative, in seconds, as Prometheus expects.  The caller
+ * is expected to emit the HELP and TYPE lines once per metric name.
+ */
+void histogram_prometheus(char **out, const char *name, const char *labels,
+			  const struct histogram *h);
+
+#endif /* LIGHTNING_COMMON_HISTOGRAM_H */
@@ -49,6 +49,7 @@ struct json_stream *new_json_stream(const tal_t *ctx,
 	js->reader = NULL;
 	js->log = log;
 	js->filter = NULL;
+	js->refill = NULL;
 	return js;
 }
 
@@ -79,6 +80,8 @@ struct json_stream *json_stream_dup(const tal_t *ctx,
 
 	js->jout = json_out_dup(js, original->jout);
 	js->log = log;
+	/* Only the original writer can produce more. */
+	js->refill = NULL;
 	/* You can't dup things with filters! */
 	assert(!js->filter);
 	return js;
@@ -145,6 +148,21 @@ void json_stream_close(struct json_stream *js, struct command *writer)
 	json_stream_double_cr(js);
 	json_stream_flush(js);
 	js->writer = NULL;
+	js->refill = NULL;
+}
+
+bool json_stream_wants(const struct json_stream *js, const char *fieldname)
+{
+	return json_filter_ok(js->filter, fieldname);
+}
+
+void json_stream_set_refill_(struct json_stream *js,
+			     void (*refill)(struct json_stream *js, void *arg),
+			     void *arg)
+{
+	assert(json_stream_still_writing(js));
+	js->refill = refill;
+	js->refill_arg = arg;
 }
 
 /* Also called when we're oom, so it will kill reader. */
@@ -262,6 +280,12 @@ static struct io_plan *json_stream_output_write(struct io_conn *conn,
 	/* Get how much we can write out from js */
 	p = json_out_contents(js->jout, &js->len_read);
 
+	/* Drained?  Ask writer for more, if it's generating on demand. */
+	while (!p && js->refill) {
+		js->refill(js, js->refill_arg);
+		p = json_out_contents(js->jout, &js->len_read);
+	}
+
 	/* Nothing in buffer? */
 	if (!p) {
 		/* We're not doing io_write now, unset. */
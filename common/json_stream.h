@@ -49,6 +49,11 @@ struct json_stream {
 	void *reader_arg;
 	size_t len_read;
 
+	/* If non-NULL, writer produces more output on demand (see
+	 * json_stream_set_refill). */
+	void (*refill)(struct json_stream *js, void *arg);
+	void *refill_arg;
+
 	/* If non-NULL, reflects the current filter position */
 	struct json_filter *filter;
 
@@ -90,6 +95,16 @@ void json_stream_attach_filter(struct json_stream *js,
 /* Detach the filter: returns non-NULL string if it was misused. */
 const char *json_stream_detach_filter(const tal_t *ctx, struct json_stream *js);
 
+/**
+ * json_stream_wants - would a member called @fieldname be output here?
+ * @js: the json_stream.
+ * @fieldname: fieldname (if in object), otherwise must be NULL.
+ *
+ * Always true unless a filter is attached.  Use this to avoid calculating
+ * fields which are expensive to produce, but would be filtered out anyway.
+ */
+bool json_stream_wants(const struct json_stream *js, const char *fieldname);
+
 /**
  * json_stream_close - finished writing to a JSON stream.
  * @js: the json_stream.
@@ -176,6 +191,29 @@ void json_add_jsonstr(struct json_stream *js,
 		      const char *jsonstr,
 		      size_t jsonstrlen);
 
+/**
+ * json_stream_set_refill - have the writer produce output as it's read.
+ * @js: the json_stream
+ * @refill: called once the reader has drained everything written so far.
+ * @arg: the argument to @refill
+ *
+ * Rather than building an entire (perhaps huge) response in memory, the
+ * writer can add the first part and set @refill.  Whenever the reader
+ * catches up, @refill is called to append the next part; once it has
+ * nothing more to add it closes the stream as normal.  If @refill adds
+ * nothing and doesn't close the stream, it's simply called again.
+ */
+#define json_stream_set_refill(js, refill, arg)				\
+	json_stream_set_refill_((js),					\
+				typesafe_cb_preargs(void, void *,	\
+						    (refill), (arg),	\
+						    struct json_stream *), \
+				(arg))
+
+void json_stream_set_refill_(struct json_stream *js,
+			     void (*refill)(struct json_stream *js, void *arg),
+			     void *arg);
+
 /**
  * json_stream_output - start writing out a json_stream to this conn.
  * @js: the json_stream
@@ -0,0 +1,53 @@
+#include "config.h"
+#include "../bloomfilter.c"
+#include <assert.h>
+#include <common/setup.h>
+#include <common/utils.h>
+
+/* AUTOGENERATED MOCKS START */
+/* AUTOGENERATED MOCKS END */
+
+/* Good enough to stand in for siphash outputs. */
+static u64 splitmix64(u64 *state)
+{
+	u64 z = (*state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bloomfilter *bf;
+	struct bloomfilter_stats stats = { 0 };
+	u64 state = 0, *added;
+	const size_t num = 20000, tries = 1000000;
+
+	common_setup(argv[0]);
+
+	bf = bloomfilter_new(tmpctx, num);
+	assert(((uintptr_t)bf->words & 63) == 0);
+	added = tal_arr(tmpctx, u64, num);
+	for (size_t i = 0; i < num; i++) {
+		assert(!bloomfilter_full(bf));
+		added[i] = splitmix64(&state);
+		bloomfilter_add(bf, added[i]);
+	}
+	assert(bloomfilter_full(bf));
+
+	/* No false negatives, ever. */
+	for (size_t i = 0; i < num; i++)
+		assert(bloomfilter_maybe(bf, added[i]));
+
+	/* Fewer than 1 in 1000 false positives. */
+	for (size_t i = 0; i < tries; i++)
+		bloomfilter_check(bf, &stats, splitmix64(&state));
+	assert(stats.checked == tries);
+	assert(stats.passed < tries / 1000);
+
+	assert(bloomfilter_rebuild_capacity(0) == 1024);
+	assert(bloomfilter_rebuild_capacity(1000) == 2000);
+
+	common_shutdown();
+	return 0;
+}
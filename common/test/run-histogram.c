@@ -0,0 +1,73 @@
+#include "config.h"
+#include "../histogram.c"
+#include <assert.h>
+#include <common/setup.h>
+#include <stdio.h>
+
+/* AUTOGENERATED MOCKS START */
+/* Generated stub for json_add_u64 */
+void json_add_u64(struct json_stream *result UNNEEDED, const char *fieldname UNNEEDED,
+		  uint64_t value UNNEEDED)
+{ fprintf(stderr, "json_add_u64 called!\n"); abort(); }
+/* Generated stub for json_array_end */
+void json_array_end(struct json_stream *js UNNEEDED)
+{ fprintf(stderr, "json_array_end called!\n"); abort(); }
+/* Generated stub for json_array_start */
+void json_array_start(struct json_stream *js UNNEEDED, const char *fieldname UNNEEDED)
+{ fprintf(stderr, "json_array_start called!\n"); abort(); }
+/* Generated stub for json_object_end */
+void json_object_end(struct json_stream *js UNNEEDED)
+{ fprintf(stderr, "json_object_end called!\n"); abort(); }
+/* Generated stub for json_object_start */
+void json_object_start(struct json_stream *ks UNNEEDED, const char *fieldname UNNEEDED)
+{ fprintf(stderr, "json_object_start called!\n"); abort(); }
+/* AUTOGENERATED MOCKS END */
+
+int main(int argc, char *argv[])
+{
+	struct histogram h;
+	char *out;
+
+	common_setup(argv[0]);
+
+	/* Bucket i is everything <= 2^i usec. */
+	assert(histogram_bucket(0) == 0);
+	assert(histogram_bucket(1) == 0);
+	assert(histogram_bucket(2) == 1);
+	assert(histogram_bucket(3) == 2);
+	assert(histogram_bucket(4) == 2);
+	assert(histogram_bucket(5) == 3);
+	assert(histogram_bucket(histogram_bucket_max(HISTOGRAM_BUCKETS - 2))
+	       == HISTOGRAM_BUCKETS - 2);
+	assert(histogram_bucket(histogram_bucket_max(HISTOGRAM_BUCKETS - 2) + 1)
+	       == HISTOGRAM_BUCKETS - 1);
+	assert(histogram_bucket(-1ULL) == HISTOGRAM_BUCKETS - 1);
+
+	memset(&h, 0, sizeof(h));
+	histogram_add(&h, time_from_usec(3));
+	histogram_add(&h, time_from_usec(4));
+	histogram_add(&h, time_from_sec(60));
+	assert(h.count == 3);
+	assert(h.sum_usec == 60000007);
+	assert(h.buckets[2] == 2);
+	assert(h.buckets[HISTOGRAM_BUCKETS - 1] == 1);
+
+	/* Prometheus buckets are cumulative, and in seconds. */
+	out = tal_strdup(tmpctx, "");
+	histogram_prometheus(&out, "test", "a=\"b\"", &h);
+	assert(strstr(out, "test_bucket{a=\"b\",le=\"0.000002\"} 0\n"));
+	assert(strstr(out, "test_bucket{a=\"b\",le=\"0.000004\"} 2\n"));
+	assert(strstr(out, "test_bucket{a=\"b\",le=\"4.194304\"} 2\n"));
+	assert(strstr(out, "test_bucket{a=\"b\",le=\"+Inf\"} 3\n"));
+	assert(strstr(out, "test_sum{a=\"b\"} 60.000007\n"));
+	assert(strstr(out, "test_count{a=\"b\"} 3\n"));
+
+	/* No labels, no braces. */
+	out = tal_strdup(tmpctx, "");
+	histogram_prometheus(&out, "test", NULL, &h);
+	assert(strstr(out, "test_bucket{le=\"+Inf\"} 3\n"));
+	assert(strstr(out, "test_sum 60.000007\n"));
+	assert(strstr(out, "test_count 3\n"));
+
+	common_shutdown();
+}
@@ -62,6 +62,26 @@ struct utxo *fromwire_utxo(const tal_t *ctx, const u8 **ptr, size_t *max)
 	return utxo;
 }
 
+struct utxo *utxo_dup(const tal_t *ctx, const struct utxo *utxo)
+{
+	struct utxo *dup = tal_dup(ctx, struct utxo, utxo);
+
+	if (utxo->close_info) {
+		dup->close_info = tal_dup(dup, struct unilateral_close_info,
+					  utxo->close_info);
+		if (utxo->close_info->commitment_point)
+			dup->close_info->commitment_point
+				= tal_dup(dup->close_info, struct pubkey,
+					  utxo->close_info->commitment_point);
+	}
+	if (utxo->blockheight)
+		dup->blockheight = tal_dup(dup, u32, utxo->blockheight);
+	if (utxo->spendheight)
+		dup->spendheight = tal_dup(dup, u32, utxo->spendheight);
+	dup->scriptPubkey = tal_dup_talarr(dup, u8, utxo->scriptPubkey);
+	return dup;
+}
+
 size_t utxo_spend_weight(const struct utxo *utxo, size_t min_witness_weight)
 {
 	size_t wit_weight = bitcoin_tx_simple_input_witness_weight();
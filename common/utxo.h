@@ -81,6 +81,9 @@ static inline bool utxo_is_csv_locked(const struct utxo *utxo, u32 current_heigh
 void towire_utxo(u8 **pptr, const struct utxo *utxo);
 struct utxo *fromwire_utxo(const tal_t *ctx, const u8 **ptr, size_t *max);
 
+/* Deep copy of @utxo (scriptPubkey must be a tal array, or NULL) */
+struct utxo *utxo_dup(const tal_t *ctx, const struct utxo *utxo);
+
 /* Estimate of (signed) UTXO weight in transaction */
 size_t utxo_spend_weight(const struct utxo *utxo, size_t min_witness_weight);
 
@@ -622,6 +622,18 @@ class LightningRpc(UnixDomainSocketRpc):
         }
         return self.call("delexpiredinvoice", payload)
 
+    def delforwards(self, status, maxtime, limit=None):
+        """
+        Delete up to {limit} forwards with {status} which were resolved
+        at or before {maxtime}.
+        """
+        payload = {
+            "status": status,
+            "maxtime": maxtime,
+            "limit": limit,
+        }
+        return self.call("delforwards", payload)
+
     def delinvoice(self, label, status, desconly=None):
         """
         Delete unpaid invoice {label} with {status} (or, with {desconly} true, remove its description).
@@ -633,6 +645,30 @@ class LightningRpc(UnixDomainSocketRpc):
         }
         return self.call("delinvoice", payload)
 
+    def delinvoices(self, status, maxtime, limit=None):
+        """
+        Delete up to {limit} invoices with {status} ("paid" or "expired")
+        which were paid (or expired) at or before {maxtime}.
+        """
+        payload = {
+            "status": status,
+            "maxtime": maxtime,
+            "limit": limit,
+        }
+        return self.call("delinvoices", payload)
+
+    def delpays(self, status, maxtime, limit=None):
+        """
+        Delete up to {limit} payments with {status} which were created
+        at or before {maxtime}.
+        """
+        payload = {
+            "status": status,
+            "maxtime": maxtime,
+            "limit": limit,
+        }
+        return self.call("delpays", payload)
+
     def dev_crash(self):
         """
         Crash lightningd by calling fatal().
@@ -847,6 +883,12 @@ class LightningRpc(UnixDomainSocketRpc):
         }
         return self.call("getlog", payload)
 
+    def getmetrics(self):
+        """
+        Show internal counters and latency histograms.
+        """
+        return self.call("getmetrics")
+
     def getpeer(self, peer_id, level=None):
         """
         Show peer with {peer_id}, if {level} is set, include {log}s.
@@ -935,6 +977,11 @@ class LightningRpc(UnixDomainSocketRpc):
         }
         return self.call("listchannels", payload)
 
+    def listclosedchannels(self):
+        """List channels which have been closed and resolved.
+        """
+        return self.call("listclosedchannels")
+
     def listconfigs(self, config=None):
         """List this node's config.
         """
@@ -943,7 +990,7 @@ class LightningRpc(UnixDomainSocketRpc):
         }
         return self.call("listconfigs", payload)
 
-    def listforwards(self, status=None, in_channel=None, out_channel=None):
+    def listforwards(self, status=None, in_channel=None, out_channel=None, index=None, start=None, limit=None):
         """List all forwarded payments and their information matching
         forward {status}, {in_channel} and {out_channel}.
         """
@@ -951,9 +998,25 @@ class LightningRpc(UnixDomainSocketRpc):
             "status": status,
             "in_channel": in_channel,
             "out_channel": out_channel,
+            "index": index,
+            "start": start,
+            "limit": limit,
         }
         return self.call("listforwards", payload)
 
+    def listforwardrollups(self, in_channel=None, out_channel=None, start_time=None, end_time=None):
+        """List hourly totals of resolved forwards matching {in_channel}
+        and {out_channel}, for buckets starting from {start_time} until
+        before {end_time}.
+        """
+        payload = {
+            "in_channel": in_channel,
+            "out_channel": out_channel,
+            "start_time": start_time,
+            "end_time": end_time,
+        }
+        return self.call("listforwardrollups", payload)
+
     def listfunds(self, spent=None):
         """
         Show funds available for opening channels
@@ -971,7 +1034,7 @@ class LightningRpc(UnixDomainSocketRpc):
         """
         return self.call("listtransactions")
 
-    def listinvoices(self, label=None, payment_hash=None, invstring=None, offer_id=None):
+    def listinvoices(self, label=None, payment_hash=None, invstring=None, offer_id=None, index=None, start=None, limit=None):
         """Query invoices
 
         Show invoice matching {label}, {payment_hash}, {invstring} or {offer_id}
@@ -983,6 +1046,9 @@ class LightningRpc(UnixDomainSocketRpc):
             "payment_hash": payment_hash,
             "invstring": invstring,
             "offer_id": offer_id,
+            "index": index,
+            "start": start,
+            "limit": limit,
         }
         return self.call("listinvoices", payload)
 
@@ -1010,6 +1076,20 @@ class LightningRpc(UnixDomainSocketRpc):
         }
         return self.call("listpays", payload)
 
+    def listpeerchannels(self, peer_id=None, short_channel_id=None,
+                         state=None, has_htlcs=None):
+        """
+        Show channels with peers, optionally only with {peer_id},
+        {short_channel_id}, in {state} or with {has_htlcs}.
+        """
+        payload = {
+            "id": peer_id,
+            "short_channel_id": short_channel_id,
+            "state": state,
+            "has_htlcs": has_htlcs,
+        }
+        return self.call("listpeerchannels", payload)
+
     def listpeers(self, peerid=None, level=None):
         """
         Show current peers, if {level} is set, include {log}s".
@@ -1020,12 +1100,15 @@ class LightningRpc(UnixDomainSocketRpc):
         }
         return self.call("listpeers", payload)
 
-    def listsendpays(self, bolt11=None, payment_hash=None, status=None):
+    def listsendpays(self, bolt11=None, payment_hash=None, status=None, index=None, start=None, limit=None):
         """Show all sendpays results, or only for `bolt11` or `payment_hash`."""
         payload = {
             "bolt11": bolt11,
             "payment_hash": payment_hash,
-            "status": status
+            "status": status,
+            "index": index,
+            "start": start,
+            "limit": limit,
         }
         return self.call("listsendpays", payload)
 
@@ -1302,12 +1385,32 @@ class LightningRpc(UnixDomainSocketRpc):
         }
         return self.call("setchannel", payload)
 
+    def sql(self, query):
+        """
+        Run read-only SQL {query} against the node's list* data.
+        """
+        payload = {
+            "query": query
+        }
+        return self.call("sql", payload)
+
     def stop(self):
         """
         Shut down the lightningd process.
         """
         return self.call("stop")
 
+    def wait(self, subsystem, indexname, nextvalue):
+        """
+        Wait for {subsystem} {indexname} to reach or exceed {nextvalue}.
+        """
+        payload = {
+            "subsystem": subsystem,
+            "indexname": indexname,
+            "nextvalue": nextvalue
+        }
+        return self.call("wait", payload)
+
     def waitanyinvoice(self, lastpay_index=None, timeout=None, **kwargs):
         """
         Wait for the next invoice to be paid, after {lastpay_index}
@@ -5,6 +5,7 @@
 #include <ccan/short_types/short_types.h>
 #include <ccan/strset/strset.h>
 #include <common/autodata.h>
+#include <common/histogram.h>
 #include <common/utils.h>
 
 /**
@@ -28,6 +29,8 @@
  */
 #define SQL(x) NAMED_SQL( __FILE__ ":" stringify(__COUNTER__), x)
 
+struct db_stmt;
+
 struct db {
 	char *filename;
 	const char *in_transaction;
@@ -56,6 +59,41 @@ struct db {
 	u32 data_version;
 
 	void (*report_changes_fn)(struct db *);
+
+	/* If set, called with each modifying statement once it has been
+	 * executed, so the query and its bindings can be recorded (unlike
+	 * `changes`, this works for every driver). */
+	void (*record_change_fn)(struct db_stmt *stmt);
+
+	/* How long each db_commit_transaction took (for getmetrics). */
+	struct histogram commit_time;
+
+	/* Which query_table slot each query_id was last found in: every
+	 * db_prepare_v2() call site hands us the same string literal, so
+	 * this saves hashing and comparing the whole SQL text each time. */
+	struct db_query_lookup *query_lookup;
+
+	/* If set, db_commit_transaction() leaves the transaction open for
+	 * db_group_commit_flush() to commit (see db_set_group_commit). */
+	bool group_commit;
+
+	/* Is there a finished transaction we haven't committed yet, and
+	 * when did it (the first one, if several) finish? */
+	bool group_commit_pending;
+	struct timemono group_commit_start;
+
+	/* If non-zero, a replica (if any) may be written in the background,
+	 * falling up to this many commits behind. */
+	u32 replica_max_lag;
+
+	/* Don't pipeline statements, even if the driver can (for
+	 * benchmarking, see --dev-no-db-pipeline). */
+	bool no_pipeline;
+};
+
+struct db_query_lookup {
+	const char *query_id;
+	size_t slot;
 };
 
 struct db_query {
@@ -105,6 +143,10 @@ struct db_stmt {
 	/* Which SQL statement are we trying to execute? */
 	const struct db_query *query;
 
+	/* Where query is in db->queries->query_table, so drivers can cache
+	 * the compiled statement: -1 for db_prepare_untranslated(). */
+	int query_slot;
+
 	/* Which parameters are we binding to the statement? */
 	struct db_binding *bindings;
 
@@ -173,6 +215,10 @@ struct db_config {
 	bool (*setup_fn)(struct db *db);
 	void (*teardown_fn)(struct db *db);
 
+	/* Optional: if a replica is being written in the background, how
+	 * many commits behind is it, and how often have we waited for it? */
+	bool (*replica_lag_fn)(struct db *db, size_t *lag, u64 *stalls);
+
 	bool (*vacuum_fn)(struct db *db);
 
 	bool (*rename_column)(struct db *db,
@@ -14,6 +14,48 @@
 #define INT4OID			23
 #define TEXTOID			25
 
+#ifndef LIBPQ_HAS_PIPELINING
+/* libpq before 14 can't pipeline, so we never try (see can_pipeline). */
+#define PQ_PIPELINE_OFF 0
+static int PQpipelineStatus(const PGconn *conn) { return PQ_PIPELINE_OFF; }
+static int PQenterPipelineMode(PGconn *conn) { return 0; }
+static int PQexitPipelineMode(PGconn *conn) { return 1; }
+static int PQpipelineSync(PGconn *conn) { return 0; }
+#endif
+
+/* We don't read results while pipelining, so don't let too many pile
+ * up in case the server blocks writing them. */
+#define PIPELINE_MAX 64
+
+/* The inner_stmt of a statement we've sent but not read the result of
+ * (db_postgres_flush replaces it with the result). */
+static char result_pending;
+#define RESULT_PENDING ((PGresult *)&result_pending)
+
+struct db_postgres {
+	PGconn *conn;
+	/* Which queries we've created named server-side prepared statements
+	 * for (indexed by query_slot), and the parameter types used then:
+	 * NULL if none. */
+	Oid **prepared;
+
+	/* Can we use libpq's pipeline mode, and are we in a transaction
+	 * using it?  Then writes are sent without waiting for their result,
+	 * so a transaction costs one round trip to the server rather than
+	 * one per statement. */
+	bool can_pipeline, pipelining;
+
+	/* What we've sent and not read the results of yet, in order: NULL
+	 * for our own commands (and statements freed meanwhile). */
+	struct db_stmt **pending;
+};
+
+static inline PGconn *conn2pg(void *conn)
+{
+	struct db_postgres *wrapper = (struct db_postgres *) conn;
+	return wrapper->conn;
+}
+
 static bool db_postgres_setup(struct db *db)
 {
 	size_t prefix_len = strlen("postgres://");
@@ -27,30 +69,138 @@ static bool db_postgres_setup(struct db *db)
 	result is discarded again immediately. */
 	PQconninfoOption *info =
 	    PQconninfoParse(db->filename + prefix_len, NULL);
+	struct db_postgres *wrapper = tal(db, struct db_postgres);
 
 	if (info != NULL) {
 		PQconninfoFree(info);
-		db->conn = PQconnectdb(db->filename + prefix_len);
+		wrapper->conn = PQconnectdb(db->filename + prefix_len);
 	} else {
-		db->conn = PQconnectdb(db->filename);
+		wrapper->conn = PQconnectdb(db->filename);
 	}
 
-	if (PQstatus(db->conn) != CONNECTION_OK) {
-		db->error = tal_fmt(db, "Could not connect to %s: %s", db->filename, PQerrorMessage(db->conn));
+	if (PQstatus(wrapper->conn) != CONNECTION_OK) {
+		db->error = tal_fmt(db, "Could not connect to %s: %s", db->filename, PQerrorMessage(wrapper->conn));
+		tal_free(wrapper);
 		db->conn = NULL;
 		return false;
 	}
+	wrapper->prepared = tal_arrz(wrapper, Oid *,
+				     db->queries->query_table_size);
+#ifdef LIBPQ_HAS_PIPELINING
+	wrapper->can_pipeline = true;
+#else
+	wrapper->can_pipeline = false;
+#endif
+	wrapper->pipelining = false;
+	wrapper->pending = tal_arr(wrapper, struct db_stmt *, 0);
+	db->conn = wrapper;
+	return true;
+}
+
+/* Returns RESULT_PENDING if it was sent: db_postgres_flush will read
+ * the result.  Otherwise, an error result (see PQerrorMessage), like
+ * PQexec would. */
+static PGresult *pipeline_sent(struct db_postgres *wrapper,
+			       struct db_stmt *stmt, int sent)
+{
+	if (!sent)
+		return PQmakeEmptyPGresult(wrapper->conn, PGRES_FATAL_ERROR);
+	tal_arr_expand(&wrapper->pending, stmt);
+	return RESULT_PENDING;
+}
+
+static PGresult *pipeline_send_command(struct db_postgres *wrapper,
+				       const char *command)
+{
+	/* Pipeline mode doesn't allow PQsendQuery. */
+	return pipeline_sent(wrapper, NULL,
+			     PQsendQueryParams(wrapper->conn, command,
+					       0, NULL, NULL, NULL, NULL, 0));
+}
+
+/* Read the results of everything we've sent, and leave pipeline mode
+ * so we can wait for results as normal.  Pending statements get their
+ * results (as if they'd just been executed).  If anything failed,
+ * returns false with db->error set. */
+static bool db_postgres_flush(struct db *db)
+{
+	struct db_postgres *wrapper = (struct db_postgres *) db->conn;
+	const char *err = NULL;
+	PGresult *res;
+
+	if (PQpipelineStatus(wrapper->conn) == PQ_PIPELINE_OFF)
+		return true;
+
+	if (!PQpipelineSync(wrapper->conn))
+		err = tal_strdup(tmpctx, PQerrorMessage(wrapper->conn));
+
+	for (size_t i = 0; i < tal_count(wrapper->pending); i++) {
+		struct db_stmt *stmt = wrapper->pending[i];
+		ExecStatusType status;
+
+		res = PQgetResult(wrapper->conn);
+		status = PQresultStatus(res);
+		/* Once one fails, the rest are PGRES_PIPELINE_ABORTED, so
+		 * report the first. */
+		if (!err && status != PGRES_COMMAND_OK
+		    && status != PGRES_TUPLES_OK)
+			err = tal_strdup(tmpctx,
+					 res ? PQresultErrorMessage(res)
+					 : PQerrorMessage(wrapper->conn));
+
+		/* Each command's results end with a NULL. */
+		if (res) {
+			PGresult *end;
+			while ((end = PQgetResult(wrapper->conn)) != NULL)
+				PQclear(end);
+		}
+
+		if (stmt)
+			stmt->inner_stmt = res;
+		else
+			PQclear(res);
+	}
+	tal_resize(&wrapper->pending, 0);
+
+	/* Finally, the result of the sync itself. */
+	PQclear(PQgetResult(wrapper->conn));
+	if (!PQexitPipelineMode(wrapper->conn) && !err)
+		err = tal_strdup(tmpctx, PQerrorMessage(wrapper->conn));
+
+	if (err) {
+		db->error = tal_fmt(db, "Pipelined command failed: %s", err);
+		return false;
+	}
 	return true;
 }
 
 static bool db_postgres_begin_tx(struct db *db)
 {
 	assert(db->conn);
+	struct db_postgres *wrapper = (struct db_postgres *) db->conn;
 	PGresult *res;
-	res = PQexec(db->conn, "BEGIN;");
+
+	/* We'll read the result with everything else. */
+	if (wrapper->can_pipeline && !db->no_pipeline) {
+		if (!PQenterPipelineMode(wrapper->conn))
+			res = PQmakeEmptyPGresult(wrapper->conn,
+						  PGRES_FATAL_ERROR);
+		else
+			res = pipeline_send_command(wrapper, "BEGIN;");
+		if (res != RESULT_PENDING) {
+			db->error = tal_fmt(db, "BEGIN command failed: %s",
+					    PQerrorMessage(wrapper->conn));
+			PQclear(res);
+			return false;
+		}
+		wrapper->pipelining = true;
+		return true;
+	}
+
+	res = PQexec(conn2pg(db->conn), "BEGIN;");
 	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
 		db->error = tal_fmt(db, "BEGIN command failed: %s",
-				    PQerrorMessage(db->conn));
+				    PQerrorMessage(conn2pg(db->conn)));
 		PQclear(res);
 		return false;
 	}
@@ -61,11 +211,34 @@ static bool db_postgres_begin_tx(struct db *db)
 static bool db_postgres_commit_tx(struct db *db)
 {
 	assert(db->conn);
+	struct db_postgres *wrapper = (struct db_postgres *) db->conn;
 	PGresult *res;
-	res = PQexec(db->conn, "COMMIT;");
+
+	/* Send COMMIT after everything else, then wait for it all. */
+	if (wrapper->pipelining) {
+		wrapper->pipelining = false;
+		if (PQpipelineStatus(wrapper->conn) == PQ_PIPELINE_OFF
+		    && !PQenterPipelineMode(wrapper->conn))
+			res = PQmakeEmptyPGresult(wrapper->conn,
+						  PGRES_FATAL_ERROR);
+		else
+			res = pipeline_send_command(wrapper, "COMMIT;");
+		if (res != RESULT_PENDING) {
+			const char *err = tal_strdup(tmpctx,
+						     PQerrorMessage(wrapper->conn));
+			PQclear(res);
+			db_postgres_flush(db);
+			db->error = tal_fmt(db, "COMMIT command failed: %s",
+					    err);
+			return false;
+		}
+		return db_postgres_flush(db);
+	}
+
+	res = PQexec(conn2pg(db->conn), "COMMIT;");
 	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
 		db->error = tal_fmt(db, "COMMIT command failed: %s",
-				    PQerrorMessage(db->conn));
+				    PQerrorMessage(conn2pg(db->conn)));
 		PQclear(res);
 		return false;
 	}
@@ -73,8 +246,39 @@ static bool db_postgres_commit_tx(struct db *db)
 	return true;
 }
 
-static PGresult *db_postgres_do_exec(struct db_stmt *stmt)
+/* Can we use a statement prepared with these parameter types? */
+static bool prepared_types_match(const Oid *prepared, const Oid *types,
+				 size_t num)
+{
+	for (size_t i = 0; i < num; i++) {
+		/* A NULL (type 0) fits any parameter type. */
+		if (types[i] != 0 && types[i] != prepared[i])
+			return false;
+	}
+	return true;
+}
+
+static bool query_changes_schema(const char *query)
+{
+	return strstarts(query, "CREATE ")
+		|| strstarts(query, "ALTER ")
+		|| strstarts(query, "DROP ");
+}
+
+/* Drop all our prepared statements, e.g. because the schema changed. */
+static void db_postgres_deallocate_all(struct db_postgres *wrapper)
 {
+	PQclear(PQexec(wrapper->conn, "DEALLOCATE ALL;"));
+	for (size_t i = 0; i < tal_count(wrapper->prepared); i++)
+		wrapper->prepared[i] = tal_free(wrapper->prepared[i]);
+}
+
+/* If pipelined, this only sends the statement, returning RESULT_PENDING
+ * (unless it couldn't be sent). */
+static PGresult *db_postgres_do_exec(struct db_stmt *stmt, bool pipelined)
+{
+	struct db_postgres *wrapper = (struct db_postgres *) stmt->db->conn;
+	char name[sizeof("clnq") + STR_MAX_CHARS(int)];
 	int slots = stmt->query->placeholders;
 	const char *paramValues[slots];
 	int paramLengths[slots];
@@ -129,19 +333,103 @@ static PGresult *db_postgres_do_exec(struct db_stmt *stmt)
 			break;
 		}
 	}
-	return PQexecParams(stmt->db->conn, stmt->query->query, slots,
+
+	/* We may have left pipeline mode to read a result. */
+	if (pipelined
+	    && PQpipelineStatus(wrapper->conn) == PQ_PIPELINE_OFF
+	    && !PQenterPipelineMode(wrapper->conn))
+		return PQmakeEmptyPGresult(wrapper->conn, PGRES_FATAL_ERROR);
+
+	/* Untranslated queries are one-offs, and schema changes run once
+	 * (and invalidate everything anyway): not worth preparing. */
+	if (stmt->query_slot < 0 || query_changes_schema(stmt->query->query))
+		goto unprepared;
+
+	/* The server keeps the query plan, so we only send the name and
+	 * parameters from now on. */
+	snprintf(name, sizeof(name), "clnq%i", stmt->query_slot);
+	if (!wrapper->prepared[stmt->query_slot]) {
+		if (pipelined) {
+			/* If this fails, so will the statement. */
+			PGresult *res;
+			res = pipeline_sent(wrapper, NULL,
+					    PQsendPrepare(wrapper->conn, name,
+							  stmt->query->query,
+							  slots, paramTypes));
+			if (res != RESULT_PENDING)
+				return res;
+		} else {
+			PGresult *res = PQprepare(wrapper->conn, name,
+						  stmt->query->query, slots,
+						  paramTypes);
+			/* Caller reports the error. */
+			if (PQresultStatus(res) != PGRES_COMMAND_OK)
+				return res;
+			PQclear(res);
+		}
+		wrapper->prepared[stmt->query_slot]
+			= tal_dup_arr(wrapper->prepared, Oid,
+				      paramTypes, slots, 0);
+	}
+
+	/* If it was prepared with different types (e.g. a NULL last time,
+	 * so the server guessed), just do it the slow way. */
+	if (!prepared_types_match(wrapper->prepared[stmt->query_slot],
+				  paramTypes, slots))
+		goto unprepared;
+
+	if (pipelined)
+		return pipeline_sent(wrapper, stmt,
+				     PQsendQueryPrepared(wrapper->conn, name,
+							 slots, paramValues,
+							 paramLengths,
+							 paramFormats,
+							 resultFormat));
+
+	return PQexecPrepared(wrapper->conn, name, slots,
+			      paramValues, paramLengths, paramFormats,
+			      resultFormat);
+
+unprepared:
+	if (pipelined)
+		return pipeline_sent(wrapper, stmt,
+				     PQsendQueryParams(wrapper->conn,
+						       stmt->query->query,
+						       slots, paramTypes,
+						       paramValues,
+						       paramLengths,
+						       paramFormats,
+						       resultFormat));
+
+	return PQexecParams(wrapper->conn, stmt->query->query, slots,
 			    paramTypes, paramValues, paramLengths, paramFormats,
 			    resultFormat);
 }
 
 static bool db_postgres_query(struct db_stmt *stmt)
 {
-	stmt->inner_stmt = db_postgres_do_exec(stmt);
+	struct db_postgres *wrapper = (struct db_postgres *) stmt->db->conn;
 	int res;
+
+	/* Send it after any writes we haven't read the results of yet, and
+	 * wait for all of them at once. */
+	if (wrapper->pipelining) {
+		stmt->inner_stmt = db_postgres_do_exec(stmt, true);
+		if (stmt->inner_stmt == RESULT_PENDING
+		    && !db_postgres_flush(stmt->db)) {
+			stmt->error = stmt->db->error;
+			if (stmt->inner_stmt)
+				PQclear(stmt->inner_stmt);
+			stmt->inner_stmt = NULL;
+			return false;
+		}
+	} else
+		stmt->inner_stmt = db_postgres_do_exec(stmt, false);
+
 	res = PQresultStatus(stmt->inner_stmt);
 
 	if (res != PGRES_EMPTY_QUERY && res != PGRES_TUPLES_OK) {
-		stmt->error = PQerrorMessage(stmt->db->conn);
+		stmt->error = PQerrorMessage(conn2pg(stmt->db->conn));
 		PQclear(stmt->inner_stmt);
 		stmt->inner_stmt = NULL;
 		return false;
@@ -215,26 +503,70 @@ static const unsigned char *db_postgres_column_text(struct db_stmt *stmt, int co
 
 static void db_postgres_stmt_free(struct db_stmt *stmt)
 {
-	if (stmt->inner_stmt)
+	struct db_postgres *wrapper = (struct db_postgres *) stmt->db->conn;
+
+	/* Don't hand it the result when it arrives. */
+	if (stmt->inner_stmt == RESULT_PENDING) {
+		for (size_t i = 0; i < tal_count(wrapper->pending); i++)
+			if (wrapper->pending[i] == stmt)
+				wrapper->pending[i] = NULL;
+	} else if (stmt->inner_stmt)
 		PQclear(stmt->inner_stmt);
 	stmt->inner_stmt = NULL;
 }
 
+/* Make sure stmt's result has been read, so we can look at it. */
+static void db_postgres_need_result(struct db_stmt *stmt)
+{
+	if (!db_postgres_flush(stmt->db))
+		db_fatal("%s", stmt->db->error);
+}
+
 static bool db_postgres_exec(struct db_stmt *stmt)
 {
+	struct db_postgres *wrapper = (struct db_postgres *) stmt->db->conn;
 	bool ok;
-	stmt->inner_stmt = db_postgres_do_exec(stmt);
+
+	/* Schema changes invalidate our prepared statements (below), so
+	 * they wait for everything before them. */
+	if (wrapper->pipelining
+	    && !query_changes_schema(stmt->query->query)) {
+		if (tal_count(wrapper->pending) >= PIPELINE_MAX
+		    && !db_postgres_flush(stmt->db)) {
+			stmt->error = stmt->db->error;
+			return false;
+		}
+		stmt->inner_stmt = db_postgres_do_exec(stmt, true);
+		if (stmt->inner_stmt == RESULT_PENDING)
+			return true;
+		stmt->error = PQerrorMessage(wrapper->conn);
+		return false;
+	}
+
+	if (!db_postgres_flush(stmt->db)) {
+		stmt->error = stmt->db->error;
+		return false;
+	}
+	stmt->inner_stmt = db_postgres_do_exec(stmt, false);
 	ok = PQresultStatus(stmt->inner_stmt) == PGRES_COMMAND_OK;
 
 	if (!ok)
-		stmt->error = PQerrorMessage(stmt->db->conn);
+		stmt->error = PQerrorMessage(conn2pg(stmt->db->conn));
+	/* Prepared statements can fail with "cached plan must not change
+	 * result type" after the schema changes, so start again. */
+	else if (query_changes_schema(stmt->query->query))
+		db_postgres_deallocate_all(stmt->db->conn);
 
 	return ok;
 }
 
 static u64 db_postgres_last_insert_id(struct db_stmt *stmt)
 {
-	PGresult *res = PQexec(stmt->db->conn, "SELECT lastval()");
+	PGresult *res;
+
+	/* lastval() is only right once the INSERT has actually happened. */
+	db_postgres_need_result(stmt);
+	res = PQexec(conn2pg(stmt->db->conn), "SELECT lastval()");
 	int id = atoi(PQgetvalue(res, 0, 0));
 	PQclear(res);
 	return id;
@@ -242,8 +574,13 @@ static u64 db_postgres_last_insert_id(struct db_stmt *stmt)
 
 static size_t db_postgres_count_changes(struct db_stmt *stmt)
 {
-	PGresult *res = (PGresult*)stmt->inner_stmt;
-	char *count = PQcmdTuples(res);
+	PGresult *res;
+	char *count;
+
+	if (stmt->inner_stmt == RESULT_PENDING)
+		db_postgres_need_result(stmt);
+	res = (PGresult*)stmt->inner_stmt;
+	count = PQcmdTuples(res);
 	return atoi(count);
 }
 
@@ -262,10 +599,10 @@ static bool db_postgres_vacuum(struct db *db)
 		return true;
 #endif
 
-	res = PQexec(db->conn, "VACUUM FULL;");
+	res = PQexec(conn2pg(db->conn), "VACUUM FULL;");
 	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
 		db->error = tal_fmt(db, "VACUUM command failed: %s",
-				    PQerrorMessage(db->conn));
+				    PQerrorMessage(conn2pg(db->conn)));
 		PQclear(res);
 		return false;
 	}
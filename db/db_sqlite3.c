@@ -7,13 +7,56 @@
 #include <db/utils.h>
 
 #if HAVE_SQLITE3
+  #include <pthread.h>
   #include <sqlite3.h>
 
+/* One committed transaction, waiting to be applied to the replica.
+ * These are malloc'ed, not tal'ed, since the writer thread frees them. */
+struct replica_batch {
+	struct replica_batch *next;
+	/* Wrap these in a transaction (not for VACUUM)? */
+	bool transaction;
+	/* What data_version the replica should have afterwards, or 0 if
+	 * it's not supposed to change. */
+	u32 data_version;
+	size_t num_stmts;
+	char **stmts;
+};
+
+/* When db->replica_max_lag is set, we hand the changes to this thread
+ * rather than writing the replica as we go. */
+struct replica_writer {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	/* Signalled when there's a new batch, or we're stopping. */
+	pthread_cond_t more;
+	/* Signalled when the writer has applied a batch, or failed. */
+	pthread_cond_t done;
+
+	/* Everything below is protected by lock. */
+	struct replica_batch *head, **tail;
+	/* How many batches are queued (including one being applied). */
+	size_t lag;
+	/* How many times we've had to wait for it. */
+	u64 stalls;
+	bool stopping;
+	/* If the writer fails, this explains why (sqlite3_malloc'ed), and
+	 * it stops. */
+	char *error;
+};
+
 struct db_sqlite3 {
 	/* The actual db connection.  */
 	sqlite3 *conn;
 	/* A replica db connection, if requested, or NULL otherwise.  */
 	sqlite3 *backup_conn;
+	/* Compiled statements not currently in use, indexed by query_slot.
+	 * We reset and rebind these, rather than compiling every time. */
+	sqlite3_stmt **stmt_cache;
+	/* Once started, the writer owns backup_conn. */
+	struct replica_writer *replica;
+	/* The transaction we're collecting for the writer, if any. */
+	struct replica_batch *batch;
 };
 
 /**
@@ -28,15 +71,240 @@ sqlite3 *conn2sql(void *conn)
 	return wrapper->conn;
 }
 
-static void replicate_statement(struct db_sqlite3 *wrapper,
-				const char *qry)
+static struct replica_batch *replica_batch_new(bool transaction)
+{
+	struct replica_batch *b = malloc(sizeof(*b));
+
+	b->next = NULL;
+	b->transaction = transaction;
+	b->data_version = 0;
+	b->num_stmts = 0;
+	b->stmts = NULL;
+	return b;
+}
+
+static void replica_batch_add(struct replica_batch *b, const char *qry)
+{
+	b->stmts = realloc(b->stmts, sizeof(b->stmts[0]) * (b->num_stmts + 1));
+	b->stmts[b->num_stmts++] = strdup(qry);
+}
+
+static void replica_batch_free(struct replica_batch *b)
+{
+	for (size_t i = 0; i < b->num_stmts; i++)
+		free(b->stmts[i]);
+	free(b->stmts);
+	free(b);
+}
+
+/* Writer thread: returns an error message, or NULL. */
+static char *replica_exec(sqlite3 *conn, const char *qry)
+{
+	char *errmsg, *ret;
+
+	if (sqlite3_exec(conn, qry, NULL, NULL, &errmsg) == SQLITE_OK)
+		return NULL;
+	ret = sqlite3_mprintf("Failed to replicate query: %s: %s",
+			      errmsg, qry);
+	sqlite3_free(errmsg);
+	return ret;
+}
+
+/* Writer thread: apply one batch, and check that the replica's
+ * data_version agrees with the main database afterwards, which is how
+ * we notice the replica diverging. */
+static char *replica_apply(sqlite3 *conn, const struct replica_batch *b)
 {
+	sqlite3_stmt *stmt;
+	char *err;
+	u32 version;
+
+	if (b->transaction && (err = replica_exec(conn, "BEGIN TRANSACTION;")))
+		return err;
+	for (size_t i = 0; i < b->num_stmts; i++) {
+		if ((err = replica_exec(conn, b->stmts[i])))
+			return err;
+	}
+	if (b->transaction && (err = replica_exec(conn, "COMMIT;")))
+		return err;
+
+	if (!b->data_version)
+		return NULL;
+
+	sqlite3_prepare_v2(conn, "SELECT intval FROM vars"
+			   " WHERE name = 'data_version';", -1, &stmt, NULL);
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+		version = sqlite3_column_int64(stmt, 0);
+	else
+		version = 0;
+	sqlite3_finalize(stmt);
+
+	if (version != b->data_version)
+		return sqlite3_mprintf("Replica has diverged: data_version"
+				       " %u, expected %u",
+				       version, b->data_version);
+	return NULL;
+}
+
+static void *replica_writer_thread(void *arg)
+{
+	struct db_sqlite3 *wrapper = arg;
+	struct replica_writer *rw = wrapper->replica;
+	struct replica_batch *b;
+	char *err;
+
+	pthread_mutex_lock(&rw->lock);
+	for (;;) {
+		while (!rw->head && !rw->stopping)
+			pthread_cond_wait(&rw->more, &rw->lock);
+		/* We drain the queue before stopping. */
+		b = rw->head;
+		if (!b)
+			break;
+		pthread_mutex_unlock(&rw->lock);
+
+		err = replica_apply(wrapper->backup_conn, b);
+
+		pthread_mutex_lock(&rw->lock);
+		rw->head = b->next;
+		if (!rw->head)
+			rw->tail = &rw->head;
+		rw->lag--;
+		replica_batch_free(b);
+		if (err) {
+			rw->error = err;
+			pthread_cond_broadcast(&rw->done);
+			break;
+		}
+		pthread_cond_broadcast(&rw->done);
+	}
+	pthread_mutex_unlock(&rw->lock);
+	return NULL;
+}
+
+static void replica_writer_start(struct db_sqlite3 *wrapper)
+{
+	struct replica_writer *rw = tal(wrapper, struct replica_writer);
+	int err;
+
+	/* Separate connections in separate threads is fine, unless sqlite3
+	 * was built without thread support at all. */
+	if (!sqlite3_threadsafe())
+		db_fatal("sqlite3 built without threads: cannot write replica"
+			 " asynchronously");
+
+	pthread_mutex_init(&rw->lock, NULL);
+	pthread_cond_init(&rw->more, NULL);
+	pthread_cond_init(&rw->done, NULL);
+	rw->head = NULL;
+	rw->tail = &rw->head;
+	rw->lag = 0;
+	rw->stalls = 0;
+	rw->stopping = false;
+	rw->error = NULL;
+	wrapper->replica = rw;
+
+	err = pthread_create(&rw->thread, NULL, replica_writer_thread, wrapper);
+	if (err != 0)
+		db_fatal("Could not start replica writer: %s", strerror(err));
+}
+
+/* Queue up a batch, and wait if the writer has fallen too far behind. */
+static bool replica_writer_queue(struct db *db, struct replica_batch *b)
+{
+	struct db_sqlite3 *wrapper = (struct db_sqlite3 *) db->conn;
+	struct replica_writer *rw = wrapper->replica;
+	bool ok;
+
+	pthread_mutex_lock(&rw->lock);
+	if (!rw->error) {
+		*rw->tail = b;
+		rw->tail = &b->next;
+		rw->lag++;
+		pthread_cond_signal(&rw->more);
+		if (rw->lag > db->replica_max_lag)
+			rw->stalls++;
+		while (rw->lag > db->replica_max_lag && !rw->error)
+			pthread_cond_wait(&rw->done, &rw->lock);
+	} else
+		replica_batch_free(b);
+
+	ok = !rw->error;
+	if (!ok)
+		db->error = tal_fmt(db, "%s", rw->error);
+	pthread_mutex_unlock(&rw->lock);
+	return ok;
+}
+
+/* Wait for the writer to finish everything, then stop it. */
+static void replica_writer_stop(struct db_sqlite3 *wrapper)
+{
+	struct replica_writer *rw = wrapper->replica;
+	char *err;
+
+	pthread_mutex_lock(&rw->lock);
+	rw->stopping = true;
+	pthread_cond_signal(&rw->more);
+	pthread_mutex_unlock(&rw->lock);
+	pthread_join(rw->thread, NULL);
+
+	err = rw->error;
+	while (rw->head) {
+		struct replica_batch *b = rw->head;
+		rw->head = b->next;
+		replica_batch_free(b);
+	}
+	pthread_cond_destroy(&rw->done);
+	pthread_cond_destroy(&rw->more);
+	pthread_mutex_destroy(&rw->lock);
+	wrapper->replica = tal_free(rw);
+
+	if (err)
+		db_fatal("Replica writer failed: %s", err);
+}
+
+static bool db_sqlite3_replica_lag(struct db *db, size_t *lag, u64 *stalls)
+{
+	struct db_sqlite3 *wrapper = (struct db_sqlite3 *) db->conn;
+	struct replica_writer *rw = wrapper->replica;
+
+	if (!rw)
+		return false;
+
+	pthread_mutex_lock(&rw->lock);
+	*lag = rw->lag;
+	*stalls = rw->stalls;
+	pthread_mutex_unlock(&rw->lock);
+	return true;
+}
+
+static void replicate_statement(struct db *db, const char *qry)
+{
+	struct db_sqlite3 *wrapper = (struct db_sqlite3 *) db->conn;
 	sqlite3_stmt *stmt;
 	int err;
 
 	if (!wrapper->backup_conn)
 		return;
 
+	/* The writer thread will do it (after we commit). */
+	if (wrapper->batch) {
+		replica_batch_add(wrapper->batch, qry);
+		return;
+	}
+
+	/* Once started, the writer owns backup_conn: even statements
+	 * outside a transaction (e.g. PRAGMA) must go through it, so
+	 * they're applied in order. */
+	if (wrapper->replica) {
+		struct replica_batch *b = replica_batch_new(false);
+		replica_batch_add(b, qry);
+		if (!replica_writer_queue(db, b))
+			db_fatal("Failed to replicate query: %s: %s",
+				 db->error, qry);
+		return;
+	}
+
 	sqlite3_prepare_v2(wrapper->backup_conn,
 			   qry, -1, &stmt, NULL);
 	err = sqlite3_step(stmt);
@@ -49,11 +317,10 @@ static void replicate_statement(struct db_sqlite3 *wrapper,
 			 qry);
 }
 
-static void db_sqlite3_changes_add(struct db_sqlite3 *wrapper,
-				   struct db_stmt *stmt,
+static void db_sqlite3_changes_add(struct db_stmt *stmt,
 				   const char *qry)
 {
-	replicate_statement(wrapper, qry);
+	replicate_statement(stmt->db, qry);
 	db_changes_add(stmt, qry);
 }
 
@@ -94,16 +361,14 @@ static bool have_same_data_version(sqlite3 *a, sqlite3 *b)
 #if !HAVE_SQLITE3_EXPANDED_SQL
 /* Prior to sqlite3 v3.14, we have to use tracing to dump statements */
 struct db_sqlite3_trace {
-	struct db_sqlite3 *wrapper;
 	struct db_stmt *stmt;
 };
 
 static void trace_sqlite3(void *stmtv, const char *stmt)
 {
 	struct db_sqlite3_trace *trace = (struct db_sqlite3_trace *)stmtv;
-	struct db_sqlite3 *wrapper = trace->wrapper;
 	struct db_stmt *s = trace->stmt;
-	db_sqlite3_changes_add(wrapper, s, stmt);
+	db_sqlite3_changes_add(s, stmt);
 }
 #endif
 
@@ -138,6 +403,10 @@ static bool db_sqlite3_setup(struct db *db)
 	}
 
 	wrapper = tal(db, struct db_sqlite3);
+	wrapper->stmt_cache = tal_arrz(wrapper, sqlite3_stmt *,
+				       db->queries->query_table_size);
+	wrapper->replica = NULL;
+	wrapper->batch = NULL;
 	db->conn = wrapper;
 
 	err = sqlite3_open_v2(filename, &sql, flags, NULL);
@@ -220,10 +489,18 @@ static bool db_sqlite3_setup(struct db *db)
 static bool db_sqlite3_query(struct db_stmt *stmt)
 {
 	sqlite3_stmt *s;
-	sqlite3 *conn = conn2sql(stmt->db->conn);
+	struct db_sqlite3 *wrapper = (struct db_sqlite3 *) stmt->db->conn;
 	int err;
 
-	err = sqlite3_prepare_v2(conn, stmt->query->query, -1, &s, NULL);
+	/* Take the cached one if it's there (if this query is already
+	 * in use, e.g. nested iteration, we compile another). */
+	if (stmt->query_slot >= 0 && wrapper->stmt_cache[stmt->query_slot]) {
+		s = wrapper->stmt_cache[stmt->query_slot];
+		wrapper->stmt_cache[stmt->query_slot] = NULL;
+		err = SQLITE_OK;
+	} else
+		err = sqlite3_prepare_v2(wrapper->conn, stmt->query->query, -1,
+					 &s, NULL);
 
 	for (size_t i=0; i<stmt->query->placeholders; i++) {
 		struct db_binding *b = &stmt->bindings[i];
@@ -269,13 +546,11 @@ static bool db_sqlite3_exec(struct db_stmt *stmt)
 {
 	int err;
 	bool success;
-	struct db_sqlite3 *wrapper = (struct db_sqlite3 *) stmt->db->conn;
 
 #if !HAVE_SQLITE3_EXPANDED_SQL
 	/* Register the tracing function if we don't have an explicit way of
 	 * expanding the statement. */
 	struct db_sqlite3_trace trace;
-	trace.wrapper = wrapper;
 	trace.stmt = stmt;
 	sqlite3_trace(conn2sql(stmt->db->conn), trace_sqlite3, &trace);
 #endif
@@ -298,7 +573,7 @@ static bool db_sqlite3_exec(struct db_stmt *stmt)
 	/* Manually expand and call the callback */
 	char *expanded_sql;
 	expanded_sql = sqlite3_expanded_sql(stmt->inner_stmt);
-	db_sqlite3_changes_add(wrapper, stmt, expanded_sql);
+	db_sqlite3_changes_add(stmt, expanded_sql);
 	sqlite3_free(expanded_sql);
 #endif
 	success = true;
@@ -332,7 +607,15 @@ static bool db_sqlite3_begin_tx(struct db *db)
 		db->error = tal_fmt(db, "Failed to begin a transaction: %s", errmsg);
 		return false;
 	}
-	replicate_statement(wrapper, "BEGIN TRANSACTION;");
+
+	/* The caller may have set replica_max_lag since setup. */
+	if (wrapper->backup_conn && (db->replica_max_lag || wrapper->replica)) {
+		if (!wrapper->replica)
+			replica_writer_start(wrapper);
+		wrapper->batch = replica_batch_new(true);
+		return true;
+	}
+	replicate_statement(db, "BEGIN TRANSACTION;");
 	return true;
 }
 
@@ -349,7 +632,19 @@ static bool db_sqlite3_commit_tx(struct db *db)
 		db->error = tal_fmt(db, "Failed to commit a transaction: %s", errmsg);
 		return false;
 	}
-	replicate_statement(wrapper, "COMMIT;");
+
+	if (wrapper->batch) {
+		struct replica_batch *b = wrapper->batch;
+		wrapper->batch = NULL;
+		/* Nothing to do? */
+		if (!b->num_stmts) {
+			replica_batch_free(b);
+			return true;
+		}
+		b->data_version = db->data_version;
+		return replica_writer_queue(db, b);
+	}
+	replicate_statement(db, "COMMIT;");
 	return true;
 }
 
@@ -391,7 +686,21 @@ static const unsigned char *db_sqlite3_column_text(struct db_stmt *stmt, int col
 
 static void db_sqlite3_stmt_free(struct db_stmt *stmt)
 {
-	if (stmt->inner_stmt)
+	struct db_sqlite3 *wrapper = (struct db_sqlite3 *) stmt->db->conn;
+
+	if (!stmt->inner_stmt)
+		return;
+
+	/* Put it back for next time, unless we already have one (or
+	 * we're shutting down and the connection is gone). */
+	if (wrapper
+	    && stmt->query_slot >= 0
+	    && !wrapper->stmt_cache[stmt->query_slot]) {
+		/* This also releases any read lock it was holding. */
+		sqlite3_reset(stmt->inner_stmt);
+		sqlite3_clear_bindings(stmt->inner_stmt);
+		wrapper->stmt_cache[stmt->query_slot] = stmt->inner_stmt;
+	} else
 		sqlite3_finalize(stmt->inner_stmt);
 	stmt->inner_stmt = NULL;
 }
@@ -406,6 +715,12 @@ static void db_sqlite3_close(struct db *db)
 {
 	struct db_sqlite3 *wrapper = (struct db_sqlite3 *) db->conn;
 
+	/* sqlite3_close() refuses while statements are outstanding. */
+	for (size_t i = 0; i < tal_count(wrapper->stmt_cache); i++)
+		sqlite3_finalize(wrapper->stmt_cache[i]);
+
+	if (wrapper->replica)
+		replica_writer_stop(wrapper);
 	if (wrapper->backup_conn)
 		sqlite3_close(wrapper->backup_conn);
 	sqlite3_close(wrapper->conn);
@@ -432,7 +747,14 @@ static bool db_sqlite3_vacuum(struct db *db)
 		db->error = tal_fmt(db, "%s",
 				    sqlite3_errmsg(conn2sql(db->conn)));
 	sqlite3_finalize(stmt);
-	replicate_statement(wrapper, "VACUUM;");
+
+	if (wrapper->replica) {
+		struct replica_batch *b = replica_batch_new(false);
+		replica_batch_add(b, "VACUUM;");
+		if (!replica_writer_queue(db, b))
+			return false;
+	} else
+		replicate_statement(db, "VACUUM;");
 
 	return err == SQLITE_DONE;
 }
@@ -685,6 +1007,7 @@ struct db_config db_sqlite3_config = {
 	.count_changes_fn = &db_sqlite3_count_changes,
 	.setup_fn = &db_sqlite3_setup,
 	.teardown_fn = &db_sqlite3_close,
+	.replica_lag_fn = &db_sqlite3_replica_lag,
 
 	.vacuum_fn = db_sqlite3_vacuum,
 	.rename_column = db_sqlite3_rename_column,
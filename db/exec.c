@@ -27,6 +27,7 @@ int db_get_version(struct db *db)
 	 */
 	if (!db_query_prepared(stmt)) {
 		db_commit_transaction(stmt->db);
+		db_group_commit_flush(stmt->db);
 		db_begin_transaction(stmt->db);
 		tal_free(stmt);
 		return res;
@@ -124,6 +125,12 @@ void db_begin_transaction_(struct db *db, const char *location)
 	if (db->in_transaction)
 		db_fatal("Already in transaction from %s", db->in_transaction);
 
+	/* Carry on in the transaction whose commit we deferred. */
+	if (db->group_commit_pending) {
+		db->in_transaction = location;
+		return;
+	}
+
 	/* No writes yet. */
 	db->dirty = false;
 
@@ -140,11 +147,13 @@ bool db_in_transaction(struct db *db)
 	return db->in_transaction;
 }
 
-void db_commit_transaction(struct db *db)
+/* Actually commit: db->in_transaction must be set. */
+static void db_commit_now(struct db *db)
 {
 	bool ok;
-	assert(db->in_transaction);
-	db_assert_no_outstanding_statements(db);
+	struct timemono start;
+
+	start = time_mono();
 
 	/* Increment before reporting changes to an eventual plugin. */
 	if (db->dirty)
@@ -156,6 +165,57 @@ void db_commit_transaction(struct db *db)
 	if (!ok)
 		db_fatal("Failed to commit DB transaction: %s", db->error);
 
+	histogram_add(&db->commit_time, timemono_since(start));
 	db->in_transaction = NULL;
 	db->dirty = false;
 }
+
+void db_commit_transaction(struct db *db)
+{
+	assert(db->in_transaction);
+	db_assert_no_outstanding_statements(db);
+
+	if (db->group_commit) {
+		if (!db->group_commit_pending) {
+			db->group_commit_pending = true;
+			db->group_commit_start = time_mono();
+		}
+		db->in_transaction = NULL;
+		return;
+	}
+
+	db_commit_now(db);
+}
+
+void db_set_group_commit(struct db *db, bool enable)
+{
+	db->group_commit = enable;
+	if (!enable)
+		db_group_commit_flush(db);
+}
+
+bool db_group_commit_pending(const struct db *db, struct timemono *since)
+{
+	if (db->group_commit_pending && since)
+		*since = db->group_commit_start;
+	return db->group_commit_pending;
+}
+
+void db_group_commit_flush(struct db *db)
+{
+	/* Can't commit in the middle of someone else's transaction (if
+	 * we're in a nested io_loop): it'll be flushed next time. */
+	if (!db->group_commit_pending || db->in_transaction)
+		return;
+
+	db->group_commit_pending = false;
+	db->in_transaction = "db_group_commit_flush";
+	db_commit_now(db);
+}
+
+bool db_replica_lag(struct db *db, size_t *lag, u64 *stalls)
+{
+	if (!db->config->replica_lag_fn)
+		return false;
+	return db->config->replica_lag_fn(db, lag, stalls);
+}
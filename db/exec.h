@@ -4,6 +4,7 @@
 
 #include <ccan/short_types/short_types.h>
 #include <ccan/take/take.h>
+#include <ccan/time/time.h>
 
 struct db;
 
@@ -48,5 +49,30 @@ bool db_in_transaction(struct db *db);
  */
 void db_commit_transaction(struct db *db);
 
+/**
+ * db_set_group_commit - Coalesce transactions into fewer commits
+ *
+ * While enabled, db_commit_transaction() leaves the transaction open
+ * and the next db_begin_transaction() carries on in it, so many
+ * transactions share a single commit (and fsync).  The caller must call
+ * db_group_commit_flush() before anyone outside the process can see the
+ * effects of those transactions.  Disabling flushes.
+ */
+void db_set_group_commit(struct db *db, bool enable);
+
+/* Is there a deferred commit?  If so, set @since to when it started. */
+bool db_group_commit_pending(const struct db *db, struct timemono *since);
+
+/* Commit anything deferred by db_set_group_commit. */
+void db_group_commit_flush(struct db *db);
+
+/**
+ * db_replica_lag - How far behind is the replica?
+ *
+ * Returns false unless there's a replica being written in the background
+ * (see db->replica_max_lag).
+ */
+bool db_replica_lag(struct db *db, size_t *lag, u64 *stalls);
+
 
 #endif /* LIGHTNING_DB_EXEC_H */
@@ -63,7 +63,8 @@ static void db_stmt_free(struct db_stmt *stmt)
 
 static struct db_stmt *db_prepare_core(struct db *db,
 				       const char *location,
-				       const struct db_query *db_query)
+				       const struct db_query *db_query,
+				       int query_slot)
 {
 	struct db_stmt *stmt = tal(db, struct db_stmt);
 	size_t num_slots = db_query->placeholders;
@@ -75,6 +76,7 @@ static struct db_stmt *db_prepare_core(struct db *db,
 	stmt->error = NULL;
 	stmt->db = db;
 	stmt->query = db_query;
+	stmt->query_slot = query_slot;
 	stmt->executed = false;
 	stmt->inner_stmt = NULL;
 
@@ -89,19 +91,14 @@ static struct db_stmt *db_prepare_core(struct db *db,
 	return stmt;
 }
 
-struct db_stmt *db_prepare_v2_(const char *location, struct db *db,
-			       const char *query_id)
+static size_t db_query_find(struct db *db, const char *query_id)
 {
+	struct db_query_lookup *l;
 	size_t pos;
 
-	/* Normalize query_id paths, because unit tests are compiled with this
-	 * prefix. */
-	if (strncmp(query_id, "./", 2) == 0)
-		query_id += 2;
-
-	if (!db->in_transaction)
-		db_fatal("Attempting to prepare a db_stmt outside of a "
-			 "transaction: %s", location);
+	l = &db->query_lookup[(uintptr_t)query_id % tal_count(db->query_lookup)];
+	if (l->query_id == query_id)
+		return l->slot;
 
 	/* Look up the query by its ID */
 	pos = hash_djb2(query_id) % db->queries->query_table_size;
@@ -113,7 +110,28 @@ struct db_stmt *db_prepare_v2_(const char *location, struct db *db,
 		pos = (pos + 1) % db->queries->query_table_size;
 	}
 
-	return db_prepare_core(db, location, &db->queries->query_table[pos]);
+	l->query_id = query_id;
+	l->slot = pos;
+	return pos;
+}
+
+struct db_stmt *db_prepare_v2_(const char *location, struct db *db,
+			       const char *query_id)
+{
+	size_t pos;
+
+	/* Normalize query_id paths, because unit tests are compiled with this
+	 * prefix. */
+	if (strncmp(query_id, "./", 2) == 0)
+		query_id += 2;
+
+	if (!db->in_transaction)
+		db_fatal("Attempting to prepare a db_stmt outside of a "
+			 "transaction: %s", location);
+
+	pos = db_query_find(db, query_id);
+	return db_prepare_core(db, location, &db->queries->query_table[pos],
+			       pos);
 }
 
 /* Provides replication and hook interface for raw SQL too */
@@ -130,7 +148,7 @@ struct db_stmt *db_prepare_untranslated(struct db *db, const char *query)
 	db_query->colnames = NULL;
 	db_query->num_colnames = 0;
 
-	stmt = db_prepare_core(db, "db_prepare_untranslated", db_query);
+	stmt = db_prepare_core(db, "db_prepare_untranslated", db_query, -1);
 	tal_steal(stmt, db_query);
 	return stmt;
 }
@@ -182,6 +200,9 @@ bool db_exec_prepared_v2(struct db_stmt *stmt TAKES)
 		db_fatal("Error executing statement: %s", stmt->error);
 	}
 
+	if (!stmt->query->readonly && stmt->db->record_change_fn)
+		stmt->db->record_change_fn(stmt);
+
 	if (taken(stmt))
 	    tal_free(stmt);
 
@@ -223,7 +244,10 @@ void db_report_changes(struct db *db, const char *final, size_t min)
 	 * changes yet. */
 	assert(!tal_count(db->changes) || db->dirty);
 
-	if (tal_count(db->changes) > min && db->report_changes_fn)
+	/* A dirty transaction always has changes for record_change_fn,
+	 * even if the driver doesn't give us any expanded SQL. */
+	if ((tal_count(db->changes) > min || db->dirty)
+	    && db->report_changes_fn)
 		db->report_changes_fn(db);
 	db->changes = tal_free(db->changes);
 }
@@ -327,10 +351,20 @@ struct db *db_open(const tal_t *ctx, const char *filename)
 	db->queries = db_queries_find(db->config);
 	if (!db->queries)
 		db_fatal("Unable to find DB queries for %s", db->config->name);
+	db->query_lookup = tal_arrz(db, struct db_query_lookup,
+				    db->queries->query_table_size);
 
 	tal_add_destructor(db, destroy_db);
 	db->in_transaction = NULL;
 	db->changes = NULL;
+	db->dirty = false;
+	db->report_changes_fn = NULL;
+	db->record_change_fn = NULL;
+	memset(&db->commit_time, 0, sizeof(db->commit_time));
+	db->group_commit = false;
+	db->group_commit_pending = false;
+	db->replica_max_lag = 0;
+	db->no_pipeline = false;
 
 	/* This must be outside a transaction, so catch it */
 	assert(!db->in_transaction);
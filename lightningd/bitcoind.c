@@ -14,8 +14,10 @@
 #include <ccan/tal/str/str.h>
 #include <common/json_parse.h>
 #include <common/memleak.h>
+#include <common/type_to_string.h>
 #include <db/exec.h>
 #include <lightningd/bitcoind.h>
+#include <lightningd/block_worker.h>
 #include <lightningd/chaintopology.h>
 #include <lightningd/io_loop_with_timers.h>
 #include <lightningd/lightningd.h>
@@ -27,6 +29,10 @@ static const char *methods[] = {"getchaininfo", "getrawblockbyheight",
                                 "sendrawtransaction", "getutxout",
                                 "estimatefees"};
 
+/* The ones it doesn't have to support: we check in `getchaininfo`. */
+static const char *optional_methods[] = {"getblockfilter",
+					 "sendrawtransactions"};
+
 static void bitcoin_destructor(struct plugin *p)
 {
 	if (p->plugins->ld->state == LD_STATE_SHUTDOWN)
@@ -97,6 +103,12 @@ void bitcoind_check_commands(struct bitcoind *bitcoind)
 		}
 		wait_plugin(bitcoind, methods[i], p);
 	}
+
+	for (i = 0; i < ARRAY_SIZE(optional_methods); i++) {
+		p = find_plugin_for_command(bitcoind->ld, optional_methods[i]);
+		if (p)
+			wait_plugin(bitcoind, optional_methods[i], p);
+	}
 }
 
 /* Our Bitcoin backend plugin gave us a bad response. We can't recover. */
@@ -326,6 +338,118 @@ void bitcoind_sendrawtx_(struct bitcoind *bitcoind,
 	bitcoin_plugin_send(bitcoind, req);
 }
 
+/* `sendrawtransactions`
+ *
+ * Optional: send several transactions in one request.  With `preflight`,
+ * the plugin may check them first (e.g. against the mempool) and not
+ * bother sending ones which are already in the mempool or a block.
+ *
+ * Plugin response, one entry for each tx, in order:
+ * {
+ *	"results": [ { "success": <true|false>,
+ *		       "errmsg": "<not empty if !success>" }, ... ]
+ * }
+ */
+
+struct sendrawtxs_call {
+	struct bitcoind *bitcoind;
+	size_t num_txs;
+	void (*cb)(struct bitcoind *bitcoind,
+		   const bool *success,
+		   const char **errmsgs,
+		   void *);
+	void *cb_arg;
+};
+
+static void sendrawtxs_callback(const char *buf, const jsmntok_t *toks,
+				const jsmntok_t *idtok,
+				struct sendrawtxs_call *call)
+{
+	const jsmntok_t *result, *results, *t;
+	bool *success;
+	const char **errmsgs;
+	size_t i;
+
+	result = json_get_member(buf, toks, "result");
+	results = result ? json_get_member(buf, result, "results") : NULL;
+	if (!results || results->type != JSMN_ARRAY
+	    || results->size != call->num_txs)
+		bitcoin_plugin_error(call->bitcoind, buf, toks,
+				     "sendrawtransactions",
+				     "bad 'results' field");
+
+	success = tal_arr(call, bool, call->num_txs);
+	errmsgs = tal_arr(call, const char *, call->num_txs);
+	json_for_each_arr(i, t, results) {
+		const char *err;
+
+		errmsgs[i] = NULL;
+		err = json_scan(tmpctx, buf, t, "{success:%}",
+				JSON_SCAN(json_to_bool, &success[i]));
+		if (!err && !success[i])
+			err = json_scan(tmpctx, buf, t, "{errmsg:%}",
+					JSON_SCAN_TAL(errmsgs, json_strdup,
+						      &errmsgs[i]));
+		if (err)
+			bitcoin_plugin_error(call->bitcoind, buf, toks,
+					     "sendrawtransactions",
+					     "bad 'results' entry: %s", err);
+	}
+
+	db_begin_transaction(call->bitcoind->ld->wallet->db);
+	call->cb(call->bitcoind, success, errmsgs, call->cb_arg);
+	db_commit_transaction(call->bitcoind->ld->wallet->db);
+
+	tal_free(call);
+}
+
+bool bitcoind_can_sendrawtxs(struct bitcoind *bitcoind)
+{
+	/* If some other plugin sends single txs, it's doing something
+	 * special: don't go around it. */
+	struct plugin *p = strmap_get(&bitcoind->pluginsmap,
+				      "sendrawtransactions");
+
+	return p && p == strmap_get(&bitcoind->pluginsmap,
+				    "sendrawtransaction");
+}
+
+void bitcoind_sendrawtxs_(struct bitcoind *bitcoind,
+			  const char **hextxs,
+			  bool allowhighfees,
+			  bool preflight,
+			  void (*cb)(struct bitcoind *bitcoind,
+				     const bool *success,
+				     const char **errmsgs,
+				     void *),
+			  void *cb_arg)
+{
+	struct jsonrpc_request *req;
+	struct sendrawtxs_call *call = tal(bitcoind, struct sendrawtxs_call);
+
+	assert(bitcoind_can_sendrawtxs(bitcoind));
+	call->bitcoind = bitcoind;
+	call->num_txs = tal_count(hextxs);
+	call->cb = cb;
+	call->cb_arg = cb_arg;
+	log_debug(bitcoind->log, "sendrawtransactions: %zu txs%s",
+		  call->num_txs, preflight ? " (with preflight)" : "");
+
+	req = jsonrpc_request_start(bitcoind, "sendrawtransactions",
+				    NULL, true,
+				    bitcoind->log,
+				    NULL, sendrawtxs_callback,
+				    call);
+	json_array_start(req->stream, "txs");
+	for (size_t i = 0; i < call->num_txs; i++)
+		json_add_string(req->stream, NULL, hextxs[i]);
+	json_array_end(req->stream);
+	json_add_bool(req->stream, "allowhighfees", allowhighfees);
+	json_add_bool(req->stream, "preflight", preflight);
+	jsonrpc_request_end(req);
+	bitcoin_plugin_send(bitcoind, req);
+}
+
 /* `getrawblockbyheight`
  *
  * If no block were found at that height, will set each field to `null`.
@@ -334,10 +458,19 @@ void bitcoind_sendrawtx_(struct bitcoind *bitcoind,
  *	"blockhash": "<blkid>",
  *	"block": "rawblock"
  * }
+ *
+ * If the plugin said it supports it in `getchaininfo`, we ask for
+ * `blockfile`, and it can instead give us the name of a file containing
+ * the raw block bytes, which we delete once read:
+ * {
+ *	"blockhash": "<blkid>",
+ *	"blockfile": "/path/to/rawblock"
+ * }
  */
 
 struct getrawblockbyheight_call {
 	struct bitcoind *bitcoind;
+	struct bitcoin_blkid blkid;
 	void (*cb)(struct bitcoind *bitcoind,
 		   struct bitcoin_blkid *blkid,
 		   struct bitcoin_block *block,
@@ -345,14 +478,35 @@ struct getrawblockbyheight_call {
 	void *cb_arg;
 };
 
+/* Back from the block worker. */
+static void getrawblockbyheight_decoded(struct bitcoin_block *blk,
+					const char *errmsg,
+					struct getrawblockbyheight_call *call)
+{
+	struct bitcoind *bitcoind = call->bitcoind;
+
+	if (!blk) {
+		struct plugin *p = strmap_get(&bitcoind->pluginsmap,
+					      "getrawblockbyheight");
+		fatal("%s error: bad response to getrawblockbyheight (%s)"
+		      " for block %s",
+		      p->cmd, errmsg,
+		      type_to_string(tmpctx, struct bitcoin_blkid,
+				     &call->blkid));
+	}
+
+	db_begin_transaction(bitcoind->ld->wallet->db);
+	call->cb(bitcoind, &call->blkid, blk, call->cb_arg);
+	db_commit_transaction(bitcoind->ld->wallet->db);
+	tal_free(call);
+}
+
 static void
 getrawblockbyheight_callback(const char *buf, const jsmntok_t *toks,
 			     const jsmntok_t *idtok,
 			     struct getrawblockbyheight_call *call)
 {
-	const char *block_str, *err;
-	struct bitcoin_blkid blkid;
-	struct bitcoin_block *blk;
+	const char *block_str, *block_file, *err;
 
 	/* If block hash is `null`, this means not found! Call the callback
 	 * with NULL values. */
@@ -361,30 +515,34 @@ getrawblockbyheight_callback(const char *buf, const jsmntok_t *toks,
 		db_begin_transaction(call->bitcoind->ld->wallet->db);
 		call->cb(call->bitcoind, NULL, NULL, call->cb_arg);
 		db_commit_transaction(call->bitcoind->ld->wallet->db);
-		goto clean;
+		tal_free(call);
+		return;
 	}
 
-	err = json_scan(tmpctx, buf, toks, "{result:{blockhash:%,block:%}}",
-			JSON_SCAN(json_to_sha256, &blkid.shad.sha),
+	/* Raw block handed over in a file?  Either way, the worker reads or
+	 * decodes it, and scans the txs, while we get on with other things. */
+	err = json_scan(tmpctx, buf, toks, "{result:{blockhash:%,blockfile:%}}",
+			JSON_SCAN(json_to_sha256, &call->blkid.shad.sha),
+			JSON_SCAN_TAL(tmpctx, json_strdup, &block_file));
+	if (!err) {
+		block_worker_decode(call->bitcoind->block_worker,
+				    NULL, take(block_file),
+				    getrawblockbyheight_decoded, call);
+		return;
+	}
+
+	err = json_scan(tmpctx, buf, toks,
+			"{result:{blockhash:%,block:%}}",
+			JSON_SCAN(json_to_sha256, &call->blkid.shad.sha),
 			JSON_SCAN_TAL(tmpctx, json_strdup, &block_str));
 	if (err)
 		bitcoin_plugin_error(call->bitcoind, buf, toks,
 				     "getrawblockbyheight",
 				     "bad 'result' field: %s", err);
 
-	blk = bitcoin_block_from_hex(tmpctx, chainparams, block_str,
-				     strlen(block_str));
-	if (!blk)
-		bitcoin_plugin_error(call->bitcoind, buf, toks,
-				     "getrawblockbyheight",
-				     "bad block");
-
-	db_begin_transaction(call->bitcoind->ld->wallet->db);
-	call->cb(call->bitcoind, &blkid, blk, call->cb_arg);
-	db_commit_transaction(call->bitcoind->ld->wallet->db);
-
-clean:
-	tal_free(call);
+	block_worker_decode(call->bitcoind->block_worker,
+			    take(block_str), NULL,
+			    getrawblockbyheight_decoded, call);
 }
 
 void bitcoind_getrawblockbyheight_(struct bitcoind *bitcoind,
@@ -408,6 +566,113 @@ void bitcoind_getrawblockbyheight_(struct bitcoind *bitcoind,
 				    NULL,  getrawblockbyheight_callback,
 				    call);
 	json_add_num(req->stream, "height", height);
+	if (bitcoind->blockfile)
+		json_add_bool(req->stream, "blockfile", true);
+	jsonrpc_request_end(req);
+	bitcoin_plugin_send(bitcoind, req);
+}
+
+/* `getblockfilter`
+ *
+ * Optional: we only call it if the plugin says it can in `getchaininfo`.
+ * Gets the header and the BIP158 "basic" filter of the block at that
+ * height, so we can skip fetching blocks which don't concern us.
+ *
+ * If no block were found at that height, will set each field to `null`.
+ * If the filter is not available (yet), `filter` is `null`.
+ * Plugin response:
+ * {
+ *	"blockhash": "<blkid>",
+ *	"header": "<raw 80-byte block header>",
+ *	"filter": "<serialized filter>"
+ * }
+ */
+
+struct getblockfilter_call {
+	struct bitcoind *bitcoind;
+	void (*cb)(struct bitcoind *bitcoind,
+		   struct bitcoin_blkid *blkid,
+		   struct bitcoin_block *blk,
+		   const u8 *filter,
+		   void *);
+	void *cb_arg;
+};
+
+static void getblockfilter_callback(const char *buf, const jsmntok_t *toks,
+				    const jsmntok_t *idtok,
+				    struct getblockfilter_call *call)
+{
+	const char *err;
+	struct bitcoin_blkid blkid, hdr_blkid;
+	struct bitcoin_block *blk;
+	u8 *header, *filter;
+
+	/* If block hash is `null`, this means not found! Call the callback
+	 * with NULL values. */
+	err = json_scan(tmpctx, buf, toks, "{result:{blockhash:null}}");
+	if (!err) {
+		db_begin_transaction(call->bitcoind->ld->wallet->db);
+		call->cb(call->bitcoind, NULL, NULL, NULL, call->cb_arg);
+		db_commit_transaction(call->bitcoind->ld->wallet->db);
+		goto clean;
+	}
+
+	err = json_scan(tmpctx, buf, toks, "{result:{blockhash:%,header:%}}",
+			JSON_SCAN(json_to_sha256, &blkid.shad.sha),
+			JSON_SCAN_TAL(tmpctx, json_tok_bin_from_hex, &header));
+	if (err)
+		bitcoin_plugin_error(call->bitcoind, buf, toks,
+				     "getblockfilter",
+				     "bad 'result' field: %s", err);
+
+	/* Make it a block with no transactions. */
+	tal_arr_expand(&header, 0);
+	blk = bitcoin_block_from_bytes(tmpctx, chainparams,
+				       header, tal_bytelen(header));
+	if (!blk)
+		bitcoin_plugin_error(call->bitcoind, buf, toks,
+				     "getblockfilter", "bad header");
+	bitcoin_block_blkid(blk, &hdr_blkid);
+	if (!bitcoin_blkid_eq(&blkid, &hdr_blkid))
+		bitcoin_plugin_error(call->bitcoind, buf, toks,
+				     "getblockfilter",
+				     "header is for a different block");
+
+	if (json_scan(tmpctx, buf, toks, "{result:{filter:%}}",
+		      JSON_SCAN_TAL(tmpctx, json_tok_bin_from_hex,
+				    &filter)) != NULL)
+		filter = NULL;
+
+	db_begin_transaction(call->bitcoind->ld->wallet->db);
+	call->cb(call->bitcoind, &blkid, blk, filter, call->cb_arg);
+	db_commit_transaction(call->bitcoind->ld->wallet->db);
+
+clean:
+	tal_free(call);
+}
+
+void bitcoind_getblockfilter_(struct bitcoind *bitcoind,
+			      u32 height,
+			      void (*cb)(struct bitcoind *bitcoind,
+					 struct bitcoin_blkid *blkid,
+					 struct bitcoin_block *blk,
+					 const u8 *filter,
+					 void *arg),
+			      void *cb_arg)
+{
+	struct jsonrpc_request *req;
+	struct getblockfilter_call *call = tal(NULL, struct getblockfilter_call);
+
+	assert(bitcoind->blockfilters);
+	call->bitcoind = bitcoind;
+	call->cb = cb;
+	call->cb_arg = cb_arg;
+
+	req = jsonrpc_request_start(bitcoind, "getblockfilter", NULL, true,
+				    bitcoind->log,
+				    NULL, getblockfilter_callback,
+				    call);
+	json_add_num(req->stream, "height", height);
 	jsonrpc_request_end(req);
 	bitcoin_plugin_send(bitcoind, req);
 }
@@ -421,7 +686,9 @@ void bitcoind_getrawblockbyheight_(struct bitcoind *bitcoind,
  *	"chain": "<bip70_chainid>",
  *	"headercount": <number of fetched headers>,
  *	"blockcount": <number of fetched block>,
- *	"ibd": <synced?>
+ *	"ibd": <synced?>,
+ *	"blockfile": <optional: getrawblockbyheight supports `blockfile`>,
+ *	"blockfilters": <optional: getblockfilter will work>
  * }
  */
 
@@ -445,7 +712,7 @@ static void getchaininfo_callback(const char *buf, const jsmntok_t *toks,
 {
 	const char *err, *chain;
 	u32 headers, blocks;
-	bool ibd;
+	bool ibd, blockfile, blockfilters;
 
 	err = json_scan(tmpctx, buf, toks,
 			"{result:{chain:%,headercount:%,blockcount:%,ibd:%}}",
@@ -457,6 +724,24 @@ static void getchaininfo_callback(const char *buf, const jsmntok_t *toks,
 		bitcoin_plugin_error(call->bitcoind, buf, toks, "getchaininfo",
 				     "bad 'result' field: %s", err);
 
+	/* Optional, so old plugins still work */
+	if (json_scan(tmpctx, buf, toks, "{result:{blockfile:%}}",
+		      JSON_SCAN(json_to_bool, &blockfile)) != NULL)
+		blockfile = false;
+#if DEVELOPER
+	if (call->bitcoind->ld->dev_no_blockfile)
+		blockfile = false;
+#endif
+	call->bitcoind->blockfile = blockfile;
+
+	/* Elements headers are different, and it doesn't have filters. */
+	if (json_scan(tmpctx, buf, toks, "{result:{blockfilters:%}}",
+		      JSON_SCAN(json_to_bool, &blockfilters)) != NULL
+	    || !strmap_get(&call->bitcoind->pluginsmap, "getblockfilter")
+	    || is_elements(chainparams))
+		blockfilters = false;
+	call->bitcoind->blockfilters = blockfilters;
+
 	db_begin_transaction(call->bitcoind->ld->wallet->db);
 	call->cb(call->bitcoind, chain, headers, blocks, ibd,
 		 call->first_call, call->cb_arg);
@@ -615,7 +900,6 @@ static void process_getfilteredblock_step1(struct bitcoind *bitcoind,
 					   struct filteredblock_call *call)
 {
 	struct filteredblock_outpoint *o;
-	struct bitcoin_tx *tx;
 
 	/* If we were unable to fetch the block hash (bitcoind doesn't know
 	 * about a block at that height), we can short-circuit and just call
@@ -639,24 +923,19 @@ static void process_getfilteredblock_step1(struct bitcoind *bitcoind,
 	 * call->result if they are unspent. */
 
 	call->outpoints = tal_arr(call, struct filteredblock_outpoint *, 0);
-	for (size_t i = 0; i < tal_count(block->tx); i++) {
-		tx = block->tx[i];
-		for (size_t j = 0; j < tx->wtx->num_outputs; j++) {
-			const u8 *script = bitcoin_tx_output_get_script(NULL, tx, j);
-			struct amount_asset amount = bitcoin_tx_output_get_amount(tx, j);
-			if (amount_asset_is_main(&amount) && is_p2wsh(script, NULL)) {
-				/* This is an interesting output, remember it. */
-				o = tal(call->outpoints, struct filteredblock_outpoint);
-				bitcoin_txid(tx, &o->outpoint.txid);
-				o->outpoint.n = j;
-				o->amount = amount_asset_to_sat(&amount);
-				o->txindex = i;
-				o->scriptPubKey = tal_steal(o, script);
-				tal_arr_expand(&call->outpoints, o);
-			} else {
-				tal_free(script);
-			}
-		}
+	for (size_t i = 0; i < block->scan->num_p2wsh; i++) {
+		/* The worker already found the P2WSH outputs. */
+		const struct block_txout *out
+			= &block->scan->outs[block->scan->p2wsh[i]];
+
+		o = tal(call->outpoints, struct filteredblock_outpoint);
+		o->outpoint.txid = block->scan->txs[out->txindex].txid;
+		o->outpoint.n = out->outnum;
+		o->amount = out->amount;
+		o->txindex = out->txindex;
+		o->scriptPubKey = tal_dup_arr(o, u8, out->script,
+					      out->script_len, 0);
+		tal_arr_expand(&call->outpoints, o);
 	}
 
 	if (tal_count(call->outpoints) == 0) {
@@ -750,6 +1029,9 @@ struct bitcoind *new_bitcoind(const tal_t *ctx,
 	list_head_init(&bitcoind->pending_getfilteredblock);
 	tal_add_destructor(bitcoind, destroy_bitcoind);
 	bitcoind->synced = false;
+	bitcoind->blockfile = false;
+	bitcoind->blockfilters = false;
+	bitcoind->block_worker = new_block_worker(bitcoind);
 
 	return bitcoind;
 }
@@ -27,9 +27,20 @@ struct bitcoind {
 	/* Ignore results, we're shutting down. */
 	bool shutdown;
 
+	/* Does the backend hand us raw blocks in files (see `blockfile` in
+	 * getchaininfo)? */
+	bool blockfile;
+
+	/* Can the backend give us BIP158 block filters (see `blockfilters`
+	 * in getchaininfo)? */
+	bool blockfilters;
+
 	/* Timer if we're waiting for it to warm up. */
 	struct oneshot *checkchain_timer;
 
+	/* Decodes the blocks we get from getrawblockbyheight. */
+	struct block_worker *block_worker;
+
 	struct list_head pending_getfilteredblock;
 
 	/* Map each method to a plugin, so we can have multiple plugins
@@ -87,6 +98,32 @@ void bitcoind_sendrawtx_(struct bitcoind *bitcoind,
 						bool, const char *),	\
 			    (arg))
 
+/* Does the backend have the optional `sendrawtransactions`? */
+bool bitcoind_can_sendrawtxs(struct bitcoind *bitcoind);
+
+/* Only if bitcoind_can_sendrawtxs(): send all of @hextxs in one request.
+ * With @preflight, the backend may skip txs it already knows (they're
+ * reported as successes).  @success and @errmsgs are in the order of
+ * @hextxs; @errmsgs[i] is NULL if success[i]. */
+void bitcoind_sendrawtxs_(struct bitcoind *bitcoind,
+			  const char **hextxs,
+			  bool allowhighfees,
+			  bool preflight,
+			  void (*cb)(struct bitcoind *bitcoind,
+				     const bool *success,
+				     const char **errmsgs,
+				     void *),
+			  void *arg);
+#define bitcoind_sendrawtxs(bitcoind_, hextxs, allowhighfees, preflight, cb, arg) \
+	bitcoind_sendrawtxs_((bitcoind_), (hextxs),			\
+			     (allowhighfees), (preflight),		\
+			     typesafe_cb_preargs(void, void *,		\
+						 (cb), (arg),		\
+						 struct bitcoind *,	\
+						 const bool *,		\
+						 const char **),	\
+			     (arg))
+
 void bitcoind_getfilteredblock_(struct bitcoind *bitcoind, u32 height,
 				void (*cb)(struct bitcoind *bitcoind,
 					   const struct filteredblock *fb,
@@ -135,6 +172,26 @@ void bitcoind_getrawblockbyheight_(struct bitcoind *bitcoind,
 							  struct bitcoin_block *),\
 				      (arg))
 
+/* Only if bitcoind->blockfilters: @blk is only the header (no transactions),
+ * and @filter is NULL if the backend couldn't get the filter. */
+void bitcoind_getblockfilter_(struct bitcoind *bitcoind,
+			      u32 height,
+			      void (*cb)(struct bitcoind *bitcoind,
+					 struct bitcoin_blkid *blkid,
+					 struct bitcoin_block *blk,
+					 const u8 *filter,
+					 void *arg),
+			      void *arg);
+#define bitcoind_getblockfilter(bitcoind_, height_, cb, arg)		\
+	bitcoind_getblockfilter_((bitcoind_), (height_),		\
+				 typesafe_cb_preargs(void, void *,	\
+						     (cb), (arg),	\
+						     struct bitcoind *,	\
+						     struct bitcoin_blkid *, \
+						     struct bitcoin_block *, \
+						     const u8 *),	\
+				 (arg))
+
 void bitcoind_getutxout_(struct bitcoind *bitcoind,
 			 const struct bitcoin_outpoint *outpoint,
 			 void (*cb)(struct bitcoind *,
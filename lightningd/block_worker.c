@@ -0,0 +1,246 @@
+#include "config.h"
+#include <assert.h>
+#include <bitcoin/block.h>
+#include <bitcoin/chainparams.h>
+#include <ccan/io/io.h>
+#include <ccan/read_write_all/read_write_all.h>
+#include <ccan/str/hex/hex.h>
+#include <ccan/tal/str/str.h>
+#include <common/memleak.h>
+#include <common/utils.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <lightningd/block_worker.h>
+#include <lightningd/log.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* A block for the worker.  These are tal'ed, but the worker only touches
+ * the fields below (tal isn't thread-safe), and hands it back to the main
+ * loop through a pipe. */
+struct block_job {
+	struct block_job *next;
+
+	/* One of these */
+	const char *hex;
+	const char *file;
+
+	/* The scan, or for Elements just the raw bytes (libwally, hence tal,
+	 * has to parse those).  Both NULL if it was bad. */
+	struct block_scan *scan;
+	u8 *raw;
+	size_t rawlen;
+	/* If we couldn't read the file, why. */
+	int read_errno;
+
+	void (*cb)(struct bitcoin_block *blk, const char *errmsg, void *arg);
+	void *arg;
+};
+
+struct block_worker {
+	bool started;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	/* Signalled when there's a new job, or we're stopping. */
+	pthread_cond_t more;
+	/* The worker writes the finished job pointers to fds[1]. */
+	int fds[2];
+	struct block_job *done;
+
+	/* Everything below is protected by lock. */
+	struct block_job *head, **tail;
+	bool stopping;
+};
+
+static void destroy_block_job(struct block_job *job)
+{
+	block_scan_free(job->scan);
+	free(job->raw);
+}
+
+/* No tal (nor libwally) in here! */
+static void block_job_run(struct block_job *job)
+{
+	if (job->file) {
+		struct stat st;
+		int fd = open(job->file, O_RDONLY);
+
+		if (fd < 0 || fstat(fd, &st) != 0) {
+			job->read_errno = errno;
+		} else {
+			job->rawlen = st.st_size;
+			job->raw = malloc(job->rawlen + 1);
+			if (!job->raw || !read_all(fd, job->raw, job->rawlen)) {
+				job->read_errno = job->raw ? errno : ENOMEM;
+				free(job->raw);
+				job->raw = NULL;
+			}
+		}
+		if (fd >= 0)
+			close(fd);
+		unlink(job->file);
+	} else {
+		size_t hexlen = strlen(job->hex);
+
+		if (hexlen && job->hex[hexlen-1] == '\n')
+			hexlen--;
+
+		job->rawlen = hex_data_size(hexlen);
+		job->raw = malloc(job->rawlen + 1);
+		if (job->raw && !hex_decode(job->hex, hexlen,
+					    job->raw, job->rawlen)) {
+			free(job->raw);
+			job->raw = NULL;
+		}
+	}
+
+	if (job->raw && !is_elements(chainparams)) {
+		job->scan = block_scan(chainparams, job->raw, job->rawlen);
+		job->raw = NULL;
+	}
+}
+
+static void *block_worker_thread(void *arg)
+{
+	struct block_worker *bw = arg;
+	struct block_job *job;
+
+	pthread_mutex_lock(&bw->lock);
+	for (;;) {
+		while (!bw->head && !bw->stopping)
+			pthread_cond_wait(&bw->more, &bw->lock);
+		/* Nobody wants the rest once we're stopping. */
+		if (bw->stopping)
+			break;
+		job = bw->head;
+		bw->head = job->next;
+		if (!bw->head)
+			bw->tail = &bw->head;
+		pthread_mutex_unlock(&bw->lock);
+
+		block_job_run(job);
+		if (!write_all(bw->fds[1], &job, sizeof(job)))
+			abort();
+
+		pthread_mutex_lock(&bw->lock);
+	}
+	pthread_mutex_unlock(&bw->lock);
+	return NULL;
+}
+
+static struct io_plan *read_done_job(struct io_conn *conn,
+				     struct block_worker *bw);
+
+static struct io_plan *done_job(struct io_conn *conn, struct block_worker *bw)
+{
+	struct block_job *job = bw->done;
+	struct bitcoin_block *blk;
+	const char *errmsg;
+
+	if (job->scan) {
+		blk = bitcoin_block_from_scan(tmpctx, job->scan);
+		job->scan = NULL;
+	} else if (job->raw)
+		blk = bitcoin_block_from_bytes(tmpctx, chainparams,
+					       job->raw, job->rawlen);
+	else
+		blk = NULL;
+
+	if (blk)
+		errmsg = NULL;
+	else if (job->read_errno)
+		errmsg = tal_fmt(tmpctx, "could not read %s: %s",
+				 job->file, strerror(job->read_errno));
+	else
+		errmsg = "bad block";
+
+	job->cb(blk, errmsg, job->arg);
+	tal_free(job);
+	return read_done_job(conn, bw);
+}
+
+static struct io_plan *read_done_job(struct io_conn *conn,
+				     struct block_worker *bw)
+{
+	return io_read(conn, &bw->done, sizeof(bw->done), done_job, bw);
+}
+
+static void destroy_block_worker(struct block_worker *bw)
+{
+	if (!bw->started)
+		return;
+
+	pthread_mutex_lock(&bw->lock);
+	bw->stopping = true;
+	pthread_cond_signal(&bw->more);
+	pthread_mutex_unlock(&bw->lock);
+	pthread_join(bw->thread, NULL);
+
+	pthread_cond_destroy(&bw->more);
+	pthread_mutex_destroy(&bw->lock);
+	close(bw->fds[1]);
+}
+
+/* We start it on first use: --daemon forks after new_bitcoind(). */
+static void block_worker_start(struct block_worker *bw)
+{
+	int err;
+
+	if (pipe(bw->fds) != 0)
+		fatal("Could not create pipe for block worker: %s",
+		      strerror(errno));
+	io_new_conn(bw, bw->fds[0], read_done_job, bw);
+
+	pthread_mutex_init(&bw->lock, NULL);
+	pthread_cond_init(&bw->more, NULL);
+	err = pthread_create(&bw->thread, NULL, block_worker_thread, bw);
+	if (err != 0)
+		fatal("Could not start block worker: %s", strerror(err));
+	bw->started = true;
+}
+
+struct block_worker *new_block_worker(const tal_t *ctx)
+{
+	struct block_worker *bw = tal(ctx, struct block_worker);
+
+	bw->started = false;
+	bw->head = NULL;
+	bw->tail = &bw->head;
+	bw->stopping = false;
+	tal_add_destructor(bw, destroy_block_worker);
+	return bw;
+}
+
+void block_worker_decode_(struct block_worker *bw,
+			  const char *hex TAKES,
+			  const char *file TAKES,
+			  void (*cb)(struct bitcoin_block *blk,
+				     const char *errmsg,
+				     void *arg),
+			  void *arg)
+{
+	/* Only the worker knows about it while it's working on it. */
+	struct block_job *job = notleak(tal(bw, struct block_job));
+
+	assert(!hex != !file);
+	job->hex = hex ? tal_strdup(job, hex) : NULL;
+	job->file = file ? tal_strdup(job, file) : NULL;
+	job->scan = NULL;
+	job->raw = NULL;
+	job->rawlen = 0;
+	job->read_errno = 0;
+	job->cb = cb;
+	job->arg = arg;
+	job->next = NULL;
+	tal_add_destructor(job, destroy_block_job);
+
+	if (!bw->started)
+		block_worker_start(bw);
+
+	pthread_mutex_lock(&bw->lock);
+	*bw->tail = job;
+	bw->tail = &job->next;
+	pthread_cond_signal(&bw->more);
+	pthread_mutex_unlock(&bw->lock);
+}
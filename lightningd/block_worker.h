@@ -0,0 +1,31 @@
+#ifndef LIGHTNING_LIGHTNINGD_BLOCK_WORKER_H
+#define LIGHTNING_LIGHTNINGD_BLOCK_WORKER_H
+#include "config.h"
+#include <ccan/take/take.h>
+#include <ccan/tal/tal.h>
+#include <ccan/typesafe_cb/typesafe_cb.h>
+
+struct bitcoin_block;
+
+/* A thread which decodes raw blocks, and hashes and scans their txs
+ * (see block_scan()), so the main loop doesn't have to. */
+struct block_worker *new_block_worker(const tal_t *ctx);
+
+/* Decode @hex (or read, then unlink, @file): @cb is called later, from the
+ * main loop, with the block (on tmpctx), or NULL and @errmsg. */
+void block_worker_decode_(struct block_worker *bw,
+			  const char *hex TAKES,
+			  const char *file TAKES,
+			  void (*cb)(struct bitcoin_block *blk,
+				     const char *errmsg,
+				     void *arg),
+			  void *arg);
+#define block_worker_decode(bw_, hex_, file_, cb, arg)			\
+	block_worker_decode_((bw_), (hex_), (file_),			\
+			     typesafe_cb_preargs(void, void *,		\
+						 (cb), (arg),		\
+						 struct bitcoin_block *, \
+						 const char *),		\
+			     (arg))
+
+#endif /* LIGHTNING_LIGHTNINGD_BLOCK_WORKER_H */
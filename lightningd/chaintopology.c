@@ -1,4 +1,5 @@
 #include "config.h"
+#include <bitcoin/blockfilter.h>
 #include <bitcoin/feerate.h>
 #include <bitcoin/script.h>
 #include <bitcoin/tx.h>
@@ -24,6 +25,7 @@
 #include <lightningd/notification.h>
 #include <math.h>
 #include <wallet/txfilter.h>
+#include <wallet/utxo_pool.h>
 
 /* Mutual recursion via timer. */
 static void try_extend_tip(struct chain_topology *topo);
@@ -56,27 +58,51 @@ static bool we_broadcast(const struct chain_topology *topo,
 	return outgoing_tx_map_get(&topo->outgoing_txs, txid) != NULL;
 }
 
+/* The worker scanned the block: we only parse the txs which concern us. */
+static struct bitcoin_tx *block_tx(struct block *b, size_t txindex)
+{
+	struct bitcoin_tx *tx = bitcoin_block_tx(b->blk, txindex);
+
+	if (!tx)
+		fatal("Block %u (%s): could not parse tx %zu",
+		      b->height,
+		      type_to_string(tmpctx, struct bitcoin_blkid, &b->blkid),
+		      txindex);
+	return tx;
+}
+
+static bool owns_output(struct chain_topology *topo,
+			const struct block_scan *scan,
+			const struct block_scan_tx *stx)
+{
+	for (size_t j = 0; j < stx->num_outs; j++) {
+		const struct block_txout *out = &scan->outs[stx->first_out + j];
+
+		if (txfilter_match_script(topo->ld->owned_txfilter,
+					  out->script, out->script_len))
+			return true;
+	}
+	return false;
+}
+
 static void filter_block_txs(struct chain_topology *topo, struct block *b)
 {
-	size_t i;
+	const struct block_scan *scan = b->blk->scan;
 	struct amount_sat owned;
 
 	/* Now we see if any of those txs are interesting. */
-	for (i = 0; i < tal_count(b->full_txs); i++) {
-		const struct bitcoin_tx *tx = b->full_txs[i];
-		struct bitcoin_txid txid;
-		size_t j;
-		bool is_coinbase = i == 0;
+	for (size_t i = 0; i < scan->num_txs; i++) {
+		const struct block_scan_tx *stx = &scan->txs[i];
+		bool is_coinbase = i == 0, watched;
 
 		/* Tell them if it spends a txo we care about. */
-		for (j = 0; j < tx->wtx->num_inputs; j++) {
-			struct bitcoin_outpoint out;
+		for (size_t j = 0; j < stx->num_ins; j++) {
 			struct txowatch *txo;
-			bitcoin_tx_input_get_txid(tx, j, &out.txid);
-			out.n = tx->wtx->inputs[j].index;
 
-			txo = txowatch_hash_get(&topo->txowatches, &out);
+			txo = find_txowatch(topo,
+					    &scan->ins[stx->first_in + j].prevout);
 			if (txo) {
+				struct bitcoin_tx *tx = block_tx(b, i);
 				wallet_transaction_add(topo->ld->wallet,
 						       tx->wtx, b->height, i);
 				txowatch_fire(txo, tx, j, b);
@@ -84,8 +110,8 @@ static void filter_block_txs(struct chain_topology *topo, struct block *b)
 		}
 
 		owned = AMOUNT_SAT(0);
-		txid = b->txids[i];
-		if (txfilter_match(topo->bitcoind->ld->owned_txfilter, tx)) {
+		if (owns_output(topo, scan, stx)) {
+			struct bitcoin_tx *tx = block_tx(b, i);
 			wallet_extract_owned_outputs(topo->bitcoind->ld->wallet,
 						     tx->wtx, is_coinbase, &b->height, &owned);
 			wallet_transaction_add(topo->ld->wallet, tx->wtx,
@@ -93,15 +119,18 @@ static void filter_block_txs(struct chain_topology *topo, struct block *b)
 		}
 
 		/* We did spends first, in case that tells us to watch tx. */
-		if (watching_txid(topo, &txid) || we_broadcast(topo, &txid)) {
+		watched = watching_txid(topo, &stx->txid);
+		if (watched || we_broadcast(topo, &stx->txid)) {
 			wallet_transaction_add(topo->ld->wallet,
-					       tx->wtx, b->height, i);
+					       block_tx(b, i)->wtx,
+					       b->height, i);
 		}
 
-		txwatch_inform(topo, &txid, tx);
+		if (watched)
+			txwatch_inform(topo, &stx->txid, block_tx(b, i),
+				       b->height);
 	}
-	b->full_txs = tal_free(b->full_txs);
-	b->txids = tal_free(b->txids);
+	b->blk = tal_free(b->blk);
 }
 
 size_t get_tx_depth(const struct chain_topology *topo,
@@ -147,8 +176,30 @@ static void broadcast_remainder(struct bitcoind *bitcoind,
 			   broadcast_remainder, txs);
 }
 
-/* FIXME: This is dumb.  We can group txs and avoid bothering bitcoind
- * if any one tx is in the main chain. */
+/* One request can't carry every tx's cmd_id as its id prefix (as
+ * bitcoind_sendrawtx does), so we log them here instead. */
+static void rebroadcast_done(struct bitcoind *bitcoind,
+			     const bool *success, const char **errmsgs,
+			     struct txs_to_broadcast *txs)
+{
+	for (size_t i = 0; i < tal_count(txs->txs); i++) {
+		const char *id = txs->cmd_id[i];
+
+		if (!success[i])
+			log_debug(bitcoind->log,
+				  "Expected error broadcasting tx %s%s%s: %s",
+				  txs->txs[i], id ? " for " : "", id ? id : "",
+				  errmsgs[i]);
+		else if (id)
+			log_debug(bitcoind->log,
+				  "Rebroadcast tx %s for %s", txs->txs[i], id);
+	}
+	tal_free(txs);
+}
+
+/* Every new block, we resend everything which isn't in a block yet: if the
+ * backend can, that's one request, and it skips what's already in the
+ * mempool. */
 static void rebroadcast_txs(struct chain_topology *topo)
 {
 	/* Copy txs now (peers may go away, and they own txs). */
@@ -172,6 +223,12 @@ static void rebroadcast_txs(struct chain_topology *topo)
 			       otx->cmd_id ? tal_strdup(txs, otx->cmd_id) : NULL);
 	}
 
+	if (tal_count(txs->txs) && bitcoind_can_sendrawtxs(topo->bitcoind)) {
+		bitcoind_sendrawtxs(topo->bitcoind, txs->txs, false, true,
+				    rebroadcast_done, txs);
+		return;
+	}
+
 	/* Let this do the dirty work. */
 	txs->cursor = (size_t)-1;
 	broadcast_remainder(topo->bitcoind, true, "", txs);
@@ -308,9 +365,10 @@ static void watch_for_utxo_reconfirmation(struct chain_topology *topo,
 		if (find_txwatch(topo, &unconfirmed[i]->outpoint.txid, NULL))
 			continue;
 
-		notleak(watch_txid(topo, topo, NULL,
-				   &unconfirmed[i]->outpoint.txid,
-				   closeinfo_txid_confirmed));
+		txwatch_set_script(notleak(watch_txid(topo, topo, NULL,
+						      &unconfirmed[i]->outpoint.txid,
+						      closeinfo_txid_confirmed)),
+				   unconfirmed[i]->scriptPubkey);
 	}
 }
 
@@ -596,6 +654,17 @@ void topology_add_sync_waiter_(const tal_t *ctx,
 /* Once we're run out of new blocks to add, call this. */
 static void updates_complete(struct chain_topology *topo)
 {
+	/* Only worth reporting if we had to catch up. */
+	if (topo->catchup_blocks > 1) {
+		u64 msec = time_to_msec(timemono_between(time_mono(),
+							 topo->catchup_start));
+		log_info(topo->log,
+			 "Added %u blocks in %"PRIu64"ms (%.1f blocks/sec)",
+			 topo->catchup_blocks, msec,
+			 topo->catchup_blocks * 1000.0 / (msec ? msec : 1));
+	}
+	topo->catchup_blocks = 0;
+
 	if (!bitcoin_blkid_eq(&topo->tip->blkid, &topo->prev_tip)) {
 		/* Tell watch code to re-evaluate all txs. */
 		watch_topology_changed(topo);
@@ -641,8 +710,8 @@ static void updates_complete(struct chain_topology *topo)
 }
 
 static void record_wallet_spend(struct lightningd *ld,
-				struct bitcoin_outpoint *outpoint,
-				struct bitcoin_txid *txid,
+				const struct bitcoin_outpoint *outpoint,
+				const struct bitcoin_txid *txid,
 				u32 tx_blockheight)
 {
 	struct utxo *utxo;
@@ -667,20 +736,16 @@ static void record_wallet_spend(struct lightningd *ld,
 static void topo_update_spends(struct chain_topology *topo, struct block *b)
 {
 	const struct short_channel_id *spent_scids;
-	for (size_t i = 0; i < tal_count(b->full_txs); i++) {
-		const struct bitcoin_tx *tx = b->full_txs[i];
+	const struct block_scan *scan = b->blk->scan;
 
-		for (size_t j = 0; j < tx->wtx->num_inputs; j++) {
-			struct bitcoin_outpoint outpoint;
+	for (size_t i = 0; i < scan->num_ins; i++) {
+		const struct block_txin *in = &scan->ins[i];
 
-			bitcoin_tx_input_get_outpoint(tx, j, &outpoint);
-
-			if (wallet_outpoint_spend(topo->ld->wallet, tmpctx,
-						  b->height, &outpoint))
-				record_wallet_spend(topo->ld, &outpoint,
-						    &b->txids[i], b->height);
-
-		}
+		if (wallet_outpoint_spend(topo->ld->wallet, tmpctx,
+					  b->height, &in->prevout))
+			record_wallet_spend(topo->ld, &in->prevout,
+					    &scan->txs[in->txindex].txid,
+					    b->height);
 	}
 
 	/* Retrieve all potential channel closes from the UTXO set and
@@ -692,28 +757,30 @@ static void topo_update_spends(struct chain_topology *topo, struct block *b)
 
 static void topo_add_utxos(struct chain_topology *topo, struct block *b)
 {
-	for (size_t i = 0; i < tal_count(b->full_txs); i++) {
-		const struct bitcoin_tx *tx = b->full_txs[i];
-		struct bitcoin_outpoint outpoint;
-
-		bitcoin_txid(tx, &outpoint.txid);
-		for (outpoint.n = 0;
-		     outpoint.n < tx->wtx->num_outputs;
-		     outpoint.n++) {
-			if (tx->wtx->outputs[outpoint.n].features
-			    & WALLY_TX_IS_COINBASE)
-				continue;
-
-			const u8 *script = bitcoin_tx_output_get_script(tmpctx, tx, outpoint.n);
-			struct amount_asset amt = bitcoin_tx_output_get_amount(tx, outpoint.n);
-
-			if (amount_asset_is_main(&amt) && is_p2wsh(script, NULL)) {
-				wallet_utxoset_add(topo->ld->wallet, &outpoint,
-						   b->height, i, script,
-						   amount_asset_to_sat(&amt));
-			}
-		}
+	struct filteredblock_outpoint **outpoints
+		= tal_arr(tmpctx, struct filteredblock_outpoint *, 0);
+	const struct block_scan *scan = b->blk->scan;
+
+	/* The worker already found the P2WSH outputs. */
+	for (size_t i = 0; i < scan->num_p2wsh; i++) {
+		const struct block_txout *out = &scan->outs[scan->p2wsh[i]];
+		struct filteredblock_outpoint *o
+			= tal(outpoints, struct filteredblock_outpoint);
+
+		o->outpoint.txid = scan->txs[out->txindex].txid;
+		o->outpoint.n = out->outnum;
+		o->txindex = out->txindex;
+		o->scriptPubKey = tal_dup_arr(o, u8, out->script,
+					      out->script_len, 0);
+		o->amount = out->amount;
+		tal_arr_expand(&outpoints, o);
 	}
+
+	/* Written all at once, so the db can batch them. */
+	wallet_utxoset_add_many(topo->ld->wallet, b->height, outpoints);
+	for (size_t i = 0; i < tal_count(outpoints); i++)
+		topology_add_utxoset_script(topo, outpoints[i]->scriptPubKey);
+	tal_free(outpoints);
 }
 
 static void add_tip(struct chain_topology *topo, struct block *b)
@@ -723,7 +790,10 @@ static void add_tip(struct chain_topology *topo, struct block *b)
 	b->prev = topo->tip;
 	topo->tip->next = b;	/* FIXME this doesn't seem to be used anywhere */
 	topo->tip = b;
-	wallet_block_add(topo->ld->wallet, b);
+	if (!b->header_only) {
+		wallet_block_add(topo->ld->wallet, b);
+		topo->last_full_block = b->height;
+	}
 
 	topo_add_utxos(topo, b);
 	topo_update_spends(topo, b);
@@ -753,8 +823,8 @@ static struct block *new_block(struct chain_topology *topo,
 
 	b->hdr = blk->hdr;
 
-	b->full_txs = tal_steal(b, blk->tx);
-	b->txids = tal_steal(b, blk->txids);
+	b->blk = tal_steal(b, blk);
+	b->header_only = false;
 
 	return b;
 }
@@ -788,7 +858,11 @@ static void remove_tip(struct chain_topology *topo)
 	/* Grab these before we delete block from db */
 	removed_scids = wallet_utxoset_get_created(tmpctx, topo->ld->wallet,
 						   b->height);
-	wallet_block_remove(topo->ld->wallet, b);
+	/* Gossip may have fetched it for the utxoset, but we didn't. */
+	if (b->header_only)
+		wallet_blocks_rollback(topo->ld->wallet, b->height - 1);
+	else
+		wallet_block_remove(topo->ld->wallet, b);
 
 	/* This may have unconfirmed txs: reconfirm as we add blocks. */
 	watch_for_utxo_reconfirmation(topo, topo->ld->wallet);
@@ -800,34 +874,256 @@ static void remove_tip(struct chain_topology *topo)
 	tal_free(b);
 }
 
+/* How many blocks we'll ask the backend for at once when catching up. */
+#define MAX_BLOCK_PREFETCH 8
+
+/* A block we've asked for: we apply them strictly in order, but while
+ * catching up we fetch (and parse) the next few while applying this one. */
+struct prefetch {
+	struct chain_topology *topo;
+	/* If this isn't topo->prefetch_gen, nobody wants it any more. */
+	u64 gen;
+	u32 height;
+	bool done;
+	/* NULL if there was no such block. */
+	struct bitcoin_block *blk;
+	/* With --block-filters, @blk may be only the header: this is its
+	 * BIP158 filter, which we check once we get to it. */
+	const u8 *filter;
+};
+
+/* With --block-filters, we still fetch a full block this often, since we
+ * restart from the last block in our db. */
+#define BLOCK_FILTER_MAX_SKIP 144
+
+static void fill_prefetch_window(struct chain_topology *topo);
 static void get_new_block(struct bitcoind *bitcoind,
 			  struct bitcoin_blkid *blkid,
 			  struct bitcoin_block *blk,
-			  struct chain_topology *topo)
+			  struct prefetch *pf);
+
+static bool use_block_filters(const struct chain_topology *topo)
+{
+	return topo->ld->config.block_filters && topo->bitcoind->blockfilters;
+}
+
+static void load_utxoset_scripts(struct chain_topology *topo)
+{
+	tal_free(topo->utxoset_scripts);
+	topo->utxoset_scripts
+		= wallet_utxoset_unspent_scripts(topo, topo->ld->wallet);
+	topo->utxoset_scripts_loaded = tal_count(topo->utxoset_scripts);
+}
+
+void topology_add_utxoset_script(struct chain_topology *topo,
+				 const u8 *script)
+{
+	/* We load them all from the db when we first need them. */
+	if (!topo->utxoset_scripts)
+		return;
+
+	/* It's already in the db, so this picks it up too. */
+	if (tal_count(topo->utxoset_scripts)
+	    >= 2 * topo->utxoset_scripts_loaded + 1024) {
+		load_utxoset_scripts(topo);
+		return;
+	}
+	tal_arr_expand(&topo->utxoset_scripts,
+		       tal_dup_talarr(topo->utxoset_scripts, u8, script));
+}
+
+/* Could anything in this block concern us?  We look for the scripts of
+ * everything we're watching, our wallet's addresses and outputs, and the
+ * utxoset (so we tell gossipd about closes). */
+static bool block_filter_matches(struct chain_topology *topo,
+				 const struct bitcoin_block *blk,
+				 const u8 *filter)
+{
+	const u8 **scripts;
+	struct bitcoin_blkid blkid;
+	struct utxo **utxos;
+
+	scripts = txfilter_scriptpubkeys(tmpctx, topo->ld->owned_txfilter);
+	if (!watched_scripts(topo, &scripts))
+		return true;
+
+	/* Our unspent outputs are already in memory: don't ask the db. */
+	utxos = utxo_pool_by_value(topo->ld->wallet->utxo_pool);
+	for (size_t i = 0; i < tal_count(utxos); i++) {
+		if (utxos[i]->scriptPubkey)
+			tal_arr_expand(&scripts, utxos[i]->scriptPubkey);
+	}
+
+	if (!topo->utxoset_scripts)
+		load_utxoset_scripts(topo);
+
+	bitcoin_block_blkid(blk, &blkid);
+	return blockfilter_match_any(&blkid, filter, tal_bytelen(filter),
+				     scripts, tal_count(scripts))
+		|| blockfilter_match_any(&blkid, filter, tal_bytelen(filter),
+					 topo->utxoset_scripts,
+					 tal_count(topo->utxoset_scripts));
+}
+
+/* Forget about what we've fetched beyond the tip (reorg, or end of chain). */
+static void discard_prefetches(struct chain_topology *topo)
+{
+	/* Those still in flight notice they're stale and free themselves. */
+	topo->prefetch_gen++;
+	for (size_t i = 0; i < tal_count(topo->prefetches); i++) {
+		if (topo->prefetches[i]->done)
+			tal_free(topo->prefetches[i]);
+	}
+	tal_resize(&topo->prefetches, 0);
+	topo->prefetch_window = 1;
+}
+
+static void apply_prefetched(struct chain_topology *topo)
 {
-	if (!blkid && !blk) {
+	struct prefetch *pf;
+
+	topo->apply_timer = NULL;
+	if (!tal_count(topo->prefetches) || !topo->prefetches[0]->done)
+		return;
+
+	/* We only decide about filters now, since the block before this
+	 * could have given us new things to watch. */
+	pf = topo->prefetches[0];
+	if (pf->filter
+	    && bitcoin_blkid_eq(&topo->tip->blkid, &pf->blk->hdr.prev_hash)) {
+		if (pf->height - topo->last_full_block >= BLOCK_FILTER_MAX_SKIP
+		    || block_filter_matches(topo, pf->blk, pf->filter)) {
+			pf->done = false;
+			pf->blk = tal_free(pf->blk);
+			pf->filter = tal_free(pf->filter);
+			bitcoind_getrawblockbyheight(topo->bitcoind, pf->height,
+						     get_new_block, pf);
+			return;
+		}
+		log_debug(topo->log, "Block %u: filter matches nothing of ours,"
+			  " not fetching it", pf->height);
+	}
+
+	pf = tal_steal(tmpctx, topo->prefetches[0]);
+	tal_arr_remove(&topo->prefetches, 0);
+	if (!pf->blk) {
 		/* No such block, we're done. */
+		discard_prefetches(topo);
 		updates_complete(topo);
 		return;
 	}
-	assert(blkid && blk);
 
-	/* Annotate all transactions with the chainparams */
-	for (size_t i = 0; i < tal_count(blk->tx); i++)
-		blk->tx[i]->chainparams = chainparams;
-
-	/* Unexpected predecessor?  Free predecessor, refetch it. */
-	if (!bitcoin_blkid_eq(&topo->tip->blkid, &blk->hdr.prev_hash))
+	/* Unexpected predecessor?  Free predecessor, refetch it
+	 * (and the ones after it will be different too). */
+	if (!bitcoin_blkid_eq(&topo->tip->blkid, &pf->blk->hdr.prev_hash)) {
 		remove_tip(topo);
-	else {
-		add_tip(topo, new_block(topo, blk, topo->tip->height + 1));
+		discard_prefetches(topo);
+	} else {
+		struct block *b = new_block(topo, pf->blk,
+					    topo->tip->height + 1);
+		b->header_only = (pf->filter != NULL);
+		add_tip(topo, b);
+		topo->catchup_blocks++;
 
 		/* tell plugins a new block was processed */
 		notify_block_added(topo->ld, topo->tip);
+
+		/* There may well be more: ask for more at once. */
+		topo->prefetch_window *= 2;
+		if (topo->prefetch_window > MAX_BLOCK_PREFETCH)
+			topo->prefetch_window = MAX_BLOCK_PREFETCH;
+
+		/* If the next one is already here, let everyone else have a
+		 * turn (e.g. JSON commands, peers) before we apply it. */
+		if (tal_count(topo->prefetches) && topo->prefetches[0]->done)
+			topo->apply_timer = new_reltimer(topo->ld->timers,
+							 topo,
+							 time_from_msec(0),
+							 apply_prefetched,
+							 topo);
 	}
 
-	/* Try for next one. */
-	try_extend_tip(topo);
+	/* Try for next ones. */
+	fill_prefetch_window(topo);
+}
+
+static void get_new_block(struct bitcoind *bitcoind,
+			  struct bitcoin_blkid *blkid,
+			  struct bitcoin_block *blk,
+			  struct prefetch *pf)
+{
+	struct chain_topology *topo = pf->topo;
+
+	if (pf->gen != topo->prefetch_gen) {
+		tal_free(pf);
+		return;
+	}
+
+	pf->done = true;
+	if (blkid || blk) {
+		assert(blkid && blk);
+		pf->blk = tal_steal(pf, blk);
+	}
+
+	/* If we're already going to apply the next one, it'll get to us. */
+	if (!topo->apply_timer)
+		apply_prefetched(topo);
+}
+
+static void get_block_filter(struct bitcoind *bitcoind,
+			     struct bitcoin_blkid *blkid,
+			     struct bitcoin_block *blk,
+			     const u8 *filter,
+			     struct prefetch *pf)
+{
+	struct chain_topology *topo = pf->topo;
+
+	if (pf->gen != topo->prefetch_gen) {
+		tal_free(pf);
+		return;
+	}
+
+	/* No filter (yet)?  We need the whole thing. */
+	if (blkid && !filter) {
+		bitcoind_getrawblockbyheight(topo->bitcoind, pf->height,
+					     get_new_block, pf);
+		return;
+	}
+
+	pf->done = true;
+	if (blkid) {
+		pf->blk = tal_steal(pf, blk);
+		pf->filter = tal_dup_talarr(pf, u8, filter);
+	}
+
+	/* If we're already going to apply the next one, it'll get to us. */
+	if (!topo->apply_timer)
+		apply_prefetched(topo);
+}
+
+static void fill_prefetch_window(struct chain_topology *topo)
+{
+	if (topo->stopping)
+		return;
+
+	while (tal_count(topo->prefetches) < topo->prefetch_window) {
+		struct prefetch *pf = tal(topo, struct prefetch);
+
+		pf->topo = topo;
+		pf->gen = topo->prefetch_gen;
+		pf->height = topo->tip->height + 1 + tal_count(topo->prefetches);
+		pf->done = false;
+		pf->blk = NULL;
+		pf->filter = NULL;
+		tal_arr_expand(&topo->prefetches, pf);
+		if (use_block_filters(topo))
+			bitcoind_getblockfilter(topo->bitcoind, pf->height,
+						get_block_filter, pf);
+		else
+			bitcoind_getrawblockbyheight(topo->bitcoind,
+						     pf->height,
+						     get_new_block, pf);
+	}
 }
 
 static void try_extend_tip(struct chain_topology *topo)
@@ -835,8 +1131,9 @@ static void try_extend_tip(struct chain_topology *topo)
 	topo->extend_timer = NULL;
 	if (topo->stopping)
 		return;
-	bitcoind_getrawblockbyheight(topo->bitcoind, topo->tip->height + 1,
-				     get_new_block, topo);
+	if (!topo->catchup_blocks)
+		topo->catchup_start = time_mono();
+	fill_prefetch_window(topo);
 }
 
 static void init_topo(struct bitcoind *bitcoind UNUSED,
@@ -948,6 +1245,7 @@ static void destroy_chain_topology(struct chain_topology *topo)
 	/* htable uses malloc, so it would leak here */
 	txwatch_hash_clear(&topo->txwatches);
 	txowatch_hash_clear(&topo->txowatches);
+	uintmap_clear(&topo->txwatch_triggers);
 	outgoing_tx_map_clear(&topo->outgoing_txs);
 	block_map_clear(&topo->block_map);
 }
@@ -961,6 +1259,11 @@ struct chain_topology *new_topology(struct lightningd *ld, struct log *log)
 	outgoing_tx_map_init(&topo->outgoing_txs);
 	txwatch_hash_init(&topo->txwatches);
 	txowatch_hash_init(&topo->txowatches);
+	uintmap_init(&topo->txwatch_triggers);
+	topo->watch_prefilter
+		= bloomfilter_new(topo, bloomfilter_rebuild_capacity(0));
+	memset(&topo->watch_prefilter_stats, 0,
+	       sizeof(topo->watch_prefilter_stats));
 	topo->log = log;
 	memset(topo->feerate, 0, sizeof(topo->feerate));
 	topo->bitcoind = new_bitcoind(topo, ld, log);
@@ -969,6 +1272,14 @@ struct chain_topology *new_topology(struct lightningd *ld, struct log *log)
 	topo->root = NULL;
 	topo->sync_waiters = tal(topo, struct list_head);
 	topo->extend_timer = NULL;
+	topo->apply_timer = NULL;
+	topo->catchup_blocks = 0;
+	topo->prefetches = tal_arr(topo, struct prefetch *, 0);
+	topo->prefetch_window = 1;
+	topo->prefetch_gen = 0;
+	topo->last_full_block = 0;
+	topo->utxoset_scripts = NULL;
+	topo->utxoset_scripts_loaded = 0;
 	topo->stopping = false;
 	list_head_init(topo->sync_waiters);
 
@@ -1016,6 +1327,11 @@ check_chain(struct bitcoind *bitcoind, const char *chain,
 	topo->headercount = headercount;
 
 	if (first_call) {
+		if (topo->ld->config.block_filters && !bitcoind->blockfilters)
+			log_unusual(bitcoind->log,
+				    "Bitcoin backend can't give us block filters"
+				    " (does bitcoind have -blockfilterindex?):"
+				    " fetching every block");
 		/* Has the Bitcoin backend gone backward ? */
 		check_blockcount(topo, blockcount);
 		/* Get up to speed with topology. */
@@ -1109,5 +1425,6 @@ void stop_topology(struct chain_topology *topo)
 	/* Remove timers while we're cleaning up plugins. */
 	tal_free(topo->bitcoind->checkchain_timer);
 	tal_free(topo->extend_timer);
+	tal_free(topo->apply_timer);
 	tal_free(topo->updatefee_timer);
 }
@@ -2,7 +2,10 @@
 #define LIGHTNING_LIGHTNINGD_CHAINTOPOLOGY_H
 #include "config.h"
 #include <bitcoin/block.h>
+#include <ccan/intmap/intmap.h>
 #include <ccan/list/list.h>
+#include <ccan/time/time.h>
+#include <common/bloomfilter.h>
 #include <lightningd/feerate.h>
 #include <lightningd/watch.h>
 
@@ -25,6 +28,8 @@ struct outgoing_tx {
 	void (*failed_or_success)(struct channel *channel, bool success, const char *err);
 };
 
+struct prefetch;
+
 struct block {
 	u32 height;
 
@@ -40,9 +45,12 @@ struct block {
 	/* Key for hash table */
 	struct bitcoin_blkid blkid;
 
-	/* Full copy of txs (freed in filter_block_txs) */
-	struct bitcoin_tx **full_txs;
-	struct bitcoin_txid *txids;
+	/* The block's txs, scanned (freed in filter_block_txs) */
+	struct bitcoin_block *blk;
+
+	/* With --block-filters: nothing in this block concerned us, so we
+	 * only fetched the header (and didn't put it in the db). */
+	bool header_only;
 };
 
 /* Hash blocks by sha */
@@ -121,15 +129,47 @@ struct chain_topology {
 	/* Transactions/txos we are watching. */
 	struct txwatch_hash txwatches;
 	struct txowatch_hash txowatches;
+	/* Confirmed txwatches, by the tip height at which they next fire. */
+	UINTMAP(struct list_head *) txwatch_triggers;
+	/* Cheaply rules out txids and outpoints we're not watching. */
+	struct bloomfilter *watch_prefilter;
+	struct bloomfilter_stats watch_prefilter_stats;
 
 	/* The number of headers known to the bitcoin backend at startup. Not
 	 * updated after the initial check. */
 	u32 headercount;
 
+	/* How many blocks we've added since we started this round of
+	 * fetching, and when we started it (so we can report sync speed). */
+	u32 catchup_blocks;
+	struct timemono catchup_start;
+
+	/* Blocks we've asked for beyond the tip, in height order, and how
+	 * many we'll ask for at once (grows while we're catching up). */
+	struct prefetch **prefetches;
+	size_t prefetch_window;
+	/* Bumped to abandon prefetches still in flight. */
+	u64 prefetch_gen;
+	/* Set if we're going to apply the next prefetched block. */
+	struct oneshot *apply_timer;
+
+	/* With --block-filters: the height of the last block we fetched in
+	 * full, and the scripts of unspent utxoset entries (NULL until we
+	 * need them), so we notice channels closing.  Spent ones pile up, so
+	 * we reload when it's twice what we loaded. */
+	u32 last_full_block;
+	const u8 **utxoset_scripts;
+	size_t utxoset_scripts_loaded;
+
 	/* Are we stopped? */
 	bool stopping;
 };
 
+/* Gossip added @script to the utxoset: with --block-filters we need to
+ * look for it being spent. */
+void topology_add_utxoset_script(struct chain_topology *topo,
+				 const u8 *script);
+
 /* Information relevant to locating a TX in a blockchain. */
 struct txlocator {
 
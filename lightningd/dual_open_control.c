@@ -105,7 +105,8 @@ static void channel_err_broken(struct channel *channel,
 }
 
 void json_add_unsaved_channel(struct json_stream *response,
-			      const struct channel *channel)
+			      const struct channel *channel,
+			      const struct peer *peer)
 {
 	struct amount_msat total;
 	struct open_attempt *oa;
@@ -125,6 +126,11 @@ void json_add_unsaved_channel(struct json_stream *response,
 	oa = channel->open_attempt;
 
 	json_object_start(response, NULL);
+	if (peer) {
+		json_add_node_id(response, "peer_id", &peer->id);
+		json_add_bool(response, "peer_connected",
+			      peer->connected == PEER_CONNECTED);
+	}
 	json_add_string(response, "state", channel_state_name(channel));
 	json_add_string(response, "owner", channel->owner->name);
 	json_add_string(response, "opener", channel->opener == LOCAL ?
@@ -21,8 +21,10 @@ void dualopen_tell_depth(struct subd *dualopend,
 /* Close connection to an unsaved channel */
 void channel_unsaved_close_conn(struct channel *channel, const char *why);
 
+/* If @peer is non-NULL, adds peer_id and peer_connected too. */
 void json_add_unsaved_channel(struct json_stream *response,
-			      const struct channel *channel);
+			      const struct channel *channel,
+			      const struct peer *peer);
 
 void channel_update_reserve(struct channel *channel,
 			    struct channel_config *their_config,
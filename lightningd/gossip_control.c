@@ -54,8 +54,12 @@ static void got_filteredblock(struct bitcoind *bitcoind,
 		return got_txout(bitcoind, NULL, scid);
 
 	/* Only fill in blocks that we are not going to scan later. */
-	if (bitcoind->ld->topology->max_blockheight > fb->height)
+	if (bitcoind->ld->topology->max_blockheight > fb->height) {
 		wallet_filteredblock_add(bitcoind->ld->wallet, fb);
+		for (size_t i = 0; i < tal_count(fb->outpoints); i++)
+			topology_add_utxoset_script(bitcoind->ld->topology,
+						    fb->outpoints[i]->scriptPubKey);
+	}
 
 	u32 outnum = short_channel_id_outnum(scid);
 	u32 txindex = short_channel_id_txnum(scid);
@@ -27,15 +27,6 @@
 #include <sodium/randombytes.h>
 #include <wire/wire_sync.h>
 
-static const char *invoice_status_str(const struct invoice_details *inv)
-{
-	if (inv->state == PAID)
-		return "paid";
-	if (inv->state == EXPIRED)
-		return "expired";
-	return "unpaid";
-}
-
 static void json_add_invoice_fields(struct json_stream *response,
 				    const struct invoice_details *inv)
 {
@@ -46,7 +37,7 @@ static void json_add_invoice_fields(struct json_stream *response,
 	if (inv->msat)
 		json_add_amount_msat_compat(response, *inv->msat,
 					    "msatoshi", "amount_msat");
-	json_add_string(response, "status", invoice_status_str(inv));
+	json_add_string(response, "status", invoice_status_str(inv->state));
 	if (inv->state == PAID) {
 		json_add_u64(response, "pay_index", inv->pay_index);
 		json_add_amount_msat_compat(response, inv->received,
@@ -83,6 +74,9 @@ static void json_add_invoice(struct json_stream *response,
 {
 	json_object_start(response, fieldname);
 	json_add_invoice_fields(response, inv);
+	json_add_u64(response, "created_index", inv->created_index);
+	if (inv->updated_index)
+		json_add_u64(response, "updated_index", inv->updated_index);
 	json_object_end(response);
 }
 
@@ -1269,45 +1263,88 @@ static const struct json_command invoice_command = {
 	"(default autogenerated)"};
 AUTODATA(json_command, &invoice_command);
 
-static void json_add_invoices(struct json_stream *response,
-			      struct wallet *wallet,
-			      const struct json_escape *label,
-			      const struct sha256 *payment_hash,
-			      const struct sha256 *local_offer_id)
+/* Don't iterate entire db if we're just after one. */
+static void json_add_invoice_by(struct json_stream *response,
+				struct wallet *wallet,
+				const struct json_escape *label,
+				const struct sha256 *payment_hash)
 {
-	struct invoice_iterator it;
 	const struct invoice_details *details;
 	struct invoice invoice;
+	bool found;
 
-	/* Don't iterate entire db if we're just after one. */
-	if (label) {
-		if (wallet_invoice_find_by_label(wallet, &invoice, label)) {
-			details =
-			    wallet_invoice_details(tmpctx, wallet, invoice);
-			json_add_invoice(response, NULL, details);
-		}
-	} else if (payment_hash != NULL) {
-		if (wallet_invoice_find_by_rhash(wallet, &invoice,
-						 payment_hash)) {
-			details =
-			    wallet_invoice_details(tmpctx, wallet, invoice);
-			json_add_invoice(response, NULL, details);
-		}
-	} else {
-		memset(&it, 0, sizeof(it));
-		while (wallet_invoice_iterate(wallet, &it)) {
-			details = wallet_invoice_iterator_deref(response,
-								wallet, &it);
-			/* FIXME: db can filter this better! */
-			if (local_offer_id) {
-				if (!details->local_offer_id
-				    || !sha256_eq(local_offer_id,
-						  details->local_offer_id))
-					continue;
-			}
-			json_add_invoice(response, NULL, details);
+	if (label)
+		found = wallet_invoice_find_by_label(wallet, &invoice, label);
+	else
+		found = wallet_invoice_find_by_rhash(wallet, &invoice,
+						     payment_hash);
+	if (found) {
+		details = wallet_invoice_details(tmpctx, wallet, invoice);
+		json_add_invoice(response, NULL, details);
+	}
+}
+
+struct listinvoices_stream {
+	const struct sha256 *local_offer_id;
+	enum wait_index listindex;
+	u64 next;
+	/* NULL if unlimited */
+	u32 *remaining;
+};
+
+static struct command_result *listinvoices_more(struct command *cmd,
+						struct json_stream *response,
+						struct listinvoices_stream *lis)
+{
+	struct wallet *wallet = cmd->ld->wallet;
+	struct invoice_iterator it;
+	const struct invoice_details *details;
+	u32 batch = COMMAND_STREAM_BATCH, count = 0;
+	const u32 *limit;
+	bool done;
+
+	/* Keyed paging only works on the created index: everything not
+	 * yet updated has updated_index 0, so do that in one go. */
+	if (lis->listindex == WAIT_INDEX_UPDATED)
+		limit = lis->remaining;
+	else {
+		if (lis->remaining && *lis->remaining < batch)
+			batch = *lis->remaining;
+		limit = &batch;
+	}
+
+	memset(&it, 0, sizeof(it));
+	while (wallet_invoice_iterate(wallet, &it, &lis->listindex,
+				      lis->next, limit)) {
+		details = wallet_invoice_iterator_deref(tmpctx, wallet, &it);
+		count++;
+		lis->next = details->created_index + 1;
+		/* FIXME: db can filter this better! */
+		if (lis->local_offer_id) {
+			if (!details->local_offer_id
+			    || !sha256_eq(lis->local_offer_id,
+					  details->local_offer_id))
+				continue;
 		}
+		json_add_invoice(response, NULL, details);
+	}
+
+	if (lis->listindex == WAIT_INDEX_UPDATED)
+		done = true;
+	else
+		done = count < batch;
+
+	if (lis->remaining) {
+		*lis->remaining -= count;
+		if (*lis->remaining == 0)
+			done = true;
 	}
+
+	if (!done)
+		return NULL;
+
+	json_array_end(response);
+	return command_success(cmd, response);
 }
 
 static struct command_result *json_listinvoices(struct command *cmd,
@@ -1317,9 +1354,13 @@ static struct command_result *json_listinvoices(struct command *cmd,
 {
 	struct json_escape *label;
 	struct json_stream *response;
+	struct listinvoices_stream *lis;
 	struct wallet *wallet = cmd->ld->wallet;
 	const char *invstring;
 	struct sha256 *payment_hash, *offer_id;
+	enum wait_index *listindex;
+	u64 *liststart;
+	u32 *listlimit;
 	char *fail;
 
 	if (!param(cmd, buffer, params,
@@ -1327,6 +1368,9 @@ static struct command_result *json_listinvoices(struct command *cmd,
 		   p_opt("invstring", param_string, &invstring),
 		   p_opt("payment_hash", param_sha256, &payment_hash),
 		   p_opt("offer_id", param_sha256, &offer_id),
+		   p_opt("index", param_index, &listindex),
+		   p_opt_def("start", param_u64, &liststart, 0),
+		   p_opt("limit", param_u32, &listlimit),
 		   NULL))
 		return command_param_failed();
 
@@ -1338,6 +1382,24 @@ static struct command_result *json_listinvoices(struct command *cmd,
 				    " or {offer_id}");
 	}
 
+	if (*liststart != 0 && !listindex) {
+		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+				    "Can only specify {start} with {index}");
+	}
+	if (listlimit && !listindex) {
+		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+				    "Can only specify {limit} with {index}");
+	}
+	if (listindex && (label || invstring || payment_hash)) {
+		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+				    "Cannot specify {index} with"
+				    " {label}, {invstring} or {payment_hash}");
+	}
+	if (listindex && *listindex == WAIT_INDEX_DELETED) {
+		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+				    "Cannot list by the deleted index");
+	}
+
 	/* Extract the payment_hash from the invoice. */
 	if (invstring != NULL) {
 		struct bolt11 *b11;
@@ -1361,9 +1423,19 @@ static struct command_result *json_listinvoices(struct command *cmd,
 
 	response = json_stream_success(cmd);
 	json_array_start(response, "invoices");
-	json_add_invoices(response, wallet, label, payment_hash, offer_id);
-	json_array_end(response);
-	return command_success(cmd, response);
+	if (label || payment_hash) {
+		json_add_invoice_by(response, wallet, label, payment_hash);
+		json_array_end(response);
+		return command_success(cmd, response);
+	}
+
+	lis = tal(cmd, struct listinvoices_stream);
+	lis->local_offer_id = offer_id;
+	/* With no index, we page through them in the order they were created */
+	lis->listindex = listindex ? *listindex : WAIT_INDEX_CREATED;
+	lis->next = *liststart;
+	lis->remaining = listlimit;
+	return command_stream_success(cmd, response, listinvoices_more, lis);
 }
 
 static const struct json_command listinvoices_command = {
@@ -1371,7 +1443,7 @@ static const struct json_command listinvoices_command = {
 	"payment",
 	json_listinvoices,
 	"Show invoice matching {label}, {invstring}, {payment_hash} or {offerid} (or all, if "
-	"no query parameter specified)"
+	"no query parameter specified), or by {index} from {start} up to {limit} entries"
 };
 AUTODATA(json_command, &listinvoices_command);
 
@@ -1403,7 +1475,7 @@ static struct command_result *json_delinvoice(struct command *cmd,
 
 	/* This is time-sensitive, so only call once; otherwise error msg
 	 * might not make sense if it changed! */
-	actual_status = invoice_status_str(details);
+	actual_status = invoice_status_str(details->state);
 	if (!streq(actual_status, status)) {
 		struct json_stream *js;
 		js = json_stream_fail(cmd, INVOICE_STATUS_UNEXPECTED,
@@ -1452,6 +1524,57 @@ static const struct json_command delinvoice_command = {
 };
 AUTODATA(json_command, &delinvoice_command);
 
+static struct command_result *param_invoice_delstatus(struct command *cmd,
+						      const char *name,
+						      const char *buffer,
+						      const jsmntok_t *tok,
+						      enum invoice_status **status)
+{
+	*status = tal(cmd, enum invoice_status);
+	if (json_tok_streq(buffer, tok, "paid"))
+		**status = PAID;
+	else if (json_tok_streq(buffer, tok, "expired"))
+		**status = EXPIRED;
+	else
+		return command_fail_badparam(cmd, name, buffer, tok,
+					     "should be 'paid' or 'expired'");
+	return NULL;
+}
+
+static struct command_result *json_delinvoices(struct command *cmd,
+					       const char *buffer,
+					       const jsmntok_t *obj UNNEEDED,
+					       const jsmntok_t *params)
+{
+	struct json_stream *response;
+	enum invoice_status *status;
+	u64 *maxtime, deleted, remaining;
+	u32 *limit;
+
+	if (!param(cmd, buffer, params,
+		   p_req("status", param_invoice_delstatus, &status),
+		   p_req("maxtime", param_u64, &maxtime),
+		   p_opt_def("limit", param_u32, &limit, 1000),
+		   NULL))
+		return command_param_failed();
+
+	deleted = wallet_invoice_delete_older(cmd->ld->wallet, *status,
+					      *maxtime, *limit, &remaining);
+
+	response = json_stream_success(cmd);
+	json_add_u64(response, "deleted", deleted);
+	json_add_u64(response, "remaining", remaining);
+	return command_success(cmd, response);
+}
+
+static const struct json_command delinvoices_command = {
+	"delinvoices",
+	"payment",
+	json_delinvoices,
+	"Delete up to {limit} invoices with {status} paid or expired at or before {maxtime}",
+};
+AUTODATA(json_command, &delinvoices_command);
+
 static struct command_result *json_delexpiredinvoice(struct command *cmd,
 						     const char *buffer,
 						     const jsmntok_t *obj UNNEEDED,
@@ -29,6 +29,7 @@
 #include <db/exec.h>
 #include <fcntl.h>
 #include <lightningd/jsonrpc.h>
+#include <lightningd/metrics.h>
 #include <lightningd/plugin_hook.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -140,10 +141,14 @@ static void jcon_remove_json_stream(struct json_connection *jcon,
 /* jcon and cmd have separate lifetimes: we detach them on either destruction */
 static void destroy_jcon(struct json_connection *jcon)
 {
-	struct command *c;
+	struct command *c, *n;
 
-	list_for_each(&jcon->commands, c, list)
+	list_for_each_safe(&jcon->commands, c, n, list) {
 		c->jcon = NULL;
+		/* Nobody left to read a streaming result: stop producing it. */
+		if (c->json_stream && c->json_stream->refill)
+			tal_free(c);
+	}
 
 	/* Make sure this happens last! */
 	tal_free(jcon->log);
@@ -447,6 +452,11 @@ static void destroy_command(struct command *cmd)
 struct command_result *command_raw_complete(struct command *cmd,
 					    struct json_stream *result)
 {
+	/* Malformed requests never found a command. */
+	if (cmd->json_cmd)
+		metrics_command_done(cmd->ld->metrics, cmd->json_cmd->name,
+				     timemono_since(cmd->start));
+
 	json_stream_close(result, cmd);
 
 	/* If we have a jcon, it will free result for us. */
@@ -521,6 +531,63 @@ struct command_result *command_still_pending(struct command *cmd)
 	return &pending;
 }
 
+struct command_stream {
+	struct command *cmd;
+	struct command_result *(*more)(struct command *cmd,
+				       struct json_stream *response,
+				       void *arg);
+	void *arg;
+};
+
+/* Client has read everything so far: append the next part. */
+static void command_stream_refill(struct json_stream *js,
+				  struct command_stream *cs)
+{
+	struct db *db = cs->cmd->ld->wallet->db;
+	struct command_result *res;
+
+	db_begin_transaction(db);
+	/* If this completes the command, cs is freed along with it. */
+	res = cs->more(cs->cmd, js, cs->arg);
+	db_commit_transaction(db);
+
+	if (res)
+		was_pending(res);
+}
+
+struct command_result *
+command_stream_success_(struct command *cmd,
+			struct json_stream *response,
+			struct command_result *(*more)(struct command *cmd,
+						       struct json_stream *response,
+						       void *arg),
+			void *arg)
+{
+	struct command_stream *cs;
+	struct command_result *res;
+
+	assert(cmd->json_stream == response);
+
+	res = more(cmd, response, arg);
+	if (res)
+		return res;
+
+	/* Nobody reading it?  Then there's no reason to wait. */
+	if (!cmd->jcon) {
+		do {
+			res = more(cmd, response, arg);
+		} while (!res);
+		return res;
+	}
+
+	cs = tal(cmd, struct command_stream);
+	cs->cmd = cmd;
+	cs->more = more;
+	cs->arg = arg;
+	json_stream_set_refill(response, command_stream_refill, cs);
+	return command_still_pending(cmd);
+}
+
 static void json_command_malformed(struct json_connection *jcon,
 				   const char *id,
 				   const char *error)
@@ -931,6 +998,8 @@ parse_request(struct json_connection *jcon, const jsmntok_t tok[])
 	c->id = json_strdup(c, jcon->buffer, id);
 	c->mode = CMD_NORMAL;
 	c->filter = NULL;
+	c->json_cmd = NULL;
+	c->start = time_mono();
 	list_add_tail(&jcon->commands, &c->list);
 	tal_add_destructor(c, destroy_command);
 
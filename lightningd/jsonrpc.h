@@ -2,6 +2,7 @@
 #define LIGHTNING_LIGHTNINGD_JSONRPC_H
 #include "config.h"
 #include <ccan/list/list.h>
+#include <ccan/time/time.h>
 #include <common/autodata.h>
 #include <common/json_stream.h>
 #include <common/status_levels.h>
@@ -43,6 +44,8 @@ struct command {
 	struct json_stream *json_stream;
 	/* Optional output field filter. */
 	struct json_filter *filter;
+	/* When we started, for metrics. */
+	struct timemono start;
 };
 
 /**
@@ -134,6 +137,41 @@ struct command_result *command_failed(struct command *cmd,
 struct command_result *command_still_pending(struct command *cmd)
 	 WARN_UNUSED_RESULT;
 
+/* How many entries list commands produce at once when streaming. */
+#define COMMAND_STREAM_BATCH 1000
+
+/**
+ * command_stream_success - produce a large result as the client reads it.
+ * @cmd: the command we're running.
+ * @response: from json_stream_success(), with any preamble already added.
+ * @more: appends the next part of the result.
+ * @arg: the argument to @more.
+ *
+ * @more is called now, then again each time the client has read
+ * everything so far, so we never hold more than one part in memory.  It
+ * runs inside a db transaction, and returns NULL if there's more to come,
+ * otherwise the result of command_success() (or command_fail()).
+ *
+ * The return value should be returned from the command handler.
+ */
+#define command_stream_success(cmd, response, more, arg)		\
+	command_stream_success_((cmd), (response),			\
+				typesafe_cb_preargs(struct command_result *, \
+						    void *,		\
+						    (more), (arg),	\
+						    struct command *,	\
+						    struct json_stream *), \
+				(arg))
+
+struct command_result *
+command_stream_success_(struct command *cmd,
+			struct json_stream *response,
+			struct command_result *(*more)(struct command *cmd,
+						       struct json_stream *response,
+						       void *arg),
+			void *arg)
+	WARN_UNUSED_RESULT;
+
 /* For low-level JSON stream access: */
 struct json_stream *json_stream_raw_for_cmd(struct command *cmd);
 void json_stream_log_suppress_for_cmd(struct json_stream *js,
@@ -68,10 +68,12 @@
 #include <lightningd/hsm_control.h>
 #include <lightningd/io_loop_with_timers.h>
 #include <lightningd/lightningd.h>
+#include <lightningd/metrics.h>
 #include <lightningd/onchain_control.h>
 #include <lightningd/options.h>
 #include <lightningd/peer_control.h>
 #include <lightningd/plugin.h>
+#include <lightningd/plugin_hook.h>
 #include <lightningd/subd.h>
 #include <sys/resource.h>
 #include <wallet/txfilter.h>
@@ -137,6 +139,9 @@ static struct lightningd *new_lightningd(const tal_t *ctx)
 	ld->dev_ignore_modern_onion = false;
 	ld->dev_disable_commit = -1;
 	ld->dev_no_ping_timer = false;
+	ld->dev_no_db_pipeline = false;
+	ld->dev_no_utxoset_batch = false;
+	ld->dev_no_blockfile = false;
 #endif
 
 	/*~ These are CCAN lists: an embedded double-linked list.  It's not
@@ -197,6 +202,7 @@ static struct lightningd *new_lightningd(const tal_t *ctx)
 	list_head_init(&ld->ping_commands);
 	list_head_init(&ld->disconnect_commands);
 	list_head_init(&ld->waitblockheight_commands);
+	list_head_init(&ld->wait_commands);
 
 	/*~ Tal also explicitly supports arrays: it stores the number of
 	 * elements, which can be accessed with tal_count() (or tal_bytelen()
@@ -237,6 +243,8 @@ static struct lightningd *new_lightningd(const tal_t *ctx)
 	/*~ This is initialized later, but the plugin loop examines this,
 	 * so set it to NULL explicitly now. */
 	ld->wallet = NULL;
+	ld->wallet_replica_max_lag = 0;
+	ld->db_write_stream_window = 8;
 
 	/*~ Behavioral options */
 	ld->accept_extra_tlv_types = tal_arr(ld, u64, 0);
@@ -248,6 +256,11 @@ static struct lightningd *new_lightningd(const tal_t *ctx)
 	 */
 	jsonrpc_setup(ld);
 
+	/*~ Cheap counters and histograms, fed by hot paths and shown by
+	 * `getmetrics` (and optionally on `--metrics-socket`). */
+	ld->metrics = new_metrics(ld);
+	ld->metrics_socket = NULL;
+
 	/*~ We run a number of plugins (subprocesses that we talk JSON-RPC with)
 	 * alongside this process. This allows us to have an easy way for users
 	 * to add their own tools without having to modify the Core Lightning source
@@ -671,11 +684,58 @@ static void pidfile_create(const struct lightningd *ld)
 	write_all(pid_fd, pid, strlen(pid));
 }
 
+/*~ With --db-group-commit, db_commit_transaction() doesn't actually commit:
+ * we do that here, once per loop.  ccan/io only ever reads or writes after
+ * poll() says it can, so anything we queued up to send (RPC responses,
+ * messages to subdaemons, which includes things like "go ahead and send
+ * revoke_and_ack") cannot leave before the database changes it depends on
+ * are committed. */
+static struct lightningd *group_commit_ld;
+
+static int group_commit_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	struct db *db = group_commit_ld->wallet->db;
+	struct timerel window, waited;
+	struct timemono since;
+	short events[nfds];
+	int r, wait_ms;
+
+	/* Nothing to commit, or we're in a nested io_loop (e.g. waiting
+	 * for a plugin) in the middle of a transaction. */
+	if (!db_group_commit_pending(db, &since) || db_in_transaction(db))
+		return daemon_poll(fds, nfds, timeout);
+
+	window = time_from_usec(group_commit_ld->config.db_group_commit_usec);
+	waited = timemono_since(since);
+	if (!time_less(waited, window)) {
+		db_group_commit_flush(db);
+		return daemon_poll(fds, nfds, timeout);
+	}
+
+	/* Still inside the window: keep reading, but don't write (round
+	 * up, so we don't spin). */
+	wait_ms = (time_to_usec(time_sub(window, waited)) + 999) / 1000;
+	if (timeout < 0 || wait_ms < timeout)
+		timeout = wait_ms;
+
+	for (size_t i = 0; i < nfds; i++) {
+		events[i] = fds[i].events;
+		fds[i].events &= ~POLLOUT;
+	}
+	r = daemon_poll(fds, nfds, timeout);
+	for (size_t i = 0; i < nfds; i++)
+		fds[i].events = events[i];
+	return r;
+}
+
 /*~ ccan/io allows overriding the poll() function that is the very core
  * of the event loop it runs for us.  We override it so that we can do
  * extra sanity checks, and it's also a good point to free the tmpctx. */
 static int io_poll_lightningd(struct pollfd *fds, nfds_t nfds, int timeout)
 {
+	if (group_commit_ld)
+		return group_commit_poll(fds, nfds, timeout);
+
 	/* These checks and freeing tmpctx are common to all daemons. */
 	return daemon_poll(fds, nfds, timeout);
 }
@@ -865,6 +925,19 @@ void lightningd_exit(struct lightningd *ld, int exit_code)
 	io_break(ld);
 }
 
+/*~ Startup can take a while on a large node, so we time each phase and
+ * log a one-line summary once we're up: this makes it obvious which part
+ * to blame when it's slow. */
+static void startup_phase_done(char **report, struct timemono *phase_start,
+			       const char *name)
+{
+	struct timemono now = time_mono();
+
+	tal_append_fmt(report, " %s=%"PRIu64"ms", name,
+		       time_to_msec(timemono_between(now, *phase_start)));
+	*phase_start = now;
+}
+
 int main(int argc, char *argv[])
 {
 	struct lightningd *ld;
@@ -880,6 +953,8 @@ int main(int argc, char *argv[])
 	int exit_code = 0;
 	char **orig_argv;
 	bool try_reexec;
+	struct timemono startup_start, phase_start;
+	char *startup_report;
 
 	/*~ We fork out new processes very very often; every channel gets its
 	 * own process, for example, and we have `hsmd` and `gossipd` and
@@ -947,6 +1022,8 @@ int main(int argc, char *argv[])
 	 * variables. */
 	ld = new_lightningd(NULL);
 	ld->state = LD_STATE_RUNNING;
+	startup_start = phase_start = time_mono();
+	startup_report = tal_strdup(ld, "");
 
 	/*~ We store an copy of our arguments before parsing mangles them, so
 	 * we can re-exec if versions of subdaemons change.  Note the use of
@@ -994,6 +1071,7 @@ int main(int argc, char *argv[])
 
 	/*~ Handle options and config. */
 	handle_opts(ld, argc, argv);
+	startup_phase_done(&startup_report, &phase_start, "options");
 
 	/*~ Now create the PID file: this errors out if there's already a
 	 * daemon running, so we call before doing almost anything else. */
@@ -1015,11 +1093,13 @@ int main(int argc, char *argv[])
 	 * doesn't really make sense, but we can't call it the Badly-named
 	 * Daemon Software Module. */
 	bip32_base = hsm_init(ld);
+	startup_phase_done(&startup_report, &phase_start, "hsmd");
 
 	/*~ Our "wallet" code really wraps the db, which is more than a simple
 	 * bitcoin wallet (though it's that too).  It also stores channel
 	 * states, invoices, payments, blocks and bitcoin transactions. */
 	ld->wallet = wallet_new(ld, ld->timers, bip32_base);
+	startup_phase_done(&startup_report, &phase_start, "wallet");
 
 	/*~ We keep a filter of scriptpubkeys we're interested in. */
 	ld->owned_txfilter = txfilter_new(ld);
@@ -1042,6 +1122,7 @@ int main(int argc, char *argv[])
 	 * addresses of nodes, so connectd_init hands it one end of a
 	 * socket pair, and gives us the other */
 	connectd_gossipd_fd = connectd_init(ld);
+	startup_phase_done(&startup_report, &phase_start, "connectd");
 
 	/*~ We do every database operation within a transaction; usually this
 	 * is covered by the infrastructure (eg. opening a transaction before
@@ -1079,10 +1160,12 @@ int main(int argc, char *argv[])
 
 	/*~ That's all of the wallet db operations for now. */
 	db_commit_transaction(ld->wallet->db);
+	startup_phase_done(&startup_report, &phase_start, "txfilter");
 
 	/*~ Initialize block topology.  This does its own io_loop to
 	 * talk to bitcoind, so does its own db transactions. */
 	setup_topology(ld->topology, min_blockheight, max_blockheight);
+	startup_phase_done(&startup_report, &phase_start, "topology");
 
 	db_begin_transaction(ld->wallet->db);
 
@@ -1091,21 +1174,25 @@ int main(int argc, char *argv[])
 	 *  know the blockheight. */
 	unconnected_htlcs_in = load_channels_from_wallet(ld);
 	db_commit_transaction(ld->wallet->db);
+	startup_phase_done(&startup_report, &phase_start, "channels");
 
  	/*~ The gossip daemon looks after the routing gossip;
 	 *  channel_announcement, channel_update, node_announcement and gossip
 	 *  queries.   It also hands us the latest channel_updates for our
 	 *  channels. */
 	gossip_init(ld, connectd_gossipd_fd);
+	startup_phase_done(&startup_report, &phase_start, "gossipd");
 
 	/*~ Create RPC socket: now lightning-cli can send us JSON RPC commands
 	 *  over a UNIX domain socket specified by `ld->rpc_filename`. */
 	jsonrpc_listen(ld->jsonrpc, ld);
+	metrics_listen(ld->metrics);
 
 	/*~ Now that the rpc path exists, we can start the plugins and they
 	 * can start talking to us. */
 	if (!plugins_config(ld->plugins))
 		goto stop;
+	startup_phase_done(&startup_report, &phase_start, "plugins");
 
 	/*~ Process any HTLCs we were in the middle of when we exited, now
 	 * that plugins (who might want to know via htlc_accepted hook) are
@@ -1114,6 +1201,7 @@ int main(int argc, char *argv[])
 	db_begin_transaction(ld->wallet->db);
 	htlcs_resubmit(ld, unconnected_htlcs_in);
 	db_commit_transaction(ld->wallet->db);
+	startup_phase_done(&startup_report, &phase_start, "htlcs");
 
 	/*~ Activate connect daemon.  Needs to be after the initialization of
 	 * chaintopology, otherwise peers may connect and ask for
@@ -1126,6 +1214,7 @@ int main(int argc, char *argv[])
 	 * chain events from the database on restart, beginning with the
 	 * "funding transaction spent" event which creates it. */
 	onchaind_replay_channels(ld);
+	startup_phase_done(&startup_report, &phase_start, "onchaind");
 
 	/*~ Now handle sigchld, so we can clean up appropriately. */
 	sigchld_conn = notleak(io_new_conn(ld, sigchld_rfd, sigchld_rfd_in, ld));
@@ -1175,6 +1264,14 @@ int main(int argc, char *argv[])
 	 *  can start the poll loop which queries bitcoind for new blocks. */
 	begin_topology(ld->topology);
 
+	/*~ Resolved HTLCs pile up forever; trickle them out of the way. */
+	htlcs_start_archiving(ld);
+	startup_phase_done(&startup_report, &phase_start, "peers");
+
+	log_info(ld->log, "Startup took %"PRIu64"ms:%s",
+		 time_to_msec(timemono_since(startup_start)), startup_report);
+	startup_report = tal_free(startup_report);
+
 	/*~ To handle --daemon, we fork the daemon early (otherwise we hit
 	 * issues with our pid changing), but keep the parent around until
 	 * we've completed most initialization: that way we'll exit with an
@@ -1192,6 +1289,13 @@ int main(int argc, char *argv[])
 	/*~ This sets up the ecdh() function in ecdh_hsmd to talk to hsmd */
 	ecdh_hsmd_setup(ld->hsm_fd, hsm_ecdh_failed);
 
+	/*~ Only now do we start deferring commits: startup is simpler if
+	 * every commit is real. */
+	if (ld->config.db_group_commit || ld->config.db_group_commit_usec) {
+		group_commit_ld = ld;
+		db_set_group_commit(ld->wallet->db, true);
+	}
+
 	/*~ The root of every backtrace (almost).  This is our main event
 	 *  loop. */
 	void *io_loop_ret = io_loop_with_timers(ld);
@@ -1202,6 +1306,13 @@ int main(int argc, char *argv[])
 	assert(io_loop_ret == ld);
 	log_debug(ld->log, "io_loop_with_timers: %s", __func__);
 
+	/* Commit anything outstanding, and go back to normal commits for
+	 * shutdown. */
+	if (group_commit_ld) {
+		db_set_group_commit(ld->wallet->db, false);
+		group_commit_ld = NULL;
+	}
+
 stop:
 	/* Stop *new* JSON RPC requests. */
 	jsonrpc_stop_listening(ld->jsonrpc);
@@ -1231,6 +1342,9 @@ stop:
 	/* Get rid of per-channel subdaemons. */
 	subd_shutdown_nonglobals(ld);
 
+	/* Make sure db_write_stream plugins have everything. */
+	plugin_hook_db_stream_drain();
+
 	/* Tell plugins we're shutting down, use force if necessary. */
 	shutdown_plugins(ld);
 
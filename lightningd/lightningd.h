@@ -3,6 +3,7 @@
 #include "config.h"
 #include <lightningd/htlc_end.h>
 #include <lightningd/htlc_set.h>
+#include <lightningd/wait.h>
 #include <signal.h>
 #include <sys/stat.h>
 #include <wallet/wallet.h>
@@ -76,6 +77,18 @@ struct config {
 	 * slight spec incompatibility, but implementations do this
 	 * already. */
 	bool allowdustreserve;
+
+	/* Coalesce db commits until we're about to do any output? */
+	bool db_group_commit;
+
+	/* ... or until this many usec after the first one. */
+	u32 db_group_commit_usec;
+
+	/* How many resolved HTLCs to archive at once (0 = never) */
+	u32 htlc_archive_batch;
+
+	/* Only fetch blocks whose BIP158 filter matches something of ours? */
+	bool block_filters;
 };
 
 typedef STRMAP(const char *) alt_subdaemon_map;
@@ -101,6 +114,12 @@ struct lightningd {
 	/* Mode of the RPC filename. */
 	mode_t rpc_filemode;
 
+	/* Where to serve Prometheus-format metrics, if anywhere. */
+	char *metrics_socket;
+
+	/* Internal counters (see getmetrics) */
+	struct metrics *metrics;
+
 	/* The root of the jsonrpc interface. Can be shut down
 	 * separately from the rest of the daemon to allow a clean
 	 * shutdown, which frees all pending cmds in a DB
@@ -199,6 +218,12 @@ struct lightningd {
 
 	struct wallet *wallet;
 
+	/* Indexes used by all the wait infra */
+	struct indexes indexes[NUM_WAIT_SUBSYSTEM];
+
+	/* Outstanding wait commands */
+	struct list_head wait_commands;
+
 	/* Outstanding waitsendpay commands. */
 	struct list_head waitsendpay_commands;
 	/* Outstanding sendpay commands. */
@@ -290,6 +315,15 @@ struct lightningd {
 
 	/* Tell channeld not to worry about pings. */
 	bool dev_no_ping_timer;
+
+	/* Don't pipeline db statements, so we can benchmark the difference. */
+	bool dev_no_db_pipeline;
+
+	/* Don't batch utxoset writes, so we can benchmark the difference. */
+	bool dev_no_utxoset_batch;
+
+	/* Fetch blocks as hex, so we can benchmark the difference. */
+	bool dev_no_blockfile;
 #endif /* DEVELOPER */
 
 	/* tor support */
@@ -302,6 +336,14 @@ struct lightningd {
 
 	char *wallet_dsn;
 
+	/* Let the sqlite3 replica fall this many commits behind (0 means
+	 * write it synchronously). */
+	u32 wallet_replica_max_lag;
+
+	/* How many db_write_stream batches a plugin may leave
+	 * unacknowledged before we wait for it (0 means always wait). */
+	u32 db_write_stream_window;
+
 	bool encrypted_hsm;
 
 	mode_t initial_umask;
@@ -0,0 +1,475 @@
+/* Cheap always-on counters, exported via `getmetrics` and (optionally)
+ * in Prometheus text format on a local socket.
+ *
+ * Everything here is updated on hot paths, so recording is just an
+ * increment or a histogram_add(): anything expensive (walking the
+ * subdaemons, formatting) only happens when someone asks.
+ */
+#include "config.h"
+#include <ccan/err/err.h>
+#include <ccan/io/io.h>
+#include <ccan/tal/str/str.h>
+#include <common/bloomfilter.h>
+#include <common/htlc.h>
+#include <common/json_command.h>
+#include <common/json_param.h>
+#include <common/memleak.h>
+#include <db/common.h>
+#include <db/exec.h>
+#include <inttypes.h>
+#include <lightningd/chaintopology.h>
+#include <lightningd/jsonrpc.h>
+#include <lightningd/lightningd.h>
+#include <lightningd/metrics.h>
+#include <lightningd/subd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <wallet/txfilter.h>
+
+static void destroy_metrics(struct metrics *metrics)
+{
+	strmap_clear(&metrics->rpc);
+	strmap_clear(&metrics->subds);
+}
+
+#if DEVELOPER
+static void memleak_help_metrics(struct htable *memtable,
+				 struct metrics *metrics)
+{
+	memleak_scan_strmap(memtable, &metrics->rpc);
+	memleak_scan_strmap(memtable, &metrics->subds);
+}
+#endif /* DEVELOPER */
+
+struct metrics *new_metrics(struct lightningd *ld)
+{
+	struct metrics *metrics = tal(ld, struct metrics);
+
+	metrics->ld = ld;
+	strmap_init(&metrics->rpc);
+	strmap_init(&metrics->subds);
+	memset(metrics->htlc_in_states, 0, sizeof(metrics->htlc_in_states));
+	memset(metrics->htlc_out_states, 0, sizeof(metrics->htlc_out_states));
+	memset(&metrics->htlc_in_resolution, 0,
+	       sizeof(metrics->htlc_in_resolution));
+	memset(&metrics->watch_processing, 0,
+	       sizeof(metrics->watch_processing));
+	metrics->listener = NULL;
+	tal_add_destructor(metrics, destroy_metrics);
+	memleak_add_helper(metrics, memleak_help_metrics);
+
+	return metrics;
+}
+
+void metrics_command_done(struct metrics *metrics,
+			  const char *method,
+			  struct timerel elapsed)
+{
+	struct histogram *h = strmap_get(&metrics->rpc, method);
+
+	if (!h) {
+		/* Plugin commands can go away, so we keep our own copy
+		 * of the name. */
+		h = talz(metrics, struct histogram);
+		strmap_add(&metrics->rpc, tal_strdup(h, method), h);
+	}
+	histogram_add(h, elapsed);
+}
+
+struct subd_metrics *metrics_for_subd(struct metrics *metrics,
+				      const char *name)
+{
+	struct subd_metrics *sm = strmap_get(&metrics->subds, name);
+
+	if (!sm) {
+		sm = talz(metrics, struct subd_metrics);
+		strmap_add(&metrics->subds, tal_strdup(sm, name), sm);
+	}
+	return sm;
+}
+
+void metrics_htlc_in_state(struct metrics *metrics,
+			   const struct htlc_in *hin,
+			   enum htlc_state newstate)
+{
+	metrics->htlc_in_states[newstate]++;
+
+	/* That's the last state for an incoming HTLC: it's resolved. */
+	if (newstate == SENT_REMOVE_ACK_REVOCATION)
+		histogram_add(&metrics->htlc_in_resolution,
+			      time_between(time_now(), hin->received_time));
+}
+
+void metrics_htlc_out_state(struct metrics *metrics,
+			    enum htlc_state newstate)
+{
+	metrics->htlc_out_states[newstate]++;
+}
+
+void metrics_watches_processed(struct metrics *metrics,
+			       struct timerel elapsed)
+{
+	histogram_add(&metrics->watch_processing, elapsed);
+}
+
+/* The live state of all the subds with this name. */
+static void subd_queue_totals(struct lightningd *ld, const char *name,
+			      size_t *running, size_t *queued)
+{
+	struct subd *sd;
+
+	*running = *queued = 0;
+	list_for_each(&ld->subds, sd, list) {
+		if (!streq(sd->name, name))
+			continue;
+		(*running)++;
+		*queued += msg_queue_length(sd->outq);
+	}
+}
+
+static bool json_add_rpc_metric(const char *method,
+				struct histogram *h,
+				struct json_stream *response)
+{
+	json_object_start(response, NULL);
+	json_add_string(response, "method", method);
+	json_add_histogram(response, "duration", h);
+	json_object_end(response);
+	return true;
+}
+
+struct json_subd_arg {
+	struct lightningd *ld;
+	struct json_stream *response;
+};
+
+static bool json_add_subd_metric(const char *name,
+				 struct subd_metrics *sm,
+				 struct json_subd_arg *arg)
+{
+	size_t running, queued;
+
+	subd_queue_totals(arg->ld, name, &running, &queued);
+	json_object_start(arg->response, NULL);
+	json_add_string(arg->response, "name", name);
+	json_add_u64(arg->response, "running", running);
+	json_add_u64(arg->response, "msgs_sent", sm->msgs_sent);
+	json_add_u64(arg->response, "queued", queued);
+	json_add_u64(arg->response, "max_queued", sm->max_queued);
+	json_object_end(arg->response);
+	return true;
+}
+
+static void json_add_htlc_states(struct json_stream *response,
+				 const char *fieldname,
+				 const u64 *states)
+{
+	json_array_start(response, fieldname);
+	for (enum htlc_state i = 0; i < HTLC_STATE_INVALID; i++) {
+		if (!states[i])
+			continue;
+		json_object_start(response, NULL);
+		json_add_string(response, "state", htlc_state_name(i));
+		json_add_u64(response, "count", states[i]);
+		json_object_end(response);
+	}
+	json_array_end(response);
+}
+
+static void json_add_prefilter(struct json_stream *response,
+			       const char *fieldname,
+			       const struct bloomfilter_stats *stats)
+{
+	json_object_start(response, fieldname);
+	json_add_u64(response, "checked", stats->checked);
+	json_add_u64(response, "passed", stats->passed);
+	json_add_u64(response, "matched", stats->matched);
+	json_object_end(response);
+}
+
+static struct command_result *json_getmetrics(struct command *cmd,
+					      const char *buffer,
+					      const jsmntok_t *obj UNNEEDED,
+					      const jsmntok_t *params)
+{
+	struct lightningd *ld = cmd->ld;
+	struct metrics *metrics = ld->metrics;
+	struct json_stream *response;
+	struct json_subd_arg subdarg;
+	size_t replica_lag;
+	u64 replica_stalls;
+
+	if (!param(cmd, buffer, params, NULL))
+		return command_param_failed();
+
+	response = json_stream_success(cmd);
+	json_array_start(response, "rpc");
+	strmap_iterate(&metrics->rpc, json_add_rpc_metric, response);
+	json_array_end(response);
+
+	json_object_start(response, "db");
+	json_add_histogram(response, "commit", &ld->wallet->db->commit_time);
+	if (db_replica_lag(ld->wallet->db, &replica_lag, &replica_stalls)) {
+		json_object_start(response, "replica");
+		json_add_u64(response, "lag", replica_lag);
+		json_add_u32(response, "max_lag", ld->wallet->db->replica_max_lag);
+		json_add_u64(response, "stalls", replica_stalls);
+		json_object_end(response);
+	}
+	json_object_end(response);
+
+	subdarg.ld = ld;
+	subdarg.response = response;
+	json_array_start(response, "subdaemons");
+	strmap_iterate(&metrics->subds, json_add_subd_metric, &subdarg);
+	json_array_end(response);
+
+	json_object_start(response, "htlcs");
+	json_add_u64(response, "in_flight_in", htlc_in_map_count(&ld->htlcs_in));
+	json_add_u64(response, "in_flight_out",
+		     htlc_out_map_count(&ld->htlcs_out));
+	json_add_htlc_states(response, "in_states", metrics->htlc_in_states);
+	json_add_htlc_states(response, "out_states", metrics->htlc_out_states);
+	json_add_histogram(response, "in_resolution",
+			   &metrics->htlc_in_resolution);
+	json_object_end(response);
+
+	json_object_start(response, "watches");
+	json_add_u64(response, "txwatches",
+		     txwatch_hash_count(&ld->topology->txwatches));
+	json_add_u64(response, "txowatches",
+		     txowatch_hash_count(&ld->topology->txowatches));
+	json_add_histogram(response, "per_block", &metrics->watch_processing);
+	json_object_end(response);
+
+	json_object_start(response, "prefilters");
+	json_add_prefilter(response, "watches",
+			   &ld->topology->watch_prefilter_stats);
+	json_add_prefilter(response, "wallet",
+			   txfilter_stats(ld->owned_txfilter));
+	json_object_end(response);
+
+	return command_success(cmd, response);
+}
+
+static const struct json_command getmetrics_command = {
+	"getmetrics",
+	"utility",
+	json_getmetrics,
+	"Show internal counters and latency histograms"
+};
+AUTODATA(json_command, &getmetrics_command);
+
+/* Label values can contain anything: escape as Prometheus requires. */
+static const char *label_escape(const tal_t *ctx, const char *str)
+{
+	char *ret = tal_strdup(ctx, "");
+
+	for (size_t i = 0; str[i]; i++) {
+		if (str[i] == '\\' || str[i] == '"')
+			tal_append_fmt(&ret, "\\%c", str[i]);
+		else if (str[i] == '\n')
+			tal_append_fmt(&ret, "\\n");
+		else
+			tal_append_fmt(&ret, "%c", str[i]);
+	}
+	return ret;
+}
+
+static bool prom_add_rpc_metric(const char *method,
+				struct histogram *h,
+				char **out)
+{
+	histogram_prometheus(out, "lightningd_rpc_duration_seconds",
+			     tal_fmt(tmpctx, "method=\"%s\"",
+				     label_escape(tmpctx, method)),
+			     h);
+	return true;
+}
+
+struct prom_subd_arg {
+	struct lightningd *ld;
+	char *running, *sent, *queued, *max_queued;
+};
+
+static bool prom_add_subd_metric(const char *name,
+				 struct subd_metrics *sm,
+				 struct prom_subd_arg *arg)
+{
+	size_t running, queued;
+
+	subd_queue_totals(arg->ld, name, &running, &queued);
+	tal_append_fmt(&arg->running,
+		       "lightningd_subd_running{subd=\"%s\"} %zu\n",
+		       name, running);
+	tal_append_fmt(&arg->sent,
+		       "lightningd_subd_messages_sent_total{subd=\"%s\"} %"PRIu64"\n",
+		       name, sm->msgs_sent);
+	tal_append_fmt(&arg->queued,
+		       "lightningd_subd_queue_length{subd=\"%s\"} %zu\n",
+		       name, queued);
+	tal_append_fmt(&arg->max_queued,
+		       "lightningd_subd_queue_length_max{subd=\"%s\"} %"PRIu64"\n",
+		       name, sm->max_queued);
+	return true;
+}
+
+static void prom_header(char **out, const char *name, const char *type,
+			const char *help)
+{
+	tal_append_fmt(out, "# HELP %s %s\n# TYPE %s %s\n",
+		       name, help, name, type);
+}
+
+static void prom_add_htlc_states(char **out, const char *dir,
+				 const u64 *states)
+{
+	for (enum htlc_state i = 0; i < HTLC_STATE_INVALID; i++) {
+		if (!states[i])
+			continue;
+		tal_append_fmt(out,
+			       "lightningd_htlc_state_transitions_total{direction=\"%s\",state=\"%s\"} %"PRIu64"\n",
+			       dir, htlc_state_name(i), states[i]);
+	}
+}
+
+static void prom_add_prefilter(char **out, const char *what,
+			       u64 watches, u64 wallet)
+{
+	tal_append_fmt(out,
+		       "lightningd_prefilter_%s_total{filter=\"watches\"} %"PRIu64"\n"
+		       "lightningd_prefilter_%s_total{filter=\"wallet\"} %"PRIu64"\n",
+		       what, watches, what, wallet);
+}
+
+static char *metrics_prometheus(const tal_t *ctx, struct metrics *metrics)
+{
+	struct lightningd *ld = metrics->ld;
+	char *out = tal_strdup(ctx, "");
+	struct prom_subd_arg subdarg;
+	size_t replica_lag;
+	u64 replica_stalls;
+
+	prom_header(&out, "lightningd_rpc_duration_seconds", "histogram",
+		    "Time taken to complete JSON-RPC commands.");
+	strmap_iterate(&metrics->rpc, prom_add_rpc_metric, &out);
+
+	prom_header(&out, "lightningd_db_commit_duration_seconds", "histogram",
+		    "Time taken to commit database transactions.");
+	histogram_prometheus(&out, "lightningd_db_commit_duration_seconds",
+			     NULL, &ld->wallet->db->commit_time);
+
+	if (db_replica_lag(ld->wallet->db, &replica_lag, &replica_stalls)) {
+		prom_header(&out, "lightningd_db_replica_lag", "gauge",
+			    "Commits not yet written to the replica database.");
+		tal_append_fmt(&out, "lightningd_db_replica_lag %zu\n",
+			       replica_lag);
+		prom_header(&out, "lightningd_db_replica_stalls_total", "counter",
+			    "Commits which waited for the replica to catch up.");
+		tal_append_fmt(&out, "lightningd_db_replica_stalls_total %"PRIu64"\n",
+			       replica_stalls);
+	}
+
+	/* Each metric's lines must be together, so we build them separately */
+	subdarg.ld = ld;
+	subdarg.running = tal_strdup(tmpctx, "");
+	subdarg.sent = tal_strdup(tmpctx, "");
+	subdarg.queued = tal_strdup(tmpctx, "");
+	subdarg.max_queued = tal_strdup(tmpctx, "");
+	strmap_iterate(&metrics->subds, prom_add_subd_metric, &subdarg);
+	prom_header(&out, "lightningd_subd_running", "gauge",
+		    "Subdaemons currently running.");
+	tal_append_fmt(&out, "%s", subdarg.running);
+	prom_header(&out, "lightningd_subd_messages_sent_total", "counter",
+		    "Messages sent to subdaemons.");
+	tal_append_fmt(&out, "%s", subdarg.sent);
+	prom_header(&out, "lightningd_subd_queue_length", "gauge",
+		    "Messages waiting to be sent to subdaemons.");
+	tal_append_fmt(&out, "%s", subdarg.queued);
+	prom_header(&out, "lightningd_subd_queue_length_max", "gauge",
+		    "Longest queue seen for any one subdaemon.");
+	tal_append_fmt(&out, "%s", subdarg.max_queued);
+
+	prom_header(&out, "lightningd_htlcs_in_flight", "gauge",
+		    "HTLCs currently in flight.");
+	tal_append_fmt(&out,
+		       "lightningd_htlcs_in_flight{direction=\"in\"} %zu\n"
+		       "lightningd_htlcs_in_flight{direction=\"out\"} %zu\n",
+		       htlc_in_map_count(&ld->htlcs_in),
+		       htlc_out_map_count(&ld->htlcs_out));
+	prom_header(&out, "lightningd_htlc_state_transitions_total", "counter",
+		    "HTLC state changes.");
+	prom_add_htlc_states(&out, "in", metrics->htlc_in_states);
+	prom_add_htlc_states(&out, "out", metrics->htlc_out_states);
+	prom_header(&out, "lightningd_htlc_in_resolution_seconds", "histogram",
+		    "Time from receiving an HTLC to it being fully resolved.");
+	histogram_prometheus(&out, "lightningd_htlc_in_resolution_seconds",
+			     NULL, &metrics->htlc_in_resolution);
+
+	prom_header(&out, "lightningd_watches", "gauge",
+		    "Transactions and outputs currently watched.");
+	tal_append_fmt(&out,
+		       "lightningd_watches{kind=\"tx\"} %zu\n"
+		       "lightningd_watches{kind=\"txo\"} %zu\n",
+		       txwatch_hash_count(&ld->topology->txwatches),
+		       txowatch_hash_count(&ld->topology->txowatches));
+	prom_header(&out, "lightningd_watch_processing_seconds", "histogram",
+		    "Time taken to fire transaction watches for each new tip.");
+	histogram_prometheus(&out, "lightningd_watch_processing_seconds",
+			     NULL, &metrics->watch_processing);
+
+	prom_header(&out, "lightningd_prefilter_checked_total", "counter",
+		    "Block lookups checked against a Bloom prefilter.");
+	prom_add_prefilter(&out, "checked",
+			   ld->topology->watch_prefilter_stats.checked,
+			   txfilter_stats(ld->owned_txfilter)->checked);
+	prom_header(&out, "lightningd_prefilter_passed_total", "counter",
+		    "Block lookups a Bloom prefilter could not rule out.");
+	prom_add_prefilter(&out, "passed",
+			   ld->topology->watch_prefilter_stats.passed,
+			   txfilter_stats(ld->owned_txfilter)->passed);
+	prom_header(&out, "lightningd_prefilter_matched_total", "counter",
+		    "Block lookups which really matched.");
+	prom_add_prefilter(&out, "matched",
+			   ld->topology->watch_prefilter_stats.matched,
+			   txfilter_stats(ld->owned_txfilter)->matched);
+
+	return out;
+}
+
+/* Scrapers connect, we write everything and hang up. */
+static struct io_plan *metrics_connected(struct io_conn *conn,
+					 struct metrics *metrics)
+{
+	char *text = metrics_prometheus(conn, metrics);
+
+	return io_write(conn, text, strlen(text), io_close_cb, NULL);
+}
+
+void metrics_listen(struct metrics *metrics)
+{
+	struct sockaddr_un addr;
+	int fd;
+	const char *filename = metrics->ld->metrics_socket;
+
+	if (!filename)
+		return;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		err(1, "metrics socket creation failed");
+	if (strlen(filename) + 1 > sizeof(addr.sun_path))
+		errx(1, "metrics-socket '%s' too long", filename);
+	strcpy(addr.sun_path, filename);
+	addr.sun_family = AF_UNIX;
+
+	unlink(filename);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		err(1, "Binding metrics socket to '%s'", filename);
+	if (listen(fd, 16) != 0)
+		err(1, "Listening on '%s'", filename);
+
+	metrics->listener = io_new_listener(metrics, fd,
+					    metrics_connected, metrics);
+}
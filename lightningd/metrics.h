@@ -0,0 +1,70 @@
+/* Internal counters and latency histograms, for getmetrics and Prometheus */
+#ifndef LIGHTNING_LIGHTNINGD_METRICS_H
+#define LIGHTNING_LIGHTNINGD_METRICS_H
+#include "config.h"
+#include <ccan/strmap/strmap.h>
+#include <ccan/time/time.h>
+#include <common/histogram.h>
+#include <common/htlc_state.h>
+
+struct htlc_in;
+struct lightningd;
+
+/* One of these per subdaemon name (eg. all channelds share one). */
+struct subd_metrics {
+	/* Messages handed to subd_send_msg / subd_send_fd */
+	u64 msgs_sent;
+	/* The longest outgoing queue any one of them has had. */
+	u64 max_queued;
+};
+
+struct metrics {
+	struct lightningd *ld;
+
+	/* Latency of each JSON command, by method name. */
+	STRMAP(struct histogram *) rpc;
+
+	/* Per-subdaemon message counters (current queue lengths are
+	 * read directly from ld->subds when asked). */
+	STRMAP(struct subd_metrics *) subds;
+
+	/* How many times each HTLC entered each state. */
+	u64 htlc_in_states[HTLC_STATE_INVALID];
+	u64 htlc_out_states[HTLC_STATE_INVALID];
+
+	/* How long incoming HTLCs took from receipt to being resolved. */
+	struct histogram htlc_in_resolution;
+
+	/* How long each new tip took to fire transaction watches. */
+	struct histogram watch_processing;
+
+	/* --metrics-socket listener, if any. */
+	struct io_listener *listener;
+};
+
+struct metrics *new_metrics(struct lightningd *ld);
+
+/* Start listening on ld->metrics_socket, if set. */
+void metrics_listen(struct metrics *metrics);
+
+/* A JSON command has completed. */
+void metrics_command_done(struct metrics *metrics,
+			  const char *method,
+			  struct timerel elapsed);
+
+/* Get (creating if necessary) the counters for this subdaemon name. */
+struct subd_metrics *metrics_for_subd(struct metrics *metrics,
+				      const char *name);
+
+/* HTLCs have moved state. */
+void metrics_htlc_in_state(struct metrics *metrics,
+			   const struct htlc_in *hin,
+			   enum htlc_state newstate);
+void metrics_htlc_out_state(struct metrics *metrics,
+			    enum htlc_state newstate);
+
+/* We've told watches about a new tip. */
+void metrics_watches_processed(struct metrics *metrics,
+			       struct timerel elapsed);
+
+#endif /* LIGHTNING_LIGHTNINGD_METRICS_H */
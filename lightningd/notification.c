@@ -335,6 +335,8 @@ static void forward_event_notification_serialize(struct json_stream *stream,
 	cur->resolved_time = tal_steal(cur, resolved_time);
 	cur->forward_style = forward_style;
 	cur->htlc_id_in = in->key.id;
+	/* These are only meaningful for listforwards */
+	cur->created_index = cur->updated_index = 0;
 
 	json_add_forwarding_object(stream, "forward_event",
 				   cur, &in->payment_hash);
@@ -252,8 +252,10 @@ static void watch_tx_and_outputs(struct channel *channel,
 		       onchain_tx_watched);
 
 	for (outpoint.n = 0; outpoint.n < tx->wtx->num_outputs; outpoint.n++)
-		watch_txo(txw, ld->topology, channel, &outpoint,
-			  onchain_txo_watched);
+		txowatch_set_script(watch_txo(txw, ld->topology, channel,
+					      &outpoint, onchain_txo_watched),
+				    take(bitcoin_tx_output_get_script(NULL, tx,
+								      outpoint.n)));
 }
 
 static void handle_onchain_log_coin_move(struct channel *channel, const u8 *msg)
@@ -32,7 +32,8 @@
 #include <wally_psbt.h>
 
 void json_add_uncommitted_channel(struct json_stream *response,
-				  const struct uncommitted_channel *uc)
+				  const struct uncommitted_channel *uc,
+				  const struct peer *peer)
 {
 	struct amount_msat total, ours;
 	if (!uc)
@@ -43,6 +44,11 @@ void json_add_uncommitted_channel(struct json_stream *response,
 		return;
 
 	json_object_start(response, NULL);
+	if (peer) {
+		json_add_node_id(response, "peer_id", &peer->id);
+		json_add_bool(response, "peer_connected",
+			      peer->connected == PEER_CONNECTED);
+	}
 	json_add_string(response, "state", "OPENINGD");
 	json_add_string(response, "owner", "lightning_openingd");
 	json_add_string(response, "opener", "local");
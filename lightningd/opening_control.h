@@ -8,11 +8,14 @@ struct channel_id;
 struct crypto_state;
 struct json_stream;
 struct lightningd;
+struct peer;
 struct peer_fd;
 struct uncommitted_channel;
 
+/* If @peer is non-NULL, adds peer_id and peer_connected too. */
 void json_add_uncommitted_channel(struct json_stream *response,
-				  const struct uncommitted_channel *uc);
+				  const struct uncommitted_channel *uc,
+				  const struct peer *peer);
 
 bool peer_start_openingd(struct peer *peer,
 			 struct peer_fd *peer_fd);
@@ -758,6 +758,15 @@ static void dev_register_opts(struct lightningd *ld)
 	opt_register_noarg("--dev-no-ping-timer", opt_set_bool,
 			   &ld->dev_no_ping_timer,
 			   "Don't hang up if we don't get a ping response");
+	opt_register_noarg("--dev-no-db-pipeline", opt_set_bool,
+			   &ld->dev_no_db_pipeline,
+			   "Don't pipeline database statements (postgres)");
+	opt_register_noarg("--dev-no-utxoset-batch", opt_set_bool,
+			   &ld->dev_no_utxoset_batch,
+			   "Don't batch utxoset inserts and pruning");
+	opt_register_noarg("--dev-no-blockfile", opt_set_bool,
+			   &ld->dev_no_blockfile,
+			   "Don't ask the backend for blocks in files");
 	opt_register_arg("--dev-onion-reply-length",
 			 opt_set_uintval,
 			 opt_show_uintval,
@@ -819,6 +828,15 @@ static const struct config testnet_config = {
 	.exp_offers = IFEXPERIMENTAL(true, false),
 
 	.allowdustreserve = false,
+
+	/* Commit every transaction as it completes. */
+	.db_group_commit = false,
+	.db_group_commit_usec = 0,
+
+	/* Archive resolved HTLCs a thousand at a time. */
+	.htlc_archive_batch = 1000,
+
+	.block_filters = false,
 };
 
 /* aka. "Dude, where's my coins?" */
@@ -885,6 +903,15 @@ static const struct config mainnet_config = {
 	.exp_offers = IFEXPERIMENTAL(true, false),
 
 	.allowdustreserve = false,
+
+	/* Commit every transaction as it completes. */
+	.db_group_commit = false,
+	.db_group_commit_usec = 0,
+
+	/* Archive resolved HTLCs a thousand at a time. */
+	.htlc_archive_batch = 1000,
+
+	.block_filters = false,
 };
 
 static void check_config(struct lightningd *ld)
@@ -1079,6 +1106,16 @@ static void register_opts(struct lightningd *ld)
 	opt_register_early_arg("--wallet", opt_set_talstr, NULL,
 			       &ld->wallet_dsn,
 			       "Location of the wallet database.");
+	opt_register_arg("--wallet-replica-max-lag=<commits>",
+			 opt_set_u32, opt_show_u32,
+			 &ld->wallet_replica_max_lag,
+			 "Write the sqlite3 backup database in the background,"
+			 " up to this many commits behind");
+	opt_register_arg("--db-write-stream-window=<batches>",
+			 opt_set_u32, opt_show_u32,
+			 &ld->db_write_stream_window,
+			 "Let db_write_stream plugins fall this many"
+			 " transactions behind before commits wait for them");
 
 	/* This affects our features, so set early. */
 	opt_register_early_noarg("--large-channels|--wumbo",
@@ -1114,6 +1151,9 @@ static void register_opts(struct lightningd *ld)
 	opt_register_arg("--pid-file=<file>", opt_set_talstr, opt_show_charp,
 			 &ld->pidfile,
 			 "Specify pid file");
+	opt_register_arg("--metrics-socket=<file>", opt_set_talstr,
+			 opt_show_charp, &ld->metrics_socket,
+			 "Serve Prometheus-format metrics on this local socket");
 
 	opt_register_arg("--ignore-fee-limits", opt_set_bool_arg, opt_show_bool,
 			 &ld->config.ignore_fee_limits,
@@ -1137,9 +1177,27 @@ static void register_opts(struct lightningd *ld)
 			 opt_set_u32, opt_show_u32,
 			 &ld->config.commit_time_ms,
 			 "Time after changes before sending out COMMIT");
+	opt_register_noarg("--db-group-commit", opt_set_bool,
+			   &ld->config.db_group_commit,
+			   "Commit database changes once per event loop iteration");
+	opt_register_arg("--db-group-commit-usec=<usec>",
+			 opt_set_u32, opt_show_u32,
+			 &ld->config.db_group_commit_usec,
+			 "Delay database commits up to this long, to batch more"
+			 " (implies --db-group-commit)");
+	opt_register_arg("--htlc-archive-batch=<num>",
+			 opt_set_u32, opt_show_u32,
+			 &ld->config.htlc_archive_batch,
+			 "Move up to this many resolved HTLCs out of the live"
+			 " table at a time (0 = never)");
 	opt_register_arg("--fee-base", opt_set_u32, opt_show_u32,
 			 &ld->config.fee_base,
 			 "Millisatoshi minimum to charge for HTLC");
+	opt_register_noarg("--block-filters", opt_set_bool,
+			   &ld->config.block_filters,
+			   "Only fetch blocks whose BIP158 filter matches"
+			   " something of ours (needs bitcoind"
+			   " -blockfilterindex)");
 	opt_register_arg("--rescan", opt_set_s32, opt_show_s32,
 			 &ld->config.rescan,
 			 "Number of blocks to rescan from the current head, or "
@@ -52,20 +52,6 @@ static bool string_to_payment_status(const char *status_str, size_t len,
 	return false;
 }
 
-static const char *payment_status_to_string(const enum wallet_payment_status status)
-{
-	switch (status) {
-	case PAYMENT_COMPLETE:
-		return "complete";
-	case PAYMENT_FAILED:
-		return "failed";
-	case PAYMENT_PENDING:
-		return "pending";
-	}
-	//This should never happen
-	abort();
-}
-
 
 static void destroy_sendpay_command(struct sendpay_command *pc)
 {
@@ -887,7 +873,8 @@ send_payment_core(struct lightningd *ld,
 	struct command_result *invreq_err;
 
 	/* Now, do we already have one or more payments? */
-	payments = wallet_payment_list(tmpctx, ld->wallet, rhash);
+	payments = wallet_payment_list(tmpctx, ld->wallet, rhash,
+				       NULL, 0, NULL);
 	for (size_t i = 0; i < tal_count(payments); i++) {
 		log_debug(ld->log, "Payment %zu/%zu: %s %s",
 			  i, tal_count(payments),
@@ -1091,6 +1078,7 @@ send_payment_core(struct lightningd *ld,
 	/* If hout fails, payment should be freed too. */
 	struct wallet_payment *payment = tal(hout, struct wallet_payment);
 	payment->id = 0;
+	payment->updated_index = 0;
 	payment->payment_hash = *rhash;
 	payment->partid = partid;
 	payment->groupid = group;
@@ -1566,12 +1554,18 @@ static struct command_result *json_listsendpays(struct command *cmd,
 	struct sha256 *rhash;
 	const char *invstring;
 	enum wallet_payment_status *status;
+	enum wait_index *listindex;
+	u64 *liststart;
+	u32 *listlimit;
 
 	if (!param(cmd, buffer, params,
 		   /* FIXME: parameter should be invstring now */
 		   p_opt("bolt11", param_string, &invstring),
 		   p_opt("payment_hash", param_sha256, &rhash),
 		   p_opt("status", param_payment_status, &status),
+		   p_opt("index", param_index, &listindex),
+		   p_opt_def("start", param_u64, &liststart, 0),
+		   p_opt("limit", param_u32, &listlimit),
 		   NULL))
 		return command_param_failed();
 
@@ -1581,6 +1575,24 @@ static struct command_result *json_listsendpays(struct command *cmd,
 				    " {bolt11} or {payment_hash}");
 	}
 
+	if (*liststart != 0 && !listindex) {
+		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+				    "Can only specify {start} with {index}");
+	}
+	if (listlimit && !listindex) {
+		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+				    "Can only specify {limit} with {index}");
+	}
+	if (listindex && (rhash || invstring)) {
+		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+				    "Cannot specify {index} with"
+				    " {bolt11} or {payment_hash}");
+	}
+	if (listindex && *listindex == WAIT_INDEX_DELETED) {
+		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+				    "Cannot list by the deleted index");
+	}
+
 	if (invstring) {
 		struct bolt11 *b11;
 		char *fail;
@@ -1603,7 +1615,8 @@ static struct command_result *json_listsendpays(struct command *cmd,
 		}
 	}
 
-	payments = wallet_payment_list(cmd, cmd->ld->wallet, rhash);
+	payments = wallet_payment_list(cmd, cmd->ld->wallet, rhash,
+				       listindex, *liststart, listlimit);
 	response = json_stream_success(cmd);
 
 	json_array_start(response, "payments");
@@ -1612,6 +1625,12 @@ static struct command_result *json_listsendpays(struct command *cmd,
 			continue;
 		json_object_start(response, NULL);
 		json_add_payment_fields(response, payments[i]);
+		/* Not yet in the db means no index */
+		if (payments[i]->id)
+			json_add_u64(response, "created_index", payments[i]->id);
+		if (payments[i]->updated_index)
+			json_add_u64(response, "updated_index",
+				     payments[i]->updated_index);
 		json_object_end(response);
 	}
 	json_array_end(response);
@@ -1623,7 +1642,7 @@ static const struct json_command listsendpays_command = {
 	"listsendpays",
 	"payment",
 	json_listsendpays,
-	"Show sendpay, old and current, optionally limiting to {bolt11} or {payment_hash}."
+	"Show sendpay, old and current, optionally limiting to {bolt11} or {payment_hash}, or by {index} from {start} up to {limit} entries."
 };
 AUTODATA(json_command, &listsendpays_command);
 
@@ -1675,7 +1694,8 @@ static struct command_result *json_delpay(struct command *cmd,
 		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
 				    "Must set both partid and groupid, or neither");
 
-	payments = wallet_payment_list(cmd, cmd->ld->wallet, payment_hash);
+	payments = wallet_payment_list(cmd, cmd->ld->wallet, payment_hash,
+				       NULL, 0, NULL);
 
 	if (tal_count(payments) == 0)
 		return command_fail(cmd, PAY_NO_SUCH_PAYMENT, "Unknown payment with payment_hash: %s",
@@ -1727,6 +1747,40 @@ static const struct json_command delpay_command = {
 };
 AUTODATA(json_command, &delpay_command);
 
+static struct command_result *json_delpays(struct command *cmd,
+					   const char *buffer,
+					   const jsmntok_t *obj UNNEEDED,
+					   const jsmntok_t *params)
+{
+	struct json_stream *response;
+	enum wallet_payment_status *status;
+	u64 *maxtime, deleted, remaining;
+	u32 *limit;
+
+	if (!param(cmd, buffer, params,
+		   p_req("status", param_payment_status_nopending, &status),
+		   p_req("maxtime", param_u64, &maxtime),
+		   p_opt_def("limit", param_u32, &limit, 1000),
+		   NULL))
+		return command_param_failed();
+
+	deleted = wallet_payment_delete_older(cmd->ld->wallet, *status,
+					      *maxtime, *limit, &remaining);
+
+	response = json_stream_success(cmd);
+	json_add_u64(response, "deleted", deleted);
+	json_add_u64(response, "remaining", remaining);
+	return command_success(cmd, response);
+}
+
+static const struct json_command delpays_command = {
+	"delpays",
+	"payment",
+	json_delpays,
+	"Delete up to {limit} payments with {status} created at or before {maxtime}",
+};
+AUTODATA(json_command, &delpays_command);
+
 static struct command_result *json_createonion(struct command *cmd,
 						const char *buffer,
 						const jsmntok_t *obj UNNEEDED,
@@ -5,6 +5,7 @@
 #include <bitcoin/tx.h>
 #include <ccan/array_size/array_size.h>
 #include <ccan/cast/cast.h>
+#include <ccan/intmap/intmap.h>
 #include <ccan/io/io.h>
 #include <ccan/mem/mem.h>
 #include <ccan/noerr/noerr.h>
@@ -435,8 +436,14 @@ static void json_add_htlcs(struct lightningd *ld,
 	struct htlc_in_map_iter ini;
 	const struct htlc_out *hout;
 	struct htlc_out_map_iter outi;
-	u32 local_feerate = get_feerate(channel->fee_states,
-					channel->opener, LOCAL);
+	u32 local_feerate;
+
+	/* This walks every HTLC we have, so skip it if filtered out. */
+	if (!json_stream_wants(response, "htlcs"))
+		return;
+
+	local_feerate = get_feerate(channel->fee_states,
+				    channel->opener, LOCAL);
 
 	/* FIXME: Add more fields. */
 	json_array_start(response, "htlcs");
@@ -693,17 +700,76 @@ struct amount_msat channel_amount_receivable(const struct channel *channel)
 	return receivable;
 }
 
+/* Field names filled in from wallet_channel_stats_load */
+static const char *channel_stats_fields[] = {
+	"in_payments_offered",
+	"in_msatoshi_offered",
+	"in_offered_msat",
+	"in_payments_fulfilled",
+	"in_msatoshi_fulfilled",
+	"in_fulfilled_msat",
+	"out_payments_offered",
+	"out_msatoshi_offered",
+	"out_offered_msat",
+	"out_payments_fulfilled",
+	"out_msatoshi_fulfilled",
+	"out_fulfilled_msat",
+};
+
+static bool json_wants_channel_stats(const struct json_stream *response)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(channel_stats_fields); i++) {
+		if (json_stream_wants(response, channel_stats_fields[i]))
+			return true;
+	}
+	return false;
+}
+
+static void json_add_state_changes(struct lightningd *ld,
+				   struct json_stream *response,
+				   u64 channel_dbid)
+{
+	struct state_change_entry *state_changes;
+
+	/* Don't hit the db if they've filtered this out. */
+	if (json_stream_wants(response, "state_changes"))
+		state_changes = wallet_state_change_get(ld->wallet, tmpctx,
+							channel_dbid);
+	else
+		state_changes = NULL;
+	json_array_start(response, "state_changes");
+	for (size_t i = 0; i < tal_count(state_changes); i++) {
+		json_object_start(response, NULL);
+		json_add_timeiso(response, "timestamp",
+				 &state_changes[i].timestamp);
+		json_add_string(response, "old_state",
+				channel_state_str(state_changes[i].old_state));
+		json_add_string(response, "new_state",
+				channel_state_str(state_changes[i].new_state));
+		json_add_string(response, "cause",
+				channel_change_state_reason_str(state_changes[i].cause));
+		json_add_string(response, "message", state_changes[i].message);
+		json_object_end(response);
+	}
+	json_array_end(response);
+}
+
 static void json_add_channel(struct lightningd *ld,
 			     struct json_stream *response, const char *key,
-			     const struct channel *channel)
+			     const struct channel *channel,
+			     const struct peer *peer)
 {
 	struct channel_stats channel_stats;
 	struct amount_msat funding_msat;
 	struct amount_sat peer_funded_sats;
-	struct state_change_entry *state_changes;
 	u32 feerate;
 
 	json_object_start(response, key);
+	if (peer) {
+		json_add_node_id(response, "peer_id", &peer->id);
+		json_add_bool(response, "peer_connected",
+			      peer->connected == PEER_CONNECTED);
+	}
 	json_add_string(response, "state", channel_state_name(channel));
 	if (channel->last_tx && !invalid_last_tx(channel->last_tx)) {
 		struct bitcoin_txid txid;
@@ -998,22 +1064,7 @@ static void json_add_channel(struct lightningd *ld,
 	json_add_num(response, "max_accepted_htlcs",
 		     channel->our_config.max_accepted_htlcs);
 
-	state_changes = wallet_state_change_get(ld->wallet, tmpctx, channel->dbid);
-	json_array_start(response, "state_changes");
-	for (size_t i = 0; i < tal_count(state_changes); i++) {
-		json_object_start(response, NULL);
-		json_add_timeiso(response, "timestamp",
-				 &state_changes[i].timestamp);
-		json_add_string(response, "old_state",
-				channel_state_str(state_changes[i].old_state));
-		json_add_string(response, "new_state",
-				channel_state_str(state_changes[i].new_state));
-		json_add_string(response, "cause",
-				channel_change_state_reason_str(state_changes[i].cause));
-		json_add_string(response, "message", state_changes[i].message);
-		json_object_end(response);
-	}
-	json_array_end(response);
+	json_add_state_changes(ld, response, channel->dbid);
 
 	json_array_start(response, "status");
 	for (size_t i = 0; i < ARRAY_SIZE(channel->billboard.permanent); i++) {
@@ -1026,32 +1077,35 @@ static void json_add_channel(struct lightningd *ld,
 		json_add_string(response, NULL, channel->billboard.transient);
 	json_array_end(response);
 
-	/* Provide channel statistics */
-	wallet_channel_stats_load(ld->wallet, channel->dbid, &channel_stats);
-	json_add_u64(response, "in_payments_offered",
-		     channel_stats.in_payments_offered);
-	json_add_amount_msat_compat(response,
-				    channel_stats.in_msatoshi_offered,
-				    "in_msatoshi_offered",
-				    "in_offered_msat");
-	json_add_u64(response, "in_payments_fulfilled",
-		     channel_stats.in_payments_fulfilled);
-	json_add_amount_msat_compat(response,
-				    channel_stats.in_msatoshi_fulfilled,
-				    "in_msatoshi_fulfilled",
-				    "in_fulfilled_msat");
-	json_add_u64(response, "out_payments_offered",
-		     channel_stats.out_payments_offered);
-	json_add_amount_msat_compat(response,
-				    channel_stats.out_msatoshi_offered,
-				    "out_msatoshi_offered",
-				    "out_offered_msat");
-	json_add_u64(response, "out_payments_fulfilled",
-		     channel_stats.out_payments_fulfilled);
-	json_add_amount_msat_compat(response,
-				    channel_stats.out_msatoshi_fulfilled,
-				    "out_msatoshi_fulfilled",
-				    "out_fulfilled_msat");
+	/* Provide channel statistics (if wanted: it's a db lookup) */
+	if (json_wants_channel_stats(response)) {
+		wallet_channel_stats_load(ld->wallet, channel->dbid,
+					  &channel_stats);
+		json_add_u64(response, "in_payments_offered",
+			     channel_stats.in_payments_offered);
+		json_add_amount_msat_compat(response,
+					    channel_stats.in_msatoshi_offered,
+					    "in_msatoshi_offered",
+					    "in_offered_msat");
+		json_add_u64(response, "in_payments_fulfilled",
+			     channel_stats.in_payments_fulfilled);
+		json_add_amount_msat_compat(response,
+					    channel_stats.in_msatoshi_fulfilled,
+					    "in_msatoshi_fulfilled",
+					    "in_fulfilled_msat");
+		json_add_u64(response, "out_payments_offered",
+			     channel_stats.out_payments_offered);
+		json_add_amount_msat_compat(response,
+					    channel_stats.out_msatoshi_offered,
+					    "out_msatoshi_offered",
+					    "out_offered_msat");
+		json_add_u64(response, "out_payments_fulfilled",
+			     channel_stats.out_payments_fulfilled);
+		json_add_amount_msat_compat(response,
+					    channel_stats.out_msatoshi_fulfilled,
+					    "out_msatoshi_fulfilled",
+					    "out_fulfilled_msat");
+	}
 
 	json_add_htlcs(ld, response, channel);
 	json_object_end(response);
@@ -1883,14 +1937,31 @@ void channel_watch_wrong_funding(struct lightningd *ld, struct channel *channel)
 	}
 }
 
+/* The funding output's script (the same for every inflight) */
+static const u8 *funding_scriptpubkey(const tal_t *ctx,
+				      const struct channel *channel)
+{
+	const u8 *wscript;
+
+	wscript = bitcoin_redeem_2of2(tmpctx,
+				      &channel->local_funding_pubkey,
+				      &channel->channel_info.remote_fundingkey);
+	return scriptpubkey_p2wsh(ctx, wscript);
+}
+
 void channel_watch_funding(struct lightningd *ld, struct channel *channel)
 {
+	const u8 *script = funding_scriptpubkey(tmpctx, channel);
+
 	/* FIXME: Remove arg from cb? */
-	watch_txid(channel, ld->topology, channel,
-		   &channel->funding.txid, funding_depth_cb);
-	watch_txo(channel, ld->topology, channel,
-		  &channel->funding,
-		  funding_spent);
+	txwatch_set_script(watch_txid(channel, ld->topology, channel,
+				      &channel->funding.txid,
+				      funding_depth_cb),
+			   script);
+	txowatch_set_script(watch_txo(channel, ld->topology, channel,
+				      &channel->funding,
+				      funding_spent),
+			    script);
 	channel_watch_wrong_funding(ld, channel);
 }
 
@@ -1898,12 +1969,17 @@ static void channel_watch_inflight(struct lightningd *ld,
 				   struct channel *channel,
 				   struct channel_inflight *inflight)
 {
+	const u8 *script = funding_scriptpubkey(tmpctx, channel);
+
 	/* FIXME: Remove arg from cb? */
-	watch_txid(channel, ld->topology, channel,
-		   &inflight->funding->outpoint.txid, funding_depth_cb);
-	watch_txo(channel, ld->topology, channel,
-		  &inflight->funding->outpoint,
-		  funding_spent);
+	txwatch_set_script(watch_txid(channel, ld->topology, channel,
+				      &inflight->funding->outpoint.txid,
+				      funding_depth_cb),
+			   script);
+	txowatch_set_script(watch_txo(channel, ld->topology, channel,
+				      &inflight->funding->outpoint,
+				      funding_spent),
+			    script);
 }
 
 static void json_add_peer(struct lightningd *ld,
@@ -1935,16 +2011,21 @@ static void json_add_peer(struct lightningd *ld,
 		json_add_hex_talarr(response, "features", p->their_features);
 	}
 
-	json_array_start(response, "channels");
-	json_add_uncommitted_channel(response, p->uncommitted_channel);
+	if (json_stream_wants(response, "channels")) {
+		json_array_start(response, "channels");
+		json_add_uncommitted_channel(response, p->uncommitted_channel,
+					     NULL);
 
-	list_for_each(&p->channels, channel, list) {
-		if (channel_unsaved(channel))
-			json_add_unsaved_channel(response, channel);
-		else
-			json_add_channel(ld, response, NULL, channel);
+		list_for_each(&p->channels, channel, list) {
+			if (channel_unsaved(channel))
+				json_add_unsaved_channel(response, channel,
+							 NULL);
+			else
+				json_add_channel(ld, response, NULL, channel,
+						 NULL);
+		}
+		json_array_end(response);
 	}
-	json_array_end(response);
 
 	if (ll)
 		json_add_log(response, ld->log_book, &p->id, *ll);
@@ -1991,6 +2072,202 @@ static const struct json_command listpeers_command = {
 /* Comment added to satisfice AUTODATA */
 AUTODATA(json_command, &listpeers_command);
 
+static struct command_result *param_channel_state(struct command *cmd,
+						  const char *name,
+						  const char *buffer,
+						  const jsmntok_t *tok,
+						  enum channel_state **state)
+{
+	*state = tal(cmd, enum channel_state);
+	for (**state = CHANNELD_AWAITING_LOCKIN;
+	     **state <= CHANNEL_STATE_MAX;
+	     (**state)++) {
+		if (json_tok_streq(buffer, tok, channel_state_str(**state)))
+			return NULL;
+	}
+	return command_fail_badparam(cmd, name, buffer, tok,
+				     "should be a channel state");
+}
+
+struct listpeerchannels_filter {
+	enum channel_state *state;
+	bool *has_htlcs;
+	/* Channels with any HTLCs, by dbid (only if has_htlcs) */
+	UINTMAP(const struct channel *) with_htlcs;
+};
+
+static bool channel_wanted(const struct listpeerchannels_filter *f,
+			   const struct channel *channel)
+{
+	if (f->state && channel->state != *f->state)
+		return false;
+	if (f->has_htlcs) {
+		bool has = uintmap_get(&f->with_htlcs, channel->dbid) != NULL;
+		if (has != *f->has_htlcs)
+			return false;
+	}
+	return true;
+}
+
+static void json_add_peer_channels(struct lightningd *ld,
+				   struct json_stream *response,
+				   const struct peer *p,
+				   const struct listpeerchannels_filter *f)
+{
+	struct channel *channel;
+
+	/* These can't be in any particular state, nor have HTLCs */
+	if (!f->state && !(f->has_htlcs && *f->has_htlcs))
+		json_add_uncommitted_channel(response, p->uncommitted_channel,
+					     p);
+
+	list_for_each(&p->channels, channel, list) {
+		if (!channel_wanted(f, channel))
+			continue;
+		if (channel_unsaved(channel))
+			json_add_unsaved_channel(response, channel, p);
+		else
+			json_add_channel(ld, response, NULL, channel, p);
+	}
+}
+
+static struct command_result *json_listpeerchannels(struct command *cmd,
+						    const char *buffer,
+						    const jsmntok_t *obj UNNEEDED,
+						    const jsmntok_t *params)
+{
+	struct node_id *peer_id;
+	struct short_channel_id *scid;
+	struct listpeerchannels_filter *f;
+	struct json_stream *response;
+	struct peer *peer;
+
+	f = tal(cmd, struct listpeerchannels_filter);
+
+	if (!param(cmd, buffer, params,
+		   p_opt("id", param_node_id, &peer_id),
+		   p_opt("short_channel_id", param_short_channel_id, &scid),
+		   p_opt("state", param_channel_state, &f->state),
+		   p_opt("has_htlcs", param_bool, &f->has_htlcs),
+		   NULL))
+		return command_param_failed();
+
+	uintmap_init(&f->with_htlcs);
+	if (f->has_htlcs) {
+		const struct htlc_in *hin;
+		struct htlc_in_map_iter ini;
+		const struct htlc_out *hout;
+		struct htlc_out_map_iter outi;
+
+		/* One pass over all HTLCs, not one per channel. */
+		for (hin = htlc_in_map_first(&cmd->ld->htlcs_in, &ini);
+		     hin;
+		     hin = htlc_in_map_next(&cmd->ld->htlcs_in, &ini))
+			uintmap_add(&f->with_htlcs, hin->key.channel->dbid,
+				    hin->key.channel);
+		for (hout = htlc_out_map_first(&cmd->ld->htlcs_out, &outi);
+		     hout;
+		     hout = htlc_out_map_next(&cmd->ld->htlcs_out, &outi))
+			uintmap_add(&f->with_htlcs, hout->key.channel->dbid,
+				    hout->key.channel);
+	}
+
+	response = json_stream_success(cmd);
+	json_array_start(response, "channels");
+	if (scid) {
+		/* Straight to the channel, if any */
+		struct channel *channel = any_channel_by_scid(cmd->ld, scid,
+							      true);
+		if (channel
+		    && (!peer_id || node_id_eq(peer_id, &channel->peer->id))
+		    && channel_wanted(f, channel))
+			json_add_channel(cmd->ld, response, NULL, channel,
+					 channel->peer);
+	} else if (peer_id) {
+		peer = peer_by_id(cmd->ld, peer_id);
+		if (peer)
+			json_add_peer_channels(cmd->ld, response, peer, f);
+	} else {
+		list_for_each(&cmd->ld->peers, peer, list)
+			json_add_peer_channels(cmd->ld, response, peer, f);
+	}
+	json_array_end(response);
+	uintmap_clear(&f->with_htlcs);
+
+	return command_success(cmd, response);
+}
+
+static const struct json_command listpeerchannels_command = {
+	"listpeerchannels",
+	"network",
+	json_listpeerchannels,
+	"Show channels with peers, optionally only those with peer {id}, "
+	"{short_channel_id}, {state} or where {has_htlcs} matches"
+};
+AUTODATA(json_command, &listpeerchannels_command);
+
+static void json_add_closed_channel(struct lightningd *ld,
+				    struct json_stream *response,
+				    const struct closed_channel *cc)
+{
+	json_object_start(response, NULL);
+	if (cc->scid)
+		json_add_short_channel_id(response, "short_channel_id",
+					  cc->scid);
+	json_add_channel_id(response, "channel_id", &cc->cid);
+	json_add_txid(response, "funding_txid", &cc->funding.txid);
+	json_add_num(response, "funding_outnum", cc->funding.n);
+	json_add_bool(response, "private",
+		      !(cc->channel_flags & CHANNEL_FLAGS_ANNOUNCE_CHANNEL));
+	json_add_string(response, "opener",
+			cc->opener == LOCAL ? "local" : "remote");
+	if (cc->closer != NUM_SIDES)
+		json_add_string(response, "closer",
+				cc->closer == LOCAL ? "local" : "remote");
+	json_add_amount_sat_msat(response, "total_msat", cc->funding_sats);
+	json_add_amount_msat_only(response, "final_to_us_msat", cc->our_msat);
+	json_add_amount_msat_only(response, "min_to_us_msat",
+				  cc->msat_to_us_min);
+	json_add_amount_msat_only(response, "max_to_us_msat",
+				  cc->msat_to_us_max);
+	json_add_string(response, "close_cause",
+			channel_change_state_reason_str(cc->state_change_cause));
+
+	json_add_state_changes(ld, response, cc->dbid);
+	json_object_end(response);
+}
+
+static struct command_result *json_listclosedchannels(struct command *cmd,
+						      const char *buffer,
+						      const jsmntok_t *obj UNNEEDED,
+						      const jsmntok_t *params)
+{
+	struct json_stream *response;
+	struct closed_channel *chans;
+
+	if (!param(cmd, buffer, params, NULL))
+		return command_param_failed();
+
+	/* These are never loaded at startup: go to the db for them. */
+	chans = wallet_closed_channels_load(cmd, cmd->ld->wallet);
+
+	response = json_stream_success(cmd);
+	json_array_start(response, "closedchannels");
+	for (size_t i = 0; i < tal_count(chans); i++)
+		json_add_closed_channel(cmd->ld, response, &chans[i]);
+	json_array_end(response);
+
+	return command_success(cmd, response);
+}
+
+static const struct json_command listclosedchannels_command = {
+	"listclosedchannels",
+	"network",
+	json_listclosedchannels,
+	"Show channels which have been closed and fully resolved"
+};
+AUTODATA(json_command, &listclosedchannels_command);
+
 static void json_add_scb(struct command *cmd,
 			 const char *fieldname,
 			 struct json_stream *response,
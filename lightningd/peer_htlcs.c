@@ -7,6 +7,7 @@
 #include <common/ecdh.h>
 #include <common/json_command.h>
 #include <common/json_param.h>
+#include <common/memleak.h>
 #include <common/onion_decode.h>
 #include <common/onionreply.h>
 #include <common/timeout.h>
@@ -16,6 +17,7 @@
 #include <lightningd/chaintopology.h>
 #include <lightningd/channel.h>
 #include <lightningd/coin_mvts.h>
+#include <lightningd/metrics.h>
 #include <lightningd/pay.h>
 #include <lightningd/peer_control.h>
 #include <lightningd/peer_htlcs.h>
@@ -68,6 +70,7 @@ static bool htlc_in_update_state(struct channel *channel,
 			   hin->badonion, hin->failonion, NULL,
 			   hin->we_filled);
 
+	metrics_htlc_in_state(channel->peer->ld->metrics, hin, newstate);
 	hin->hstate = newstate;
 	return true;
 }
@@ -88,6 +91,7 @@ static bool htlc_out_update_state(struct channel *channel,
 			   0, hout->failonion,
 			   hout->failmsg, &we_filled);
 
+	metrics_htlc_out_state(channel->peer->ld->metrics, newstate);
 	hout->hstate = newstate;
 	return true;
 }
@@ -2828,6 +2832,38 @@ void htlcs_resubmit(struct lightningd *ld,
 	tal_free(unconnected_htlcs_in);
 }
 
+/* How long between archive batches while there's a backlog... */
+#define HTLC_ARCHIVE_BUSY_SECONDS 1
+/* ... and once we've caught up. */
+#define HTLC_ARCHIVE_IDLE_SECONDS 60
+
+static void htlc_archive_timer(struct lightningd *ld)
+{
+	size_t num;
+
+	/* One batch per timer (and thus per db transaction), so we
+	 * never hold things up for long. */
+	num = wallet_htlcs_archive(ld->wallet, ld->config.htlc_archive_batch);
+	if (num)
+		log_debug(ld->log, "Archived %zu resolved HTLCs", num);
+
+	notleak(new_reltimer(ld->timers, ld,
+			     time_from_sec(num == ld->config.htlc_archive_batch
+					   ? HTLC_ARCHIVE_BUSY_SECONDS
+					   : HTLC_ARCHIVE_IDLE_SECONDS),
+			     htlc_archive_timer, ld));
+}
+
+void htlcs_start_archiving(struct lightningd *ld)
+{
+	if (ld->config.htlc_archive_batch == 0)
+		return;
+
+	notleak(new_reltimer(ld->timers, ld,
+			     time_from_sec(HTLC_ARCHIVE_BUSY_SECONDS),
+			     htlc_archive_timer, ld));
+}
+
 #if DEVELOPER
 static struct command_result *json_dev_ignore_htlcs(struct command *cmd,
 						    const char *buffer,
@@ -2930,27 +2966,73 @@ void json_add_forwarding_object(struct json_stream *response,
 	if (cur->resolved_time)
 		json_add_timeabs(response, "resolved_time", *cur->resolved_time);
 #endif
+	/* Not set for forward_event */
+	if (cur->created_index)
+		json_add_u64(response, "created_index", cur->created_index);
+	if (cur->updated_index)
+		json_add_u64(response, "updated_index", cur->updated_index);
 	json_object_end(response);
 }
 
-static void listforwardings_add_forwardings(struct json_stream *response,
-					    struct wallet *wallet,
-					    enum forward_status status,
-					    const struct short_channel_id *chan_in,
-					    const struct short_channel_id *chan_out)
+struct listforwards_stream {
+	enum forward_status status;
+	struct short_channel_id *chan_in, *chan_out;
+	enum wait_index listindex;
+	u64 next;
+	/* NULL if unlimited */
+	u32 *remaining;
+};
+
+static struct command_result *listforwards_more(struct command *cmd,
+						struct json_stream *response,
+						struct listforwards_stream *lfs)
 {
 	const struct forwarding *forwardings;
-
-	forwardings = wallet_forwarded_payments_get(wallet, tmpctx, status, chan_in, chan_out);
-
-	json_array_start(response, "forwards");
-	for (size_t i=0; i<tal_count(forwardings); i++) {
+	u32 batch = COMMAND_STREAM_BATCH;
+	bool done;
+
+	/* Keyed paging only works on the created index: everything not
+	 * yet updated has updated_index 0, so do that in one go. */
+	if (lfs->listindex == WAIT_INDEX_UPDATED) {
+		done = true;
+		forwardings = wallet_forwarded_payments_get(cmd->ld->wallet,
+							    tmpctx, lfs->status,
+							    lfs->chan_in,
+							    lfs->chan_out,
+							    &lfs->listindex,
+							    lfs->next,
+							    lfs->remaining);
+	} else {
+		if (lfs->remaining && *lfs->remaining < batch)
+			batch = *lfs->remaining;
+		forwardings = wallet_forwarded_payments_get(cmd->ld->wallet,
+							    tmpctx, lfs->status,
+							    lfs->chan_in,
+							    lfs->chan_out,
+							    &lfs->listindex,
+							    lfs->next,
+							    &batch);
+		done = tal_count(forwardings) < batch;
+	}
+
+	for (size_t i = 0; i < tal_count(forwardings); i++) {
 		const struct forwarding *cur = &forwardings[i];
 		json_add_forwarding_object(response, NULL, cur, NULL);
+		/* forwards_created_idx is UNIQUE, so this skips nothing */
+		lfs->next = cur->created_index + 1;
 	}
-	json_array_end(response);
 
-	tal_free(forwardings);
+	if (lfs->remaining) {
+		*lfs->remaining -= tal_count(forwardings);
+		if (*lfs->remaining == 0)
+			done = true;
+	}
+
+	if (!done)
+		return NULL;
+
+	json_array_end(response);
+	return command_success(cmd, response);
 }
 
 static struct command_result *param_forward_status(struct command *cmd,
@@ -2976,28 +3058,56 @@ static struct command_result *json_listforwards(struct command *cmd,
 {
 
 	struct json_stream *response;
+	struct listforwards_stream *lfs;
 	struct short_channel_id *chan_in, *chan_out;
 	enum forward_status *status;
+	enum wait_index *listindex;
+	u64 *liststart;
+	u32 *listlimit;
 
 	if (!param(cmd, buffer, params,
 		   p_opt_def("status", param_forward_status, &status,
 			     FORWARD_ANY),
 		   p_opt("in_channel", param_short_channel_id, &chan_in),
 		   p_opt("out_channel", param_short_channel_id, &chan_out),
+		   p_opt("index", param_index, &listindex),
+		   p_opt_def("start", param_u64, &liststart, 0),
+		   p_opt("limit", param_u32, &listlimit),
 		   NULL))
 		return command_param_failed();
 
-	response = json_stream_success(cmd);
-	listforwardings_add_forwardings(response, cmd->ld->wallet, *status, chan_in, chan_out);
+	if (*liststart != 0 && !listindex) {
+		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+				    "Can only specify {start} with {index}");
+	}
+	if (listlimit && !listindex) {
+		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+				    "Can only specify {limit} with {index}");
+	}
+	if (listindex && *listindex == WAIT_INDEX_DELETED) {
+		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+				    "Cannot list by the deleted index");
+	}
 
-	return command_success(cmd, response);
+	lfs = tal(cmd, struct listforwards_stream);
+	lfs->status = *status;
+	lfs->chan_in = chan_in;
+	lfs->chan_out = chan_out;
+	/* With no index, we page through them in the order they were created */
+	lfs->listindex = listindex ? *listindex : WAIT_INDEX_CREATED;
+	lfs->next = *liststart;
+	lfs->remaining = listlimit;
+
+	response = json_stream_success(cmd);
+	json_array_start(response, "forwards");
+	return command_stream_success(cmd, response, listforwards_more, lfs);
 }
 
 static const struct json_command listforwards_command = {
 	"listforwards",
 	"channels",
 	json_listforwards,
-	"List all forwarded payments and their information optionally filtering by [status], [in_channel] and [out_channel]"
+	"List all forwarded payments and their information optionally filtering by [status], [in_channel] and [out_channel], or by [index] from [start] up to [limit] entries"
 };
 AUTODATA(json_command, &listforwards_command);
 
@@ -3066,6 +3176,109 @@ static const struct json_command delforward_command = {
 };
 AUTODATA(json_command, &delforward_command);
 
+static struct command_result *json_delforwards(struct command *cmd,
+					       const char *buffer,
+					       const jsmntok_t *obj UNNEEDED,
+					       const jsmntok_t *params)
+{
+	struct json_stream *response;
+	enum forward_status *status;
+	u64 *maxtime, deleted, remaining;
+	u32 *limit;
+
+	if (!param(cmd, buffer, params,
+		   p_req("status", param_forward_delstatus, &status),
+		   p_req("maxtime", param_u64, &maxtime),
+		   p_opt_def("limit", param_u32, &limit, 1000),
+		   NULL))
+		return command_param_failed();
+
+	deleted = wallet_forward_delete_older(cmd->ld->wallet, *status,
+					      *maxtime, *limit, &remaining);
+
+	response = json_stream_success(cmd);
+	json_add_u64(response, "deleted", deleted);
+	json_add_u64(response, "remaining", remaining);
+	return command_success(cmd, response);
+}
+
+static const struct json_command delforwards_command = {
+	"delforwards",
+	"channels",
+	json_delforwards,
+	"Delete up to {limit} forwards with {status} resolved at or before {maxtime}"
+};
+AUTODATA(json_command, &delforwards_command);
+
+static void json_add_forward_rollup(struct json_stream *response,
+				    const struct forward_rollup *r)
+{
+	json_object_start(response, NULL);
+	json_add_u64(response, "bucket_time", r->bucket_time);
+	json_add_short_channel_id(response, "in_channel", &r->channel_in);
+	/* This can be unknown if we failed before channel lookup */
+	if (r->channel_out.u64 != 0)
+		json_add_short_channel_id(response, "out_channel",
+					  &r->channel_out);
+	json_add_u64(response, "settled", r->settled);
+	json_add_u64(response, "failed", r->failed);
+	json_add_u64(response, "local_failed", r->local_failed);
+	json_add_amount_msat_only(response, "in_msat", r->msat_in);
+	json_add_amount_msat_only(response, "out_msat", r->msat_out);
+	json_add_amount_msat_only(response, "fee_msat", r->fee);
+	if (tal_count(r->failures)) {
+		json_array_start(response, "failures");
+		for (size_t i = 0; i < tal_count(r->failures); i++) {
+			json_object_start(response, NULL);
+			json_add_num(response, "failcode", r->failures[i].failcode);
+			json_add_string(response, "failreason",
+					onion_wire_name(r->failures[i].failcode));
+			json_add_u64(response, "count", r->failures[i].count);
+			json_object_end(response);
+		}
+		json_array_end(response);
+	}
+	json_object_end(response);
+}
+
+static struct command_result *json_listforwardrollups(struct command *cmd,
+						      const char *buffer,
+						      const jsmntok_t *obj UNNEEDED,
+						      const jsmntok_t *params)
+{
+	struct json_stream *response;
+	struct short_channel_id *chan_in, *chan_out;
+	u64 *start, *end;
+	const struct forward_rollup *rollups;
+
+	if (!param(cmd, buffer, params,
+		   p_opt("in_channel", param_short_channel_id, &chan_in),
+		   p_opt("out_channel", param_short_channel_id, &chan_out),
+		   p_opt_def("start_time", param_u64, &start, 0),
+		   p_opt("end_time", param_u64, &end),
+		   NULL))
+		return command_param_failed();
+
+	rollups = wallet_forward_rollups_get(cmd->ld->wallet, cmd,
+					     chan_in, chan_out, *start, end);
+
+	response = json_stream_success(cmd);
+	json_add_u64(response, "bucket_seconds", FORWARD_ROLLUP_SECONDS);
+	json_array_start(response, "rollups");
+	for (size_t i = 0; i < tal_count(rollups); i++)
+		json_add_forward_rollup(response, &rollups[i]);
+	json_array_end(response);
+	return command_success(cmd, response);
+}
+
+static const struct json_command listforwardrollups_command = {
+	"listforwardrollups",
+	"channels",
+	json_listforwardrollups,
+	"List hourly totals of resolved forwards, optionally filtering by [in_channel], [out_channel], and buckets starting from [start_time] until before [end_time]"
+};
+AUTODATA(json_command, &listforwardrollups_command);
+
 static struct command_result *param_channel(struct command *cmd,
 					    const char *name,
 					    const char *buffer,
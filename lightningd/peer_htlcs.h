@@ -67,6 +67,9 @@ void fixup_htlcs_out(struct lightningd *ld);
 void htlcs_resubmit(struct lightningd *ld,
 		    struct htlc_in_map *unconnected_htlcs_in);
 
+/* Start moving resolved HTLCs out of the live table, in the background. */
+void htlcs_start_archiving(struct lightningd *ld);
+
 /* For HTLCs which terminate here, invoice payment calls one of these. */
 void fulfill_htlc(struct htlc_in *hin, const struct preimage *preimage);
 void local_fail_in_htlc(struct htlc_in *hin, const u8 *failmsg TAKES);
@@ -76,7 +79,7 @@ void local_fail_in_htlc_needs_update(struct htlc_in *hin,
 
 /* This json process will be used as the serialize method for
  * forward_event_notification_gen and be used in
- * `listforwardings_add_forwardings()`. */
+ * `listforwards`. */
 void json_add_forwarding_object(struct json_stream *response,
 				const char *fieldname,
 				const struct forwarding *cur,
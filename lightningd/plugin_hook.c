@@ -3,9 +3,12 @@
 #include <ccan/tal/str/str.h>
 #include <common/json_parse.h>
 #include <common/memleak.h>
+#include <db/common.h>
 #include <db/exec.h>
 #include <db/utils.h>
+#include <inttypes.h>
 #include <lightningd/plugin_hook.h>
+#include <wire/wire.h>
 
 /* Struct containing all the information needed to deserialize and
  * dispatch an eventual plugin_hook response. */
@@ -346,6 +349,285 @@ static void db_hook_response(const char *buffer, const jsmntok_t *toks,
 	io_break(dwh_req->ph_req);
 }
 
+/* `db_write_stream` is the pipelined alternative to `db_write`: rather
+ * than expanded SQL, each transaction is sent as a batch of compact
+ * change records (see plugin_hook_db_record), and we only stop to wait
+ * once a plugin has more than --db-write-stream-window batches it hasn't
+ * acknowledged. */
+static struct plugin_hook db_write_stream_hook = {"db_write_stream", NULL, NULL};
+AUTODATA(hooks, &db_write_stream_hook);
+
+/* Change records for the current transaction, and the query_table
+ * slots they refer to (possibly repeated). */
+static u8 *db_stream_records;
+static u32 *db_stream_slots;
+
+/* Records say which query they used by query_table slot, or this
+ * followed by the SQL itself (for db_prepare_untranslated()). */
+#define DB_STREAM_QUERY_INLINE 0xFFFFFFFF
+
+/* Types of bound parameters in change records. */
+enum db_stream_param {
+	DB_STREAM_NULL = 0,
+	DB_STREAM_INT = 1,
+	DB_STREAM_U64 = 2,
+	DB_STREAM_TEXT = 3,
+	DB_STREAM_BLOB = 4,
+};
+
+/* One for each plugin subscribed to db_write_stream. */
+struct db_stream {
+	struct plugin *plugin;
+
+	/* Sequence number of the next batch we send, and of the next batch
+	 * we expect to be acknowledged: batches are acknowledged in order. */
+	u64 next_seq, next_ack;
+
+	/* Which query_table entries we've already sent it the text of. */
+	bool *query_sent;
+
+	/* Are we in plugins_exclusive_loop waiting for it? */
+	bool waiting;
+};
+static struct db_stream **db_streams;
+
+struct db_stream_batch {
+	struct db_stream *stream;
+	u64 seq;
+};
+
+static void destroy_db_stream(struct db_stream *stream)
+{
+	/* We can't leave plugins_exclusive_loop using a freed plugin. */
+	if (stream->waiting)
+		fatal("Plugin '%s' died with unacknowledged db_write_stream"
+		      " batches", stream->plugin->cmd);
+
+	if (stream->next_ack != stream->next_seq)
+		log_broken(stream->plugin->plugins->ld->log,
+			   "Plugin '%s' died with %"PRIu64" unacknowledged"
+			   " db_write_stream batches",
+			   stream->plugin->cmd,
+			   stream->next_seq - stream->next_ack);
+
+	for (size_t i = 0; i < tal_count(db_streams); i++) {
+		if (db_streams[i] == stream) {
+			tal_arr_remove(&db_streams, i);
+			return;
+		}
+	}
+	abort();
+}
+
+static struct db_stream *db_stream_for(struct plugin *plugin,
+				       const struct db *db)
+{
+	struct db_stream *stream;
+
+	for (size_t i = 0; i < tal_count(db_streams); i++)
+		if (db_streams[i]->plugin == plugin)
+			return db_streams[i];
+
+	if (!db_streams)
+		db_streams = notleak(tal_arr(NULL, struct db_stream *, 0));
+
+	stream = tal(plugin, struct db_stream);
+	stream->plugin = plugin;
+	stream->next_seq = stream->next_ack = 0;
+	stream->query_sent = tal_arrz(stream, bool,
+				      db->queries->query_table_size);
+	stream->waiting = false;
+	tal_arr_expand(&db_streams, stream);
+	tal_add_destructor(stream, destroy_db_stream);
+	return stream;
+}
+
+static u64 db_stream_window(const struct db_stream *stream)
+{
+	return stream->plugin->plugins->ld->db_write_stream_window;
+}
+
+static void db_stream_response(const char *buffer, const jsmntok_t *toks,
+			       const jsmntok_t *idtok,
+			       struct db_stream_batch *batch)
+{
+	struct db_stream *stream = batch->stream;
+	const jsmntok_t *resulttok;
+
+	resulttok = json_get_member(buffer, toks, "result");
+	if (resulttok)
+		resulttok = json_get_member(buffer, resulttok, "result");
+	if (!resulttok || !json_tok_streq(buffer, resulttok, "continue"))
+		fatal("Plugin '%s' returned failed db_write_stream: %.*s",
+		      stream->plugin->cmd,
+		      json_tok_full_len(toks),
+		      json_tok_full(buffer, toks));
+
+	if (batch->seq != stream->next_ack)
+		fatal("Plugin '%s' acknowledged db_write_stream batch %"PRIu64
+		      " before batch %"PRIu64,
+		      stream->plugin->cmd, batch->seq, stream->next_ack);
+	stream->next_ack++;
+	tal_free(batch);
+
+	/* db_stream_wait will check if this was enough. */
+	if (stream->waiting) {
+		stream->waiting = false;
+		log_debug(stream->plugin->plugins->ld->log,
+			  "io_break: %s", __func__);
+		io_break(stream);
+	}
+}
+
+/* Wait until no more than window batches are unacknowledged. */
+static void db_stream_wait(struct db_stream *stream, u64 window)
+{
+	struct plugin **plugins;
+	void *ret, *outer = NULL;
+
+	if (stream->next_seq - stream->next_ack <= window)
+		return;
+
+	plugins = notleak(tal_arr(NULL, struct plugin *, 1));
+	plugins[0] = stream->plugin;
+	while (stream->next_seq - stream->next_ack > window) {
+		stream->waiting = true;
+		/* As in plugin_hook_db_sync, we might already be breaking:
+		 * remember that, and hand it onwards once we're done. */
+		ret = plugins_exclusive_loop(plugins);
+		if (ret != stream) {
+			assert(!outer);
+			outer = ret;
+		}
+	}
+	stream->waiting = false;
+	tal_free(plugins);
+
+	if (outer) {
+		log_debug(stream->plugin->plugins->ld->log,
+			  "io_break: %s", __func__);
+		io_break(outer);
+	}
+}
+
+void plugin_hook_db_record(struct db_stmt *stmt)
+{
+	const char *query = stmt->query->query;
+
+	if (tal_count(db_write_stream_hook.hooks) == 0)
+		return;
+
+	if (!db_stream_records) {
+		db_stream_records = notleak(tal_arr(NULL, u8, 0));
+		db_stream_slots = notleak(tal_arr(NULL, u32, 0));
+	}
+
+	if (stmt->query_slot < 0) {
+		towire_u32(&db_stream_records, DB_STREAM_QUERY_INLINE);
+		towire_u32(&db_stream_records, strlen(query));
+		towire(&db_stream_records, query, strlen(query));
+	} else {
+		towire_u32(&db_stream_records, stmt->query_slot);
+		tal_arr_expand(&db_stream_slots, stmt->query_slot);
+	}
+
+	towire_u16(&db_stream_records, tal_count(stmt->bindings));
+	for (size_t i = 0; i < tal_count(stmt->bindings); i++) {
+		const struct db_binding *b = &stmt->bindings[i];
+		switch (b->type) {
+		case DB_BINDING_UNINITIALIZED:
+		case DB_BINDING_NULL:
+			towire_u8(&db_stream_records, DB_STREAM_NULL);
+			continue;
+		case DB_BINDING_INT:
+			towire_u8(&db_stream_records, DB_STREAM_INT);
+			towire_u32(&db_stream_records, b->v.i);
+			continue;
+		case DB_BINDING_UINT64:
+			towire_u8(&db_stream_records, DB_STREAM_U64);
+			towire_u64(&db_stream_records, b->v.u64);
+			continue;
+		case DB_BINDING_TEXT:
+			towire_u8(&db_stream_records, DB_STREAM_TEXT);
+			towire_u32(&db_stream_records, b->len);
+			towire(&db_stream_records, b->v.text, b->len);
+			continue;
+		case DB_BINDING_BLOB:
+			towire_u8(&db_stream_records, DB_STREAM_BLOB);
+			towire_u32(&db_stream_records, b->len);
+			towire(&db_stream_records, b->v.blob, b->len);
+			continue;
+		}
+		abort();
+	}
+}
+
+static void db_stream_send(struct db_stream *stream, struct db *db)
+{
+	struct jsonrpc_request *req;
+	struct db_stream_batch *batch;
+
+	batch = tal(stream, struct db_stream_batch);
+	batch->stream = stream;
+	batch->seq = stream->next_seq++;
+
+	req = jsonrpc_request_start(NULL, db_write_stream_hook.name, NULL,
+				    stream->plugin->non_numeric_ids,
+				    NULL, NULL,
+				    db_stream_response,
+				    batch);
+	json_add_u64(req->stream, "seq", batch->seq);
+	json_add_num(req->stream, "data_version", db_data_version_get(db));
+
+	/* Text of any queries it hasn't seen before. */
+	json_array_start(req->stream, "queries");
+	for (size_t i = 0; i < tal_count(db_stream_slots); i++) {
+		u32 slot = db_stream_slots[i];
+		if (stream->query_sent[slot])
+			continue;
+		json_object_start(req->stream, NULL);
+		json_add_u32(req->stream, "id", slot);
+		json_add_string(req->stream, "query",
+				db->queries->query_table[slot].query);
+		json_object_end(req->stream);
+		stream->query_sent[slot] = true;
+	}
+	json_array_end(req->stream);
+	json_add_hex_talarr(req->stream, "changes", db_stream_records);
+	jsonrpc_request_end(req);
+
+	plugin_request_send(stream->plugin, req);
+}
+
+/* Send this transaction's change records to every db_write_stream
+ * plugin, then wait for any which are too far behind. */
+static void db_stream_sync(struct db *db)
+{
+	const struct plugin_hook *hook = &db_write_stream_hook;
+	struct db_stream **streams;
+
+	if (tal_count(db_stream_records) == 0)
+		return;
+
+	streams = tal_arr(tmpctx, struct db_stream *, tal_count(hook->hooks));
+	for (size_t i = 0; i < tal_count(hook->hooks); i++) {
+		streams[i] = db_stream_for(hook->hooks[i]->plugin, db);
+		db_stream_send(streams[i], db);
+	}
+
+	tal_resize(&db_stream_records, 0);
+	tal_resize(&db_stream_slots, 0);
+
+	for (size_t i = 0; i < tal_count(streams); i++)
+		db_stream_wait(streams[i], db_stream_window(streams[i]));
+}
+
+void plugin_hook_db_stream_drain(void)
+{
+	for (size_t i = 0; i < tal_count(db_streams); i++)
+		db_stream_wait(db_streams[i], 0);
+}
+
 void plugin_hook_db_sync(struct db *db)
 {
 	const struct plugin_hook *hook = &db_write_hook;
@@ -357,8 +639,13 @@ void plugin_hook_db_sync(struct db *db)
 	size_t num_hooks;
 
 	const char **changes = db_changes(db);
+
+	db_stream_sync(db);
+
 	num_hooks = tal_count(hook->hooks);
-	if (num_hooks == 0)
+	/* We're also called for dirty transactions without expanded SQL
+	 * (e.g. postgres), which are only interesting to db_write_stream. */
+	if (num_hooks == 0 || tal_count(changes) == 0)
 		return;
 
 	plugins = notleak(tal_arr(NULL, struct plugin *,
@@ -4,6 +4,8 @@
 #include "config.h"
 #include <lightningd/plugin.h>
 
+struct db_stmt;
+
 /**
  * Plugin hooks are a way for plugins to implement custom behavior and
  * reactions to certain things in `lightningd`. `lightningd` will ask
@@ -113,6 +115,12 @@ struct plugin_hook *plugin_hook_register(struct plugin *plugin,
 /* Special sync plugin hook for db. */
 void plugin_hook_db_sync(struct db *db);
 
+/* Record a modifying statement for db_write_stream (db->record_change_fn) */
+void plugin_hook_db_record(struct db_stmt *stmt);
+
+/* Wait until db_write_stream plugins have acknowledged everything. */
+void plugin_hook_db_stream_drain(void);
+
 /* Add dependencies for this hook. */
 void plugin_hook_add_deps(struct plugin_hook *hook,
 			  struct plugin *plugin,
@@ -15,6 +15,7 @@
 #include <fcntl.h>
 #include <lightningd/lightningd.h>
 #include <lightningd/log_status.h>
+#include <lightningd/metrics.h>
 #include <lightningd/peer_fd.h>
 #include <lightningd/subd.h>
 #include <sys/socket.h>
@@ -762,6 +763,7 @@ static struct subd *new_subd(const tal_t *ctx,
 	sd->billboardcb = billboardcb;
 	sd->fds_in = NULL;
 	sd->outq = msg_queue_new(sd, true);
+	sd->metrics = metrics_for_subd(ld->metrics, shortname);
 	sd->wstatus = NULL;
 	list_add(&ld->subds, &sd->list);
 	tal_add_destructor(sd, destroy_subd);
@@ -831,6 +833,15 @@ struct subd *new_channel_subd_(const tal_t *ctx,
 	return sd;
 }
 
+static void subd_sent_metrics(struct subd *sd)
+{
+	size_t len = msg_queue_length(sd->outq);
+
+	sd->metrics->msgs_sent++;
+	if (len > sd->metrics->max_queued)
+		sd->metrics->max_queued = len;
+}
+
 void subd_send_msg(struct subd *sd, const u8 *msg_out)
 {
 	u16 type = fromwire_peektype(msg_out);
@@ -839,11 +850,13 @@ void subd_send_msg(struct subd *sd, const u8 *msg_out)
 	if (strstarts(sd->msgname(type), "INVALID"))
 		fatal("Sending %s an invalid message %s", sd->name, tal_hex(tmpctx, msg_out));
 	msg_enqueue(sd->outq, msg_out);
+	subd_sent_metrics(sd);
 }
 
 void subd_send_fd(struct subd *sd, int fd)
 {
 	msg_enqueue_fd(sd->outq, fd);
+	subd_sent_metrics(sd);
 }
 
 struct subd_req *subd_req_(const tal_t *ctx,
@@ -12,6 +12,7 @@
 struct crypto_state;
 struct io_conn;
 struct peer_fd;
+struct subd_metrics;
 
 /* By convention, replies are requests + 100 */
 #define SUBD_REPLY_OFFSET 100
@@ -75,6 +76,9 @@ struct subd {
 	/* Messages queue up here. */
 	struct msg_queue *outq;
 
+	/* Counters shared by all subds of this name. */
+	struct subd_metrics *metrics;
+
 	/* Callbacks for replies. */
 	struct list_head reqs;
 
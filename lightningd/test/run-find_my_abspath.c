@@ -40,9 +40,18 @@ void db_commit_transaction(struct db *db UNNEEDED)
 /* Generated stub for db_get_intvar */
 s64 db_get_intvar(struct db *db UNNEEDED, char *varname UNNEEDED, s64 defval UNNEEDED)
 { fprintf(stderr, "db_get_intvar called!\n"); abort(); }
+/* Generated stub for db_group_commit_flush */
+void db_group_commit_flush(struct db *db UNNEEDED)
+{ fprintf(stderr, "db_group_commit_flush called!\n"); abort(); }
+/* Generated stub for db_group_commit_pending */
+bool db_group_commit_pending(const struct db *db UNNEEDED, struct timemono *since UNNEEDED)
+{ fprintf(stderr, "db_group_commit_pending called!\n"); abort(); }
 /* Generated stub for db_in_transaction */
 bool db_in_transaction(struct db *db UNNEEDED)
 { fprintf(stderr, "db_in_transaction called!\n"); abort(); }
+/* Generated stub for db_set_group_commit */
+void db_set_group_commit(struct db *db UNNEEDED, bool enable UNNEEDED)
+{ fprintf(stderr, "db_set_group_commit called!\n"); abort(); }
 /* Generated stub for discard_key */
 void discard_key(struct secret *key TAKES UNNEEDED)
 { fprintf(stderr, "discard_key called!\n"); abort(); }
@@ -111,6 +120,9 @@ void htlcs_notify_new_block(struct lightningd *ld UNNEEDED, u32 height UNNEEDED)
 void htlcs_resubmit(struct lightningd *ld UNNEEDED,
 		    struct htlc_in_map *unconnected_htlcs_in UNNEEDED)
 { fprintf(stderr, "htlcs_resubmit called!\n"); abort(); }
+/* Generated stub for htlcs_start_archiving */
+void htlcs_start_archiving(struct lightningd *ld UNNEEDED)
+{ fprintf(stderr, "htlcs_start_archiving called!\n"); abort(); }
 /* Generated stub for jsonrpc_listen */
 void jsonrpc_listen(struct jsonrpc *rpc UNNEEDED, struct lightningd *ld UNNEEDED)
 { fprintf(stderr, "jsonrpc_listen called!\n"); abort(); }
@@ -150,6 +162,9 @@ bool log_status_msg(struct log *log UNNEEDED,
  		    const struct node_id *node_id UNNEEDED,
 		    const u8 *msg UNNEEDED)
 { fprintf(stderr, "log_status_msg called!\n"); abort(); }
+/* Generated stub for metrics_listen */
+void metrics_listen(struct metrics *metrics UNNEEDED)
+{ fprintf(stderr, "metrics_listen called!\n"); abort(); }
 /* Generated stub for new_log */
 struct log *new_log(const tal_t *ctx UNNEEDED, struct log_book *record UNNEEDED,
 		    const struct node_id *default_node_id UNNEEDED,
@@ -158,6 +173,9 @@ struct log *new_log(const tal_t *ctx UNNEEDED, struct log_book *record UNNEEDED,
 /* Generated stub for new_log_book */
 struct log_book *new_log_book(struct lightningd *ld UNNEEDED, size_t max_mem UNNEEDED)
 { fprintf(stderr, "new_log_book called!\n"); abort(); }
+/* Generated stub for new_metrics */
+struct metrics *new_metrics(struct lightningd *ld UNNEEDED)
+{ fprintf(stderr, "new_metrics called!\n"); abort(); }
 /* Generated stub for new_peer_fd_arr */
 struct peer_fd *new_peer_fd_arr(const tal_t *ctx UNNEEDED, const int *fd UNNEEDED)
 { fprintf(stderr, "new_peer_fd_arr called!\n"); abort(); }
@@ -167,6 +185,9 @@ struct chain_topology *new_topology(struct lightningd *ld UNNEEDED, struct log *
 /* Generated stub for onchaind_replay_channels */
 void onchaind_replay_channels(struct lightningd *ld UNNEEDED)
 { fprintf(stderr, "onchaind_replay_channels called!\n"); abort(); }
+/* Generated stub for plugin_hook_db_stream_drain */
+void plugin_hook_db_stream_drain(void)
+{ fprintf(stderr, "plugin_hook_db_stream_drain called!\n"); abort(); }
 /* Generated stub for plugins_config */
 bool plugins_config(struct plugins *plugins UNNEEDED)
 { fprintf(stderr, "plugins_config called!\n"); abort(); }
@@ -147,6 +147,15 @@ struct command_result *command_param_failed(void)
 struct command_result *command_still_pending(struct command *cmd)
 
 { fprintf(stderr, "command_still_pending called!\n"); abort(); }
+/* Generated stub for command_stream_success_ */
+struct command_result *command_stream_success_(struct command *cmd UNNEEDED,
+					       struct json_stream *response UNNEEDED,
+					       struct command_result *(*more)(struct command *cmd UNNEEDED,
+									      struct json_stream *response UNNEEDED,
+									      void *arg) UNNEEDED,
+					       void *arg UNNEEDED)
+
+{ fprintf(stderr, "command_stream_success_ called!\n"); abort(); }
 /* Generated stub for command_success */
 struct command_result *command_success(struct command *cmd UNNEEDED,
 				       struct json_stream *response)
@@ -445,11 +454,13 @@ void json_add_u64(struct json_stream *result UNNEEDED, const char *fieldname UNN
 { fprintf(stderr, "json_add_u64 called!\n"); abort(); }
 /* Generated stub for json_add_uncommitted_channel */
 void json_add_uncommitted_channel(struct json_stream *response UNNEEDED,
-				  const struct uncommitted_channel *uc UNNEEDED)
+				  const struct uncommitted_channel *uc UNNEEDED,
+				  const struct peer *peer UNNEEDED)
 { fprintf(stderr, "json_add_uncommitted_channel called!\n"); abort(); }
 /* Generated stub for json_add_unsaved_channel */
 void json_add_unsaved_channel(struct json_stream *response UNNEEDED,
-			      const struct channel *channel UNNEEDED)
+			      const struct channel *channel UNNEEDED,
+			      const struct peer *peer UNNEEDED)
 { fprintf(stderr, "json_add_unsaved_channel called!\n"); abort(); }
 /* Generated stub for json_array_end */
 void json_array_end(struct json_stream *js UNNEEDED)
@@ -622,6 +633,13 @@ struct command_result *param_escaped_string(struct command *cmd UNNEEDED,
 					    const jsmntok_t *tok UNNEEDED,
 					    const char **str UNNEEDED)
 { fprintf(stderr, "param_escaped_string called!\n"); abort(); }
+/* Generated stub for param_index */
+struct command_result *param_index(struct command *cmd UNNEEDED,
+				   const char *name UNNEEDED,
+				   const char *buffer UNNEEDED,
+				   const jsmntok_t *tok UNNEEDED,
+				   enum wait_index **index UNNEEDED)
+{ fprintf(stderr, "param_index called!\n"); abort(); }
 /* Generated stub for param_label */
 struct command_result *param_label(struct command *cmd UNNEEDED, const char *name UNNEEDED,
 				   const char * buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
@@ -668,6 +686,11 @@ struct command_result *param_string(struct command *cmd UNNEEDED, const char *na
 				    const char * buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
 				    const char **str UNNEEDED)
 { fprintf(stderr, "param_string called!\n"); abort(); }
+/* Generated stub for param_u32 */
+struct command_result *param_u32(struct command *cmd UNNEEDED, const char *name UNNEEDED,
+				 const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
+				 uint32_t **num UNNEEDED)
+{ fprintf(stderr, "param_u32 called!\n"); abort(); }
 /* Generated stub for param_u64 */
 struct command_result *param_u64(struct command *cmd UNNEEDED, const char *name UNNEEDED,
 				 const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
@@ -801,6 +824,12 @@ void try_reconnect(const tal_t *ctx UNNEEDED,
 		   struct peer *peer UNNEEDED,
 		   const struct wireaddr_internal *addrhint UNNEEDED)
 { fprintf(stderr, "try_reconnect called!\n"); abort(); }
+/* Generated stub for txowatch_set_script */
+void txowatch_set_script(struct txowatch *w UNNEEDED, const u8 *script TAKES UNNEEDED)
+{ fprintf(stderr, "txowatch_set_script called!\n"); abort(); }
+/* Generated stub for txwatch_set_script */
+void txwatch_set_script(struct txwatch *w UNNEEDED, const u8 *script TAKES UNNEEDED)
+{ fprintf(stderr, "txwatch_set_script called!\n"); abort(); }
 /* Generated stub for version */
 const char *version(void)
 { fprintf(stderr, "version called!\n"); abort(); }
@@ -820,6 +849,10 @@ void wallet_channeltxs_add(struct wallet *w UNNEEDED, struct channel *chan UNNEE
 			    const int type UNNEEDED, const struct bitcoin_txid *txid UNNEEDED,
 			   const u32 input_num UNNEEDED, const u32 blockheight UNNEEDED)
 { fprintf(stderr, "wallet_channeltxs_add called!\n"); abort(); }
+/* Generated stub for wallet_closed_channels_load */
+struct closed_channel *wallet_closed_channels_load(const tal_t *ctx UNNEEDED,
+						   struct wallet *w UNNEEDED)
+{ fprintf(stderr, "wallet_closed_channels_load called!\n"); abort(); }
 /* Generated stub for wallet_htlcs_load_in_for_channel */
 bool wallet_htlcs_load_in_for_channel(struct wallet *wallet UNNEEDED,
 				      struct channel *chan UNNEEDED,
@@ -859,6 +892,12 @@ bool wallet_invoice_delete_description(struct wallet *wallet UNNEEDED,
 void wallet_invoice_delete_expired(struct wallet *wallet UNNEEDED,
 				   u64 max_expiry_time UNNEEDED)
 { fprintf(stderr, "wallet_invoice_delete_expired called!\n"); abort(); }
+/* Generated stub for wallet_invoice_delete_older */
+u64 wallet_invoice_delete_older(struct wallet *wallet UNNEEDED,
+				enum invoice_status state UNNEEDED,
+				u64 max_time UNNEEDED, u32 limit UNNEEDED,
+				u64 *remaining UNNEEDED)
+{ fprintf(stderr, "wallet_invoice_delete_older called!\n"); abort(); }
 /* Generated stub for wallet_invoice_details */
 struct invoice_details *wallet_invoice_details(const tal_t *ctx UNNEEDED,
 					       struct wallet *wallet UNNEEDED,
@@ -881,7 +920,10 @@ bool wallet_invoice_find_unpaid(struct wallet *wallet UNNEEDED,
 { fprintf(stderr, "wallet_invoice_find_unpaid called!\n"); abort(); }
 /* Generated stub for wallet_invoice_iterate */
 bool wallet_invoice_iterate(struct wallet *wallet UNNEEDED,
-			    struct invoice_iterator *it UNNEEDED)
+			    struct invoice_iterator *it UNNEEDED,
+			    const enum wait_index *listindex UNNEEDED,
+			    u64 liststart UNNEEDED,
+			    const u32 *listlimit UNNEEDED)
 { fprintf(stderr, "wallet_invoice_iterate called!\n"); abort(); }
 /* Generated stub for wallet_invoice_iterator_deref */
 const struct invoice_details *wallet_invoice_iterator_deref(const tal_t *ctx UNNEEDED,
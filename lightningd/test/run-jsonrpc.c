@@ -52,6 +52,11 @@ void log_io(struct log *log UNNEEDED, enum log_level dir UNNEEDED,
 /* Generated stub for log_level_name */
 const char *log_level_name(enum log_level level UNNEEDED)
 { fprintf(stderr, "log_level_name called!\n"); abort(); }
+/* Generated stub for metrics_command_done */
+void metrics_command_done(struct metrics *metrics UNNEEDED,
+			  const char *method UNNEEDED,
+			  struct timerel elapsed UNNEEDED)
+{ fprintf(stderr, "metrics_command_done called!\n"); abort(); }
 /* Generated stub for new_log */
 struct log *new_log(const tal_t *ctx UNNEEDED, struct log_book *record UNNEEDED,
 		    const struct node_id *default_node_id UNNEEDED,
@@ -93,6 +93,10 @@ bool log_status_msg(struct log *log UNNEEDED,
  		    const struct node_id *node_id UNNEEDED,
 		    const u8 *msg UNNEEDED)
 { fprintf(stderr, "log_status_msg called!\n"); abort(); }
+/* Generated stub for metrics_for_subd */
+struct subd_metrics *metrics_for_subd(struct metrics *metrics UNNEEDED,
+				      const char *name UNNEEDED)
+{ fprintf(stderr, "metrics_for_subd called!\n"); abort(); }
 /* Generated stub for new_log */
 struct log *new_log(const tal_t *ctx UNNEEDED, struct log_book *record UNNEEDED,
 		    const struct node_id *default_node_id UNNEEDED,
@@ -0,0 +1,282 @@
+/* Code to allow users to wait on changes to the list commands.
+ *
+ * Each subsystem (forwards, sendpays, invoices) has three monotonic
+ * indexes: "created", "updated" and "deleted".  Every row carries its
+ * created_index and (once changed) its updated_index, so a client can
+ * `wait` for an index to reach a value, then call the matching list
+ * command with `index` and `start` to get only the rows which changed.
+ */
+#include "config.h"
+#include <ccan/array_size/array_size.h>
+#include <ccan/build_assert/build_assert.h>
+#include <ccan/tal/str/str.h>
+#include <common/json_command.h>
+#include <common/json_param.h>
+#include <db/exec.h>
+#include <lightningd/jsonrpc.h>
+#include <lightningd/lightningd.h>
+#include <lightningd/wait.h>
+#include <wallet/wallet.h>
+
+struct waiter {
+	struct list_node list;
+	struct command *cmd;
+	/* These are pointers because of how param_ works */
+	enum wait_subsystem *subsystem;
+	enum wait_index *index;
+	u64 *nextval;
+};
+
+static const char *subsystem_names[] = {
+	"forwards",
+	"sendpays",
+	"invoices",
+};
+
+static const char *index_names[] = {
+	"created",
+	"updated",
+	"deleted",
+};
+
+const char *wait_subsystem_name(enum wait_subsystem subsystem)
+{
+	/* This is part of the API, so check it! */
+	BUILD_ASSERT(ARRAY_SIZE(subsystem_names) == NUM_WAIT_SUBSYSTEM);
+
+	switch (subsystem) {
+	case WAIT_SUBSYSTEM_FORWARD:
+	case WAIT_SUBSYSTEM_SENDPAY:
+	case WAIT_SUBSYSTEM_INVOICE:
+		return subsystem_names[subsystem];
+	}
+	abort();
+}
+
+const char *wait_index_name(enum wait_index index)
+{
+	BUILD_ASSERT(ARRAY_SIZE(index_names) == NUM_WAIT_INDEX);
+
+	switch (index) {
+	case WAIT_INDEX_CREATED:
+	case WAIT_INDEX_UPDATED:
+	case WAIT_INDEX_DELETED:
+		return index_names[index];
+	}
+	abort();
+}
+
+/* The db variable we keep each index in, eg. "last_invoices_created_index" */
+static char *index_varname(const tal_t *ctx,
+			   enum wait_subsystem subsystem,
+			   enum wait_index index)
+{
+	return tal_fmt(ctx, "last_%s_%s_index",
+		       wait_subsystem_name(subsystem),
+		       wait_index_name(index));
+}
+
+void load_indexes(struct db *db, struct indexes *indexes)
+{
+	for (size_t s = 0; s < NUM_WAIT_SUBSYSTEM; s++) {
+		for (size_t i = 0; i < NUM_WAIT_INDEX; i++) {
+			indexes[s].i[i] = db_get_intvar(db,
+							index_varname(tmpctx, s, i),
+							0);
+		}
+	}
+}
+
+static void json_add_index(struct json_stream *response,
+			   enum wait_subsystem subsystem,
+			   enum wait_index index,
+			   u64 val,
+			   va_list *ap)
+{
+	const char *name, *value;
+
+	json_add_string(response, "subsystem", wait_subsystem_name(subsystem));
+	json_add_u64(response, wait_index_name(index), val);
+
+	if (!ap)
+		return;
+
+	json_object_start(response, "details");
+	while ((name = va_arg(*ap, const char *)) != NULL) {
+		value = va_arg(*ap, const char *);
+		if (!value)
+			continue;
+
+		/* A leading '=' means it's a number, not a string. */
+		if (name[0] == '=')
+			json_add_primitive(response, name + 1, value);
+		else
+			json_add_string(response, name, value);
+	}
+	json_object_end(response);
+}
+
+static void wait_updated(struct lightningd *ld,
+			 enum wait_subsystem subsystem,
+			 enum wait_index index,
+			 u64 val,
+			 va_list *ap)
+{
+	struct waiter *i, *n;
+
+	list_for_each_safe(&ld->wait_commands, i, n, list) {
+		struct json_stream *response;
+		va_list ap2;
+
+		if (*i->subsystem != subsystem)
+			continue;
+		if (*i->index != index)
+			continue;
+		if (val < *i->nextval)
+			continue;
+
+		response = json_stream_success(i->cmd);
+		/* Each waiter needs to walk the same details again. */
+		va_copy(ap2, *ap);
+		json_add_index(response, subsystem, index, val, &ap2);
+		va_end(ap2);
+
+		/* This frees i, and its destructor removes it from the list. */
+		was_pending(command_success(i->cmd, response));
+	}
+}
+
+static u64 wait_index_add(struct lightningd *ld,
+			  enum wait_subsystem subsystem,
+			  enum wait_index index,
+			  u64 num,
+			  va_list *ap)
+{
+	u64 *idx = &ld->indexes[subsystem].i[index];
+
+	/* FIXME: We could lazily write this only on delete, since it's
+	 * otherwise always the max of the column in the table. */
+	*idx += num;
+	db_set_intvar(ld->wallet->db,
+		      index_varname(tmpctx, subsystem, index), *idx);
+
+	wait_updated(ld, subsystem, index, *idx, ap);
+	return *idx;
+}
+
+u64 wait_index_increment(struct lightningd *ld,
+			 enum wait_subsystem subsystem,
+			 enum wait_index index,
+			 ...)
+{
+	va_list ap;
+	u64 ret;
+
+	va_start(ap, index);
+	ret = wait_index_add(ld, subsystem, index, 1, &ap);
+	va_end(ap);
+
+	return ret;
+}
+
+u64 wait_index_increase(struct lightningd *ld,
+			enum wait_subsystem subsystem,
+			enum wait_index index,
+			u64 num,
+			...)
+{
+	va_list ap;
+	u64 ret;
+
+	/* Nothing changed, so don't wake anyone. */
+	if (num == 0)
+		return ld->indexes[subsystem].i[index];
+
+	va_start(ap, num);
+	ret = wait_index_add(ld, subsystem, index, num, &ap);
+	va_end(ap);
+
+	return ret;
+}
+
+static struct command_result *param_subsystem(struct command *cmd,
+					      const char *name,
+					      const char *buffer,
+					      const jsmntok_t *tok,
+					      enum wait_subsystem **subsystem)
+{
+	for (size_t i = 0; i < NUM_WAIT_SUBSYSTEM; i++) {
+		if (json_tok_streq(buffer, tok, wait_subsystem_name(i))) {
+			*subsystem = tal(cmd, enum wait_subsystem);
+			**subsystem = i;
+			return NULL;
+		}
+	}
+	return command_fail_badparam(cmd, name, buffer, tok,
+				     "unknown subsystem");
+}
+
+struct command_result *param_index(struct command *cmd,
+				   const char *name,
+				   const char *buffer,
+				   const jsmntok_t *tok,
+				   enum wait_index **index)
+{
+	for (size_t i = 0; i < NUM_WAIT_INDEX; i++) {
+		if (json_tok_streq(buffer, tok, wait_index_name(i))) {
+			*index = tal(cmd, enum wait_index);
+			**index = i;
+			return NULL;
+		}
+	}
+	return command_fail_badparam(cmd, name, buffer, tok,
+				     "unknown index");
+}
+
+static void destroy_waiter(struct waiter *waiter)
+{
+	list_del(&waiter->list);
+}
+
+static struct command_result *json_wait(struct command *cmd,
+					const char *buffer,
+					const jsmntok_t *obj UNNEEDED,
+					const jsmntok_t *params)
+{
+	struct waiter *waiter = tal(cmd, struct waiter);
+	u64 val;
+
+	if (!param(cmd, buffer, params,
+		   p_req("subsystem", param_subsystem,
+			 &waiter->subsystem),
+		   p_req("indexname", param_index, &waiter->index),
+		   p_req("nextvalue", param_u64, &waiter->nextval),
+		   NULL))
+		return command_param_failed();
+
+	/* Are we there already?  Return immediately. */
+	val = cmd->ld->indexes[*waiter->subsystem].i[*waiter->index];
+	if (val >= *waiter->nextval) {
+		struct json_stream *response;
+
+		response = json_stream_success(cmd);
+		json_add_index(response,
+			       *waiter->subsystem,
+			       *waiter->index,
+			       val, NULL);
+		return command_success(cmd, response);
+	}
+
+	waiter->cmd = cmd;
+	list_add_tail(&cmd->ld->wait_commands, &waiter->list);
+	tal_add_destructor(waiter, destroy_waiter);
+	return command_still_pending(cmd);
+}
+
+static const struct json_command wait_command = {
+	"wait",
+	"utility",
+	json_wait,
+	"Wait for {subsystem} {indexname} to reach or exceed {nextvalue}",
+};
+AUTODATA(json_command, &wait_command);
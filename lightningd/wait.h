@@ -0,0 +1,93 @@
+/* Generic monotonic change indexes, and the `wait` command to block on them */
+#ifndef LIGHTNING_LIGHTNINGD_WAIT_H
+#define LIGHTNING_LIGHTNINGD_WAIT_H
+#include "config.h"
+#include <ccan/compiler/compiler.h>
+#include <ccan/short_types/short_types.h>
+#include <common/json_parse_simple.h>
+
+struct command;
+struct db;
+struct lightningd;
+
+/* This WAIT_SUBSYSTEM_X corresponds to listX */
+enum wait_subsystem {
+	WAIT_SUBSYSTEM_FORWARD,
+	WAIT_SUBSYSTEM_SENDPAY,
+	WAIT_SUBSYSTEM_INVOICE,
+};
+#define NUM_WAIT_SUBSYSTEM (WAIT_SUBSYSTEM_INVOICE+1)
+
+enum wait_index {
+	WAIT_INDEX_CREATED,
+	WAIT_INDEX_UPDATED,
+	WAIT_INDEX_DELETED,
+};
+#define NUM_WAIT_INDEX (WAIT_INDEX_DELETED+1)
+
+/**
+ * struct indexes - the current index values for one subsystem.
+ *
+ * Each one only ever increases: created is bumped when a row is
+ * added, updated when a row changes, and deleted when one is removed.
+ */
+struct indexes {
+	u64 i[NUM_WAIT_INDEX];
+};
+
+/* Names used in the API ("forwards", "created" etc.) */
+const char *wait_subsystem_name(enum wait_subsystem subsystem);
+const char *wait_index_name(enum wait_index index);
+
+/* Extract "created", "updated" or "deleted" (list commands use this too). */
+struct command_result *param_index(struct command *cmd,
+				   const char *name,
+				   const char *buffer,
+				   const jsmntok_t *tok,
+				   enum wait_index **index);
+
+/**
+ * wait_index_increment - increment an index, tell waiters.
+ * @ld: the lightningd
+ * @subsystem: subsystem for index
+ * @index: which index
+ * ...: name/value pairs, followed by NULL.
+ *
+ * A value can be NULL, which means it's omitted.  A name which starts
+ * with '=' is a numeric value, and is put into the details without
+ * quotes.  The name/value pairs are handed to any waiter as the
+ * "details" object.
+ *
+ * Increments the index, persists it to the db (we're inside the
+ * caller's transaction), and returns the new value.
+ */
+u64 LAST_ARG_NULL wait_index_increment(struct lightningd *ld,
+				       enum wait_subsystem subsystem,
+				       enum wait_index index,
+				       ...);
+
+/**
+ * wait_index_increase - increase an index by @num at once, tell waiters.
+ * @ld: the lightningd
+ * @subsystem: subsystem for index
+ * @index: which index
+ * @num: how many entries changed (if 0, nothing happens)
+ * ...: name/value pairs, followed by NULL.
+ *
+ * Like wait_index_increment, but for bulk operations: waiters are only
+ * told once, about the final value.
+ */
+u64 LAST_ARG_NULL wait_index_increase(struct lightningd *ld,
+				      enum wait_subsystem subsystem,
+				      enum wait_index index,
+				      u64 num,
+				      ...);
+
+/**
+ * load_indexes - read the persisted index values at startup.
+ * @db: the database (must be in a transaction)
+ * @indexes: array of NUM_WAIT_SUBSYSTEM indexes to fill.
+ */
+void load_indexes(struct db *db, struct indexes *indexes);
+
+#endif /* LIGHTNING_LIGHTNINGD_WAIT_H */
@@ -27,10 +27,13 @@
  * WE ASSUME NO MALLEABILITY!  This requires segregated witness.
  */
 #include "config.h"
+#include <bitcoin/blockfilter.h>
+#include <common/bloomfilter.h>
 #include <common/type_to_string.h>
 #include <lightningd/chaintopology.h>
 #include <lightningd/channel.h>
 #include <lightningd/lightningd.h>
+#include <lightningd/metrics.h>
 #include <lightningd/watch.h>
 
 /* Watching an output */
@@ -43,6 +46,9 @@ struct txowatch {
 	/* Output to watch. */
 	struct bitcoin_outpoint out;
 
+	/* Its scriptPubKey, if we know it (for block filters) */
+	const u8 *script;
+
 	/* A new tx. */
 	enum watch_result (*cb)(struct channel *channel,
 				const struct bitcoin_tx *tx,
@@ -62,8 +68,19 @@ struct txwatch {
 	/* May be NULL if we haven't seen it yet. */
 	const struct bitcoin_tx *tx;
 
+	/* One of its output scripts, if we know it (for block filters) */
+	const u8 *script;
+
 	unsigned int depth;
 
+	/* Height of the block it's in, or 0 if it's not in one. */
+	u32 blockheight;
+
+	/* If non-zero, the tip height at which we next call cb: we're in
+	 * topo->txwatch_triggers under that height. */
+	u32 trigger;
+	struct list_node trigger_list;
+
 	/* A new depth (0 if kicked out, otherwise 1 = tip, etc.) */
 	enum watch_result (*cb)(struct lightningd *ld,
 				struct channel *channel,
@@ -77,7 +94,8 @@ const struct bitcoin_outpoint *txowatch_keyof(const struct txowatch *w)
 	return &w->out;
 }
 
-size_t txo_hash(const struct bitcoin_outpoint *out)
+/* The prefilter wants all 64 bits, even where size_t is 32 bits. */
+static u64 txo_hash64(const struct bitcoin_outpoint *out)
 {
 	/* This hash-in-one-go trick only works if they're consecutive. */
 	BUILD_ASSERT(offsetof(struct bitcoin_outpoint, n)
@@ -86,6 +104,11 @@ size_t txo_hash(const struct bitcoin_outpoint *out)
 			 sizeof(out->txid) + sizeof(out->n));
 }
 
+size_t txo_hash(const struct bitcoin_outpoint *out)
+{
+	return txo_hash64(out);
+}
+
 bool txowatch_eq(const struct txowatch *w, const struct bitcoin_outpoint *out)
 {
 	return bitcoin_txid_eq(&w->out.txid, &out->txid)
@@ -102,22 +125,96 @@ const struct bitcoin_txid *txwatch_keyof(const struct txwatch *w)
 	return &w->txid;
 }
 
-size_t txid_hash(const struct bitcoin_txid *txid)
+static u64 txid_hash64(const struct bitcoin_txid *txid)
 {
 	return siphash24(siphash_seed(),
 			 txid->shad.sha.u.u8, sizeof(txid->shad.sha.u.u8));
 }
 
+size_t txid_hash(const struct bitcoin_txid *txid)
+{
+	return txid_hash64(txid);
+}
+
 bool txwatch_eq(const struct txwatch *w, const struct bitcoin_txid *txid)
 {
 	return bitcoin_txid_eq(&w->txid, txid);
 }
 
+/* Take it out of its topo->txwatch_triggers bucket, if any. */
+static void txwatch_unschedule(struct txwatch *w)
+{
+	struct list_head *bucket;
+
+	if (!w->trigger)
+		return;
+
+	/* If topology is being freed, the buckets are already gone. */
+	bucket = uintmap_get(&w->topo->txwatch_triggers, w->trigger);
+	if (bucket) {
+		list_del_from(bucket, &w->trigger_list);
+		if (list_empty(bucket)) {
+			uintmap_del(&w->topo->txwatch_triggers, w->trigger);
+			tal_free(bucket);
+		}
+	}
+	w->trigger = 0;
+}
+
+/* Call cb once the tip reaches @height. */
+static void txwatch_schedule(struct txwatch *w, u32 height)
+{
+	struct list_head *bucket;
+
+	txwatch_unschedule(w);
+	bucket = uintmap_get(&w->topo->txwatch_triggers, height);
+	if (!bucket) {
+		bucket = tal(w->topo, struct list_head);
+		list_head_init(bucket);
+		uintmap_add(&w->topo->txwatch_triggers, height, bucket);
+	}
+	list_add_tail(bucket, &w->trigger_list);
+	w->trigger = height;
+}
+
 static void destroy_txwatch(struct txwatch *w)
 {
+	txwatch_unschedule(w);
 	txwatch_hash_del(&w->topo->txwatches, w);
 }
 
+/* We can't remove entries, so once it's full we start again with what
+ * we're actually watching now. */
+static void watch_prefilter_rebuild(struct chain_topology *topo)
+{
+	struct txowatch_hash_iter oi;
+	struct txwatch_hash_iter i;
+	const struct txowatch *ow;
+	const struct txwatch *w;
+	size_t count = txowatch_hash_count(&topo->txowatches)
+		+ txwatch_hash_count(&topo->txwatches);
+
+	tal_free(topo->watch_prefilter);
+	topo->watch_prefilter
+		= bloomfilter_new(topo, bloomfilter_rebuild_capacity(count));
+	for (ow = txowatch_hash_first(&topo->txowatches, &oi);
+	     ow;
+	     ow = txowatch_hash_next(&topo->txowatches, &oi))
+		bloomfilter_add(topo->watch_prefilter, txo_hash64(&ow->out));
+	for (w = txwatch_hash_first(&topo->txwatches, &i);
+	     w;
+	     w = txwatch_hash_next(&topo->txwatches, &i))
+		bloomfilter_add(topo->watch_prefilter, txid_hash64(&w->txid));
+}
+
+static void watch_prefilter_add(struct chain_topology *topo, u64 hash)
+{
+	if (bloomfilter_full(topo->watch_prefilter))
+		watch_prefilter_rebuild(topo);
+	else
+		bloomfilter_add(topo->watch_prefilter, hash);
+}
+
 struct txwatch *watch_txid(const tal_t *ctx,
 			   struct chain_topology *topo,
 			   struct channel *channel,
@@ -135,12 +232,21 @@ struct txwatch *watch_txid(const tal_t *ctx,
 	w->depth = 0;
 	w->txid = *txid;
 	w->tx = NULL;
+	w->script = NULL;
 	w->channel = channel;
 	w->cb = cb;
+	w->trigger = 0;
 
 	txwatch_hash_add(&w->topo->txwatches, w);
+	watch_prefilter_add(topo, txid_hash64(txid));
 	tal_add_destructor(w, destroy_txwatch);
 
+	/* The only time we ask the db: after this, txwatch_inform() and
+	 * txwatch_fire() tell us when it enters or leaves a block. */
+	w->blockheight = wallet_transaction_height(topo->ld->wallet, txid);
+	if (w->blockheight)
+		txwatch_schedule(w, w->blockheight);
+
 	return w;
 }
 
@@ -162,10 +268,34 @@ struct txwatch *find_txwatch(struct chain_topology *topo,
 	return w;
 }
 
-bool watching_txid(const struct chain_topology *topo,
+bool watching_txid(struct chain_topology *topo,
 		   const struct bitcoin_txid *txid)
 {
-	return txwatch_hash_get(&topo->txwatches, txid) != NULL;
+	if (!bloomfilter_check(topo->watch_prefilter,
+			       &topo->watch_prefilter_stats,
+			       txid_hash64(txid)))
+		return false;
+
+	if (!txwatch_hash_get(&topo->txwatches, txid))
+		return false;
+	topo->watch_prefilter_stats.matched++;
+	return true;
+}
+
+struct txowatch *find_txowatch(struct chain_topology *topo,
+			       const struct bitcoin_outpoint *out)
+{
+	struct txowatch *w;
+
+	if (!bloomfilter_check(topo->watch_prefilter,
+			       &topo->watch_prefilter_stats,
+			       txo_hash64(out)))
+		return NULL;
+
+	w = txowatch_hash_get(&topo->txowatches, out);
+	if (w)
+		topo->watch_prefilter_stats.matched++;
+	return w;
 }
 
 struct txwatch *watch_tx(const tal_t *ctx,
@@ -179,10 +309,22 @@ struct txwatch *watch_tx(const tal_t *ctx,
 						 unsigned int depth))
 {
 	struct bitcoin_txid txid;
+	struct txwatch *w;
 
 	bitcoin_txid(tx, &txid);
 	/* FIXME: Save populate txwatch->tx here, too! */
-	return watch_txid(ctx, topo, channel, &txid, cb);
+	w = watch_txid(ctx, topo, channel, &txid, cb);
+
+	/* Any output will do to find it in a block filter. */
+	for (size_t i = 0; i < tx->wtx->num_outputs; i++) {
+		const struct wally_tx_output *out = &tx->wtx->outputs[i];
+		if (blockfilter_script_excluded(out->script, out->script_len))
+			continue;
+		txwatch_set_script(w, bitcoin_tx_output_get_script(tmpctx,
+								   tx, i));
+		break;
+	}
+	return w;
 }
 
 struct txowatch *watch_txo(const tal_t *ctx,
@@ -198,17 +340,54 @@ struct txowatch *watch_txo(const tal_t *ctx,
 
 	w->topo = topo;
 	w->out = *outpoint;
+	w->script = NULL;
 	w->channel = channel;
 	w->cb = cb;
 
 	txowatch_hash_add(&w->topo->txowatches, w);
+	watch_prefilter_add(topo, txo_hash64(outpoint));
 	tal_add_destructor(w, destroy_txowatch);
 
 	return w;
 }
 
-/* Returns true if we fired a callback */
-static bool txw_fire(struct txwatch *txw,
+void txwatch_set_script(struct txwatch *w, const u8 *script TAKES)
+{
+	tal_free(w->script);
+	w->script = tal_dup_talarr(w, u8, script);
+}
+
+void txowatch_set_script(struct txowatch *w, const u8 *script TAKES)
+{
+	tal_free(w->script);
+	w->script = tal_dup_talarr(w, u8, script);
+}
+
+bool watched_scripts(struct chain_topology *topo, const u8 ***scripts)
+{
+	struct txowatch_hash_iter oi;
+	struct txwatch_hash_iter i;
+	const struct txowatch *ow;
+	const struct txwatch *w;
+
+	for (ow = txowatch_hash_first(&topo->txowatches, &oi);
+	     ow;
+	     ow = txowatch_hash_next(&topo->txowatches, &oi)) {
+		if (!ow->script)
+			return false;
+		tal_arr_expand(scripts, ow->script);
+	}
+	for (w = txwatch_hash_first(&topo->txwatches, &i);
+	     w;
+	     w = txwatch_hash_next(&topo->txwatches, &i)) {
+		if (!w->script)
+			return false;
+		tal_arr_expand(scripts, w->script);
+	}
+	return true;
+}
+
+static void txw_fire(struct txwatch *txw,
 		     const struct bitcoin_txid *txid,
 		     unsigned int depth)
 {
@@ -216,7 +395,7 @@ static bool txw_fire(struct txwatch *txw,
 	struct log *log;
 
 	if (depth == txw->depth)
-		return false;
+		goto reschedule;
 	if (txw->channel)
 		log = txw->channel->log;
 	else
@@ -234,19 +413,35 @@ static bool txw_fire(struct txwatch *txw,
 	switch (r) {
 	case DELETE_WATCH:
 		tal_free(txw);
-		return true;
+		return;
 	case KEEP_WATCHING:
-		return true;
+		goto reschedule;
 	}
 	fatal("txwatch callback %p returned %i\n", txw->cb, r);
+
+reschedule:
+	/* Every callback wants to hear about the next depth, too. */
+	if (txw->blockheight)
+		txwatch_schedule(txw, txw->blockheight + txw->depth);
 }
 
 void txwatch_fire(struct chain_topology *topo,
 		  const struct bitcoin_txid *txid,
 		  unsigned int depth)
 {
+	struct txwatch_hash_iter i;
 	struct txwatch *txw;
 
+	/* A reorg: none of them are in a block any more. */
+	if (depth == 0) {
+		for (txw = txwatch_hash_getfirst(&topo->txwatches, txid, &i);
+		     txw;
+		     txw = txwatch_hash_getnext(&topo->txwatches, txid, &i)) {
+			txw->blockheight = 0;
+			txwatch_unschedule(txw);
+		}
+	}
+
 	txw = txwatch_hash_get(&topo->txwatches, txid);
 
 	if (txw)
@@ -279,36 +474,49 @@ void txowatch_fire(const struct txowatch *txow,
 	fatal("txowatch callback %p returned %i", txow->cb, r);
 }
 
+/* Watches are bucketed by the tip height at which they next need to hear
+ * about their depth, so unconfirmed txs cost nothing here, and we never
+ * have to ask the db how deep anything is. */
 void watch_topology_changed(struct chain_topology *topo)
 {
-	struct txwatch_hash_iter i;
-	struct txwatch *w;
-	bool needs_rerun;
-	do {
-		/* Iterating a htable during deletes is safe, but might skip entries. */
-		needs_rerun = false;
-		for (w = txwatch_hash_first(&topo->txwatches, &i);
-		     w;
-		     w = txwatch_hash_next(&topo->txwatches, &i)) {
-			u32 depth;
-
-			depth = get_tx_depth(topo, &w->txid);
-			if (depth) {
-				if (!w->tx)
-					w->tx = wallet_transaction_get(w, topo->ld->wallet,
-								       &w->txid);
-				needs_rerun |= txw_fire(w, &w->txid, depth);
-			}
-		}
-	} while (needs_rerun);
+	struct timemono start = time_mono();
+	struct list_head *bucket;
+	intmap_index_t height;
+
+	/* Callbacks can add and delete watches (including ones in this
+	 * bucket, or earlier ones), so we take one at a time. */
+	while ((bucket = uintmap_first(&topo->txwatch_triggers, &height))
+	       && height <= topo->tip->height) {
+		struct txwatch *w = list_top(bucket, struct txwatch,
+					     trigger_list);
+
+		txwatch_unschedule(w);
+		if (!w->tx)
+			w->tx = wallet_transaction_get(w, topo->ld->wallet,
+						       &w->txid);
+		txw_fire(w, &w->txid, topo->tip->height - w->blockheight + 1);
+	}
+
+	metrics_watches_processed(topo->ld->metrics,
+				  timemono_between(time_mono(), start));
 }
 
-void txwatch_inform(const struct chain_topology *topo,
+void txwatch_inform(struct chain_topology *topo,
 		    const struct bitcoin_txid *txid,
-		    const struct bitcoin_tx *tx_may_steal)
+		    const struct bitcoin_tx *tx_may_steal,
+		    u32 blockheight)
 {
+	struct txwatch_hash_iter i;
 	struct txwatch *txw;
 
+	for (txw = txwatch_hash_getfirst(&topo->txwatches, txid, &i);
+	     txw;
+	     txw = txwatch_hash_getnext(&topo->txwatches, txid, &i)) {
+		txw->blockheight = blockheight;
+		/* It'll be told its depth once we've finished adding blocks */
+		txwatch_schedule(txw, blockheight);
+	}
+
 	txw = txwatch_hash_get(&topo->txwatches, txid);
 
 	if (txw && !txw->tx)
@@ -59,6 +59,15 @@ struct txowatch *watch_txo(const tal_t *ctx,
 						   size_t input_num,
 						   const struct block *block));
 
+/* With block filters, we only look at blocks which contain these scripts:
+ * @script is one output of the tx (or for a txowatch, the output itself). */
+void txwatch_set_script(struct txwatch *w, const u8 *script TAKES);
+void txowatch_set_script(struct txowatch *w, const u8 *script TAKES);
+
+/* Append every watch's script to *@scripts: false if some watch doesn't
+ * have one, so there's no point using block filters. */
+bool watched_scripts(struct chain_topology *topo, const u8 ***scripts);
+
 struct txwatch *find_txwatch(struct chain_topology *topo,
 			     const struct bitcoin_txid *txid,
 			     const struct channel *channel);
@@ -71,13 +80,18 @@ void txowatch_fire(const struct txowatch *txow,
 		   const struct bitcoin_tx *tx, size_t input_num,
 		   const struct block *block);
 
-bool watching_txid(const struct chain_topology *topo,
+bool watching_txid(struct chain_topology *topo,
 		   const struct bitcoin_txid *txid);
 
+/* Like txowatch_hash_get(), but cheaply rules out most misses first. */
+struct txowatch *find_txowatch(struct chain_topology *topo,
+			       const struct bitcoin_outpoint *out);
+
 /* FIXME: Implement bitcoin_tx_dup() so we tx arg can be TAKEN */
-void txwatch_inform(const struct chain_topology *topo,
+void txwatch_inform(struct chain_topology *topo,
 		    const struct bitcoin_txid *txid,
-		    const struct bitcoin_tx *tx_may_steal);
+		    const struct bitcoin_tx *tx_may_steal,
+		    u32 blockheight);
 
 void watch_topology_changed(struct chain_topology *topo);
 #endif /* LIGHTNING_LIGHTNINGD_WATCH_H */
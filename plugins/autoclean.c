@@ -49,7 +49,10 @@ static bool json_to_subsystem(const char *buffer, const jsmntok_t *tok,
  * it's a temporary. */
 struct clean_info {
 	struct command *cmd;
-	size_t cleanup_reqs_remaining;
+	/* Index into clean_jobs of the command we're running */
+	size_t job;
+	/* Ages are relative to when we started */
+	u64 now;
 	u64 subsystem_age[NUM_SUBSYSTEM];
 	u64 num_cleaned[NUM_SUBSYSTEM];
 	u64 num_uncleaned;
@@ -123,321 +126,109 @@ static struct command_result *clean_finished(struct clean_info *cinfo)
 	}
 }
 
-static struct command_result *clean_finished_one(struct clean_info *cinfo)
-{
-	assert(cinfo->cleanup_reqs_remaining != 0);
-	if (--cinfo->cleanup_reqs_remaining > 0)
-		return command_still_pending(cinfo->cmd);
-
-	return clean_finished(cinfo);
-}
-
-struct del_data {
+/* Each subsystem is cleaned by one or more bulk deletion commands. */
+static const struct clean_job {
 	enum subsystem subsystem;
-	struct clean_info *cinfo;
+	const char *cmdname;
+	const char *status;
+} clean_jobs[] = {
+	{ SUCCEEDEDFORWARDS, "delforwards", "settled" },
+	{ FAILEDFORWARDS, "delforwards", "failed" },
+	{ FAILEDFORWARDS, "delforwards", "local_failed" },
+	{ SUCCEEDEDPAYS, "delpays", "complete" },
+	{ FAILEDPAYS, "delpays", "failed" },
+	{ PAIDINVOICES, "delinvoices", "paid" },
+	{ EXPIREDINVOICES, "delinvoices", "expired" },
 };
 
+/* How many to delete per command (each is a single db transaction) */
+#define DELETE_LIMIT 1000
+
+static struct command_result *clean_next(struct clean_info *cinfo);
+
 static struct command_result *del_done(struct command *cmd,
 				       const char *buf,
 				       const jsmntok_t *result,
-				       struct del_data *del_data)
+				       struct clean_info *cinfo)
 {
-	struct clean_info *cinfo = del_data->cinfo;
-
-	cinfo->num_cleaned[del_data->subsystem]++;
-	tal_free(del_data);
-	return clean_finished_one(cinfo);
+	const struct clean_job *job = &clean_jobs[cinfo->job];
+	u64 deleted, remaining;
+	const char *err;
+
+	err = json_scan(tmpctx, buf, result, "{deleted:%,remaining:%}",
+			JSON_SCAN(json_to_u64, &deleted),
+			JSON_SCAN(json_to_u64, &remaining));
+	if (err)
+		plugin_err(plugin, "Bad %s response '%.*s': %s",
+			   job->cmdname,
+			   json_tok_full_len(result),
+			   json_tok_full(buf, result),
+			   err);
+
+	cinfo->num_cleaned[job->subsystem] += deleted;
+
+	/* If it didn't hit the limit, there are no more to delete, and
+	 * remaining is everything we left (other status, or too new). */
+	if (deleted < DELETE_LIMIT) {
+		cinfo->num_uncleaned = remaining;
+		cinfo->job++;
+	}
+	return clean_next(cinfo);
 }
 
 static struct command_result *del_failed(struct command *cmd,
 					 const char *buf,
 					 const jsmntok_t *result,
-					 struct del_data *del_data)
+					 struct clean_info *cinfo)
 {
-	struct clean_info *cinfo = del_data->cinfo;
+	const struct clean_job *job = &clean_jobs[cinfo->job];
 
-	plugin_log(plugin, LOG_UNUSUAL, "%s del failed: %.*s",
-		   subsystem_to_str(del_data->subsystem),
+	plugin_log(plugin, LOG_UNUSUAL, "%s %s failed: %.*s",
+		   job->cmdname, job->status,
 		   json_tok_full_len(result),
 		   json_tok_full(buf, result));
-	tal_free(del_data);
-	return clean_finished_one(cinfo);
-}
-
-static struct out_req *del_request_start(const char *method,
-					 struct clean_info *cinfo,
-					 enum subsystem subsystem)
-{
-	struct del_data *del_data = tal(plugin, struct del_data);
-
-	del_data->cinfo = cinfo;
-	del_data->subsystem = subsystem;
-	cinfo->cleanup_reqs_remaining++;
-	return jsonrpc_request_start(plugin, NULL, method,
-				     del_done, del_failed, del_data);
-}
-
-static struct command_result *listinvoices_done(struct command *cmd,
-						const char *buf,
-						const jsmntok_t *result,
-						struct clean_info *cinfo)
-{
-	const jsmntok_t *t, *inv = json_get_member(buf, result, "invoices");
-	size_t i;
-	u64 now = time_now().ts.tv_sec;
-
-	json_for_each_arr(i, t, inv) {
-		const jsmntok_t *status = json_get_member(buf, t, "status");
-		const jsmntok_t *time;
-		enum subsystem subsys;
-		u64 invtime;
-
-		if (json_tok_streq(buf, status, "expired")) {
-			subsys = EXPIREDINVOICES;
-			time = json_get_member(buf, t, "expires_at");
-		} else if (json_tok_streq(buf, status, "paid")) {
-			subsys = PAIDINVOICES;
-			time = json_get_member(buf, t, "paid_at");
-		} else {
-			cinfo->num_uncleaned++;
-			continue;
-		}
-
-		/* Continue if we don't care. */
-		if (cinfo->subsystem_age[subsys] == 0) {
-			cinfo->num_uncleaned++;
-			continue;
-		}
-
-		if (!json_to_u64(buf, time, &invtime)) {
-			plugin_err(plugin, "Bad time '%.*s'",
-				   json_tok_full_len(time),
-				   json_tok_full(buf, time));
-		}
-
-		if (invtime <= now - cinfo->subsystem_age[subsys]) {
-			struct out_req *req;
-			const jsmntok_t *label = json_get_member(buf, t, "label");
-
-			req = del_request_start("delinvoice", cinfo, subsys);
-			json_add_tok(req->js, "label", label, buf);
-			json_add_tok(req->js, "status", status, buf);
-			send_outreq(plugin, req);
-		}
-	}
-
-	if (cinfo->cleanup_reqs_remaining)
-		return command_still_pending(cmd);
-	return clean_finished(cinfo);
+	cinfo->job++;
+	return clean_next(cinfo);
 }
 
-static struct command_result *listsendpays_done(struct command *cmd,
-						const char *buf,
-						const jsmntok_t *result,
-						struct clean_info *cinfo)
+static struct command_result *clean_next(struct clean_info *cinfo)
 {
-	const jsmntok_t *t, *pays = json_get_member(buf, result, "payments");
-	size_t i;
-	u64 now = time_now().ts.tv_sec;
-
-	json_for_each_arr(i, t, pays) {
-		const jsmntok_t *status = json_get_member(buf, t, "status");
-		const jsmntok_t *time;
-		enum subsystem subsys;
-		u64 paytime;
-
-		if (json_tok_streq(buf, status, "failed")) {
-			subsys = FAILEDPAYS;
-		} else if (json_tok_streq(buf, status, "complete")) {
-			subsys = SUCCEEDEDPAYS;
-		} else {
-			cinfo->num_uncleaned++;
-			continue;
-		}
+	const struct clean_job *job;
+	struct out_req *req;
+	u64 age;
 
-		/* Continue if we don't care. */
-		if (cinfo->subsystem_age[subsys] == 0) {
-			cinfo->num_uncleaned++;
-			continue;
-		}
+	/* Skip over subsystems we don't care about. */
+	while (cinfo->job < ARRAY_SIZE(clean_jobs)
+	       && cinfo->subsystem_age[clean_jobs[cinfo->job].subsystem] == 0)
+		cinfo->job++;
 
-		time = json_get_member(buf, t, "created_at");
-		if (!json_to_u64(buf, time, &paytime)) {
-			plugin_err(plugin, "Bad created_at '%.*s'",
-				   json_tok_full_len(time),
-				   json_tok_full(buf, time));
-		}
-
-		if (paytime <= now - cinfo->subsystem_age[subsys]) {
-			struct out_req *req;
-			const jsmntok_t *phash = json_get_member(buf, t, "payment_hash");
-			const jsmntok_t *groupid = json_get_member(buf, t, "groupid");
-			const jsmntok_t *partidtok = json_get_member(buf, t, "partid");
-			u64 partid;
-			if (partidtok)
-				json_to_u64(buf, partidtok, &partid);
-			else
-				partid = 0;
-
-			req = del_request_start("delpay", cinfo, subsys);
-			json_add_tok(req->js, "payment_hash", phash, buf);
-			json_add_tok(req->js, "status", status, buf);
-			json_add_tok(req->js, "groupid", groupid, buf);
-			json_add_u64(req->js, "partid", partid);
-			send_outreq(plugin, req);
-		}
-	}
-
- 	if (cinfo->cleanup_reqs_remaining)
-		return command_still_pending(cmd);
-	return clean_finished(cinfo);
-}
-
-static struct command_result *listforwards_done(struct command *cmd,
-						const char *buf,
-						const jsmntok_t *result,
-						struct clean_info *cinfo)
-{
-	const jsmntok_t *t, *fwds = json_get_member(buf, result, "forwards");
-	size_t i;
-	u64 now = time_now().ts.tv_sec;
-
-	json_for_each_arr(i, t, fwds) {
-		const jsmntok_t *status = json_get_member(buf, t, "status");
-		jsmntok_t time;
-		enum subsystem subsys;
-		u64 restime;
-
-		if (json_tok_streq(buf, status, "settled")) {
-			subsys = SUCCEEDEDFORWARDS;
-		} else if (json_tok_streq(buf, status, "failed")
-			   || json_tok_streq(buf, status, "local_failed")) {
-			subsys = FAILEDFORWARDS;
-		} else {
-			cinfo->num_uncleaned++;
-			continue;
-		}
-
-		/* Continue if we don't care. */
-		if (cinfo->subsystem_age[subsys] == 0) {
-			cinfo->num_uncleaned++;
-			continue;
-		}
-
-		/* Check if we have a resolved_time, before making a
-		 * decision on it. This is possible in older nodes
-		 * that predate our annotations for forwards.*/
-		if (json_get_member(buf, t, "resolved_time") == NULL) {
-			cinfo->num_uncleaned++;
-			continue;
-		}
-
-		time = *json_get_member(buf, t, "resolved_time");
-		/* This is a float, so truncate at '.' */
-		for (int off = time.start; off < time.end; off++) {
-			if (buf[off] == '.')
-				time.end = off;
-		}
-		if (!json_to_u64(buf, &time, &restime)) {
-			plugin_err(plugin, "Bad time '%.*s'",
-				   json_tok_full_len(&time),
-				   json_tok_full(buf, &time));
-		}
-
-		if (restime <= now - cinfo->subsystem_age[subsys]) {
-			struct out_req *req;
-			const jsmntok_t *inchan, *inid;
-
-			inchan = json_get_member(buf, t, "in_channel");
-			inid = json_get_member(buf, t, "in_htlc_id");
-
-			req = del_request_start("delforward", cinfo, subsys);
-			json_add_tok(req->js, "in_channel", inchan, buf);
-			/* This can be missing if it was a forwards record from an old
-			 * closed channel in version <= 0.12.1.  This is a special value
-			 * but we will delete them *all*, resulting in some failures! */
-#ifdef COMPAT_V0121
-			if (!inid)
-				json_add_u64(req->js, "in_htlc_id", -1ULL);
-			else
-#endif
-				json_add_tok(req->js, "in_htlc_id", inid, buf);
-			json_add_tok(req->js, "status", status, buf);
-			send_outreq(plugin, req);
-		}
-	}
-
- 	if (cinfo->cleanup_reqs_remaining)
-		return command_still_pending(cmd);
-	return clean_finished(cinfo);
-}
-
-static struct command_result *listsendpays_failed(struct command *cmd,
-						  const char *buf,
-						  const jsmntok_t *result,
-						  void *unused)
-{
-	return cmd_failed(cmd, buf, result, "listsendpays");
-}
+	if (cinfo->job == ARRAY_SIZE(clean_jobs))
+		return clean_finished(cinfo);
 
-static struct command_result *listinvoices_failed(struct command *cmd,
-						  const char *buf,
-						  const jsmntok_t *result,
-						  void *unused)
-{
-	return cmd_failed(cmd, buf, result, "listinvoices");
-}
+	job = &clean_jobs[cinfo->job];
+	age = cinfo->subsystem_age[job->subsystem];
 
-static struct command_result *listforwards_failed(struct command *cmd,
-						  const char *buf,
-						  const jsmntok_t *result,
-						  void *unused)
-{
-	return cmd_failed(cmd, buf, result, "listforwards");
+	req = jsonrpc_request_start(plugin, NULL, job->cmdname,
+				    del_done, del_failed, cinfo);
+	json_add_string(req->js, "status", job->status);
+	json_add_u64(req->js, "maxtime", age < cinfo->now ? cinfo->now - age : 0);
+	json_add_u32(req->js, "limit", DELETE_LIMIT);
+	return send_outreq(plugin, req);
 }
 
 static struct command_result *do_clean(struct clean_info *cinfo)
 {
-	struct out_req *req = NULL;
-
-	cinfo->cleanup_reqs_remaining = 0;
+	cinfo->job = 0;
+	cinfo->now = time_now().ts.tv_sec;
 	cinfo->num_uncleaned = 0;
 	memset(cinfo->num_cleaned, 0, sizeof(cinfo->num_cleaned));
 
-	if (cinfo->subsystem_age[SUCCEEDEDPAYS] != 0
-	    || cinfo->subsystem_age[FAILEDPAYS] != 0) {
-		req = jsonrpc_request_start(plugin, NULL, "listsendpays",
-					    listsendpays_done, listsendpays_failed,
-					    cinfo);
-		send_outreq(plugin, req);
-	}
-
-	if (cinfo->subsystem_age[EXPIREDINVOICES] != 0
-	    || cinfo->subsystem_age[PAIDINVOICES] != 0) {
-		req = jsonrpc_request_start(plugin, NULL, "listinvoices",
-					    listinvoices_done, listinvoices_failed,
-					    cinfo);
-		send_outreq(plugin, req);
-	}
-
-	if (cinfo->subsystem_age[SUCCEEDEDFORWARDS] != 0
-	    || cinfo->subsystem_age[FAILEDFORWARDS] != 0) {
-		req = jsonrpc_request_start(plugin, NULL, "listforwards",
-					    listforwards_done, listforwards_failed,
-					    cinfo);
-		send_outreq(plugin, req);
-	}
-
-	if (req)
-		return command_still_pending(NULL);
-	else
-		return clean_finished(cinfo);
+	return clean_next(cinfo);
 }
 
 /* Needs a different signature than do_clean */
 static void do_clean_timer(void *unused)
 {
-	assert(timer_cinfo.cleanup_reqs_remaining == 0);
 	do_clean(&timer_cinfo);
 }
 
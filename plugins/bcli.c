@@ -1,17 +1,30 @@
 #include "config.h"
 #include <bitcoin/base58.h>
+#include <bitcoin/tx.h>
 #include <ccan/array_size/array_size.h>
 #include <ccan/cast/cast.h>
 #include <ccan/io/io.h>
+#include <ccan/json_escape/json_escape.h>
+#include <ccan/mem/mem.h>
+#include <ccan/noerr/noerr.h>
 #include <ccan/pipecmd/pipecmd.h>
 #include <ccan/read_write_all/read_write_all.h>
+#include <ccan/str/hex/hex.h>
+#include <ccan/strmap/strmap.h>
 #include <ccan/tal/grab_file/grab_file.h>
+#include <ccan/tal/path/path.h>
 #include <ccan/tal/str/str.h>
+#include <common/base64.h>
 #include <common/json_param.h>
 #include <common/json_stream.h>
 #include <common/memleak.h>
 #include <errno.h>
+#include <netdb.h>
 #include <plugins/libplugin.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 /* Bitcoind's web server has a default of 4 threads, with queue depth 16.
  * It will *fail* rather than queue beyond that, so we must not stress it!
@@ -74,6 +87,33 @@ struct bitcoind {
 	/* Override in case we're developer mode for testing*/
 	bool no_fake_fees;
 #endif
+
+	/* How many HTTP connections we may keep open to bitcoind's RPC
+	 * server (0 means run bitcoin-cli for every request). */
+	u32 rpc_max_conns;
+
+	/* How many requests we send on each before waiting for answers */
+	u32 rpc_pipeline;
+
+	/* Are we talking to the RPC server directly? */
+	bool rpc;
+
+	/* Where it is ("host:port" for the Host: header, too) */
+	struct addrinfo *rpc_addrs, *rpc_addr;
+	char *rpc_host;
+
+	/* base64 of user:password, and the cookie file it came from (if any) */
+	char *rpc_auth, *rpc_cookie_file;
+
+	/* Open connections, and how many */
+	struct list_head rpc_conns;
+	size_t num_rpc_conns;
+
+	/* JSON-RPC id of the next request */
+	u64 rpc_next_id;
+
+	/* So we can log from io callbacks */
+	struct plugin *plugin;
 };
 
 static struct bitcoind *bitcoind;
@@ -135,6 +175,21 @@ static const char **gather_argsv(const tal_t *ctx, const char *cmd, va_list ap)
 	return args;
 }
 
+/* For the RPC server, we only need the method and its parameters. */
+static const char **gather_rpc_argsv(const tal_t *ctx, const char *cmd,
+				     va_list ap)
+{
+	const char **args = tal_arr(ctx, const char *, 0);
+	const char *arg;
+
+	add_arg(&args, cmd);
+	while ((arg = va_arg(ap, char *)) != NULL)
+		add_arg(&args, arg);
+	add_arg(&args, NULL);
+
+	return args;
+}
+
 static LAST_ARG_NULL const char **
 gather_args(const tal_t *ctx, const char *cmd, ...)
 {
@@ -238,11 +293,10 @@ static void bcli_failure(struct bitcoin_cli *bcli,
 	plugin_timer(bcli->cmd->plugin, time_from_sec(1), retry_bcli, bcli);
 }
 
-static void bcli_finished(struct io_conn *conn UNUSED, struct bitcoin_cli *bcli)
+/* Common to bitcoin-cli and RPC: handle the result of a finished request. */
+static void bcli_done(struct bitcoin_cli *bcli, int exitstatus)
 {
-	int ret, status;
 	struct command_result *res;
-	enum bitcoind_prio prio = bcli->prio;
 	u64 msec = time_to_msec(time_between(time_now(), bcli->start));
 
 	/* If it took over 10 seconds, that's rather strange. */
@@ -251,6 +305,30 @@ static void bcli_finished(struct io_conn *conn UNUSED, struct bitcoin_cli *bcli)
 		           "bitcoin-cli: finished %s (%"PRIu64" ms)",
 		           bcli_args(bcli), msec);
 
+	/* Implicit nonzero_exit_ok == false */
+	if (!bcli->exitstatus) {
+		if (exitstatus != 0) {
+			bcli_failure(bcli, exitstatus);
+			return;
+		}
+	} else
+		*bcli->exitstatus = exitstatus;
+
+	if (exitstatus == 0)
+		bitcoind->error_count = 0;
+
+	res = bcli->process(bcli);
+	if (!res)
+		bcli_failure(bcli, exitstatus);
+	else
+		tal_free(bcli);
+}
+
+static void bcli_finished(struct io_conn *conn UNUSED, struct bitcoin_cli *bcli)
+{
+	int ret, status;
+	enum bitcoind_prio prio = bcli->prio;
+
 	assert(bitcoind->num_requests[prio] > 0);
 
 	/* FIXME: If we waited for SIGCHILD, this could never hang! */
@@ -264,29 +342,474 @@ static void bcli_finished(struct io_conn *conn UNUSED, struct bitcoin_cli *bcli)
 		           bcli_args(bcli),
 		           WTERMSIG(status));
 
-	/* Implicit nonzero_exit_ok == false */
-	if (!bcli->exitstatus) {
-		if (WEXITSTATUS(status) != 0) {
-			bcli_failure(bcli, WEXITSTATUS(status));
-			bitcoind->num_requests[prio]--;
-			goto done;
+	bitcoind->num_requests[prio]--;
+	bcli_done(bcli, WEXITSTATUS(status));
+	next_bcli(prio);
+}
+
+static void strip_trailing_whitespace(char *str, size_t len)
+{
+	size_t stripped_len = len;
+	while (stripped_len > 0 && cisspace(str[stripped_len-1]))
+		stripped_len--;
+
+	str[stripped_len] = 0x00;
+}
+
+/*~ Rather than running bitcoin-cli for every request, we can talk to
+ * bitcoind's RPC server ourselves, over a few HTTP/1.1 connections which we
+ * keep open.  We turn its answers into exactly what bitcoin-cli would have
+ * printed (and the exit status it would have returned), so everything below
+ * works the same either way. */
+struct rpc_conn {
+	struct list_node list;
+	struct io_conn *conn;
+
+	/* Requests on this connection, oldest first: answers come in order. */
+	struct bitcoin_cli **reqs;
+	/* How many of those we've written out. */
+	size_t num_written;
+	/* How many answers we've had on this connection. */
+	size_t num_answered;
+
+	/* Request we're writing, and what we've read. */
+	char *outbuf;
+	char *inbuf;
+	size_t inlen, inlen_new;
+};
+
+/* Like bitcoin-cli, we need to know which parameters are JSON rather than
+ * strings (bitcoin-cli has a big table, vRPCConvertParams). */
+static const struct {
+	const char *method;
+	size_t param;
+} rpc_json_params[] = {
+	{ "getblockhash", 0 },
+	{ "getblock", 1 },
+	{ "getblockheader", 1 },
+	{ "estimatesmartfee", 0 },
+	{ "sendrawtransaction", 1 },
+	{ "gettxout", 1 },
+};
+
+static bool rpc_param_is_json(const char *method, size_t param)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(rpc_json_params); i++) {
+		if (streq(rpc_json_params[i].method, method)
+		    && rpc_json_params[i].param == param)
+			return true;
+	}
+	return false;
+}
+
+static char *rpc_request(const tal_t *ctx, const char **args)
+{
+	char *body = tal_fmt(tmpctx,
+			     "{\"jsonrpc\":\"1.0\",\"id\":%"PRIu64","
+			     "\"method\":\"%s\",\"params\":[",
+			     bitcoind->rpc_next_id++, args[0]);
+
+	for (size_t i = 1; args[i]; i++) {
+		if (i != 1)
+			tal_append_fmt(&body, ",");
+		if (rpc_param_is_json(args[0], i - 1))
+			tal_append_fmt(&body, "%s", args[i]);
+		else
+			tal_append_fmt(&body, "\"%s\"",
+				       json_escape(tmpctx, args[i])->s);
+	}
+	tal_append_fmt(&body, "]}");
+
+	return tal_fmt(ctx,
+		       "POST / HTTP/1.1\r\n"
+		       "Host: %s\r\n"
+		       "Authorization: Basic %s\r\n"
+		       "Content-Type: application/json\r\n"
+		       "Content-Length: %zu\r\n"
+		       "\r\n"
+		       "%s",
+		       bitcoind->rpc_host, bitcoind->rpc_auth,
+		       strlen(body), body);
+}
+
+/* Is this header line @name?  If so, set *val and *vallen. */
+static bool http_header_is(const char *line, const char *eol,
+			   const char *name,
+			   const char **val, size_t *vallen)
+{
+	size_t namelen = strlen(name);
+
+	if ((size_t)(eol - line) <= namelen
+	    || strncasecmp(line, name, namelen) != 0
+	    || line[namelen] != ':')
+		return false;
+
+	*val = line + namelen + 1;
+	while (*val < eol && cisspace(**val))
+		(*val)++;
+	*vallen = eol - *val;
+	return true;
+}
+
+/* Returns the length of a complete response at the start of @buf, 0 if we
+ * need to read more, or -1 if it's not something we understand. */
+static ssize_t http_response_parse(const char *buf, size_t len,
+				   int *status,
+				   const char **body, size_t *bodylen,
+				   bool *close)
+{
+	const char *end, *line, *eol, *val;
+	size_t hdrlen, vallen;
+	bool have_len = false;
+
+	end = memmem(buf, len, "\r\n\r\n", 4);
+	if (!end)
+		return len > 65536 ? -1 : 0;
+	hdrlen = end + 4 - buf;
+
+	if (hdrlen < 12 || !memstarts(buf, hdrlen, "HTTP/1.", 7))
+		return -1;
+	*status = atoi(buf + 9);
+	/* HTTP/1.0 closes unless told otherwise */
+	*close = (buf[7] == '0');
+
+	eol = memmem(buf, hdrlen, "\r\n", 2);
+	for (line = eol + 2; line < end; line = eol + 2) {
+		eol = memmem(line, end + 2 - line, "\r\n", 2);
+		if (http_header_is(line, eol, "Content-Length", &val, &vallen)) {
+			*bodylen = strtoul(val, NULL, 10);
+			have_len = true;
+		} else if (http_header_is(line, eol, "Connection",
+					  &val, &vallen)) {
+			if (memeqstr(val, vallen, "close"))
+				*close = true;
+			else if (memeqstr(val, vallen, "keep-alive"))
+				*close = false;
+		} else if (http_header_is(line, eol, "Transfer-Encoding",
+					  &val, &vallen)) {
+			/* bitcoind doesn't chunk its replies */
+			return -1;
 		}
-	} else
-		*bcli->exitstatus = WEXITSTATUS(status);
+	}
 
-	if (WEXITSTATUS(status) == 0)
-		bitcoind->error_count = 0;
+	if (!have_len)
+		return -1;
+	if (len < hdrlen + *bodylen)
+		return 0;
+
+	*body = buf + hdrlen;
+	return hdrlen + *bodylen;
+}
 
-	bitcoind->num_requests[bcli->prio]--;
+/* Returns the exit status bitcoin-cli would give, and sets *output to what it
+ * would print. */
+static int rpc_reply_to_output(const tal_t *ctx, int http_status,
+			       const char *body, size_t bodylen,
+			       char **output)
+{
+	const jsmntok_t *toks, *result, *error;
 
-	res = bcli->process(bcli);
-	if (!res)
-		bcli_failure(bcli, WEXITSTATUS(status));
-	else
-		tal_free(bcli);
+	if (http_status == 401) {
+		*output = tal_strdup(ctx, "error: Authorization failed:"
+				     " Incorrect rpcuser or rpcpassword\n");
+		return 1;
+	}
 
-done:
-	next_bcli(prio);
+	toks = json_parse_simple(tmpctx, body, bodylen);
+	if (!toks || toks[0].type != JSMN_OBJECT) {
+		*output = tal_fmt(ctx, "error: server returned HTTP error %d\n",
+				  http_status);
+		return 1;
+	}
+
+	error = json_get_member(body, toks, "error");
+	if (error && !json_tok_is_null(body, error)) {
+		const jsmntok_t *msg = json_get_member(body, error, "message");
+		const jsmntok_t *codetok = json_get_member(body, error, "code");
+		int code;
+
+		if (!codetok || !json_to_int(body, codetok, &code))
+			code = -1;
+		*output = tal_fmt(ctx, "error code: %d\nerror message:\n%.*s\n",
+				  code,
+				  msg ? msg->end - msg->start : 0,
+				  msg ? body + msg->start : "");
+		return abs(code);
+	}
+
+	result = json_get_member(body, toks, "result");
+	if (!result || json_tok_is_null(body, result)) {
+		*output = tal_strdup(ctx, "");
+	} else if (result->type == JSMN_STRING) {
+		const char *str = body + result->start;
+		size_t len = result->end - result->start;
+
+		/* Block hex is large, and never needs unescaping */
+		if (memchr(str, '\\', len)) {
+			struct json_escape *esc;
+			esc = json_escape_string_(tmpctx, str, len);
+			str = json_escape_unescape(tmpctx, esc);
+			if (!str) {
+				*output = tal_strdup(ctx, "error: bad string\n");
+				return 1;
+			}
+			len = strlen(str);
+		}
+		*output = tal_fmt(ctx, "%.*s\n", (int)len, str);
+	} else {
+		*output = tal_fmt(ctx, "%.*s\n",
+				  json_tok_full_len(result),
+				  json_tok_full(body, result));
+	}
+	return 0;
+}
+
+static bool rpc_load_cookie(void)
+{
+	char *cookie = grab_file(tmpctx, bitcoind->rpc_cookie_file);
+
+	if (!cookie)
+		return false;
+	strip_trailing_whitespace(cookie, tal_count(cookie) - 1);
+	tal_free(bitcoind->rpc_auth);
+	bitcoind->rpc_auth = b64_encode(bitcoind, cookie, strlen(cookie));
+	return true;
+}
+
+static void rpc_send_pending(void);
+
+/* As if bitcoin-cli couldn't connect (it exits 1). */
+static void rpc_fail_request(struct bitcoin_cli *bcli)
+{
+	bcli->output = tal_fmt(bcli, "error: couldn't connect to server: %s\n",
+			       strerror(errno));
+	bcli->output_bytes = strlen(bcli->output);
+	bcli_failure(bcli, 1);
+}
+
+static void rpc_request_done(struct bitcoin_cli *bcli, int http_status,
+			     const char *body, size_t bodylen)
+{
+	int exitstatus;
+
+	/* bitcoind writes a new cookie every time it starts. */
+	if (http_status == 401 && bitcoind->rpc_cookie_file)
+		rpc_load_cookie();
+
+	exitstatus = rpc_reply_to_output(bcli, http_status, body, bodylen,
+					 &bcli->output);
+	bcli->output_bytes = strlen(bcli->output);
+	bcli_done(bcli, exitstatus);
+}
+
+static struct io_plan *rpc_conn_read(struct io_conn *conn,
+				     struct rpc_conn *rc);
+
+static struct io_plan *rpc_conn_got(struct io_conn *conn,
+				    struct rpc_conn *rc)
+{
+	rc->inlen += rc->inlen_new;
+
+	for (;;) {
+		int status;
+		const char *body;
+		size_t bodylen;
+		bool close;
+		struct bitcoin_cli *bcli;
+		ssize_t used;
+
+		used = http_response_parse(rc->inbuf, rc->inlen, &status,
+					   &body, &bodylen, &close);
+		if (used == 0)
+			break;
+		if (used < 0 || rc->num_written == 0) {
+			plugin_log(bitcoind->plugin, LOG_UNUSUAL,
+				   "Unexpected reply from bitcoind: '%.*s'",
+				   (int)rc->inlen, rc->inbuf);
+			return io_close(conn);
+		}
+
+		bcli = rc->reqs[0];
+		tal_arr_remove(&rc->reqs, 0);
+		rc->num_written--;
+		rc->num_answered++;
+		rpc_request_done(bcli, status, body, bodylen);
+
+		memmove(rc->inbuf, rc->inbuf + used, rc->inlen - used);
+		rc->inlen -= used;
+		if (close)
+			return io_close(conn);
+	}
+
+	/* Don't hang onto a huge buffer after a block. */
+	if (rc->inlen < 4096 && tal_count(rc->inbuf) > 65536)
+		tal_resize(&rc->inbuf, 4096);
+
+	/* We might have room for more requests now. */
+	rpc_send_pending();
+	return rpc_conn_read(conn, rc);
+}
+
+static struct io_plan *rpc_conn_read(struct io_conn *conn,
+				     struct rpc_conn *rc)
+{
+	if (rc->inlen == tal_count(rc->inbuf))
+		tal_resize(&rc->inbuf, rc->inlen * 2);
+	return io_read_partial(conn, rc->inbuf + rc->inlen,
+			       tal_count(rc->inbuf) - rc->inlen,
+			       &rc->inlen_new, rpc_conn_got, rc);
+}
+
+static struct io_plan *rpc_conn_write(struct io_conn *conn,
+				      struct rpc_conn *rc)
+{
+	tal_free(rc->outbuf);
+	rc->outbuf = NULL;
+
+	if (rc->num_written == tal_count(rc->reqs))
+		return io_out_wait(conn, rc, rpc_conn_write, rc);
+
+	rc->outbuf = rpc_request(rc, rc->reqs[rc->num_written]->args);
+	rc->num_written++;
+	return io_write(conn, rc->outbuf, strlen(rc->outbuf),
+			rpc_conn_write, rc);
+}
+
+static struct io_plan *rpc_conn_connected(struct io_conn *conn,
+					  struct rpc_conn *rc)
+{
+	return io_duplex(conn,
+			 rpc_conn_read(conn, rc),
+			 rpc_conn_write(conn, rc));
+}
+
+static void rpc_conn_finished(struct io_conn *conn UNUSED,
+			      struct rpc_conn *rc)
+{
+	bool requeued = false;
+
+	list_del_from(&bitcoind->rpc_conns, &rc->list);
+	bitcoind->num_rpc_conns--;
+
+	/* Backwards, so they go back on the front of pending in order. */
+	for (size_t i = tal_count(rc->reqs); i > 0; i--) {
+		struct bitcoin_cli *bcli = rc->reqs[i-1];
+
+		/* If this connection worked, bitcoind simply closed it on
+		 * us (it times out idle ones): just try again. */
+		if (rc->num_answered) {
+			list_del_from(&bitcoind->current, &bcli->list);
+			tal_del_destructor(bcli, destroy_bcli);
+			list_add(&bitcoind->pending[bcli->prio], &bcli->list);
+			requeued = true;
+			continue;
+		}
+		rpc_fail_request(bcli);
+	}
+
+	tal_free(rc);
+	if (requeued)
+		rpc_send_pending();
+}
+
+static struct io_plan *rpc_conn_init(struct io_conn *conn,
+				     struct rpc_conn *rc)
+{
+	io_set_finish(conn, rpc_conn_finished, rc);
+	return io_connect(conn, bitcoind->rpc_addr, rpc_conn_connected, rc);
+}
+
+static struct rpc_conn *new_rpc_conn(void)
+{
+	struct rpc_conn *rc;
+	struct io_conn *conn;
+	int fd;
+
+	fd = socket(bitcoind->rpc_addr->ai_family,
+		    bitcoind->rpc_addr->ai_socktype,
+		    bitcoind->rpc_addr->ai_protocol);
+	if (fd < 0) {
+		plugin_log(bitcoind->plugin, LOG_UNUSUAL,
+			   "Creating socket for bitcoind: %s",
+			   strerror(errno));
+		return NULL;
+	}
+
+	rc = tal(bitcoind, struct rpc_conn);
+	rc->reqs = tal_arr(rc, struct bitcoin_cli *, 0);
+	rc->num_written = rc->num_answered = 0;
+	rc->outbuf = NULL;
+	rc->inbuf = tal_arr(rc, char, 4096);
+	rc->inlen = 0;
+	list_add_tail(&bitcoind->rpc_conns, &rc->list);
+	bitcoind->num_rpc_conns++;
+
+	/* If connect fails immediately, this frees rc and returns NULL. */
+	conn = io_new_conn(bitcoind, fd, rpc_conn_init, rc);
+	if (!conn)
+		return NULL;
+	rc->conn = conn;
+	return rc;
+}
+
+/* Find (or open) a connection with room for another request. */
+static struct rpc_conn *rpc_conn_for_request(void)
+{
+	struct rpc_conn *rc, *best = NULL;
+
+	list_for_each(&bitcoind->rpc_conns, rc, list) {
+		if (!best || tal_count(rc->reqs) < tal_count(best->reqs))
+			best = rc;
+	}
+
+	if (best && tal_count(best->reqs) == 0)
+		return best;
+
+	if (bitcoind->num_rpc_conns < bitcoind->rpc_max_conns) {
+		rc = new_rpc_conn();
+		if (rc)
+			return rc;
+	}
+
+	if (best && tal_count(best->reqs) < bitcoind->rpc_pipeline)
+		return best;
+	return NULL;
+}
+
+static void rpc_send_pending(void)
+{
+	for (;;) {
+		struct bitcoin_cli *bcli;
+		struct rpc_conn *rc;
+		enum bitcoind_prio prio;
+
+		if (!list_empty(&bitcoind->pending[BITCOIND_HIGH_PRIO]))
+			prio = BITCOIND_HIGH_PRIO;
+		else if (!list_empty(&bitcoind->pending[BITCOIND_LOW_PRIO]))
+			prio = BITCOIND_LOW_PRIO;
+		else
+			return;
+
+		rc = rpc_conn_for_request();
+		/* They're all busy: we'll be called again on replies. */
+		if (!rc && bitcoind->num_rpc_conns != 0)
+			return;
+
+		bcli = list_pop(&bitcoind->pending[prio],
+				struct bitcoin_cli, list);
+		bcli->start = time_now();
+		list_add_tail(&bitcoind->current, &bcli->list);
+		tal_add_destructor(bcli, destroy_bcli);
+
+		/* Couldn't even open a connection: retry later. */
+		if (!rc) {
+			rpc_fail_request(bcli);
+			continue;
+		}
+
+		tal_arr_expand(&rc->reqs, bcli);
+		io_wake(rc);
+	}
 }
 
 static void next_bcli(enum bitcoind_prio prio)
@@ -295,6 +818,11 @@ static void next_bcli(enum bitcoind_prio prio)
 	struct io_conn *conn;
 	int in;
 
+	if (bitcoind->rpc) {
+		rpc_send_pending();
+		return;
+	}
+
 	if (bitcoind->num_requests[prio] >= BITCOIND_MAX_PARALLEL)
 		return;
 
@@ -347,7 +875,10 @@ start_bitcoin_cliv(const tal_t *ctx,
 	else
 		bcli->exitstatus = NULL;
 
-	bcli->args = gather_argsv(bcli, method, ap);
+	if (bitcoind->rpc)
+		bcli->args = gather_rpc_argsv(bcli, method, ap);
+	else
+		bcli->args = gather_argsv(bcli, method, ap);
 	bcli->stash = stash;
 
 	list_add_tail(&bitcoind->pending[bcli->prio], &bcli->list);
@@ -374,15 +905,6 @@ start_bitcoin_cli(const tal_t *ctx,
 	va_end(ap);
 }
 
-static void strip_trailing_whitespace(char *str, size_t len)
-{
-	size_t stripped_len = len;
-	while (stripped_len > 0 && cisspace(str[stripped_len-1]))
-		stripped_len--;
-
-	str[stripped_len] = 0x00;
-}
-
 static struct command_result *command_err_bcli_badjson(struct bitcoin_cli *bcli,
 						       const char *errmsg)
 {
@@ -431,10 +953,48 @@ static struct command_result *process_getutxout(struct bitcoin_cli *bcli)
 	return command_finished(bcli->cmd, response);
 }
 
-static struct command_result *process_getblockchaininfo(struct bitcoin_cli *bcli)
+struct getchaininfo_stash {
+	const char *chain;
+	u32 headers, blocks;
+	bool ibd;
+};
+
+static struct command_result *process_getindexinfo(struct bitcoin_cli *bcli)
 {
 	const jsmntok_t *tokens;
 	struct json_stream *response;
+	struct getchaininfo_stash *stash = bcli->stash;
+	bool blockfilters = false;
+
+	/* Older bitcoind don't have getindexinfo at all; if the index isn't
+	 * enabled, it's simply not mentioned. */
+	if (*bcli->exitstatus == 0) {
+		tokens = json_parse_simple(bcli->output,
+					   bcli->output, bcli->output_bytes);
+		if (!tokens)
+			return command_err_bcli_badjson(bcli, "cannot parse");
+		blockfilters = json_get_member(bcli->output, tokens,
+					       "basic block filter index")
+			!= NULL;
+	}
+
+	response = jsonrpc_stream_success(bcli->cmd);
+	json_add_string(response, "chain", stash->chain);
+	json_add_u32(response, "headercount", stash->headers);
+	json_add_u32(response, "blockcount", stash->blocks);
+	json_add_bool(response, "ibd", stash->ibd);
+	/* We can hand over raw blocks in files: see getrawblockbyheight */
+	json_add_bool(response, "blockfile", true);
+	/* bitcoind has `-blockfilterindex`: see getblockfilter */
+	json_add_bool(response, "blockfilters", blockfilters);
+
+	return command_finished(bcli->cmd, response);
+}
+
+static struct command_result *process_getblockchaininfo(struct bitcoin_cli *bcli)
+{
+	const jsmntok_t *tokens;
+	struct getchaininfo_stash *stash;
 	bool ibd;
 	u32 headers, blocks;
 	const char *chain, *err;
@@ -454,13 +1014,17 @@ static struct command_result *process_getblockchaininfo(struct bitcoin_cli *bcli
 	if (err)
 		return command_err_bcli_badjson(bcli, err);
 
-	response = jsonrpc_stream_success(bcli->cmd);
-	json_add_string(response, "chain", chain);
-	json_add_u32(response, "headercount", headers);
-	json_add_u32(response, "blockcount", blocks);
-	json_add_bool(response, "ibd", ibd);
+	stash = tal(bcli->cmd, struct getchaininfo_stash);
+	stash->chain = tal_steal(stash, chain);
+	stash->headers = headers;
+	stash->blocks = blocks;
+	stash->ibd = ibd;
 
-	return command_finished(bcli->cmd, response);
+	start_bitcoin_cli(NULL, bcli->cmd, process_getindexinfo, true,
+			  BITCOIND_HIGH_PRIO, stash,
+			  "getindexinfo", "basic block filter index", NULL);
+
+	return command_still_pending(bcli->cmd);
 }
 
 enum feerate_levels {
@@ -554,19 +1118,60 @@ struct getrawblock_stash {
 	const char *block_hash;
 	u32 block_height;
 	const char *block_hex;
+	/* Did the caller ask for the block in a file? */
+	bool blockfile;
 };
 
+/* Write the raw block into a temporary file for the caller, who deletes it:
+ * this saves them (and us) pushing twice its size through JSON. */
+static const char *write_blockfile(const tal_t *ctx, const char *hex)
+{
+	size_t hexlen = strlen(hex), len = hex_data_size(hexlen);
+	u8 *raw = tal_arr(tmpctx, u8, len);
+	const char *tmpdir = getenv("TMPDIR");
+	char *path;
+	int fd;
+
+	if (!hex_decode(hex, hexlen, raw, len))
+		return NULL;
+
+	path = tal_fmt(ctx, "%s/cln-block-XXXXXX", tmpdir ? tmpdir : "/tmp");
+	fd = mkstemp(path);
+	if (fd < 0) {
+		plugin_log(bitcoind->plugin, LOG_UNUSUAL,
+			   "Could not create %s: %s", path, strerror(errno));
+		return tal_free(path);
+	}
+	if (!write_all(fd, raw, len)) {
+		plugin_log(bitcoind->plugin, LOG_UNUSUAL,
+			   "Could not write %s: %s", path, strerror(errno));
+		close_noerr(fd);
+		unlink(path);
+		return tal_free(path);
+	}
+	close(fd);
+	return path;
+}
+
 static struct command_result *process_getrawblock(struct bitcoin_cli *bcli)
 {
 	struct json_stream *response;
 	struct getrawblock_stash *stash = bcli->stash;
+	const char *blockfile = NULL;
 
 	strip_trailing_whitespace(bcli->output, bcli->output_bytes);
 	stash->block_hex = tal_steal(stash, bcli->output);
 
+	/* If that fails, we simply fall back to hex. */
+	if (stash->blockfile)
+		blockfile = write_blockfile(tmpctx, stash->block_hex);
+
 	response = jsonrpc_stream_success(bcli->cmd);
 	json_add_string(response, "blockhash", stash->block_hash);
-	json_add_string(response, "block", stash->block_hex);
+	if (blockfile)
+		json_add_string(response, "blockfile", blockfile);
+	else
+		json_add_string(response, "block", stash->block_hex);
 
 	return command_finished(bcli->cmd, response);
 }
@@ -622,15 +1227,18 @@ static struct command_result *getrawblockbyheight(struct command *cmd,
 {
 	struct getrawblock_stash *stash;
 	u32 *height;
+	bool *blockfile;
 
 	/* bitcoin-cli wants a string. */
 	if (!param(cmd, buf, toks,
 	           p_req("height", param_number, &height),
+	           p_opt_def("blockfile", param_bool, &blockfile, false),
 	           NULL))
 		return command_param_failed();
 
 	stash = tal(cmd, struct getrawblock_stash);
 	stash->block_height = *height;
+	stash->blockfile = *blockfile;
 	tal_free(height);
 
 	start_bitcoin_cli(NULL, cmd, process_getblockhash, true,
@@ -642,6 +1250,129 @@ static struct command_result *getrawblockbyheight(struct command *cmd,
 	return command_still_pending(cmd);
 }
 
+struct getblockfilter_stash {
+	u32 block_height;
+	const char *block_hash;
+	const char *header_hex;
+};
+
+static struct command_result *process_getblockfilter(struct bitcoin_cli *bcli)
+{
+	const jsmntok_t *tokens;
+	struct json_stream *response;
+	struct getblockfilter_stash *stash = bcli->stash;
+	const char *filter = NULL, *err;
+
+	/* Index not enabled, or not caught up: they'll have to get the
+	 * whole block. */
+	if (*bcli->exitstatus == 0) {
+		tokens = json_parse_simple(bcli->output,
+					   bcli->output, bcli->output_bytes);
+		if (!tokens)
+			return command_err_bcli_badjson(bcli, "cannot parse");
+		err = json_scan(tmpctx, bcli->output, tokens, "{filter:%}",
+				JSON_SCAN_TAL(tmpctx, json_strdup, &filter));
+		if (err)
+			return command_err_bcli_badjson(bcli, err);
+	}
+
+	response = jsonrpc_stream_success(bcli->cmd);
+	json_add_string(response, "blockhash", stash->block_hash);
+	json_add_string(response, "header", stash->header_hex);
+	if (filter)
+		json_add_string(response, "filter", filter);
+	else
+		json_add_null(response, "filter");
+
+	return command_finished(bcli->cmd, response);
+}
+
+static struct command_result *process_getblockheader(struct bitcoin_cli *bcli)
+{
+	struct getblockfilter_stash *stash = bcli->stash;
+
+	strip_trailing_whitespace(bcli->output, bcli->output_bytes);
+	stash->header_hex = tal_strdup(stash, bcli->output);
+
+	start_bitcoin_cli(NULL, bcli->cmd, process_getblockfilter, true,
+			  BITCOIND_HIGH_PRIO, stash,
+			  "getblockfilter", stash->block_hash, "basic", NULL);
+
+	return command_still_pending(bcli->cmd);
+}
+
+static struct command_result *
+getblockfilter_notfound(struct bitcoin_cli *bcli)
+{
+	struct json_stream *response;
+
+	response = jsonrpc_stream_success(bcli->cmd);
+	json_add_null(response, "blockhash");
+	json_add_null(response, "header");
+	json_add_null(response, "filter");
+
+	return command_finished(bcli->cmd, response);
+}
+
+static struct command_result *
+process_getblockhash_for_filter(struct bitcoin_cli *bcli)
+{
+	struct getblockfilter_stash *stash = bcli->stash;
+
+	/* If it failed with error 8, give an empty response. */
+	if (bcli->exitstatus && *bcli->exitstatus != 0) {
+		/* Other error means we have to retry. */
+		if (*bcli->exitstatus != 8)
+			return NULL;
+		return getblockfilter_notfound(bcli);
+	}
+
+	strip_trailing_whitespace(bcli->output, bcli->output_bytes);
+	stash->block_hash = tal_strdup(stash, bcli->output);
+	if (!stash->block_hash || strlen(stash->block_hash) != 64) {
+		return command_err_bcli_badjson(bcli, "bad blockhash");
+	}
+
+	start_bitcoin_cli(NULL, bcli->cmd, process_getblockheader, false,
+			  BITCOIND_HIGH_PRIO, stash,
+			  "getblockheader",
+			  stash->block_hash,
+			  /* Non-verbose: raw header. */
+			  "false",
+			  NULL);
+
+	return command_still_pending(bcli->cmd);
+}
+
+/* Get a block header and its BIP158 filter given its height.
+ * Calls `getblockhash`, `getblockheader` then `getblockfilter`.
+ * Will return early with null fields if block isn't known (yet).
+ */
+static struct command_result *getblockfilter(struct command *cmd,
+					     const char *buf,
+					     const jsmntok_t *toks)
+{
+	struct getblockfilter_stash *stash;
+	u32 *height;
+
+	if (!param(cmd, buf, toks,
+		   p_req("height", param_number, &height),
+		   NULL))
+		return command_param_failed();
+
+	stash = tal(cmd, struct getblockfilter_stash);
+	stash->block_height = *height;
+	tal_free(height);
+
+	start_bitcoin_cli(NULL, cmd, process_getblockhash_for_filter, true,
+			  BITCOIND_LOW_PRIO, stash,
+			  "getblockhash",
+			  take(tal_fmt(NULL, "%u", stash->block_height)),
+			  NULL);
+
+	return command_still_pending(cmd);
+}
+
 /* Get infos about the block chain.
  * Calls `getblockchaininfo` and returns headers count, blocks count,
  * the chain id, and whether this is initialblockdownload.
@@ -750,6 +1481,25 @@ static struct command_result *estimatefees_done(struct bitcoin_cli *bcli)
 	return estimatefees_next(bcli->cmd, stash);
 }
 
+/* Second arg to sendrawtransaction, if any */
+static const char *highfees_arg(bool allowhighfees)
+{
+	if (!allowhighfees)
+		return NULL;
+
+	if (bitcoind->version >= 190001)
+		/* Starting in 19.0.1, second argument is
+		 * maxfeerate, which when set to 0 means
+		 * no max feerate.
+		 */
+		return "0";
+
+	/* in older versions, second arg is allowhighfees,
+	 * set to true to allow high fees.
+	 */
+	return "true";
+}
+
 /* Send a transaction to the Bitcoin network.
  * Calls `sendrawtransaction` using the first parameter as the raw tx.
  */
@@ -757,7 +1507,7 @@ static struct command_result *sendrawtransaction(struct command *cmd,
                                                  const char *buf,
                                                  const jsmntok_t *toks)
 {
-	const char *tx, *highfeesarg;
+	const char *tx;
 	bool *allowhighfees;
 
 	/* bitcoin-cli wants strings. */
@@ -767,29 +1517,192 @@ static struct command_result *sendrawtransaction(struct command *cmd,
 	           NULL))
 		return command_param_failed();
 
-	if (*allowhighfees) {
-		if (bitcoind->version >= 190001)
-			/* Starting in 19.0.1, second argument is
-			 * maxfeerate, which when set to 0 means
-			 * no max feerate.
-			 */
-			highfeesarg = "0";
-		else
-			/* in older versions, second arg is allowhighfees,
-			 * set to true to allow high fees.
-			 */
-			highfeesarg = "true";
-	} else
-		highfeesarg = NULL;
-
 	start_bitcoin_cli(NULL, cmd, process_sendrawtransaction, true,
 			  BITCOIND_HIGH_PRIO, NULL,
 			  "sendrawtransaction",
-			  tx, highfeesarg, NULL);
+			  tx, highfees_arg(*allowhighfees), NULL);
 
 	return command_still_pending(cmd);
 }
 
+struct sendrawtxs_stash {
+	const char **txs;
+	const char *highfeesarg;
+	/* Set as each one is sent (or found not to need sending) */
+	bool *success;
+	const char **errmsg;
+	/* How many getrawmempool/sendrawtransaction calls are running */
+	size_t pending;
+};
+
+/* Which of stash->txs a single sendrawtransaction call is about. */
+struct sendrawtxs_part {
+	struct sendrawtxs_stash *stash;
+	size_t n;
+};
+
+static struct command_result *sendrawtxs_part_done(struct command *cmd,
+						   struct sendrawtxs_stash *stash)
+{
+	struct json_stream *response;
+
+	assert(stash->pending > 0);
+	if (--stash->pending)
+		return command_still_pending(cmd);
+
+	response = jsonrpc_stream_success(cmd);
+	json_array_start(response, "results");
+	for (size_t i = 0; i < tal_count(stash->txs); i++) {
+		json_object_start(response, NULL);
+		json_add_bool(response, "success", stash->success[i]);
+		json_add_string(response, "errmsg", stash->errmsg[i]);
+		json_object_end(response);
+	}
+	json_array_end(response);
+
+	return command_finished(cmd, response);
+}
+
+static struct command_result *process_sendrawtxs_one(struct bitcoin_cli *bcli)
+{
+	struct sendrawtxs_part *part = bcli->stash;
+	struct sendrawtxs_stash *stash = part->stash;
+	int exitstatus = *bcli->exitstatus;
+
+	/* Same as process_sendrawtransaction, which tests look for. */
+	plugin_log(bcli->cmd->plugin, LOG_DBG,
+		   "sendrawtx exit %i (%s) %.*s",
+		   exitstatus, bcli_args(bcli),
+		   exitstatus ? (u32)bcli->output_bytes-1 : 0,
+		   bcli->output);
+
+	stash->success[part->n] = exitstatus == 0
+		|| exitstatus == RPC_TRANSACTION_ALREADY_IN_CHAIN;
+	stash->errmsg[part->n] = exitstatus ?
+		tal_strndup(stash, bcli->output, bcli->output_bytes-1) : "";
+
+	return sendrawtxs_part_done(bcli->cmd, stash);
+}
+
+static void sendrawtxs_one(struct command *cmd,
+			   struct sendrawtxs_stash *stash, size_t i)
+{
+	struct sendrawtxs_part *part = tal(stash, struct sendrawtxs_part);
+
+	part->stash = stash;
+	part->n = i;
+	stash->pending++;
+	start_bitcoin_cli(NULL, cmd, process_sendrawtxs_one, true,
+			  BITCOIND_HIGH_PRIO, part,
+			  "sendrawtransaction",
+			  stash->txs[i], stash->highfeesarg, NULL);
+}
+
+static struct command_result *process_getrawmempool(struct bitcoin_cli *bcli)
+{
+	struct sendrawtxs_stash *stash = bcli->stash;
+	const jsmntok_t *toks = NULL, *t;
+	bool *known = tal_arrz(tmpctx, bool, tal_count(stash->txs));
+	STRMAP(size_t *) ours;
+	size_t i;
+
+	if (*bcli->exitstatus == 0)
+		toks = json_parse_simple(bcli->output,
+					 bcli->output, bcli->output_bytes);
+
+	/* If we can't get the mempool, we simply send everything. */
+	if (toks && toks->type == JSMN_ARRAY) {
+		strmap_init(&ours);
+		for (i = 0; i < tal_count(stash->txs); i++) {
+			struct bitcoin_tx *tx;
+			struct bitcoin_txid txid;
+			char hex[hex_str_size(sizeof(txid))];
+			size_t *n;
+
+			/* sendrawtransaction will tell them what's wrong. */
+			tx = bitcoin_tx_from_hex(tmpctx, stash->txs[i],
+						 strlen(stash->txs[i]));
+			if (!tx)
+				continue;
+			bitcoin_txid(tx, &txid);
+			bitcoin_txid_to_hex(&txid, hex, sizeof(hex));
+			n = tal(tmpctx, size_t);
+			*n = i;
+			/* Fails (harmlessly) for a duplicate: we send that. */
+			strmap_add(&ours, tal_strdup(tmpctx, hex), n);
+		}
+
+		json_for_each_arr(i, t, toks) {
+			size_t *n = strmap_getn(&ours, bcli->output + t->start,
+						t->end - t->start);
+			if (n)
+				known[*n] = true;
+		}
+		strmap_clear(&ours);
+	}
+
+	for (i = 0; i < tal_count(stash->txs); i++) {
+		if (known[i]) {
+			plugin_log(bcli->cmd->plugin, LOG_DBG,
+				   "getrawmempool: tx %zu already known,"
+				   " not sending", i);
+			stash->success[i] = true;
+			stash->errmsg[i] = "";
+			continue;
+		}
+		sendrawtxs_one(bcli->cmd, stash, i);
+	}
+
+	return sendrawtxs_part_done(bcli->cmd, stash);
+}
+
+/* Send several transactions.  With `preflight`, first fetch the mempool
+ * (in one call, however many txs there are) and don't send txs already in
+ * it: each would cost a call just to ask, which saves nothing over sending
+ * it.  Ones already in a block are caught by sendrawtransaction. */
+static struct command_result *sendrawtransactions(struct command *cmd,
+						  const char *buf,
+						  const jsmntok_t *toks)
+{
+	const jsmntok_t *txstok, *t;
+	bool *allowhighfees, *preflight;
+	struct sendrawtxs_stash *stash;
+	size_t i;
+
+	if (!param(cmd, buf, toks,
+		   p_req("txs", param_array, &txstok),
+		   p_req("allowhighfees", param_bool, &allowhighfees),
+		   p_opt_def("preflight", param_bool, &preflight, false),
+		   NULL))
+		return command_param_failed();
+
+	stash = tal(cmd, struct sendrawtxs_stash);
+	stash->txs = tal_arr(stash, const char *, txstok->size);
+	json_for_each_arr(i, t, txstok) {
+		if (t->type != JSMN_STRING)
+			return command_fail_badparam(cmd, "txs", buf, t,
+						     "should be a string");
+		stash->txs[i] = json_strdup(stash->txs, buf, t);
+	}
+	stash->highfeesarg = highfees_arg(*allowhighfees);
+	stash->success = tal_arrz(stash, bool, txstok->size);
+	stash->errmsg = tal_arr(stash, const char *, txstok->size);
+	/* Held until we've started them all, so we can't finish early. */
+	stash->pending = 1;
+
+	if (*preflight && tal_count(stash->txs)) {
+		stash->pending++;
+		start_bitcoin_cli(NULL, cmd, process_getrawmempool, true,
+				  BITCOIND_HIGH_PRIO, stash,
+				  "getrawmempool", NULL);
+	} else {
+		for (i = 0; i < tal_count(stash->txs); i++)
+			sendrawtxs_one(cmd, stash, i);
+	}
+
+	return sendrawtxs_part_done(cmd, stash);
+}
+
 static struct command_result *getutxout(struct command *cmd,
                                        const char *buf,
                                        const jsmntok_t *toks)
@@ -921,6 +1834,197 @@ static void wait_and_check_bitcoind(struct plugin *p)
 	tal_free(cmd);
 }
 
+/* Where bitcoind puts its cookie, if it's a network we know. */
+static char *rpc_cookie_path(const tal_t *ctx)
+{
+	const char *datadir = bitcoind->datadir, *subdir;
+
+	if (streq(chainparams->network_name, "bitcoin"))
+		subdir = "";
+	else if (streq(chainparams->network_name, "testnet"))
+		subdir = "testnet3/";
+	else if (streq(chainparams->network_name, "regtest"))
+		subdir = "regtest/";
+	else if (streq(chainparams->network_name, "signet"))
+		subdir = "signet/";
+	else
+		return NULL;
+
+	if (!datadir) {
+		const char *home = getenv("HOME");
+		if (!home)
+			return NULL;
+		datadir = path_join(tmpctx, home, ".bitcoin");
+	}
+	return tal_fmt(ctx, "%s/%s.cookie", datadir, subdir);
+}
+
+/* Returns NULL if we can use the RPC server, otherwise why not. */
+static const char *rpc_setup(const tal_t *ctx)
+{
+	const char *host, *port;
+	struct addrinfo hints;
+	int err;
+
+	if (bitcoind->rpcuser && bitcoind->rpcpass) {
+		const char *userpass = tal_fmt(tmpctx, "%s:%s",
+					       bitcoind->rpcuser,
+					       bitcoind->rpcpass);
+		bitcoind->rpc_auth = b64_encode(bitcoind, userpass,
+						strlen(userpass));
+	} else if (!bitcoind->rpcuser && !bitcoind->rpcpass) {
+		bitcoind->rpc_cookie_file = rpc_cookie_path(bitcoind);
+		if (!bitcoind->rpc_cookie_file)
+			return "no bitcoin-rpcuser/bitcoin-rpcpassword";
+		if (!rpc_load_cookie())
+			return tal_fmt(ctx, "no bitcoin-rpcuser/bitcoin-rpcpassword,"
+				       " and cannot read %s",
+				       bitcoind->rpc_cookie_file);
+	} else
+		return "need both bitcoin-rpcuser and bitcoin-rpcpassword";
+
+	host = bitcoind->rpcconnect ? bitcoind->rpcconnect : "127.0.0.1";
+	if (bitcoind->rpcport)
+		port = bitcoind->rpcport;
+	else
+		port = tal_fmt(tmpctx, "%u", chainparams->rpc_port);
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	err = getaddrinfo(host, port, &hints, &bitcoind->rpc_addrs);
+	if (err)
+		return tal_fmt(ctx, "cannot resolve %s:%s: %s",
+			       host, port, gai_strerror(err));
+
+	bitcoind->rpc_host = tal_fmt(bitcoind, "%s:%s", host, port);
+	return NULL;
+}
+
+/* Synchronous call, only used at startup: returns NULL (and sets *err) if we
+ * couldn't talk to the RPC server at all. */
+static char *rpc_call_sync(const tal_t *ctx, const char **args,
+			   int *exitstatus, const char **err)
+{
+	char *req = rpc_request(tmpctx, args), *buf, *output;
+	const char *body;
+	size_t len = 0, bodylen;
+	struct addrinfo *ai;
+	int fd = -1, status;
+	bool close_conn;
+
+	for (ai = bitcoind->rpc_addrs; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close_noerr(fd);
+		fd = -1;
+	}
+	if (fd < 0) {
+		*err = tal_fmt(ctx, "cannot connect to %s: %s",
+			       bitcoind->rpc_host, strerror(errno));
+		return NULL;
+	}
+	/* This is the one which works. */
+	bitcoind->rpc_addr = ai;
+
+	if (!write_all(fd, req, strlen(req))) {
+		*err = tal_fmt(ctx, "writing to %s: %s",
+			       bitcoind->rpc_host, strerror(errno));
+		close_noerr(fd);
+		return NULL;
+	}
+
+	buf = tal_arr(tmpctx, char, 4096);
+	for (;;) {
+		ssize_t r, used;
+
+		if (len == tal_count(buf))
+			tal_resize(&buf, len * 2);
+		r = read(fd, buf + len, tal_count(buf) - len);
+		if (r <= 0) {
+			*err = tal_fmt(ctx, "reading from %s: %s",
+				       bitcoind->rpc_host,
+				       r == 0 ? "connection closed"
+				       : strerror(errno));
+			close_noerr(fd);
+			return NULL;
+		}
+		len += r;
+
+		used = http_response_parse(buf, len, &status,
+					   &body, &bodylen, &close_conn);
+		if (used < 0) {
+			*err = tal_fmt(ctx, "bad HTTP reply from %s: '%.*s'",
+				       bitcoind->rpc_host, (int)len, buf);
+			close_noerr(fd);
+			return NULL;
+		}
+		if (used > 0)
+			break;
+	}
+	close(fd);
+
+	if (status == 401) {
+		*err = tal_fmt(ctx, "%s refused our credentials",
+			       bitcoind->rpc_host);
+		return NULL;
+	}
+
+	*exitstatus = rpc_reply_to_output(ctx, status, body, bodylen, &output);
+	return output;
+}
+
+/* Like wait_and_check_bitcoind, but over RPC: returns false if that's
+ * not possible, so we should use bitcoin-cli. */
+static bool wait_and_check_bitcoind_rpc(struct plugin *p)
+{
+	const char *args[] = { "getnetworkinfo", NULL };
+	const char *err;
+	char *output;
+	int exitstatus;
+	bool printed = false;
+
+	err = rpc_setup(tmpctx);
+	if (err) {
+		plugin_log(p, LOG_DBG, "Not using bitcoind RPC directly: %s",
+			   err);
+		return false;
+	}
+
+	for (;;) {
+		output = rpc_call_sync(tmpctx, args, &exitstatus, &err);
+		if (!output) {
+			plugin_log(p, LOG_UNUSUAL,
+				   "Could not use bitcoind RPC directly (%s):"
+				   " falling back to bitcoin-cli", err);
+			return false;
+		}
+		if (exitstatus == 0)
+			break;
+
+		/* bitcoin/src/rpc/protocol.h:
+		 *	RPC_IN_WARMUP = -28, //!< Client still warming up
+		 */
+		if (exitstatus != 28)
+			bitcoind_failure(p, tal_fmt(bitcoind,
+						    "getnetworkinfo failed: %s",
+						    output));
+
+		if (!printed) {
+			plugin_log(p, LOG_UNUSUAL,
+				   "Waiting for bitcoind to warm up...");
+			printed = true;
+		}
+		sleep(1);
+	}
+
+	parse_getnetworkinfo_result(p, output);
+	return true;
+}
+
 #if DEVELOPER
 static void memleak_mark_bitcoind(struct plugin *p, struct htable *memtable)
 {
@@ -931,7 +2035,11 @@ static void memleak_mark_bitcoind(struct plugin *p, struct htable *memtable)
 static const char *init(struct plugin *p, const char *buffer UNUSED,
 			const jsmntok_t *config UNUSED)
 {
-	wait_and_check_bitcoind(p);
+	bitcoind->plugin = p;
+	bitcoind->rpc = bitcoind->rpc_max_conns != 0
+		&& wait_and_check_bitcoind_rpc(p);
+	if (!bitcoind->rpc)
+		wait_and_check_bitcoind(p);
 
 	/* Usually we fake up fees in regtest */
 	if (streq(chainparams->network_name, "regtest"))
@@ -942,8 +2050,13 @@ static const char *init(struct plugin *p, const char *buffer UNUSED,
 #if DEVELOPER
 	plugin_set_memleak_handler(p, memleak_mark_bitcoind);
 #endif
-	plugin_log(p, LOG_INFORM,
-		   "bitcoin-cli initialized and connected to bitcoind.");
+	if (bitcoind->rpc)
+		plugin_log(p, LOG_INFORM,
+			   "RPC initialized and connected to bitcoind at %s.",
+			   bitcoind->rpc_host);
+	else
+		plugin_log(p, LOG_INFORM,
+			   "bitcoin-cli initialized and connected to bitcoind.");
 
 	return NULL;
 }
@@ -956,6 +2069,14 @@ static const struct plugin_command commands[] = {
 		"",
 		getrawblockbyheight
 	},
+	{
+		"getblockfilter",
+		"bitcoin",
+		"Get the header and BIP158 filter of the bitcoin block at a"
+		" given height",
+		"",
+		getblockfilter
+	},
 	{
 		"getchaininfo",
 		"bitcoin",
@@ -979,6 +2100,14 @@ static const struct plugin_command commands[] = {
 		"",
 		sendrawtransaction
 	},
+	{
+		"sendrawtransactions",
+		"bitcoin",
+		"Send several raw transactions to the Bitcoin network at once"
+		" (with {preflight}, skipping ones bitcoind already has).",
+		"",
+		sendrawtransactions
+	},
 	{
 		"getutxout",
 		"bitcoin",
@@ -1010,6 +2139,16 @@ static struct bitcoind *new_bitcoind(const tal_t *ctx)
 #if DEVELOPER
 	bitcoind->no_fake_fees = false;
 #endif
+	bitcoind->rpc_max_conns = BITCOIND_MAX_PARALLEL;
+	bitcoind->rpc_pipeline = 1;
+	bitcoind->rpc = false;
+	bitcoind->rpc_addrs = bitcoind->rpc_addr = NULL;
+	bitcoind->rpc_host = NULL;
+	bitcoind->rpc_auth = bitcoind->rpc_cookie_file = NULL;
+	list_head_init(&bitcoind->rpc_conns);
+	bitcoind->num_rpc_conns = 0;
+	bitcoind->rpc_next_id = 0;
+	bitcoind->plugin = NULL;
 
 	return bitcoind;
 }
@@ -1053,6 +2192,17 @@ int main(int argc, char *argv[])
 				  "how long to keep retrying to contact bitcoind"
 				  " before fatally exiting",
 				  u64_option, &bitcoind->retry_timeout),
+		    plugin_option("bitcoin-rpc-connections",
+				  "int",
+				  "How many HTTP connections to keep open to"
+				  " bitcoind's RPC server (0 to run bitcoin-cli"
+				  " for every request instead)",
+				  u32_option, &bitcoind->rpc_max_conns),
+		    plugin_option("bitcoin-rpc-pipeline",
+				  "int",
+				  "How many requests to send on each of those"
+				  " connections before waiting for a reply",
+				  u32_option, &bitcoind->rpc_pipeline),
 		    plugin_option("commit-fee",
 				  "string",
 				  "Percentage of fee to request for their commitment",
@@ -0,0 +1,642 @@
+/* This plugin mirrors the list* commands into an in-memory sqlite3
+ * database, and lets you run (read-only!) queries against it.
+ *
+ * Tables with a wait subsystem are refreshed incrementally using the
+ * created/updated/deleted indexes; the rest are simply reloaded. */
+#include "config.h"
+#include <ccan/array_size/array_size.h>
+#include <ccan/json_escape/json_escape.h>
+#include <ccan/list/list.h>
+#include <ccan/tal/str/str.h>
+#include <common/json_param.h>
+#include <common/json_stream.h>
+#include <errno.h>
+#include <plugins/libplugin.h>
+#include <sqlite3.h>
+
+enum coltype {
+	/* Numbers, booleans and msat amounts */
+	COL_INT,
+	/* Timestamps with fractional seconds */
+	COL_REAL,
+	COL_TEXT,
+};
+
+struct column {
+	/* Both the JSON field name and the column name. */
+	const char *name;
+	enum coltype type;
+};
+
+struct table_desc {
+	/* Name of the SQL table */
+	const char *name;
+	/* Command to populate it, and the array it returns. */
+	const char *cmd;
+	const char *arrname;
+	/* If non-NULL, the wait subsystem for incremental refresh;
+	 * created_index is then the primary key (lightningd keeps it
+	 * unique, even for forwards, which lack a unique id). */
+	const char *subsystem;
+	const struct column *columns;
+	size_t num_columns;
+	/* Columns we index (NULL terminated) */
+	const char **indexes;
+
+	/* Runtime state: how far we've loaded.  */
+	u64 max_created, max_updated, deleted;
+	sqlite3_stmt *insert;
+};
+
+#define COLUMNS(arr) (arr), ARRAY_SIZE(arr)
+
+static const struct column invoice_cols[] = {
+	{ "created_index", COL_INT },
+	{ "updated_index", COL_INT },
+	{ "label", COL_TEXT },
+	{ "description", COL_TEXT },
+	{ "payment_hash", COL_TEXT },
+	{ "status", COL_TEXT },
+	{ "expires_at", COL_INT },
+	{ "amount_msat", COL_INT },
+	{ "bolt11", COL_TEXT },
+	{ "bolt12", COL_TEXT },
+	{ "local_offer_id", COL_TEXT },
+	{ "invreq_payer_note", COL_TEXT },
+	{ "pay_index", COL_INT },
+	{ "amount_received_msat", COL_INT },
+	{ "paid_at", COL_INT },
+	{ "payment_preimage", COL_TEXT },
+};
+static const char *invoice_indexes[] = { "payment_hash", "paid_at", NULL };
+
+static const struct column sendpay_cols[] = {
+	{ "created_index", COL_INT },
+	{ "updated_index", COL_INT },
+	{ "id", COL_INT },
+	{ "groupid", COL_INT },
+	{ "partid", COL_INT },
+	{ "payment_hash", COL_TEXT },
+	{ "status", COL_TEXT },
+	{ "amount_msat", COL_INT },
+	{ "destination", COL_TEXT },
+	{ "created_at", COL_INT },
+	{ "completed_at", COL_INT },
+	{ "amount_sent_msat", COL_INT },
+	{ "label", COL_TEXT },
+	{ "bolt11", COL_TEXT },
+	{ "description", COL_TEXT },
+	{ "bolt12", COL_TEXT },
+	{ "payment_preimage", COL_TEXT },
+	{ "erroronion", COL_TEXT },
+};
+static const char *sendpay_indexes[] = { "payment_hash", "created_at", NULL };
+
+static const struct column forward_cols[] = {
+	{ "created_index", COL_INT },
+	{ "updated_index", COL_INT },
+	{ "in_channel", COL_TEXT },
+	{ "in_htlc_id", COL_INT },
+	{ "in_msat", COL_INT },
+	{ "status", COL_TEXT },
+	{ "received_time", COL_REAL },
+	{ "out_channel", COL_TEXT },
+	{ "out_htlc_id", COL_INT },
+	{ "style", COL_TEXT },
+	{ "resolved_time", COL_REAL },
+	{ "failcode", COL_INT },
+	{ "failreason", COL_TEXT },
+	{ "fee_msat", COL_INT },
+	{ "out_msat", COL_INT },
+};
+static const char *forward_indexes[] = { "in_channel", "out_channel",
+					 "resolved_time", NULL };
+
+/* Nested objects and arrays are not included. */
+static const struct column peerchannel_cols[] = {
+	{ "peer_id", COL_TEXT },
+	{ "peer_connected", COL_INT },
+	{ "state", COL_TEXT },
+	{ "short_channel_id", COL_TEXT },
+	{ "channel_id", COL_TEXT },
+	{ "funding_txid", COL_TEXT },
+	{ "funding_outnum", COL_INT },
+	{ "private", COL_INT },
+	{ "opener", COL_TEXT },
+	{ "closer", COL_TEXT },
+	{ "to_us_msat", COL_INT },
+	{ "min_to_us_msat", COL_INT },
+	{ "max_to_us_msat", COL_INT },
+	{ "total_msat", COL_INT },
+	{ "fee_base_msat", COL_INT },
+	{ "fee_proportional_millionths", COL_INT },
+	{ "dust_limit_msat", COL_INT },
+	{ "spendable_msat", COL_INT },
+	{ "receivable_msat", COL_INT },
+	{ "their_to_self_delay", COL_INT },
+	{ "our_to_self_delay", COL_INT },
+	{ "max_accepted_htlcs", COL_INT },
+	{ "in_payments_offered", COL_INT },
+	{ "in_offered_msat", COL_INT },
+	{ "in_payments_fulfilled", COL_INT },
+	{ "in_fulfilled_msat", COL_INT },
+	{ "out_payments_offered", COL_INT },
+	{ "out_offered_msat", COL_INT },
+	{ "out_payments_fulfilled", COL_INT },
+	{ "out_fulfilled_msat", COL_INT },
+};
+static const char *peerchannel_indexes[] = { "short_channel_id", "peer_id", NULL };
+
+static struct table_desc tables[] = {
+	{ "invoices", "listinvoices", "invoices", "invoices",
+	  COLUMNS(invoice_cols), invoice_indexes },
+	{ "sendpays", "listsendpays", "payments", "sendpays",
+	  COLUMNS(sendpay_cols), sendpay_indexes },
+	{ "forwards", "listforwards", "forwards", "forwards",
+	  COLUMNS(forward_cols), forward_indexes },
+	{ "peerchannels", "listpeerchannels", "channels", NULL,
+	  COLUMNS(peerchannel_cols), peerchannel_indexes },
+};
+
+/* A query waiting for (or undergoing) refresh of the tables it uses. */
+struct sql_query {
+	struct list_node list;
+	struct command *cmd;
+	sqlite3_stmt *stmt;
+	bool used[ARRAY_SIZE(tables)];
+	/* Which table we're refreshing now. */
+	size_t tabnum;
+};
+
+static struct plugin *plugin;
+static sqlite3 *db;
+/* Only one query refreshes at a time: the rest wait here. */
+static struct list_head queries;
+
+static const char *coltype_name(enum coltype type)
+{
+	switch (type) {
+	case COL_INT:
+		return "INTEGER";
+	case COL_REAL:
+		return "REAL";
+	case COL_TEXT:
+		return "TEXT";
+	}
+	abort();
+}
+
+static void db_exec_or_die(const char *sql)
+{
+	char *errmsg;
+
+	if (sqlite3_exec(db, sql, NULL, NULL, &errmsg) != SQLITE_OK)
+		plugin_err(plugin, "Could not execute '%s': %s", sql, errmsg);
+}
+
+static void create_table(struct table_desc *td)
+{
+	char *create, *insert;
+
+	create = tal_fmt(tmpctx, "CREATE TABLE %s (", td->name);
+	insert = tal_fmt(tmpctx, "INSERT OR REPLACE INTO %s VALUES (", td->name);
+	for (size_t i = 0; i < td->num_columns; i++) {
+		tal_append_fmt(&create, "%s%s %s%s",
+			       i ? ", " : "",
+			       td->columns[i].name,
+			       coltype_name(td->columns[i].type),
+			       td->subsystem && streq(td->columns[i].name,
+						      "created_index")
+			       ? " PRIMARY KEY" : "");
+		tal_append_fmt(&insert, "%s?", i ? ", " : "");
+	}
+	tal_append_fmt(&create, ");");
+	tal_append_fmt(&insert, ");");
+	db_exec_or_die(create);
+
+	for (size_t i = 0; td->indexes[i]; i++)
+		db_exec_or_die(tal_fmt(tmpctx,
+				       "CREATE INDEX %s_%s_idx ON %s (%s);",
+				       td->name, td->indexes[i],
+				       td->name, td->indexes[i]));
+
+	if (sqlite3_prepare_v2(db, insert, -1, &td->insert, NULL) != SQLITE_OK)
+		plugin_err(plugin, "Could not prepare '%s': %s",
+			   insert, sqlite3_errmsg(db));
+}
+
+/* With deprecated APIs, amounts are strings like "1000msat". */
+static bool json_to_msat_string(const char *buffer, const jsmntok_t *tok,
+				u64 *num)
+{
+	jsmntok_t t = *tok;
+
+	if (t.type != JSMN_STRING || t.end - t.start < 4
+	    || strncmp(buffer + t.end - 4, "msat", 4) != 0)
+		return false;
+	t.end -= 4;
+	t.type = JSMN_PRIMITIVE;
+	return json_to_u64(buffer, &t, num);
+}
+
+/* Timestamps are printed like 1679994923.123 */
+static bool json_to_real(const char *buffer, const jsmntok_t *tok, double *d)
+{
+	char *str, *end;
+
+	if (tok->type != JSMN_PRIMITIVE)
+		return false;
+	str = json_strdup(tmpctx, buffer, tok);
+	errno = 0;
+	*d = strtod(str, &end);
+	return errno == 0 && end != str && *end == '\0';
+}
+
+static void bind_column(sqlite3_stmt *stmt, int pos,
+			const struct column *col,
+			const char *buf, const jsmntok_t *tok)
+{
+	u64 u;
+	s64 s;
+	bool b;
+	double d;
+	const char *str;
+
+	if (!tok || json_tok_is_null(buf, tok)) {
+		sqlite3_bind_null(stmt, pos);
+		return;
+	}
+
+	switch (col->type) {
+	case COL_INT:
+		if (json_to_bool(buf, tok, &b)) {
+			sqlite3_bind_int(stmt, pos, b);
+			return;
+		}
+		if (json_to_s64(buf, tok, &s)) {
+			sqlite3_bind_int64(stmt, pos, s);
+			return;
+		}
+		if (json_to_u64(buf, tok, &u)
+		    || json_to_msat_string(buf, tok, &u)) {
+			sqlite3_bind_int64(stmt, pos, u);
+			return;
+		}
+		break;
+	case COL_REAL:
+		if (json_to_real(buf, tok, &d)) {
+			sqlite3_bind_double(stmt, pos, d);
+			return;
+		}
+		break;
+	case COL_TEXT:
+		break;
+	}
+
+	/* Store anything else as (unescaped) text */
+	str = json_escape_unescape(tmpctx,
+				   json_escape_string_(tmpctx, buf + tok->start,
+						       tok->end - tok->start));
+	if (!str)
+		str = json_strdup(tmpctx, buf, tok);
+	sqlite3_bind_text(stmt, pos, str, strlen(str), SQLITE_TRANSIENT);
+}
+
+/* Insert (or replace) every element of the array, returns max of
+ * @idxfield seen (if any). */
+static u64 insert_rows(struct table_desc *td,
+		       const char *buf, const jsmntok_t *result,
+		       const char *idxfield)
+{
+	const jsmntok_t *arr, *t;
+	size_t i;
+	u64 max = 0;
+
+	arr = json_get_member(buf, result, td->arrname);
+	if (!arr || arr->type != JSMN_ARRAY)
+		plugin_err(plugin, "%s gave no %s? %.*s",
+			   td->cmd, td->arrname,
+			   json_tok_full_len(result),
+			   json_tok_full(buf, result));
+
+	db_exec_or_die("BEGIN TRANSACTION;");
+	json_for_each_arr(i, t, arr) {
+		for (size_t c = 0; c < td->num_columns; c++)
+			bind_column(td->insert, c + 1, &td->columns[c], buf,
+				    json_get_member(buf, t,
+						    td->columns[c].name));
+		if (sqlite3_step(td->insert) != SQLITE_DONE)
+			plugin_err(plugin, "Inserting into %s: %s",
+				   td->name, sqlite3_errmsg(db));
+		sqlite3_reset(td->insert);
+		sqlite3_clear_bindings(td->insert);
+
+		if (idxfield) {
+			u64 idx;
+			const jsmntok_t *idxtok = json_get_member(buf, t, idxfield);
+			if (idxtok && json_to_u64(buf, idxtok, &idx) && idx > max)
+				max = idx;
+		}
+	}
+	db_exec_or_die("COMMIT;");
+	return max;
+}
+
+static struct command_result *refresh_tables(struct sql_query *q);
+
+static struct command_result *next_table(struct sql_query *q)
+{
+	q->tabnum++;
+	return refresh_tables(q);
+}
+
+/* Removes @q from the queue, and starts the next one refreshing. */
+static struct command_result *query_done(struct sql_query *q,
+					 struct command_result *ret)
+{
+	list_del_from(&queries, &q->list);
+	if (!list_empty(&queries))
+		refresh_tables(list_top(&queries, struct sql_query, list));
+	return ret;
+}
+
+static struct command_result *refresh_failed(struct command *cmd,
+					     const char *buf,
+					     const jsmntok_t *error,
+					     struct sql_query *q)
+{
+	plugin_log(plugin, LOG_UNUSUAL, "Refreshing %s failed: %.*s",
+		   tables[q->tabnum].name,
+		   json_tok_full_len(error), json_tok_full(buf, error));
+	return query_done(q, forward_error(cmd, buf, error, q));
+}
+
+static struct command_result *full_refresh_done(struct command *cmd,
+						const char *buf,
+						const jsmntok_t *result,
+						struct sql_query *q)
+{
+	struct table_desc *td = &tables[q->tabnum];
+
+	db_exec_or_die(tal_fmt(tmpctx, "DELETE FROM %s;", td->name));
+	insert_rows(td, buf, result, NULL);
+	return next_table(q);
+}
+
+static struct command_result *updated_done(struct command *cmd,
+					   const char *buf,
+					   const jsmntok_t *result,
+					   struct sql_query *q)
+{
+	struct table_desc *td = &tables[q->tabnum];
+	u64 max = insert_rows(td, buf, result, "updated_index");
+
+	if (max > td->max_updated)
+		td->max_updated = max;
+	return next_table(q);
+}
+
+static struct command_result *created_done(struct command *cmd,
+					   const char *buf,
+					   const jsmntok_t *result,
+					   struct sql_query *q)
+{
+	struct table_desc *td = &tables[q->tabnum];
+	struct out_req *req;
+	u64 max = insert_rows(td, buf, result, "created_index");
+
+	if (max > td->max_created)
+		td->max_created = max;
+
+	/* Now anything which changed since we last looked. */
+	req = jsonrpc_request_start(plugin, cmd, td->cmd,
+				    updated_done, refresh_failed, q);
+	json_add_string(req->js, "index", "updated");
+	json_add_u64(req->js, "start", td->max_updated + 1);
+	return send_outreq(plugin, req);
+}
+
+static struct command_result *wait_deleted_done(struct command *cmd,
+						const char *buf,
+						const jsmntok_t *result,
+						struct sql_query *q)
+{
+	struct table_desc *td = &tables[q->tabnum];
+	struct out_req *req;
+	u64 deleted;
+	const char *err;
+
+	err = json_scan(tmpctx, buf, result, "{deleted:%}",
+			JSON_SCAN(json_to_u64, &deleted));
+	if (err)
+		plugin_err(plugin, "Bad wait %s deleted: %s", td->subsystem, err);
+
+	/* We can't tell which were deleted, so start again. */
+	if (deleted != td->deleted) {
+		plugin_log(plugin, LOG_DBG,
+			   "%s: %"PRIu64" deleted, reloading",
+			   td->name, deleted - td->deleted);
+		db_exec_or_die(tal_fmt(tmpctx, "DELETE FROM %s;", td->name));
+		td->max_created = td->max_updated = 0;
+		td->deleted = deleted;
+	}
+
+	req = jsonrpc_request_start(plugin, cmd, td->cmd,
+				    created_done, refresh_failed, q);
+	json_add_string(req->js, "index", "created");
+	json_add_u64(req->js, "start", td->max_created + 1);
+	return send_outreq(plugin, req);
+}
+
+static struct command_result *run_query(struct sql_query *q);
+
+static struct command_result *refresh_tables(struct sql_query *q)
+{
+	struct table_desc *td;
+	struct out_req *req;
+
+	while (q->tabnum < ARRAY_SIZE(tables) && !q->used[q->tabnum])
+		q->tabnum++;
+
+	if (q->tabnum == ARRAY_SIZE(tables))
+		return run_query(q);
+
+	td = &tables[q->tabnum];
+	if (!td->subsystem) {
+		req = jsonrpc_request_start(plugin, q->cmd, td->cmd,
+					    full_refresh_done, refresh_failed,
+					    q);
+		return send_outreq(plugin, req);
+	}
+
+	req = jsonrpc_request_start(plugin, q->cmd, "wait",
+				    wait_deleted_done, refresh_failed, q);
+	json_add_string(req->js, "subsystem", td->subsystem);
+	json_add_string(req->js, "indexname", "deleted");
+	json_add_u64(req->js, "nextvalue", 0);
+	return send_outreq(plugin, req);
+}
+
+static void json_add_column(struct json_stream *js,
+			    sqlite3_stmt *stmt, int col)
+{
+	switch (sqlite3_column_type(stmt, col)) {
+	case SQLITE_INTEGER:
+		json_add_primitive_fmt(js, NULL, "%lld",
+				       (long long)sqlite3_column_int64(stmt, col));
+		return;
+	case SQLITE_FLOAT:
+		json_add_primitive_fmt(js, NULL, "%f",
+				       sqlite3_column_double(stmt, col));
+		return;
+	case SQLITE_TEXT:
+		json_add_string(js, NULL,
+				(const char *)sqlite3_column_text(stmt, col));
+		return;
+	case SQLITE_BLOB:
+		json_add_hex(js, NULL, sqlite3_column_blob(stmt, col),
+			     sqlite3_column_bytes(stmt, col));
+		return;
+	case SQLITE_NULL:
+		json_add_null(js, NULL);
+		return;
+	}
+	abort();
+}
+
+static struct command_result *run_query(struct sql_query *q)
+{
+	struct json_stream *js;
+	struct command_result *ret;
+	int err;
+
+	js = jsonrpc_stream_success(q->cmd);
+	json_array_start(js, "rows");
+	while ((err = sqlite3_step(q->stmt)) == SQLITE_ROW) {
+		json_array_start(js, NULL);
+		for (int i = 0; i < sqlite3_column_count(q->stmt); i++)
+			json_add_column(js, q->stmt, i);
+		json_array_end(js);
+	}
+	json_array_end(js);
+
+	if (err != SQLITE_DONE)
+		ret = command_fail(q->cmd, LIGHTNINGD,
+				   "Executing statement: %s",
+				   sqlite3_errmsg(db));
+	else
+		ret = command_finished(q->cmd, js);
+
+	return query_done(q, ret);
+}
+
+static void destroy_sql_query(struct sql_query *q)
+{
+	sqlite3_finalize(q->stmt);
+}
+
+/* Only allow reading from our tables: this is called during prepare. */
+static int sql_authorize(void *arg, int action,
+			 const char *arg1, const char *arg2,
+			 const char *dbname, const char *trigger)
+{
+	struct sql_query *q = arg;
+
+	switch (action) {
+	case SQLITE_SELECT:
+	case SQLITE_FUNCTION:
+	case SQLITE_RECURSIVE:
+		return SQLITE_OK;
+	case SQLITE_READ:
+		for (size_t i = 0; i < ARRAY_SIZE(tables); i++) {
+			if (streq(arg1, tables[i].name)) {
+				q->used[i] = true;
+				return SQLITE_OK;
+			}
+		}
+		/* Don't let them read sqlite_master etc. */
+		return SQLITE_DENY;
+	}
+	return SQLITE_DENY;
+}
+
+static struct command_result *json_sql(struct command *cmd,
+				       const char *buffer,
+				       const jsmntok_t *params)
+{
+	const char *query, *tail;
+	struct sql_query *q;
+	int err;
+
+	if (!param(cmd, buffer, params,
+		   p_req("query", param_string, &query),
+		   NULL))
+		return command_param_failed();
+
+	q = tal(cmd, struct sql_query);
+	q->cmd = cmd;
+	q->tabnum = 0;
+	for (size_t i = 0; i < ARRAY_SIZE(tables); i++)
+		q->used[i] = false;
+
+	sqlite3_set_authorizer(db, sql_authorize, q);
+	err = sqlite3_prepare_v2(db, query, -1, &q->stmt, &tail);
+	sqlite3_set_authorizer(db, NULL, NULL);
+
+	if (err != SQLITE_OK)
+		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+				    "query failed with %s",
+				    sqlite3_errmsg(db));
+	tal_add_destructor(q, destroy_sql_query);
+
+	if (!q->stmt)
+		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+				    "query is empty");
+
+	/* One statement only, please. */
+	tail += strspn(tail, " \t\r\n;");
+	if (*tail != '\0')
+		return command_fail(cmd, JSONRPC2_INVALID_PARAMS,
+				    "query must be a single statement");
+
+	list_add_tail(&queries, &q->list);
+	/* Someone else refreshing?  Wait for them. */
+	if (list_top(&queries, struct sql_query, list) != q)
+		return command_still_pending(cmd);
+
+	return refresh_tables(q);
+}
+
+static const char *init(struct plugin *p,
+			const char *buf UNUSED, const jsmntok_t *config UNUSED)
+{
+	plugin = p;
+	list_head_init(&queries);
+
+	if (sqlite3_open(":memory:", &db) != SQLITE_OK)
+		return tal_fmt(p, "Could not create in-memory db: %s",
+			       strerror(errno));
+
+	for (size_t i = 0; i < ARRAY_SIZE(tables); i++)
+		create_table(&tables[i]);
+
+	return NULL;
+}
+
+static const struct plugin_command commands[] = { {
+	"sql",
+	"utility",
+	"Run {query} against the node's list* data",
+	"Run a read-only SQL {query} against tables mirroring listinvoices,"
+	" listsendpays, listforwards and listpeerchannels",
+	json_sql,
+	},
+};
+
+int main(int argc, char *argv[])
+{
+	setup_locale();
+	plugin_main(argv, init, PLUGIN_RESTARTABLE, true, NULL,
+		    commands, ARRAY_SIZE(commands),
+	            NULL, 0, NULL, 0, NULL, 0, NULL);
+}
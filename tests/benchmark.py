@@ -1,15 +1,21 @@
 from concurrent import futures
 from fixtures import *  # noqa: F401,F403
+from pyln.proto.bech32 import encode as segwit_encode
 from time import time
 from tqdm import tqdm
+from utils import only_one, sync_blockheight, wait_for, DEVELOPER
 
 
+import os
 import pytest
 import random
+import re
+import unittest
 
 
 num_workers = 480
 num_payments = 10000
+num_archive_htlcs = 5000
 
 
 @pytest.fixture
@@ -91,6 +97,124 @@ def test_invoice(node_factory, benchmark):
     benchmark(bench_invoice)
 
 
+@pytest.mark.parametrize("pipeline", [True, False])
+@unittest.skipIf(os.getenv('TEST_DB_PROVIDER', 'sqlite3') != 'postgres', "Postgres only")
+@unittest.skipIf(not DEVELOPER, "needs --dev-no-db-pipeline")
+def test_invoice_postgres(node_factory, benchmark, pipeline):
+    """Compare with and without libpq pipelining: run with
+    TEST_DB_PROVIDER=postgres (which starts a local postgres)"""
+    l1 = node_factory.get_node(options={'dev-no-db-pipeline': None} if not pipeline else {})
+
+    def bench_invoice():
+        l1.rpc.invoice(1000, 'invoice-{}'.format(time()), 'desc')
+
+    benchmark(bench_invoice)
+
+
+@pytest.mark.parametrize("batch", [True, False])
+@unittest.skipIf(not DEVELOPER, "needs --dev-no-utxoset-batch")
+def test_utxoset_blocks(node_factory, bitcoind, benchmark, batch):
+    """Compare batched and unbatched utxoset writes, for synthetic blocks
+    each containing 1000 P2WSH outputs"""
+    l1 = node_factory.get_node(options={'dev-no-utxoset-batch': None} if not batch else {})
+
+    def fill_mempool():
+        outputs = {segwit_encode('bcrt', 0, os.urandom(32)): 0.0001
+                   for _ in range(1000)}
+        bitcoind.rpc.sendmany("", outputs)
+
+    def process_block():
+        bitcoind.generate_block(1)
+        sync_blockheight(bitcoind, [l1])
+
+    benchmark.pedantic(process_block, setup=fill_mempool, rounds=20)
+
+
+@pytest.mark.parametrize("blockfile", [True, False])
+@unittest.skipIf(not DEVELOPER, "needs --dev-no-blockfile")
+def test_resync(node_factory, bitcoind, benchmark, blockfile):
+    """Compare catching up on 100 blocks (each with 1000 outputs) with raw
+    blocks handed over in files, and as hex in JSON"""
+    l1 = node_factory.get_node(options={'dev-no-blockfile': None} if not blockfile else {})
+    rates = []
+
+    def add_blocks():
+        l1.stop()
+        for _ in range(100):
+            outputs = {segwit_encode('bcrt', 0, os.urandom(32)): 0.0001
+                       for _ in range(1000)}
+            bitcoind.rpc.sendmany("", outputs)
+            bitcoind.generate_block(1)
+
+    def resync():
+        l1.start()
+        sync_blockheight(bitcoind, [l1])
+        line = l1.daemon.wait_for_log(r'Added [0-9]+ blocks in')
+        rates.append(float(re.search(r'\(([0-9.]+) blocks/sec\)', line).group(1)))
+
+    benchmark.pedantic(resync, setup=add_blocks, rounds=5)
+    benchmark.extra_info['blocks_per_sec'] = sum(rates) / len(rates)
+
+
+def fill_htlcs(executor, l1, l2, num):
+    """Leave num resolved HTLCs in the channel from l1 to l2"""
+    route = l1.rpc.getroute(l2.info['id'], 1000, 1)['route']
+
+    def do_pay(i):
+        inv = l2.rpc.invoice(1000, 'fill-{}'.format(i), 'desc')
+        l1.rpc.sendpay(route, inv['payment_hash'], payment_secret=inv['payment_secret'])
+        l1.rpc.waitsendpay(inv['payment_hash'])
+
+    fs = [executor.submit(do_pay, i) for i in range(num)]
+    for f in tqdm(futures.as_completed(fs), total=len(fs)):
+        f.result()
+
+
+def archived_htlc_nodes(node_factory, executor, archive):
+    """Two nodes with num_archive_htlcs resolved HTLCs between them: with
+    archive, l1 has moved them all out of channel_htlcs"""
+    l1, l2 = node_factory.line_graph(2, opts=[{'htlc-archive-batch': 1000 if archive else 0,
+                                               'may_reconnect': True},
+                                              {'may_reconnect': True}])
+    fill_htlcs(executor, l1, l2, num_archive_htlcs)
+
+    # Archiving restarts (rather than idling) just after startup.
+    l1.restart()
+    if archive:
+        wait_for(lambda: l1.db_query('SELECT COUNT(*) AS c FROM channel_htlcs')[0]['c'] == 0)
+    else:
+        assert l1.db_query('SELECT COUNT(*) AS c FROM channel_htlcs')[0]['c'] == num_archive_htlcs
+    wait_for(lambda: only_one(l1.rpc.listpeerchannels()['channels'])['peer_connected'])
+    return l1, l2
+
+
+@pytest.mark.parametrize("archive", [True, False])
+def test_htlc_archive_restart(node_factory, executor, benchmark, archive):
+    """Compare restart times with resolved HTLCs archived, and still in
+    channel_htlcs (htlc-archive-batch=0)"""
+    l1, l2 = archived_htlc_nodes(node_factory, executor, archive)
+
+    def restart():
+        l1.start()
+        l1.connect(l2)
+        wait_for(lambda: only_one(l1.rpc.listpeerchannels()['channels'])['peer_connected'])
+
+    benchmark.pedantic(restart, setup=l1.stop, rounds=10)
+
+
+@pytest.mark.parametrize("archive", [True, False])
+def test_htlc_archive_pay(node_factory, executor, benchmark, archive):
+    """Compare payment rates with resolved HTLCs archived, and still in
+    channel_htlcs (htlc-archive-batch=0)"""
+    l1, l2 = archived_htlc_nodes(node_factory, executor, archive)
+
+    def do_pay():
+        invoice = l2.rpc.invoice(1000, 'invoice-{}'.format(random.random()), 'desc')['bolt11']
+        l1.rpc.pay(invoice)
+
+    benchmark(do_pay)
+
+
 def test_pay(node_factory, benchmark):
     l1, l2 = node_factory.line_graph(2)
 
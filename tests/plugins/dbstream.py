@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""This plugin replays db_write_stream batches into a copy of the database.
+"""
+from pyln.client import Plugin, RpcError
+import sqlite3
+import struct
+
+plugin = Plugin()
+plugin.pre_init_batches = []
+plugin.queries = {}
+plugin.next_seq = 0
+plugin.conn = None
+
+
+def decode_changes(changes):
+    """Yields (query, params) for each change record"""
+    buf = bytes.fromhex(changes)
+    off = 0
+    while off < len(buf):
+        qid, = struct.unpack_from('>I', buf, off)
+        off += 4
+        if qid == 0xFFFFFFFF:
+            qlen, = struct.unpack_from('>I', buf, off)
+            off += 4
+            query = buf[off:off + qlen].decode('utf-8')
+            off += qlen
+        else:
+            query = plugin.queries[qid]
+
+        nparams, = struct.unpack_from('>H', buf, off)
+        off += 2
+        params = []
+        for _ in range(nparams):
+            ptype = buf[off]
+            off += 1
+            if ptype == 0:
+                params.append(None)
+            elif ptype == 1:
+                params.append(struct.unpack_from('>i', buf, off)[0])
+                off += 4
+            elif ptype == 2:
+                # sqlite3 stores u64 as (signed) int64.
+                params.append(struct.unpack_from('>q', buf, off)[0])
+                off += 8
+            else:
+                plen, = struct.unpack_from('>I', buf, off)
+                off += 4
+                val = buf[off:off + plen]
+                off += plen
+                params.append(val.decode('utf-8') if ptype == 3 else val)
+        yield query, params
+
+
+def apply_batch(changes):
+    plugin.conn.execute("BEGIN TRANSACTION;")
+    for query, params in decode_changes(changes):
+        plugin.conn.execute(query, params)
+    plugin.conn.execute("COMMIT;")
+
+
+@plugin.init()
+def init(configuration, options, plugin):
+    if not plugin.get_option('dbstream-file'):
+        raise RpcError("No dbstream-file specified")
+    plugin.conn = sqlite3.connect(plugin.get_option('dbstream-file'),
+                                  isolation_level=None)
+    plugin.conn.execute("PRAGMA foreign_keys = ON;")
+    plugin.log("replaying {} pre-init batches".format(len(plugin.pre_init_batches)))
+    for changes in plugin.pre_init_batches:
+        apply_batch(changes)
+    plugin.pre_init_batches = []
+    plugin.log("initialized")
+
+
+@plugin.hook('db_write_stream')
+def db_write_stream(plugin, seq, data_version, queries, changes, **kwargs):
+    if seq != plugin.next_seq:
+        return {"result": "error", "message": "Expected seq {}".format(plugin.next_seq)}
+    plugin.next_seq += 1
+
+    for q in queries:
+        plugin.queries[q['id']] = q['query']
+
+    if plugin.conn is None:
+        plugin.pre_init_batches.append(changes)
+    else:
+        apply_batch(changes)
+        plugin.log("applied batch {} data_version {}".format(seq, data_version))
+
+    return {"result": "continue"}
+
+
+plugin.add_option('dbstream-file', None, 'The db file to create.')
+plugin.run()
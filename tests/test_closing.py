@@ -145,6 +145,44 @@ def test_closing_while_disconnected(node_factory, bitcoind, executor):
     wait_for(lambda: len(l2.rpc.listchannels()['channels']) == 0)
 
 
+def test_listclosedchannels(node_factory, bitcoind):
+    l1, l2 = node_factory.line_graph(2, opts={'may_reconnect': True})
+    scid = l1.get_channel_scid(l2)
+    channel_id = first_channel_id(l1, l2)
+
+    l1.pay(l2, 200000000)
+    assert l1.rpc.listclosedchannels() == {'closedchannels': []}
+
+    l1.rpc.close(scid)
+    l1.daemon.wait_for_log('sendrawtx exit 0')
+    bitcoind.generate_block(101)
+    l1.daemon.wait_for_log('onchaind complete, forgetting peer')
+    assert l1.rpc.listpeerchannels()['channels'] == []
+
+    # Closed channels aren't loaded at startup, but still listed.
+    l1.restart()
+    l1.daemon.wait_for_log('Loaded 0 channels from DB')
+    l1.daemon.wait_for_log(r'Startup took [0-9]*ms: options=.* channels=.* peers=[0-9]*ms')
+
+    closed = only_one(l1.rpc.listclosedchannels()['closedchannels'])
+    assert closed['short_channel_id'] == scid
+    assert closed['channel_id'] == channel_id
+    assert closed['private'] is False
+    assert closed['opener'] == 'local'
+    assert closed['closer'] == 'local'
+    assert closed['close_cause'] == 'user'
+    assert closed['total_msat'] == Millisatoshi(10**9)
+    assert closed['final_to_us_msat'] == Millisatoshi(10**9 - 200000000)
+    assert closed['min_to_us_msat'] == Millisatoshi(10**9 - 200000000)
+    assert closed['max_to_us_msat'] == Millisatoshi(10**9)
+    assert closed['state_changes'][-1]['new_state'] == 'ONCHAIN'
+
+    # History is only read if they want it.
+    closed = only_one(l1.rpc.call('listclosedchannels', {},
+                                  filter={'closedchannels': [{'channel_id': True}]})['closedchannels'])
+    assert closed == {'channel_id': channel_id}
+
+
 def test_closing_disconnected_notify(node_factory, bitcoind, executor):
     l1, l2 = node_factory.line_graph(2)
 
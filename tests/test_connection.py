@@ -4290,3 +4290,55 @@ def test_no_reconnect_awating_unilateral(node_factory, bitcoind):
     time.sleep(10)
 
     assert not l1.daemon.is_in_log('Will try reconnect', start=l1.daemon.logsearch_start)
+
+
+def test_listpeerchannels(node_factory, bitcoind):
+    l1, l2, l3 = node_factory.line_graph(3, wait_for_announce=True,
+                                         opts=[{}, {},
+                                               {'plugin': os.path.join(os.getcwd(), 'tests/plugins/hold_invoice.py'),
+                                                'holdtime': str(TIMEOUT * 2)}])
+
+    # Same as listpeers, just flattened, with the peer added.
+    peers = l2.rpc.listpeers()['peers']
+    expected = []
+    for p in peers:
+        for c in p['channels']:
+            c['peer_id'] = p['id']
+            c['peer_connected'] = p['connected']
+            expected.append(c)
+    channels = l2.rpc.listpeerchannels()['channels']
+    assert len(channels) == 2
+    assert sorted(channels, key=lambda c: c['short_channel_id']) == sorted(expected, key=lambda c: c['short_channel_id'])
+
+    # Filter by peer
+    chan = only_one(l2.rpc.listpeerchannels(l1.info['id'])['channels'])
+    assert chan['peer_id'] == l1.info['id']
+    assert chan['peer_connected'] is True
+    scid12 = chan['short_channel_id']
+    scid23 = only_one(l2.rpc.listpeerchannels(l3.info['id'])['channels'])['short_channel_id']
+
+    # Filter by scid (and by scid and peer)
+    assert only_one(l2.rpc.listpeerchannels(short_channel_id=scid23)['channels'])['peer_id'] == l3.info['id']
+    assert l2.rpc.listpeerchannels(peer_id=l1.info['id'], short_channel_id=scid23)['channels'] == []
+
+    # Filter by state
+    assert len(l2.rpc.listpeerchannels(state='CHANNELD_NORMAL')['channels']) == 2
+    assert l2.rpc.listpeerchannels(state='ONCHAIN')['channels'] == []
+    with pytest.raises(RpcError, match='should be a channel state'):
+        l2.rpc.listpeerchannels(state='CHANNELD_WEIRD')
+
+    # Filter by HTLCs: l3 holds on to this one.
+    assert l2.rpc.listpeerchannels(has_htlcs=True)['channels'] == []
+    assert len(l2.rpc.listpeerchannels(has_htlcs=False)['channels']) == 2
+
+    inv = l3.rpc.invoice(1000, 'held', 'held')
+    route = l1.rpc.getroute(l3.info['id'], 1000, 1)['route']
+    l1.rpc.sendpay(route, inv['payment_hash'], payment_secret=inv['payment_secret'])
+    wait_for(lambda: len(l2.rpc.listpeerchannels(has_htlcs=True)['channels']) == 2)
+    assert l2.rpc.listpeerchannels(has_htlcs=False)['channels'] == []
+    assert set(c['short_channel_id'] for c in l2.rpc.listpeerchannels(has_htlcs=True)['channels']) == set([scid12, scid23])
+
+    # Skipping the heavy fields.
+    res = l2.rpc.call('listpeerchannels', {'short_channel_id': scid12},
+                      filter={'channels': [{'peer_id': True, 'state': True}]})
+    assert res == {'channels': [{'peer_id': l1.info['id'], 'state': 'CHANNELD_NORMAL'}]}
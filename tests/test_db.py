@@ -511,9 +511,53 @@ def test_db_forward_migrate(bitcoind, node_factory):
     # The two null in_htlc_id are replaced with bogus entries!
     assert sum([f['in_htlc_id'] > 0xFFFFFFFFFFFF for f in l1.rpc.listforwards()['forwards']]) == 2
 
+    # Every migrated forward gets its own created_index, so paging
+    # through them one at a time doesn't skip any.
+    fwds = l1.rpc.listforwards()['forwards']
+    assert sorted([f['created_index'] for f in fwds]) == [1, 2, 3, 4]
+    paged = []
+    while len(paged) < len(fwds):
+        start = paged[-1]['created_index'] + 1 if paged else 0
+        page = l1.rpc.listforwards(index='created', start=start, limit=1)['forwards']
+        assert len(page) == 1
+        paged += page
+    assert paged == sorted(fwds, key=lambda f: f['created_index'])
+
+    # The sql plugin keys forwards on created_index: none may collide.
+    assert l1.rpc.sql("SELECT COUNT(*) FROM forwards") == {'rows': [[4]]}
+
     # Make sure autoclean can handle these!
     l1.stop()
     l1.daemon.opts['autoclean-succeededforwards-age'] = 2
     l1.daemon.opts['autoclean-cycle'] = 1
     l1.start()
     wait_for(lambda: l1.rpc.listforwards()['forwards'] == [])
+
+
+def test_db_group_commit(node_factory, bitcoind):
+    """Payments survive a restart with commits coalesced"""
+    l1, l2, l3 = node_factory.line_graph(3, wait_for_announce=True,
+                                         opts=[{'db-group-commit': None},
+                                               {'db-group-commit-usec': 2000},
+                                               {}])
+
+    assert l1.rpc.listconfigs()['db-group-commit'] is True
+    assert l2.rpc.listconfigs()['db-group-commit-usec'] == 2000
+
+    for i in range(5):
+        inv = l3.rpc.invoice(1000 + i, 'test_db_group_commit{}'.format(i), 'desc')
+        l1.rpc.pay(inv['bolt11'])
+
+    l1.restart()
+    l2.restart()
+
+    assert len([p for p in l1.rpc.listpays()['pays'] if p['status'] == 'complete']) == 5
+    assert len(l2.rpc.listforwards(status='settled')['forwards']) == 5
+
+    # Channels still work after restart.
+    l1.rpc.connect(l2.info['id'], 'localhost', l2.port)
+    l2.rpc.connect(l3.info['id'], 'localhost', l3.port)
+    wait_for(lambda: all(c['state'] == 'CHANNELD_NORMAL' and c['peer_connected']
+                         for c in l2.rpc.listpeerchannels()['channels']))
+    inv = l3.rpc.invoice(2000, 'test_db_group_commit_after', 'desc')
+    l1.rpc.pay(inv['bolt11'])
@@ -1,7 +1,7 @@
 from fixtures import *  # noqa: F401,F403
 from fixtures import TEST_NETWORK
 from pyln.client import RpcError, Millisatoshi
-from utils import only_one, wait_for, wait_channel_quiescent, mine_funding_to_announce
+from utils import only_one, wait_for, wait_channel_quiescent, mine_funding_to_announce, TIMEOUT
 
 
 import os
@@ -741,3 +741,112 @@ def test_invoice_deschash(node_factory, chainparams):
     wait_for(lambda: len([ev for ev in l1.rpc.bkpr_listincome()['income_events'] if ev['tag'] == 'invoice']) == 1)
     inv = only_one([ev for ev in l1.rpc.bkpr_listincome()['income_events'] if ev['tag'] == 'invoice'])
     assert inv['description'] == b11['description_hash']
+
+
+def test_wait_invoices(node_factory, executor):
+    l1, l2 = node_factory.line_graph(2)
+
+    # Asking for 0 gives us current index.
+    waitres = l2.rpc.wait(subsystem='invoices', indexname='created', nextvalue=0)
+    assert waitres == {'subsystem': 'invoices',
+                       'created': 0}
+
+    # Now ask for 1.
+    waitfut = executor.submit(l2.rpc.wait, subsystem='invoices', indexname='created', nextvalue=1)
+    time.sleep(1)
+
+    inv = l2.rpc.invoice(42, 'invlabel', 'invdesc')
+    waitres = waitfut.result(TIMEOUT)
+    assert waitres == {'subsystem': 'invoices',
+                       'created': 1,
+                       'details': {'label': 'invlabel',
+                                   'bolt11': inv['bolt11'],
+                                   'description': 'invdesc',
+                                   'status': 'unpaid'}}
+
+    # Second returns instantly, without any details.
+    waitres = l2.rpc.wait(subsystem='invoices', indexname='created', nextvalue=1)
+    assert waitres == {'subsystem': 'invoices',
+                       'created': 1}
+
+    # Now check for updates
+    waitres = l2.rpc.wait(subsystem='invoices', indexname='updated', nextvalue=0)
+    assert waitres == {'subsystem': 'invoices',
+                       'updated': 0}
+
+    waitfut = executor.submit(l2.rpc.wait, subsystem='invoices', indexname='updated', nextvalue=1)
+    time.sleep(1)
+    l1.rpc.pay(inv['bolt11'])
+    waitres = waitfut.result(TIMEOUT)
+    assert waitres == {'subsystem': 'invoices',
+                       'updated': 1,
+                       'details': {'label': 'invlabel',
+                                   'status': 'paid'}}
+
+    # Now check for deletions
+    waitres = l2.rpc.wait(subsystem='invoices', indexname='deleted', nextvalue=0)
+    assert waitres == {'subsystem': 'invoices',
+                       'deleted': 0}
+
+    waitfut = executor.submit(l2.rpc.wait, subsystem='invoices', indexname='deleted', nextvalue=1)
+    time.sleep(1)
+    l2.rpc.delinvoice('invlabel', 'paid')
+    waitres = waitfut.result(TIMEOUT)
+
+    assert waitres == {'subsystem': 'invoices',
+                       'deleted': 1,
+                       'details': {'label': 'invlabel',
+                                   'bolt11': inv['bolt11'],
+                                   'status': 'paid'}}
+
+    # Bad subsystem or index are rejected.
+    with pytest.raises(RpcError, match='unknown subsystem'):
+        l2.rpc.wait(subsystem='invoicesx', indexname='created', nextvalue=0)
+    with pytest.raises(RpcError, match='unknown index'):
+        l2.rpc.wait(subsystem='invoices', indexname='createdx', nextvalue=0)
+
+
+def test_listinvoices_index(node_factory):
+    l1 = node_factory.get_node()
+
+    for i in range(5):
+        l1.rpc.invoice(1000, 'inv{}'.format(i), 'desc')
+
+    invs = l1.rpc.listinvoices(index='created', start=2)['invoices']
+    assert [i['created_index'] for i in invs] == [2, 3, 4, 5]
+    assert [i['label'] for i in invs] == ['inv1', 'inv2', 'inv3', 'inv4']
+
+    invs = l1.rpc.listinvoices(index='created', start=2, limit=2)['invoices']
+    assert [i['label'] for i in invs] == ['inv1', 'inv2']
+
+    # Nothing updated yet.
+    assert l1.rpc.listinvoices(index='updated', start=1)['invoices'] == []
+    l1.rpc.delinvoice('inv3', 'unpaid', desconly=True)
+    invs = l1.rpc.listinvoices(index='updated', start=1)['invoices']
+    assert [(i['label'], i['updated_index']) for i in invs] == [('inv3', 1)]
+
+    with pytest.raises(RpcError, match='Can only specify {start} with {index}'):
+        l1.rpc.listinvoices(start=1)
+    with pytest.raises(RpcError, match='Cannot list by the deleted index'):
+        l1.rpc.listinvoices(index='deleted')
+
+
+def test_listinvoices_streaming(node_factory):
+    """More invoices than we produce in one batch"""
+    l1 = node_factory.get_node()
+
+    # COMMAND_STREAM_BATCH is 1000
+    for i in range(2100):
+        l1.rpc.invoice(1000, 'inv{}'.format(i), 'desc')
+
+    invs = l1.rpc.listinvoices()['invoices']
+    assert [i['label'] for i in invs] == ['inv{}'.format(i) for i in range(2100)]
+
+    # Limit which crosses a batch boundary.
+    invs = l1.rpc.listinvoices(index='created', start=990, limit=1020)['invoices']
+    assert [i['created_index'] for i in invs] == list(range(990, 2010))
+
+    # Filtering still works across batches.
+    invs = l1.rpc.call('listinvoices', {}, filter={'invoices': [{'label': True}]})
+    assert len(invs['invoices']) == 2100
+    assert invs['invoices'][2099] == {'label': 'inv2099'}
@@ -1300,6 +1300,103 @@ def test_bitcoind_goes_backwards(node_factory, bitcoind):
     l1.daemon.wait_for_log('Adding block 111')
 
 
+def test_catchup_prefetch(node_factory, bitcoind):
+    """We fetch several blocks at once when catching up, but apply them in order, and still notice reorgs"""
+    l1 = node_factory.get_node()
+    l1.stop()
+
+    bitcoind.generate_block(50)
+    l1.start()
+    sync_blockheight(bitcoind, [l1])
+    for height in range(102, 152):
+        l1.daemon.wait_for_log('Adding block {}:'.format(height))
+
+    # Replace the last 12 blocks with a longer chain.
+    bitcoind.rpc.invalidateblock(bitcoind.rpc.getblockhash(140))
+    bitcoind.generate_block(30)
+    l1.daemon.wait_for_log('Removing stale block 151')
+    l1.daemon.wait_for_log('Removing stale block 140')
+    for height in range(140, 170):
+        l1.daemon.wait_for_log('Adding block {}:'.format(height))
+    sync_blockheight(bitcoind, [l1])
+
+
+@unittest.skipIf(TEST_NETWORK != 'regtest', "elementsd has no block filters")
+def test_block_filters(node_factory, bitcoind):
+    """With --block-filters we only fetch blocks which concern us"""
+    bitcoind.stop()
+    bitcoind.cmd_line += ["-blockfilterindex=1"]
+    bitcoind.start()
+    wait_for(lambda: bitcoind.rpc.getindexinfo()['basic block filter index']['synced'])
+
+    l1, l2 = node_factory.line_graph(2, fundchannel=True,
+                                     wait_for_announce=True,
+                                     opts={'block-filters': None})
+
+    # Nothing happens in these, so we only look at their filters.
+    height = bitcoind.rpc.getblockcount()
+    bitcoind.generate_block(5)
+    sync_blockheight(bitcoind, [l1, l2])
+    for h in range(height + 1, height + 6):
+        l1.daemon.wait_for_log(r'Block {}: filter matches nothing of ours'.format(h))
+    assert l1.db_query('SELECT COUNT(*) AS c FROM blocks WHERE height > {}'.format(height))[0]['c'] == 0
+
+    # But we still see payments to us...
+    addr = l1.rpc.newaddr()['bech32']
+    txid = bitcoind.rpc.sendtoaddress(addr, 0.01)
+    bitcoind.generate_block(1, wait_for_mempool=txid)
+    wait_for(lambda: [o for o in l1.rpc.listfunds()['outputs'] if o['txid'] == txid and o['status'] == 'confirmed'] != [])
+
+    # ... and restarting works.
+    bitcoind.generate_block(3)
+    l1.restart()
+    sync_blockheight(bitcoind, [l1, l2])
+
+    # And the channel close.
+    l1.rpc.close(l2.info['id'])
+    bitcoind.generate_block(1, wait_for_mempool=1)
+    wait_for(lambda: only_one(l1.rpc.listpeerchannels()['channels'])['state'] == 'ONCHAIN')
+    bitcoind.generate_block(100)
+    l1.daemon.wait_for_log('onchaind complete, forgetting peer')
+    assert not l1.daemon.is_in_log('fetching every block')
+
+
+@unittest.skipIf(TEST_NETWORK != 'regtest', "elementsd has no block filters")
+def test_utxoset_prune_header_only(node_factory, bitcoind):
+    """We still prune the utxoset when the blocks at prune heights were
+    only headers (--block-filters)"""
+    bitcoind.stop()
+    bitcoind.cmd_line += ["-blockfilterindex=1"]
+    bitcoind.start()
+    wait_for(lambda: bitcoind.rpc.getindexinfo()['basic block filter index']['synced'])
+
+    l1, l2 = node_factory.line_graph(2, fundchannel=True,
+                                     wait_for_announce=True,
+                                     opts={'block-filters': None})
+
+    # Spend the funding output, which is in the utxoset.
+    l1.rpc.close(l2.info['id'])
+    bitcoind.generate_block(1, wait_for_mempool=1)
+    sync_blockheight(bitcoind, [l1])
+    wait_for(lambda: l1.db_query('SELECT COUNT(*) AS c FROM utxoset'
+                                 ' WHERE spendheight IS NOT NULL')[0]['c'] == 1)
+
+    # Bury it, in blocks which concern us so little we only see headers.
+    bitcoind.generate_block(150)
+    sync_blockheight(bitcoind, [l1])
+
+    # The next full block isn't at a multiple of 16, but prunes anyway.
+    if (bitcoind.rpc.getblockcount() + 1) % 16 == 0:
+        bitcoind.generate_block(1)
+        sync_blockheight(bitcoind, [l1])
+    addr = l1.rpc.newaddr()['bech32']
+    txid = bitcoind.rpc.sendtoaddress(addr, 0.01)
+    bitcoind.generate_block(1, wait_for_mempool=txid)
+    sync_blockheight(bitcoind, [l1])
+    assert l1.db_query('SELECT COUNT(*) AS c FROM utxoset'
+                       ' WHERE spendheight IS NOT NULL')[0]['c'] == 0
+
+
 @pytest.mark.openchannel('v1')
 @pytest.mark.openchannel('v2')
 @pytest.mark.developer("needs dev-no-reconnect")
@@ -2870,6 +2967,105 @@ def test_field_filter(node_factory, chainparams):
     assert res == {"currency": chainparams['bip173_prefix']}
 
 
+def test_field_filter_pushdown(node_factory, bitcoind):
+    """Commands skip expensive fields which are filtered out: make sure the
+    ones we do want are still correct"""
+    l1, l2 = node_factory.line_graph(2, wait_for_announce=True)
+    l1.pay(l2, 100000)
+
+    # listpeers: channels without the db-backed fields
+    peers = l1.rpc.listpeers()['peers']
+    res = l1.rpc.call('listpeers', {},
+                      filter={"peers": [{"id": True,
+                                         "channels": [{"state": True,
+                                                       "out_payments_fulfilled": True}]}]})
+    assert res == {"peers": [{"id": p['id'],
+                              "channels": [{"state": c['state'],
+                                            "out_payments_fulfilled": c['out_payments_fulfilled']}
+                                           for c in p['channels']]}
+                             for p in peers]}
+    assert only_one(only_one(res['peers'])['channels'])['out_payments_fulfilled'] == 1
+
+    # No channels at all.
+    res = l1.rpc.call('listpeers', {}, filter={"peers": [{"id": True}]})
+    assert res == {"peers": [{"id": p['id']} for p in peers]}
+
+    # listfunds without outputs, and without addresses.
+    funds = l1.rpc.listfunds()
+    res = l1.rpc.call('listfunds', {}, filter={"channels": [{"peer_id": True}]})
+    assert res == {"channels": [{"peer_id": c['peer_id']} for c in funds['channels']]}
+    res = l1.rpc.call('listfunds', {}, filter={"outputs": [{"txid": True, "address": True}]})
+    assert res == {"outputs": [{"txid": o['txid'], "address": o['address']} for o in funds['outputs']]}
+
+    # listtransactions without the transactions, or without inputs.
+    txs = l1.rpc.listtransactions()['transactions']
+    assert l1.rpc.call('listtransactions', {}, filter={"foo": True}) == {}
+    res = l1.rpc.call('listtransactions', {},
+                      filter={"transactions": [{"hash": True, "outputs": [{"index": True}]}]})
+    assert res == {"transactions": [{"hash": t['hash'],
+                                     "outputs": [{"index": o['index']} for o in t['outputs']]}
+                                    for t in txs]}
+
+
+def test_getmetrics(node_factory):
+    """getmetrics and the Prometheus socket see commands, db commits,
+    subdaemons and HTLCs"""
+    l1, l2 = node_factory.line_graph(2, opts=[{'metrics-socket': 'metrics'}, {}])
+    l1.pay(l2, 100000)
+    l1.rpc.getinfo()
+
+    metrics = l1.rpc.getmetrics()
+    getinfo = only_one([m for m in metrics['rpc'] if m['method'] == 'getinfo'])
+    assert getinfo['duration']['count'] >= 1
+    assert sum(b['count'] for b in getinfo['duration']['buckets']) == getinfo['duration']['count']
+    assert metrics['db']['commit']['count'] > 0
+
+    channeld = only_one([s for s in metrics['subdaemons'] if s['name'] == 'channeld'])
+    assert channeld['running'] == 1
+    assert channeld['msgs_sent'] > 0
+    assert channeld['max_queued'] >= 1
+
+    # The final revocations happen after pay returns.
+    wait_for(lambda: {'state': 'RCVD_REMOVE_ACK_REVOCATION', 'count': 1}
+             in l1.rpc.getmetrics()['htlcs']['out_states'])
+    wait_for(lambda: l2.rpc.getmetrics()['htlcs']['in_resolution']['count'] == 1)
+
+    # Each new block told the funding watch its depth.
+    watches = l1.rpc.getmetrics()['watches']
+    assert watches['txowatches'] >= 1
+    assert watches['per_block']['count'] > 0
+
+    # Funding was mined: we checked its (and the coinbase's) txid, and our
+    # change output got past the wallet prefilter.
+    prefilters = l1.rpc.getmetrics()['prefilters']
+    assert prefilters['watches']['checked'] > 0
+    assert prefilters['watches']['matched'] >= 1
+    assert prefilters['wallet']['matched'] >= 1
+    for p in prefilters.values():
+        assert p['checked'] >= p['passed'] >= p['matched']
+
+    # Same thing, in Prometheus format.
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(os.path.join(l1.daemon.lightning_dir, TEST_NETWORK, 'metrics'))
+    text = b''
+    while True:
+        data = sock.recv(4096)
+        if not data:
+            break
+        text += data
+    sock.close()
+    lines = text.decode().splitlines()
+    assert '# TYPE lightningd_rpc_duration_seconds histogram' in lines
+    assert [line for line in lines
+            if line.startswith('lightningd_rpc_duration_seconds_count{method="getinfo"} ')]
+    assert [line for line in lines
+            if line.startswith('lightningd_db_commit_duration_seconds_bucket{le="+Inf"} ')]
+    assert 'lightningd_subd_running{subd="channeld"} 1' in lines
+    assert 'lightningd_htlc_state_transitions_total{direction="out",state="RCVD_REMOVE_ACK_REVOCATION"} 1' in lines
+    assert [line for line in lines
+            if line.startswith('lightningd_prefilter_checked_total{filter="watches"} ')]
+
+
 def test_checkmessage_pubkey_not_found(node_factory):
     l1 = node_factory.get_node()
 
@@ -1422,6 +1422,34 @@ def test_forward_stats(node_factory, bitcoind):
     assert stats['forwards'][1]['received_time'] <= stats['forwards'][1]['resolved_time']
     assert 'received_time' in stats['forwards'][2] and 'resolved_time' not in stats['forwards'][2]
 
+    # Resolved ones are rolled up by hour; the offered one isn't (yet).
+    rollups = l2.rpc.listforwardrollups()
+    assert rollups['bucket_seconds'] == 3600
+    assert sum(r['settled'] for r in rollups['rollups']) == 1
+    assert sum(r['failed'] + r['local_failed'] for r in rollups['rollups']) == 1
+    assert sum(r['fee_msat'] for r in rollups['rollups']) == 1 + amount // 100000
+    for r in rollups['rollups']:
+        assert r['bucket_time'] % 3600 == 0
+        assert r['in_channel'] == inchan['short_channel_id']
+
+    settled = l2.rpc.listforwardrollups(out_channel=outchan['short_channel_id'])['rollups']
+    assert len(settled) == 1
+    assert settled[0]['settled'] == 1
+    assert settled[0]['in_msat'] == stats['forwards'][0]['in_msat']
+    assert settled[0]['out_msat'] == stats['forwards'][0]['out_msat']
+
+    # Time ranges select by bucket start.
+    bucket = settled[0]['bucket_time']
+    assert l2.rpc.listforwardrollups(start_time=bucket + 3600)['rollups'] == [r for r in rollups['rollups'] if r['bucket_time'] > bucket]
+    assert l2.rpc.listforwardrollups(end_time=bucket)['rollups'] == [r for r in rollups['rollups'] if r['bucket_time'] < bucket]
+
+    # Deleting forwards doesn't change rollups (or fees collected).
+    l2.rpc.delforward(in_channel=inchan['short_channel_id'],
+                      in_htlc_id=stats['forwards'][0]['in_htlc_id'],
+                      status='settled')
+    assert l2.rpc.listforwardrollups() == rollups
+    assert l2.rpc.getinfo()['fees_collected_msat'] == 1 + amount // 100000
+
 
 @pytest.mark.developer("too slow without --dev-fast-gossip")
 @pytest.mark.slow_test
@@ -4078,6 +4106,78 @@ def test_delpay_payment_split(node_factory, bitcoind):
     assert len(l1.rpc.listpays()['pays']) == 0
 
 
+def test_bulk_delete(node_factory, bitcoind):
+    """Test delpays, delinvoices and delforwards"""
+    l1, l2, l3 = node_factory.line_graph(3, wait_for_announce=True)
+
+    invs = [l3.rpc.invoice(1000, 'inv{}'.format(i), 'desc') for i in range(3)]
+    for inv in invs:
+        l1.rpc.pay(inv['bolt11'])
+    wait_for(lambda: [f['status'] for f in l2.rpc.listforwards()['forwards']] == ['settled'] * 3)
+
+    now = int(time.time())
+    # Nothing is that old.
+    assert l1.rpc.delpays('complete', now - 3600) == {'deleted': 0, 'remaining': 3}
+    assert l3.rpc.delinvoices('paid', now - 3600) == {'deleted': 0, 'remaining': 3}
+    assert l2.rpc.delforwards('settled', now - 3600) == {'deleted': 0, 'remaining': 3}
+
+    # Wrong status
+    assert l1.rpc.delpays('failed', now) == {'deleted': 0, 'remaining': 3}
+    assert l3.rpc.delinvoices('expired', now) == {'deleted': 0, 'remaining': 3}
+    assert l2.rpc.delforwards('failed', now) == {'deleted': 0, 'remaining': 3}
+
+    l1.rpc.check_request_schemas = False
+    with pytest.raises(RpcError, match='Cannot delete pending status'):
+        l1.rpc.delpays('pending', now)
+    l1.rpc.check_request_schemas = True
+
+    # Limit is obeyed, and the oldest go first.
+    assert l1.rpc.delpays('complete', now, 2) == {'deleted': 2, 'remaining': 1}
+    assert [p['payment_hash'] for p in l1.rpc.listsendpays()['payments']] == [invs[2]['payment_hash']]
+    assert l1.rpc.delpays('complete', now, 2) == {'deleted': 1, 'remaining': 0}
+
+    assert l3.rpc.delinvoices('paid', now, 2) == {'deleted': 2, 'remaining': 1}
+    assert [i['label'] for i in l3.rpc.listinvoices()['invoices']] == ['inv2']
+    assert l3.rpc.delinvoices('paid', now) == {'deleted': 1, 'remaining': 0}
+
+    assert l2.rpc.delforwards('settled', now, 1) == {'deleted': 1, 'remaining': 2}
+    assert l2.rpc.delforwards('settled', now) == {'deleted': 2, 'remaining': 0}
+
+    # The deleted indexes moved by the number deleted.
+    assert l1.rpc.wait('sendpays', 'deleted', 0)['deleted'] == 3
+    assert l3.rpc.wait('invoices', 'deleted', 0)['deleted'] == 3
+    assert l2.rpc.wait('forwards', 'deleted', 0)['deleted'] == 3
+
+    # Rollups are untouched.
+    assert sum(r['settled'] for r in l2.rpc.listforwardrollups()['rollups']) == 3
+
+
+def test_htlc_archive(node_factory):
+    """Resolved HTLCs are moved out of the live table, but still listed"""
+    l1, l2 = node_factory.line_graph(2, opts={'may_reconnect': True,
+                                              'htlc-archive-batch': 2})
+
+    for i in range(3):
+        inv = l2.rpc.invoice(1000, 'inv{}'.format(i), 'desc')
+        l1.rpc.pay(inv['bolt11'])
+    wait_for(lambda: [h['state'] for h in l1.rpc.listhtlcs()['htlcs']] == ['RCVD_REMOVE_ACK_REVOCATION'] * 3)
+    before = l1.rpc.listhtlcs()['htlcs']
+
+    # It starts just after startup, one batch at a time.
+    l1.restart()
+    l1.daemon.wait_for_logs(['Archived 2 resolved HTLCs',
+                             'Archived 1 resolved HTLCs'])
+    assert l1.rpc.listhtlcs()['htlcs'] == before
+
+    # Channel still works, and newer HTLCs come after archived ones.
+    wait_for(lambda: only_one(l1.rpc.listpeerchannels()['channels'])['state'] == 'CHANNELD_NORMAL'
+             and only_one(l1.rpc.listpeerchannels()['channels'])['peer_connected'])
+    inv = l2.rpc.invoice(1000, 'inv3', 'desc')
+    l1.rpc.pay(inv['bolt11'])
+    wait_for(lambda: len(l1.rpc.listhtlcs()['htlcs']) == 4)
+    assert l1.rpc.listhtlcs()['htlcs'][:3] == before
+
+
 def test_listpay_result_with_paymod(node_factory, bitcoind):
     """
     The object of this test is to verify the correct behavior
@@ -574,6 +574,34 @@ def test_db_hook_multiple(node_factory, executor):
     assert [x for x in db1.iterdump()] == [x for x in db2.iterdump()]
 
 
+@unittest.skipIf(os.getenv('TEST_DB_PROVIDER', 'sqlite3') != 'sqlite3', "The test plugin replays into sqlite3")
+def test_db_write_stream(node_factory):
+    """This tests the pipelined db_write_stream hook."""
+    dbfile = os.path.join(node_factory.directory, "dbstream.sqlite3")
+    l1 = node_factory.get_node(options={'plugin': os.path.join(os.getcwd(), 'tests/plugins/dbstream.py'),
+                                        'dbstream-file': dbfile,
+                                        'db-write-stream-window': 2})
+
+    l1.daemon.logsearch_start = 0
+    l1.daemon.wait_for_log(r'plugin-dbstream.py: replaying [1-9][0-9]* pre-init batches')
+    l1.daemon.wait_for_log('plugin-dbstream.py: initialized')
+
+    # Some writes with TEXT, BLOB and integer parameters.
+    for i in range(10):
+        l1.rpc.invoice(1000 + i, 'inv{}'.format(i), 'description {}'.format(i))
+        l1.rpc.newaddr()
+    l1.rpc.delinvoice('inv3', 'unpaid')
+
+    # Shutdown waits for every batch to be acknowledged.
+    l1.stop()
+
+    # Databases should be identical.
+    db1 = sqlite3.connect(os.path.join(l1.daemon.lightning_dir, TEST_NETWORK, 'lightningd.sqlite3'))
+    db2 = sqlite3.connect(dbfile)
+
+    assert [x for x in db1.iterdump()] == [x for x in db2.iterdump()]
+
+
 def test_utf8_passthrough(node_factory, executor):
     l1 = node_factory.get_node(options={'plugin': os.path.join(os.getcwd(), 'tests/plugins/utf8.py'),
                                         'log-level': 'io'})
@@ -1707,8 +1735,7 @@ def test_bitcoin_backend(node_factory, bitcoind):
     del l1.daemon.opts["plugin-dir"]
     del l1.daemon.opts["disable-plugin"]
     l1.start()
-    assert l1.daemon.is_in_log("bitcoin-cli initialized and connected to"
-                               " bitcoind")
+    assert l1.daemon.is_in_log("initialized and connected to bitcoind")
 
 
 def test_bcli(node_factory, bitcoind, chainparams):
@@ -1760,6 +1787,95 @@ def test_bcli(node_factory, bitcoind, chainparams):
     assert not resp["success"] and "decode failed" in resp["errmsg"]
 
 
+def test_bcli_rpc(node_factory, bitcoind, executor):
+    """bcli talks to bitcoind's RPC server itself, unless told not to"""
+    l1 = node_factory.get_node(options={'bitcoin-rpc-connections': 1,
+                                        'bitcoin-rpc-pipeline': 4})
+    l2 = node_factory.get_node(options={'bitcoin-rpc-connections': 0})
+    assert l1.daemon.is_in_log('RPC initialized and connected to bitcoind at')
+    assert l2.daemon.is_in_log('bitcoin-cli initialized and connected to bitcoind')
+
+    # Both give the same answers.
+    for n in (l1, l2):
+        resp = n.rpc.call("getrawblockbyheight", {"height": 500})
+        assert resp["blockhash"] is resp["block"] is None
+
+        blockhash = bitcoind.rpc.getblockhash(50)
+        resp = n.rpc.call("getrawblockbyheight", {"height": 50})
+        assert resp["blockhash"] == blockhash
+        assert resp["block"] == bitcoind.rpc.getblock(blockhash, 0)
+
+        resp = n.rpc.call("sendrawtransaction", {"tx": "dummy", "allowhighfees": False})
+        assert not resp["success"] and "decode failed" in resp["errmsg"]
+
+    # Lots at once get queued on the one connection.
+    futs = [executor.submit(l1.rpc.call, "getrawblockbyheight", {"height": h})
+            for h in range(1, 51)]
+    for h, f in enumerate(futs, start=1):
+        assert f.result(TIMEOUT)["blockhash"] == bitcoind.rpc.getblockhash(h)
+
+
+def test_bcli_blockfile(node_factory, bitcoind):
+    """bcli can hand raw blocks over in a file, and lightningd uses that"""
+    l1 = node_factory.get_node()
+
+    assert l1.rpc.call("getchaininfo")["blockfile"] is True
+
+    blockhash = bitcoind.rpc.getblockhash(50)
+    resp = l1.rpc.call("getrawblockbyheight", {"height": 50, "blockfile": True})
+    assert resp["blockhash"] == blockhash
+    assert "block" not in resp
+    with open(resp["blockfile"], "rb") as f:
+        assert f.read().hex() == bitcoind.rpc.getblock(blockhash, 0)
+    os.unlink(resp["blockfile"])
+
+    # Not found is still null.
+    resp = l1.rpc.call("getrawblockbyheight", {"height": 500, "blockfile": True})
+    assert resp["blockhash"] is resp["block"] is None
+
+    # lightningd catches up using files, and reports how fast.
+    l1.stop()
+    bitcoind.generate_block(20)
+    l1.start()
+    l1.daemon.wait_for_log(r'Added [0-9]* blocks in [0-9]*ms \([0-9.]* blocks/sec\)')
+    wait_for(lambda: l1.rpc.getinfo()['blockheight'] == bitcoind.rpc.getblockcount())
+
+
+def test_bcli_sendrawtransactions(node_factory, bitcoind):
+    """bcli can send several txs at once, skipping ones bitcoind has"""
+    l1 = node_factory.get_node()
+
+    def make_tx():
+        addr = bitcoind.rpc.getnewaddress()
+        raw = bitcoind.rpc.createrawtransaction([], {addr: 0.001})
+        funded = bitcoind.rpc.fundrawtransaction(raw)
+        return bitcoind.rpc.signrawtransactionwithwallet(funded['hex'])['hex']
+
+    tx1 = make_tx()
+    resp = l1.rpc.call("sendrawtransactions", {"txs": [tx1, "dummy"],
+                                               "allowhighfees": False})
+    assert resp["results"][0] == {"success": True, "errmsg": ""}
+    assert not resp["results"][1]["success"]
+    assert "decode failed" in resp["results"][1]["errmsg"]
+    assert bitcoind.rpc.decoderawtransaction(tx1)['txid'] in bitcoind.rpc.getrawmempool()
+
+    # tx1, tx2 and tx3 are already in the mempool, so only tx4 needs sending.
+    tx2, tx3, tx4 = make_tx(), make_tx(), make_tx()
+    bitcoind.rpc.sendrawtransaction(tx2)
+    bitcoind.rpc.sendrawtransaction(tx3)
+    resp = l1.rpc.call("sendrawtransactions", {"txs": [tx1, tx2, tx4, tx3],
+                                               "allowhighfees": False,
+                                               "preflight": True})
+    assert [r["success"] for r in resp["results"]] == [True] * 4
+    l1.daemon.wait_for_logs(['getrawmempool: tx {} already known, not sending'.format(i)
+                             for i in (0, 1, 3)])
+    assert not l1.daemon.is_in_log('getrawmempool: tx 2 already known')
+    assert bitcoind.rpc.decoderawtransaction(tx4)['txid'] in bitcoind.rpc.getrawmempool()
+
+    assert l1.rpc.call("sendrawtransactions", {"txs": [],
+                                               "allowhighfees": False}) == {"results": []}
+
+
 def test_hook_crash(node_factory, executor, bitcoind):
     """Verify that we fail over if a plugin crashes while handling a hook.
 
@@ -3209,6 +3325,48 @@ def test_autoclean_once(node_factory):
                                                                         'cleaned': 1}}}
 
 
+def test_sql(node_factory, bitcoind):
+    l1, l2, l3 = node_factory.line_graph(3, wait_for_announce=True)
+
+    assert l3.rpc.sql("SELECT COUNT(*) FROM invoices") == {'rows': [[0]]}
+
+    inv1 = l3.rpc.invoice(amount_msat=100000, label='inv1', description='desc1')
+    l3.rpc.invoice(amount_msat=200000, label='inv2', description='desc2')
+    assert (l3.rpc.sql("SELECT label, status FROM invoices ORDER BY label")
+            == {'rows': [['inv1', 'unpaid'], ['inv2', 'unpaid']]})
+
+    # Updates are picked up.
+    l1.rpc.pay(inv1['bolt11'])
+    assert (l3.rpc.sql("SELECT label, status, amount_received_msat FROM invoices"
+                       " WHERE status = 'paid'")
+            == {'rows': [['inv1', 'paid', 100000]]})
+
+    # As are deletions.
+    l3.rpc.delinvoice('inv2', 'unpaid')
+    assert l3.rpc.sql("SELECT label FROM invoices") == {'rows': [['inv1']]}
+
+    assert (l1.rpc.sql("SELECT payment_hash, status FROM sendpays")
+            == {'rows': [[inv1['payment_hash'], 'complete']]})
+
+    # Aggregates match what listforwards says.
+    fwds = l2.rpc.listforwards(status='settled')['forwards']
+    assert len(fwds) == 1
+    assert (l2.rpc.sql("SELECT in_channel, SUM(fee_msat) FROM forwards"
+                       " WHERE status = 'settled' GROUP BY in_channel")
+            == {'rows': [[fwds[0]['in_channel'], fwds[0]['fee_msat']]]})
+
+    assert l2.rpc.sql("SELECT COUNT(*) FROM peerchannels WHERE state = 'CHANNELD_NORMAL'") == {'rows': [[2]]}
+
+    # It's read-only.
+    with pytest.raises(RpcError, match='not authorized'):
+        l3.rpc.sql("DELETE FROM invoices")
+    with pytest.raises(RpcError, match='prohibited'):
+        l3.rpc.sql("SELECT * FROM sqlite_master")
+    with pytest.raises(RpcError, match='single statement'):
+        l3.rpc.sql("SELECT 1; SELECT 2")
+    assert l3.rpc.sql("SELECT COUNT(*) FROM invoices") == {'rows': [[1]]}
+
+
 def test_block_added_notifications(node_factory, bitcoind):
     """Test if a plugin gets notifications when a new block is found"""
     base = bitcoind.rpc.getblockchaininfo()["blocks"]
@@ -584,6 +584,33 @@ def test_fundpsbt(node_factory, bitcoind, chainparams):
         l1.rpc.fundpsbt(amount // 2, feerate, 0)
 
 
+@unittest.skipIf(TEST_NETWORK != 'regtest', "Elements adds a fee output")
+def test_fundpsbt_changeless(node_factory, bitcoind):
+    """fundpsbt prefers a set of inputs which needs no change"""
+    l1 = node_factory.get_node()
+
+    addr = l1.rpc.newaddr()['bech32']
+    for amount in (100000, 200000, 300000):
+        bitcoind.rpc.sendtoaddress(addr, amount / 10**8)
+    bitcoind.generate_block(1)
+    wait_for(lambda: len(l1.rpc.listfunds()['outputs']) == 3)
+
+    # Spending all of them tells us what each input costs.
+    feerate = '1000perkw'
+    funding = l1.rpc.fundpsbt('all', feerate, 0, reserve=0)
+    input_fee = (600000 - funding['excess_msat'].to_whole_satoshi()) // 3
+
+    # Only 100000 + 300000 comes within a few sats of this.
+    amount = 400000 - 2 * input_fee - 50
+    funding = l1.rpc.fundpsbt(amount, feerate, 0, reserve=0,
+                              excess_as_change=True)
+    psbt = bitcoind.rpc.decodepsbt(funding['psbt'])
+    assert len(psbt['tx']['vin']) == 2
+    assert 'change_outnum' not in funding
+    assert psbt['tx']['vout'] == []
+    assert funding['excess_msat'] < Millisatoshi(1000 * 1000)
+
+
 def test_utxopsbt(node_factory, bitcoind, chainparams):
     amount = 1000000
     l1 = node_factory.get_node()
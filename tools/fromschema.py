@@ -100,7 +100,10 @@ def output_member(propname, properties, is_optional, indent, print_type=True, pr
 
 def output_array(items, indent):
     """We've already said it's an array of {type}"""
-    if items['type'] == 'object':
+    # No type means any JSON value.
+    if 'type' not in items:
+        output(indent + '- {}\n'.format(items['description']))
+    elif items['type'] == 'object':
         output_members(items, indent)
     elif items['type'] == 'array':
         output(indent + '- {}:\n'.format(items['description']))
@@ -234,7 +237,7 @@ def generate_from_schema(schema):
         # Don't have a description field here, it's not used.
         assert 'description' not in toplevels[0]
         sub = props[toplevels[0]]
-    elif len(toplevels) == 1 and props[toplevels[0]]['type'] == 'array':
+    elif len(toplevels) == 1 and props[toplevels[0]]['type'] == 'array' and props[toplevels[0]]['items']['type'] == 'object':
         output('On success, an object containing {} is returned.  It is an array of objects, where each object contains:\n\n'.format(fmt_propname(toplevels[0])))
         # Don't have a description field here, it's not used.
         assert 'description' not in toplevels[0]
@@ -67,6 +67,10 @@ static void migrate_payments_scids_as_integers(struct lightningd *ld,
 					       struct db *db,
 					       const struct migration_context *mc);
 
+static void migrate_initialize_wait_indexes(struct lightningd *ld,
+					    struct db *db,
+					    const struct migration_context *mc);
+
 /* Do not reorder or remove elements from this array, it is used to
  * migrate existing databases from a previous state, based on the
  * string indices */
@@ -943,6 +947,93 @@ static struct migration dbmigrations[] = {
     /* A reference into our own invoicerequests table, if it was made from one */
     {SQL("ALTER TABLE payments ADD COLUMN local_invreq_id BLOB DEFAULT NULL REFERENCES invoicerequests(invreq_id);"), NULL},
     /* FIXME: Remove payments local_offer_id column! */
+    /* Indexes for the `wait` command: ids are the created_index for
+     * invoices and payments, forwards need their own column. */
+    {SQL("ALTER TABLE invoices ADD updated_index BIGINT DEFAULT 0"), NULL},
+    {SQL("CREATE INDEX invoice_update_idx ON invoices (updated_index)"), NULL},
+    {SQL("ALTER TABLE payments ADD updated_index BIGINT DEFAULT 0"), NULL},
+    {SQL("CREATE INDEX payments_update_idx ON payments (updated_index)"), NULL},
+    {SQL("ALTER TABLE forwards ADD updated_index BIGINT DEFAULT 0"), NULL},
+    {SQL("CREATE INDEX forwards_updated_idx ON forwards (updated_index)"), NULL},
+    {SQL("ALTER TABLE forwards ADD created_index BIGINT DEFAULT NULL"), migrate_initialize_wait_indexes},
+    {SQL("CREATE UNIQUE INDEX forwards_created_idx ON forwards (created_index)"), NULL},
+    /* Hourly per-channel totals of resolved forwards (not touched by
+     * delforward).  out_channel_scid is 0 if unknown. */
+    {SQL("CREATE TABLE forward_rollups ("
+	 "  bucket_time BIGINT"
+	 ", in_channel_scid BIGINT"
+	 ", out_channel_scid BIGINT"
+	 ", settled BIGINT"
+	 ", failed BIGINT"
+	 ", local_failed BIGINT"
+	 ", in_msatoshi BIGINT"
+	 ", out_msatoshi BIGINT"
+	 ", fee_msatoshi BIGINT"
+	 ", PRIMARY KEY (bucket_time, in_channel_scid, out_channel_scid))"), NULL},
+    {SQL("CREATE INDEX forward_rollups_in_idx ON forward_rollups (in_channel_scid, bucket_time)"), NULL},
+    {SQL("CREATE INDEX forward_rollups_out_idx ON forward_rollups (out_channel_scid, bucket_time)"), NULL},
+    {SQL("CREATE TABLE forward_rollup_failures ("
+	 "  bucket_time BIGINT"
+	 ", in_channel_scid BIGINT"
+	 ", out_channel_scid BIGINT"
+	 ", failcode INTEGER"
+	 ", num BIGINT"
+	 ", PRIMARY KEY (bucket_time, in_channel_scid, out_channel_scid, failcode))"), NULL},
+    /* Times are in nanoseconds; local failures have no resolved_time. */
+    {SQL("INSERT INTO forward_rollups SELECT"
+	 "  COALESCE(resolved_time, received_time) / 3600000000000 * 3600"
+	 ", in_channel_scid"
+	 ", COALESCE(out_channel_scid, 0)"
+	 ", SUM(CASE WHEN state = 1 THEN 1 ELSE 0 END)"
+	 ", SUM(CASE WHEN state = 2 THEN 1 ELSE 0 END)"
+	 ", SUM(CASE WHEN state = 3 THEN 1 ELSE 0 END)"
+	 ", SUM(CASE WHEN state = 1 THEN in_msatoshi ELSE 0 END)"
+	 ", SUM(CASE WHEN state = 1 THEN COALESCE(out_msatoshi, 0) ELSE 0 END)"
+	 ", SUM(CASE WHEN state = 1 THEN COALESCE(in_msatoshi - out_msatoshi, 0) ELSE 0 END)"
+	 " FROM forwards"
+	 " WHERE state != 0"
+	 " GROUP BY COALESCE(resolved_time, received_time) / 3600000000000 * 3600"
+	 ", in_channel_scid"
+	 ", COALESCE(out_channel_scid, 0)"), NULL},
+    {SQL("INSERT INTO forward_rollup_failures SELECT"
+	 "  COALESCE(resolved_time, received_time) / 3600000000000 * 3600"
+	 ", in_channel_scid"
+	 ", COALESCE(out_channel_scid, 0)"
+	 ", failcode"
+	 ", COUNT(*)"
+	 " FROM forwards"
+	 " WHERE state != 0 AND failcode IS NOT NULL AND failcode != 0"
+	 " GROUP BY COALESCE(resolved_time, received_time) / 3600000000000 * 3600"
+	 ", in_channel_scid"
+	 ", COALESCE(out_channel_scid, 0)"
+	 ", failcode"), NULL},
+    /* Resolved HTLCs are moved here by wallet_htlcs_archive(), keeping
+     * only what we need to punish old commitments (and for listhtlcs). */
+    {SQL("CREATE TABLE channel_htlcs_archive ("
+	 "  id BIGINT"
+	 ", channel_id BIGINT REFERENCES channels(id) ON DELETE CASCADE"
+	 ", channel_htlc_id BIGINT"
+	 ", direction INTEGER"
+	 ", msatoshi BIGINT"
+	 ", cltv_expiry INTEGER"
+	 ", payment_hash BLOB"
+	 ", hstate INTEGER"
+	 ", min_commit_num BIGINT"
+	 ", max_commit_num BIGINT"
+	 ", PRIMARY KEY (id)"
+	 ");"), NULL},
+    {SQL("CREATE INDEX channel_htlcs_archive_channel_idx"
+	 " ON channel_htlcs_archive (channel_id, min_commit_num)"), NULL},
+    /* wallet_outpoint_for_scid() is answered from the index alone, without
+     * touching the table; this replaces the narrower short_channel_id. */
+    {SQL("CREATE INDEX utxoset_scid ON utxoset (blockheight, txindex, "
+	 "outnum, spendheight, txid, satoshis, scriptpubkey)"), NULL},
+    {SQL("DROP INDEX short_channel_id;"), NULL},
+    /* For the bulk deletions (delinvoices, delpays, delforwards). */
+    {SQL("CREATE INDEX invoices_state_paid_idx ON invoices (state, paid_timestamp)"), NULL},
+    {SQL("CREATE INDEX invoices_state_expiry_idx ON invoices (state, expiry_time)"), NULL},
+    {SQL("CREATE INDEX payments_status_time_idx ON payments (status, timestamp)"), NULL},
+    {SQL("CREATE INDEX forwards_state_resolved_idx ON forwards (state, resolved_time)"), NULL},
 };
 
 /* Released versions are of form v{num}[.{num}]* */
@@ -1024,6 +1115,11 @@ struct db *db_setup(const tal_t *ctx, struct lightningd *ld,
 	bool migrated;
 
 	db->report_changes_fn = plugin_hook_db_sync;
+	db->record_change_fn = plugin_hook_db_record;
+	db->replica_max_lag = ld->wallet_replica_max_lag;
+#if DEVELOPER
+	db->no_pipeline = ld->dev_no_db_pipeline;
+#endif
 
 	db_begin_transaction(db);
 	db->data_version = db_data_version_get(db);
@@ -1563,3 +1659,57 @@ static void migrate_payments_scids_as_integers(struct lightningd *ld,
 	if (!db->config->delete_columns(db, "payments", colnames, ARRAY_SIZE(colnames)))
 		db_fatal("Could not delete payments.failchannel");
 }
+
+/* Set up the created indexes for existing rows, so `wait` starts sane */
+static void migrate_initialize_wait_indexes(struct lightningd *ld,
+					    struct db *db,
+					    const struct migration_context *mc)
+{
+	struct db_stmt *stmt;
+	u64 *rowids = tal_arr(tmpctx, u64, 0);
+	u64 max;
+
+	/* invoices and payments simply use their id as created_index */
+	stmt = db_prepare_v2(db, SQL("SELECT MAX(id) FROM invoices;"));
+	db_query_prepared(stmt);
+	db_step(stmt);
+	if (db_col_is_null(stmt, "MAX(id)"))
+		max = 0;
+	else
+		max = db_col_u64(stmt, "MAX(id)");
+	tal_free(stmt);
+	db_set_intvar(db, "last_invoices_created_index", max);
+
+	stmt = db_prepare_v2(db, SQL("SELECT MAX(id) FROM payments;"));
+	db_query_prepared(stmt);
+	db_step(stmt);
+	if (db_col_is_null(stmt, "MAX(id)"))
+		max = 0;
+	else
+		max = db_col_u64(stmt, "MAX(id)");
+	tal_free(stmt);
+	db_set_intvar(db, "last_sendpays_created_index", max);
+
+	/* Forwards get numbered in the order we received them.  Old
+	 * (pre-0.12.1) forwards may lack in_htlc_id, so (in_channel_scid,
+	 * in_htlc_id) doesn't identify a row: go by rowid instead. */
+	stmt = db_prepare_v2(db, SQL("SELECT _ROWID_"
+				     " FROM forwards"
+				     " ORDER BY received_time, _ROWID_;"));
+	db_query_prepared(stmt);
+	while (db_step(stmt)) {
+		u64 rowid = db_col_u64(stmt, "_ROWID_");
+		tal_arr_expand(&rowids, rowid);
+	}
+	tal_free(stmt);
+
+	for (size_t i = 0; i < tal_count(rowids); i++) {
+		stmt = db_prepare_v2(db, SQL("UPDATE forwards"
+					     " SET created_index = ?"
+					     " WHERE _ROWID_ = ?"));
+		db_bind_u64(stmt, 0, i + 1);
+		db_bind_u64(stmt, 1, rowids[i]);
+		db_exec_prepared_v2(take(stmt));
+	}
+	db_set_intvar(db, "last_forwards_created_index", tal_count(rowids));
+}
@@ -5,6 +5,9 @@
 #include <db/common.h>
 #include <db/exec.h>
 #include <db/utils.h>
+#include <inttypes.h>
+#include <lightningd/lightningd.h>
+#include <lightningd/wait.h>
 #include <wallet/invoices.h>
 #include <wallet/wallet.h>
 
@@ -24,6 +27,8 @@ struct invoice_waiter {
 };
 
 struct invoices {
+	/* The wallet we belong to (for ld, to tell `wait` about changes). */
+	struct wallet *wallet;
 	/* The database connection to use. */
 	struct db *db;
 	/* The timers object to use for expirations. */
@@ -36,6 +41,28 @@ struct invoices {
 	struct oneshot *expiration_timer;
 };
 
+/* Bump an index (and tell `wait`).  Any of the details can be NULL. */
+static u64 invoice_index_inc(struct invoices *invoices,
+			     enum wait_index index,
+			     const enum invoice_status *state,
+			     const struct json_escape *label,
+			     const char *invstring,
+			     const char *description)
+{
+	bool is_bolt12 = invstring && strstarts(invstring, "lni");
+
+	return wait_index_increment(invoices->wallet->ld,
+				    WAIT_SUBSYSTEM_INVOICE,
+				    index,
+				    "status", state ? invoice_status_str(*state) : NULL,
+				    /* Label is already JSON escaped */
+				    "label", label ? label->s : NULL,
+				    "bolt11", is_bolt12 ? NULL : invstring,
+				    "bolt12", is_bolt12 ? invstring : NULL,
+				    "description", description,
+				    NULL);
+}
+
 static void trigger_invoice_waiter(struct invoice_waiter *w,
 				   const struct invoice *invoice)
 {
@@ -80,6 +107,8 @@ static struct invoice_details *wallet_stmt2invoice_details(const tal_t *ctx,
 {
 	struct invoice_details *dtl = tal(ctx, struct invoice_details);
 	dtl->state = db_col_int(stmt, "state");
+	dtl->created_index = db_col_u64(stmt, "id");
+	dtl->updated_index = db_col_u64(stmt, "updated_index");
 
 	db_col_preimage(stmt, "payment_key", &dtl->r);
 
@@ -125,29 +154,63 @@ static struct invoice_details *wallet_stmt2invoice_details(const tal_t *ctx,
 	return dtl;
 }
 
-/* Update expirations. */
-static void update_db_expirations(struct invoices *invoices, u64 now)
+struct expired_invoice {
+	u64 id;
+	const struct json_escape *label;
+};
+
+/* Update expirations, return the ones we expired (allocated off tmpctx). */
+static struct expired_invoice *update_db_expirations(struct invoices *invoices,
+						     u64 now)
 {
 	struct db_stmt *stmt;
-	stmt = db_prepare_v2(invoices->db, SQL("UPDATE invoices"
-					       "   SET state = ?"
+	struct expired_invoice *expired
+		= tal_arr(tmpctx, struct expired_invoice, 0);
+	const enum invoice_status state = EXPIRED;
+
+	/* Each one gets its own updated_index, so do them one at a time */
+	stmt = db_prepare_v2(invoices->db, SQL("SELECT id, label"
+					       "  FROM invoices"
 					       " WHERE state = ?"
 					       "   AND expiry_time <= ?;"));
-	db_bind_int(stmt, 0, EXPIRED);
-	db_bind_int(stmt, 1, UNPAID);
-	db_bind_u64(stmt, 2, now);
-	db_exec_prepared_v2(take(stmt));
+	db_bind_int(stmt, 0, UNPAID);
+	db_bind_u64(stmt, 1, now);
+	db_query_prepared(stmt);
+
+	while (db_step(stmt)) {
+		struct expired_invoice e;
+		e.id = db_col_u64(stmt, "id");
+		e.label = db_col_json_escape(expired, stmt, "label");
+		tal_arr_expand(&expired, e);
+	}
+	tal_free(stmt);
+
+	for (size_t i = 0; i < tal_count(expired); i++) {
+		stmt = db_prepare_v2(invoices->db, SQL("UPDATE invoices"
+						       "   SET state = ?"
+						       "     , updated_index = ?"
+						       " WHERE id = ?;"));
+		db_bind_int(stmt, 0, EXPIRED);
+		db_bind_u64(stmt, 1,
+			    invoice_index_inc(invoices, WAIT_INDEX_UPDATED,
+					      &state, expired[i].label,
+					      NULL, NULL));
+		db_bind_u64(stmt, 2, expired[i].id);
+		db_exec_prepared_v2(take(stmt));
+	}
+	return expired;
 }
 
 static void install_expiration_timer(struct invoices *invoices);
 
 struct invoices *invoices_new(const tal_t *ctx,
-			      struct db *db,
+			      struct wallet *wallet,
 			      struct timers *timers)
 {
 	struct invoices *invs = tal(ctx, struct invoices);
 
-	invs->db = db;
+	invs->wallet = wallet;
+	invs->db = wallet->db;
 	invs->timers = timers;
 
 	list_head_init(&invs->waiters);
@@ -159,47 +222,22 @@ struct invoices *invoices_new(const tal_t *ctx,
 	return invs;
 }
 
-struct invoice_id_node {
-	struct list_node list;
-	u64 id;
-};
-
 static void trigger_expiration(struct invoices *invoices)
 {
-	struct list_head idlist;
-	struct invoice_id_node *idn;
 	u64 now = time_now().ts.tv_sec;
-	struct db_stmt *stmt;
+	struct expired_invoice *expired;
 	struct invoice i;
 
 	/* Free current expiration timer */
 	invoices->expiration_timer = tal_free(invoices->expiration_timer);
 
-	/* Acquire all expired invoices and save them in a list */
-	list_head_init(&idlist);
-	stmt = db_prepare_v2(invoices->db, SQL("SELECT id"
-					       "  FROM invoices"
-					       " WHERE state = ?"
-					       "   AND expiry_time <= ?"));
-	db_bind_int(stmt, 0, UNPAID);
-	db_bind_u64(stmt, 1, now);
-	db_query_prepared(stmt);
-
-	while (db_step(stmt)) {
-		idn = tal(tmpctx, struct invoice_id_node);
-		list_add_tail(&idlist, &idn->list);
-		idn->id = db_col_u64(stmt, "id");
-	}
-	tal_free(stmt);
-
-	/* Expire all those invoices */
-	update_db_expirations(invoices, now);
+	/* Expire all the invoices which are due */
+	expired = update_db_expirations(invoices, now);
 
 	/* Trigger expirations */
-	list_for_each(&idlist, idn, list) {
-		/* Trigger expiration */
-		i.id = idn->id;
-		trigger_invoice_waiter_expire_or_delete(invoices, idn->id, &i);
+	for (size_t n = 0; n < tal_count(expired); n++) {
+		i.id = expired[n].id;
+		trigger_invoice_waiter_expire_or_delete(invoices, i.id, &i);
 	}
 
 	install_expiration_timer(invoices);
@@ -269,6 +307,7 @@ bool invoices_create(struct invoices *invoices,
 	struct invoice dummy;
 	u64 expiry_time;
 	u64 now = time_now().ts.tv_sec;
+	const enum invoice_status state = UNPAID;
 
 	if (invoices_find_by_label(invoices, &dummy, label)) {
 		if (taken(msat))
@@ -281,42 +320,45 @@ bool invoices_create(struct invoices *invoices,
 	/* Compute expiration. */
 	expiry_time = now + expiry;
 
+	/* The created_index is the id. */
+	pinvoice->id = invoice_index_inc(invoices, WAIT_INDEX_CREATED,
+					 &state, label, b11enc, description);
+
 	/* Save to database. */
 	stmt = db_prepare_v2(
 	    invoices->db,
 	    SQL("INSERT INTO invoices"
-		"            ( payment_hash, payment_key, state"
+		"            ( id, payment_hash, payment_key, state"
 		"            , msatoshi, label, expiry_time"
 		"            , pay_index, msatoshi_received"
 		"            , paid_timestamp, bolt11, description, features, local_offer_id)"
-		"     VALUES ( ?, ?, ?"
+		"     VALUES ( ?, ?, ?, ?"
 		"            , ?, ?, ?"
 		"            , NULL, NULL"
 		"            , NULL, ?, ?, ?, ?);"));
 
-	db_bind_sha256(stmt, 0, rhash);
-	db_bind_preimage(stmt, 1, r);
-	db_bind_int(stmt, 2, UNPAID);
+	db_bind_u64(stmt, 0, pinvoice->id);
+	db_bind_sha256(stmt, 1, rhash);
+	db_bind_preimage(stmt, 2, r);
+	db_bind_int(stmt, 3, state);
 	if (msat)
-		db_bind_amount_msat(stmt, 3, msat);
+		db_bind_amount_msat(stmt, 4, msat);
 	else
-		db_bind_null(stmt, 3);
-	db_bind_json_escape(stmt, 4, label);
-	db_bind_u64(stmt, 5, expiry_time);
-	db_bind_text(stmt, 6, b11enc);
+		db_bind_null(stmt, 4);
+	db_bind_json_escape(stmt, 5, label);
+	db_bind_u64(stmt, 6, expiry_time);
+	db_bind_text(stmt, 7, b11enc);
 	if (!description)
-		db_bind_null(stmt, 7);
+		db_bind_null(stmt, 8);
 	else
-		db_bind_text(stmt, 7, description);
-	db_bind_talarr(stmt, 8, features);
+		db_bind_text(stmt, 8, description);
+	db_bind_talarr(stmt, 9, features);
 	if (local_offer_id)
-		db_bind_sha256(stmt, 9, local_offer_id);
+		db_bind_sha256(stmt, 10, local_offer_id);
 	else
-		db_bind_null(stmt, 9);
+		db_bind_null(stmt, 10);
 
-	db_exec_prepared_v2(stmt);
-
-	pinvoice->id = db_last_insert_id_v2(take(stmt));
+	db_exec_prepared_v2(take(stmt));
 
 	/* Install expiration trigger. */
 	if (!invoices->expiration_timer ||
@@ -404,6 +446,25 @@ bool invoices_delete(struct invoices *invoices, struct invoice invoice)
 {
 	struct db_stmt *stmt;
 	int changes;
+	enum invoice_status state;
+	const struct json_escape *label;
+	const char *invstring;
+
+	/* We need these to tell `wait` what went away. */
+	stmt = db_prepare_v2(invoices->db, SQL("SELECT state, label, bolt11"
+					       "  FROM invoices"
+					       " WHERE id = ?;"));
+	db_bind_u64(stmt, 0, invoice.id);
+	db_query_prepared(stmt);
+	if (!db_step(stmt)) {
+		tal_free(stmt);
+		return false;
+	}
+	state = db_col_int(stmt, "state");
+	label = db_col_json_escape(tmpctx, stmt, "label");
+	invstring = db_col_strdup(tmpctx, stmt, "bolt11");
+	tal_free(stmt);
+
 	/* Delete from database. */
 	stmt = db_prepare_v2(invoices->db,
 			     SQL("DELETE FROM invoices WHERE id=?;"));
@@ -416,6 +477,9 @@ bool invoices_delete(struct invoices *invoices, struct invoice invoice)
 	if (changes != 1) {
 		return false;
 	}
+	invoice_index_inc(invoices, WAIT_INDEX_DELETED,
+			  &state, label, invstring, NULL);
+
 	/* Tell all the waiters about the fact that it was deleted. */
 	trigger_invoice_waiter_expire_or_delete(invoices, invoice.id, NULL);
 	return true;
@@ -425,11 +489,29 @@ bool invoices_delete_description(struct invoices *invoices, struct invoice invoi
 {
 	struct db_stmt *stmt;
 	int changes;
+	const struct json_escape *label;
+
+	stmt = db_prepare_v2(invoices->db, SQL("SELECT label"
+					       "  FROM invoices"
+					       " WHERE id = ?;"));
+	db_bind_u64(stmt, 0, invoice.id);
+	db_query_prepared(stmt);
+	if (!db_step(stmt)) {
+		tal_free(stmt);
+		return false;
+	}
+	label = db_col_json_escape(tmpctx, stmt, "label");
+	tal_free(stmt);
 
 	stmt = db_prepare_v2(invoices->db, SQL("UPDATE invoices"
 					       "   SET description = NULL"
+					       "     , updated_index = ?"
 					       " WHERE ID = ?;"));
-	db_bind_u64(stmt, 0, invoice.id);
+	/* Empty description tells them it was removed. */
+	db_bind_u64(stmt, 0,
+		    invoice_index_inc(invoices, WAIT_INDEX_UPDATED,
+				      NULL, label, NULL, ""));
+	db_bind_u64(stmt, 1, invoice.id);
 	db_exec_prepared_v2(stmt);
 
 	changes = db_count_changes(stmt);
@@ -442,37 +524,192 @@ void invoices_delete_expired(struct invoices *invoices,
 			     u64 max_expiry_time)
 {
 	struct db_stmt *stmt;
+	const enum invoice_status state = EXPIRED;
+	struct deleted_invoice {
+		u64 id;
+		const struct json_escape *label;
+		const char *invstring;
+	} *deleted = tal_arr(tmpctx, struct deleted_invoice, 0);
+
+	/* Each deletion bumps the deleted index, so do them one by one */
 	stmt = db_prepare_v2(invoices->db, SQL(
-			  "DELETE FROM invoices"
+			  "SELECT id, label, bolt11"
+			  "  FROM invoices"
 			  " WHERE state = ?"
 			  "   AND expiry_time <= ?;"));
 	db_bind_int(stmt, 0, EXPIRED);
 	db_bind_u64(stmt, 1, max_expiry_time);
-	db_exec_prepared_v2(take(stmt));
+	db_query_prepared(stmt);
+	while (db_step(stmt)) {
+		struct deleted_invoice d;
+		d.id = db_col_u64(stmt, "id");
+		d.label = db_col_json_escape(deleted, stmt, "label");
+		d.invstring = db_col_strdup(deleted, stmt, "bolt11");
+		tal_arr_expand(&deleted, d);
+	}
+	tal_free(stmt);
+
+	for (size_t i = 0; i < tal_count(deleted); i++) {
+		stmt = db_prepare_v2(invoices->db, SQL(
+				  "DELETE FROM invoices"
+				  " WHERE id = ?;"));
+		db_bind_u64(stmt, 0, deleted[i].id);
+		db_exec_prepared_v2(take(stmt));
+
+		invoice_index_inc(invoices, WAIT_INDEX_DELETED,
+				  &state, deleted[i].label,
+				  deleted[i].invstring, NULL);
+	}
+}
+
+u64 invoices_delete_older(struct invoices *invoices,
+			  enum invoice_status state,
+			  u64 max_time,
+			  u32 limit,
+			  u64 *remaining)
+{
+	struct db_stmt *stmt;
+	u64 deleted;
+
+	/* Nobody can be waiting on these (waiters are triggered when an
+	 * invoice is paid or expires), so we can remove them en masse. */
+	assert(state == PAID || state == EXPIRED);
+	if (state == PAID) {
+		stmt = db_prepare_v2(invoices->db, SQL(
+				  "DELETE FROM invoices"
+				  " WHERE id IN (SELECT id FROM invoices"
+				  "               WHERE state = ?"
+				  "                 AND paid_timestamp <= ?"
+				  "               ORDER BY id"
+				  "               LIMIT ?);"));
+	} else {
+		stmt = db_prepare_v2(invoices->db, SQL(
+				  "DELETE FROM invoices"
+				  " WHERE id IN (SELECT id FROM invoices"
+				  "               WHERE state = ?"
+				  "                 AND expiry_time <= ?"
+				  "               ORDER BY id"
+				  "               LIMIT ?);"));
+	}
+	db_bind_int(stmt, 0, invoice_status_in_db(state));
+	db_bind_u64(stmt, 1, max_time);
+	db_bind_int(stmt, 2, limit);
+	db_exec_prepared_v2(stmt);
+	deleted = db_count_changes(stmt);
+	tal_free(stmt);
+
+	/* One bump for the lot, rather than one per invoice. */
+	wait_index_increase(invoices->wallet->ld,
+			    WAIT_SUBSYSTEM_INVOICE,
+			    WAIT_INDEX_DELETED,
+			    deleted,
+			    "status", invoice_status_str(state),
+			    "=count", tal_fmt(tmpctx, "%"PRIu64, deleted),
+			    NULL);
+
+	/* If we didn't hit the limit, this is the last call: count what's
+	 * left, once.  Otherwise just what the caller still has to delete. */
+	if (deleted < limit)
+		stmt = db_prepare_v2(invoices->db, SQL(
+				  "SELECT COUNT(*) FROM invoices;"));
+	else {
+		if (state == PAID)
+			stmt = db_prepare_v2(invoices->db, SQL(
+					  "SELECT COUNT(*) FROM invoices"
+					  " WHERE state = ?"
+					  "   AND paid_timestamp <= ?;"));
+		else
+			stmt = db_prepare_v2(invoices->db, SQL(
+					  "SELECT COUNT(*) FROM invoices"
+					  " WHERE state = ?"
+					  "   AND expiry_time <= ?;"));
+		db_bind_int(stmt, 0, invoice_status_in_db(state));
+		db_bind_u64(stmt, 1, max_time);
+	}
+	db_query_prepared(stmt);
+	db_step(stmt);
+	*remaining = db_col_u64(stmt, "COUNT(*)");
+	tal_free(stmt);
+
+	return deleted;
 }
 
 bool invoices_iterate(struct invoices *invoices,
-		      struct invoice_iterator *it)
+		      struct invoice_iterator *it,
+		      const enum wait_index *listindex,
+		      u64 liststart,
+		      const u32 *listlimit)
 {
 	struct db_stmt *stmt;
 
 	if (!it->p) {
-		stmt = db_prepare_v2(invoices->db, SQL("SELECT"
-						       "  state"
-						       ", payment_key"
-						       ", payment_hash"
-						       ", label"
-						       ", msatoshi"
-						       ", expiry_time"
-						       ", pay_index"
-						       ", msatoshi_received"
-						       ", paid_timestamp"
-						       ", bolt11"
-						       ", description"
-						       ", features"
-						       ", local_offer_id"
-						       " FROM invoices"
-						       " ORDER BY id;"));
+		if (!listindex) {
+			stmt = db_prepare_v2(invoices->db, SQL("SELECT"
+							       "  state"
+							       ", payment_key"
+							       ", payment_hash"
+							       ", label"
+							       ", msatoshi"
+							       ", expiry_time"
+							       ", pay_index"
+							       ", msatoshi_received"
+							       ", paid_timestamp"
+							       ", bolt11"
+							       ", description"
+							       ", features"
+							       ", local_offer_id"
+							       ", id"
+							       ", updated_index"
+							       " FROM invoices"
+							       " ORDER BY id;"));
+		} else if (*listindex == WAIT_INDEX_CREATED) {
+			stmt = db_prepare_v2(invoices->db, SQL("SELECT"
+							       "  state"
+							       ", payment_key"
+							       ", payment_hash"
+							       ", label"
+							       ", msatoshi"
+							       ", expiry_time"
+							       ", pay_index"
+							       ", msatoshi_received"
+							       ", paid_timestamp"
+							       ", bolt11"
+							       ", description"
+							       ", features"
+							       ", local_offer_id"
+							       ", id"
+							       ", updated_index"
+							       " FROM invoices"
+							       " WHERE id >= ?"
+							       " ORDER BY id"
+							       " LIMIT ?;"));
+			db_bind_u64(stmt, 0, liststart);
+			db_bind_int(stmt, 1, listlimit ? *listlimit : INT_MAX);
+		} else {
+			assert(*listindex == WAIT_INDEX_UPDATED);
+			stmt = db_prepare_v2(invoices->db, SQL("SELECT"
+							       "  state"
+							       ", payment_key"
+							       ", payment_hash"
+							       ", label"
+							       ", msatoshi"
+							       ", expiry_time"
+							       ", pay_index"
+							       ", msatoshi_received"
+							       ", paid_timestamp"
+							       ", bolt11"
+							       ", description"
+							       ", features"
+							       ", local_offer_id"
+							       ", id"
+							       ", updated_index"
+							       " FROM invoices"
+							       " WHERE updated_index >= ?"
+							       " ORDER BY updated_index"
+							       " LIMIT ?;"));
+			db_bind_u64(stmt, 0, liststart);
+			db_bind_int(stmt, 1, listlimit ? *listlimit : INT_MAX);
+		}
 		db_query_prepared(stmt);
 		it->p = stmt;
 	} else
@@ -508,20 +745,26 @@ static s64 get_next_pay_index(struct db *db)
 	return next_pay_index;
 }
 
-static enum invoice_status invoice_get_status(struct invoices *invoices, struct invoice invoice)
+static enum invoice_status invoice_get_status(struct invoices *invoices,
+					      struct invoice invoice,
+					      const struct json_escape **label)
 {
 	struct db_stmt *stmt;
 	enum invoice_status state;
 	bool res;
 
 	stmt = db_prepare_v2(
-	    invoices->db, SQL("SELECT state FROM invoices WHERE id = ?;"));
+	    invoices->db, SQL("SELECT state, label FROM invoices WHERE id = ?;"));
 	db_bind_u64(stmt, 0, invoice.id);
 	db_query_prepared(stmt);
 
 	res = db_step(stmt);
 	assert(res);
 	state = db_col_int(stmt, "state");
+	if (label)
+		*label = db_col_json_escape(tmpctx, stmt, "label");
+	else
+		db_col_ignore(stmt, "label");
 	tal_free(stmt);
 	return state;
 }
@@ -555,10 +798,13 @@ bool invoices_resolve(struct invoices *invoices,
 	struct db_stmt *stmt;
 	s64 pay_index;
 	u64 paid_timestamp;
-	enum invoice_status state = invoice_get_status(invoices, invoice);
+	const struct json_escape *label;
+	enum invoice_status state = invoice_get_status(invoices, invoice,
+						       &label);
 
 	if (state != UNPAID)
 		return false;
+	state = PAID;
 
 	/* Assign a pay-index. */
 	pay_index = get_next_pay_index(invoices->db);
@@ -570,12 +816,16 @@ bool invoices_resolve(struct invoices *invoices,
 					       "     , pay_index=?"
 					       "     , msatoshi_received=?"
 					       "     , paid_timestamp=?"
+					       "     , updated_index=?"
 					       " WHERE id=?;"));
-	db_bind_int(stmt, 0, PAID);
+	db_bind_int(stmt, 0, state);
 	db_bind_u64(stmt, 1, pay_index);
 	db_bind_amount_msat(stmt, 2, &received);
 	db_bind_u64(stmt, 3, paid_timestamp);
-	db_bind_u64(stmt, 4, invoice.id);
+	db_bind_u64(stmt, 4,
+		    invoice_index_inc(invoices, WAIT_INDEX_UPDATED,
+				      &state, label, NULL, NULL));
+	db_bind_u64(stmt, 5, invoice.id);
 	db_exec_prepared_v2(take(stmt));
 
 	maybe_mark_offer_used(invoices->db, invoice);
@@ -653,7 +903,7 @@ void invoices_waitone(const tal_t *ctx,
 {
 	enum invoice_status state;
 
-	state = invoice_get_status(invoices, invoice);
+	state = invoice_get_status(invoices, invoice, NULL);
 
 	if (state == PAID || state == EXPIRED) {
 		cb(&invoice, cbarg);
@@ -687,6 +937,8 @@ struct invoice_details *invoices_get_details(const tal_t *ctx,
 					       ", description"
 					       ", features"
 					       ", local_offer_id"
+					       ", id"
+					       ", updated_index"
 					       " FROM invoices"
 					       " WHERE id = ?;"));
 	db_bind_u64(stmt, 0, invoice.id);
@@ -3,6 +3,7 @@
 #include "config.h"
 #include <bitcoin/preimage.h>
 #include <ccan/tal/tal.h>
+#include <lightningd/wait.h>
 
 struct amount_msat;
 struct db;
@@ -13,16 +14,17 @@ struct invoice_iterator;
 struct invoices;
 struct sha256;
 struct timers;
+struct wallet;
 
 /**
  * invoices_new - Constructor for a new invoice handler
  *
  * @ctx - the owner of the invoice handler.
- * @db - the database connection to use for saving invoice.
+ * @wallet - the wallet (whose db we use for saving invoices).
  * @timers - the timers object to use for expirations.
  */
 struct invoices *invoices_new(const tal_t *ctx,
-			      struct db *db,
+			      struct wallet *wallet,
 			      struct timers *timers);
 
 /**
@@ -129,23 +131,48 @@ bool invoices_delete_description(struct invoices *invoices,
 void invoices_delete_expired(struct invoices *invoices,
 			     u64 max_expiry_time);
 
+/**
+ * invoices_delete_older - Delete up to @limit paid or expired invoices
+ * which were paid (or expired) at or before @max_time.
+ *
+ * @invoices - the invoice handler.
+ * @state - PAID or EXPIRED.
+ * @max_time - the latest paid_at (or expires_at) to delete.
+ * @limit - the maximum number of invoices to delete.
+ * @remaining - set to the number of invoices left afterwards (if @limit
+ *   were deleted, only those matching @state and @max_time).
+ *
+ * Returns the number of invoices deleted.
+ */
+u64 invoices_delete_older(struct invoices *invoices,
+			  enum invoice_status state,
+			  u64 max_time,
+			  u32 limit,
+			  u64 *remaining);
+
 /**
  * invoices_iterate - Iterate over all existing invoices
  *
  * @invoices - the invoice handler.
  * @iterator - the iterator object to use.
+ * @listindex - what index to order by (or NULL for all, by created_index)
+ * @liststart - first index to return (if @listindex)
+ * @listlimit - limit on number of entries to return (if @listindex, or NULL)
  *
  * Return false at end-of-sequence, true if still iterating.
  * Usage:
  *
  *   struct invoice_iterator it;
  *   memset(&it, 0, sizeof(it))
- *   while (invoices_iterate(wallet, &it)) {
+ *   while (invoices_iterate(wallet, &it, NULL, 0, NULL)) {
  *       ...
  *   }
  */
 bool invoices_iterate(struct invoices *invoices,
-		      struct invoice_iterator *it);
+		      struct invoice_iterator *it,
+		      const enum wait_index *listindex,
+		      u64 liststart,
+		      const u32 *listlimit);
 
 /**
  * wallet_invoice_iterator_deref - Read the details of the
@@ -491,6 +491,39 @@ static struct command_result *json_fundpsbt(struct command *cmd,
 	utxos = tal_arr(cmd, struct utxo *, 0);
 
 	input = AMOUNT_SAT(0);
+
+	/* Best of all is a set of inputs which doesn't need change. */
+	if (!all) {
+		struct amount_sat target, cost_of_change;
+		struct utxo **changeless;
+
+		/* Below this much excess, we wouldn't make change anyway. */
+		cost_of_change = amount_tx_fee(*feerate_per_kw,
+					       bitcoin_tx_output_weight(BITCOIN_SCRIPTPUBKEY_P2WPKH_LEN));
+		if (amount_sat_add(&target, *amount,
+				   amount_tx_fee(*feerate_per_kw, *weight))
+		    && amount_sat_add(&cost_of_change, cost_of_change,
+				      chainparams->dust_limit))
+			changeless = wallet_find_utxos_changeless(cmd,
+								  cmd->ld->wallet,
+								  cmd->ld->topology->tip->height,
+								  target,
+								  cost_of_change,
+								  *feerate_per_kw,
+								  *min_witness_weight,
+								  maxheight);
+		else
+			changeless = NULL;
+
+		for (size_t i = 0; i < tal_count(changeless); i++) {
+			if (!amount_sat_add(&input, input, changeless[i]->amount))
+				return command_fail(cmd, LIGHTNINGD,
+						    "impossible UTXO value");
+			*weight += utxo_spend_weight(changeless[i],
+						     *min_witness_weight);
+			tal_arr_expand(&utxos, tal_steal(utxos, changeless[i]));
+		}
+	}
 	while (!inputs_sufficient(input, *amount, *feerate_per_kw, *weight,
 				  &diff)) {
 		struct utxo *utxo;
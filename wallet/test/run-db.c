@@ -70,6 +70,9 @@ void db_fatal(const char *fmt, ...)
 void plugin_hook_db_sync(struct db *db UNNEEDED)
 {
 }
+void plugin_hook_db_record(struct db_stmt *stmt UNNEEDED)
+{
+}
 
 static struct db *create_test_db(void)
 {
@@ -258,6 +261,163 @@ static bool test_manip_columns(void)
 	return true;
 }
 
+static struct db_stmt *prepare_select_var(struct db *db, const char *name)
+{
+	struct db_stmt *stmt;
+
+	/* One call site, so every call uses the same query_table slot. */
+	stmt = db_prepare_v2(db, SQL("SELECT intval FROM vars WHERE name = ?;"));
+	db_bind_text(stmt, 0, name);
+	db_query_prepared(stmt);
+	return stmt;
+}
+
+static bool test_stmt_cache(struct lightningd *ld)
+{
+	struct db *db = create_test_db();
+	struct db_stmt *stmt, *stmt2;
+	CHECK(db);
+
+	db_begin_transaction(db);
+	db_migrate(ld, db, NULL);
+	db_set_intvar(db, "a", 1);
+	db_set_intvar(db, "b", 2);
+
+	/* Reused statement must not remember old bindings or rows. */
+	for (size_t i = 0; i < 3; i++) {
+		stmt = prepare_select_var(db, i % 2 ? "b" : "a");
+		CHECK(stmt->query_slot >= 0);
+		CHECK(db_step(stmt));
+		CHECK(db_col_int(stmt, "intval") == (i % 2 ? 2 : 1));
+		tal_free(stmt);
+	}
+
+	/* Two live statements from the same slot can't share. */
+	stmt = prepare_select_var(db, "a");
+	stmt2 = prepare_select_var(db, "b");
+	CHECK(db_step(stmt));
+	CHECK(db_step(stmt2));
+	CHECK(db_col_int(stmt, "intval") == 1);
+	CHECK(db_col_int(stmt2, "intval") == 2);
+	tal_free(stmt);
+	tal_free(stmt2);
+	db_commit_transaction(db);
+
+	tal_free(db);
+	return true;
+}
+
+static bool test_group_commit(struct lightningd *ld)
+{
+	struct db *db = create_test_db();
+	struct timemono since;
+	u32 data_version;
+	CHECK(db);
+
+	db_begin_transaction(db);
+	db_migrate(ld, db, NULL);
+	db_commit_transaction(db);
+	data_version = db->data_version;
+
+	db_set_group_commit(db, true);
+	CHECK(!db_group_commit_pending(db, NULL));
+	db_begin_transaction(db);
+	db_set_intvar(db, "a", 1);
+	db_commit_transaction(db);
+	CHECK(!db->in_transaction);
+	CHECK(db_group_commit_pending(db, &since));
+
+	/* Second one carries on in the same transaction. */
+	db_begin_transaction(db);
+	CHECK(db_get_intvar(db, "a", 0) == 1);
+	db_set_intvar(db, "a", 2);
+	db_commit_transaction(db);
+	CHECK(db->data_version == data_version);
+
+	/* One real commit for both. */
+	db_group_commit_flush(db);
+	CHECK(!db_group_commit_pending(db, NULL));
+	CHECK(db->data_version == data_version + 1);
+
+	/* Disabling flushes too. */
+	db_begin_transaction(db);
+	db_set_intvar(db, "a", 3);
+	db_commit_transaction(db);
+	db_set_group_commit(db, false);
+	CHECK(!db_group_commit_pending(db, NULL));
+	CHECK(db->data_version == data_version + 2);
+
+	tal_free(db);
+	return true;
+}
+
+static bool test_async_replica(struct lightningd *ld)
+{
+	struct db *db;
+	struct db_stmt *stmt;
+	char *dsn, *filename, *backup;
+	size_t lag;
+	u64 stalls;
+	int fd;
+
+	fd = tmpdir_mkstemp(tmpctx, "ldb-XXXXXX", &filename);
+	CHECK(fd != -1);
+	close(fd);
+	fd = tmpdir_mkstemp(tmpctx, "ldb-backup-XXXXXX", &backup);
+	CHECK(fd != -1);
+	close(fd);
+
+	dsn = tal_fmt(tmpctx, "sqlite3://%s:%s", filename, backup);
+	db = db_open(NULL, dsn);
+	db->data_version = 0;
+	db->report_changes_fn = NULL;
+	db->replica_max_lag = 1;
+
+	db_begin_transaction(db);
+	db_migrate(ld, db, NULL);
+	db_commit_transaction(db);
+
+	/* Lag can never exceed the bound. */
+	for (int i = 0; i < 10; i++) {
+		db_begin_transaction(db);
+		db_set_intvar(db, "a", i);
+		db_commit_transaction(db);
+		CHECK(db_replica_lag(db, &lag, &stalls));
+		CHECK(lag <= 1);
+	}
+
+	/* Table manipulation does PRAGMAs outside a transaction: those
+	 * must also go via the writer, in order. */
+	db_begin_transaction(db);
+	stmt = db_prepare_v2(db, SQL("CREATE TABLE tablec ("
+				     "  id BIGSERIAL"
+				     ", field1 INTEGER"
+				     ", PRIMARY KEY (id))"));
+	CHECK(db_exec_prepared_v2(take(stmt)));
+	stmt = db_prepare_v2(db, SQL("INSERT INTO tablec (id, field1) VALUES (0, 1);"));
+	CHECK(db_exec_prepared_v2(take(stmt)));
+	CHECK(db->config->rename_column(db, "tablec", "field1", "field1c"));
+	db_commit_transaction(db);
+
+	/* Closing waits for the writer to catch up. */
+	tal_free(db);
+
+	db = db_open(NULL, tal_fmt(tmpctx, "sqlite3://%s", backup));
+	db->report_changes_fn = NULL;
+	db_begin_transaction(db);
+	CHECK(db_get_intvar(db, "a", -1) == 9);
+	stmt = db_prepare_v2(db, SQL("SELECT id, field1c FROM tablec;"));
+	CHECK(db_query_prepared(stmt));
+	CHECK(db_step(stmt));
+	CHECK(db_col_u64(stmt, "field1c") == 1);
+	db_col_ignore(stmt, "id");
+	CHECK(!db_step(stmt));
+	tal_free(stmt);
+	db_commit_transaction(db);
+	tal_free(db);
+	return true;
+}
+
 int main(int argc, char *argv[])
 {
 	bool ok = true;
@@ -273,6 +433,9 @@ int main(int argc, char *argv[])
 		ok &= test_vars(ld);
 		ok &= test_primitives();
 		ok &= test_manip_columns();
+		ok &= test_stmt_cache(ld);
+		ok &= test_group_commit(ld);
+		ok &= test_async_replica(ld);
 	}
 
 	tal_free(ld);
@@ -0,0 +1,136 @@
+#include "config.h"
+#include "../utxo_pool.c"
+#include <assert.h>
+#include <ccan/array_size/array_size.h>
+#include <common/setup.h>
+#include <stdio.h>
+
+/* AUTOGENERATED MOCKS START */
+/* AUTOGENERATED MOCKS END */
+
+static struct utxo *new_utxo(const tal_t *ctx, u8 txid, u32 n, u64 sats)
+{
+	struct utxo *u = tal(ctx, struct utxo);
+
+	memset(u, 0, sizeof(*u));
+	memset(&u->outpoint.txid, txid, sizeof(u->outpoint.txid));
+	u->outpoint.n = n;
+	u->amount = amount_sat(sats);
+	u->status = OUTPUT_STATE_AVAILABLE;
+	u->scriptPubkey = tal_arrz(u, u8, 22);
+	return u;
+}
+
+static struct amount_sat *effvals(const tal_t *ctx, const u64 *sats, size_t n)
+{
+	struct amount_sat *vals = tal_arr(ctx, struct amount_sat, n);
+
+	for (size_t i = 0; i < n; i++)
+		vals[i] = amount_sat(sats[i]);
+	return vals;
+}
+
+static u64 chosen_total(const u64 *sats, const bool *chosen, size_t n)
+{
+	u64 total = 0;
+
+	for (size_t i = 0; i < n; i++)
+		if (chosen[i])
+			total += sats[i];
+	return total;
+}
+
+static void test_pool(void)
+{
+	struct utxo_pool *pool = utxo_pool_new(tmpctx);
+	struct utxo *a, *b, *c, **sorted;
+	struct bitcoin_txid txid;
+	u32 height = 100;
+
+	a = new_utxo(tmpctx, 1, 0, 1000);
+	b = new_utxo(tmpctx, 1, 1, 5000);
+	c = new_utxo(tmpctx, 2, 0, 3000);
+	c->blockheight = &height;
+
+	utxo_pool_set(pool, a);
+	utxo_pool_set(pool, b);
+	utxo_pool_set(pool, c);
+
+	/* It keeps its own copies. */
+	assert(utxo_pool_get(pool, &a->outpoint) != a);
+	assert(amount_sat_eq(utxo_pool_get(pool, &b->outpoint)->amount,
+			     b->amount));
+	assert(*utxo_pool_get(pool, &c->outpoint)->blockheight == 100);
+
+	sorted = utxo_pool_by_value(pool);
+	assert(tal_count(sorted) == 3);
+	assert(amount_sat_eq(sorted[0]->amount, AMOUNT_SAT(5000)));
+	assert(amount_sat_eq(sorted[1]->amount, AMOUNT_SAT(3000)));
+	assert(amount_sat_eq(sorted[2]->amount, AMOUNT_SAT(1000)));
+
+	/* Both outputs of txid 1 confirm together. */
+	memset(&txid, 1, sizeof(txid));
+	utxo_pool_confirm_tx(pool, &txid, 102);
+	assert(*utxo_pool_get(pool, &a->outpoint)->blockheight == 102);
+	assert(*utxo_pool_get(pool, &b->outpoint)->blockheight == 102);
+	assert(*utxo_pool_get(pool, &c->outpoint)->blockheight == 100);
+
+	/* Reorg removes block 102 (and above) */
+	utxo_pool_unconfirm_above(pool, 101);
+	assert(!utxo_pool_get(pool, &a->outpoint)->blockheight);
+	assert(!utxo_pool_get(pool, &b->outpoint)->blockheight);
+	assert(*utxo_pool_get(pool, &c->outpoint)->blockheight == 100);
+
+	/* Spending removes it. */
+	b->status = OUTPUT_STATE_SPENT;
+	utxo_pool_set(pool, b);
+	assert(!utxo_pool_get(pool, &b->outpoint));
+	assert(tal_count(utxo_pool_by_value(pool)) == 2);
+
+	utxo_pool_del(pool, &a->outpoint);
+	assert(!utxo_pool_get(pool, &a->outpoint));
+	assert(tal_count(utxo_pool_by_value(pool)) == 1);
+}
+
+static void test_bnb(void)
+{
+	const u64 sats[] = { 1000, 2000, 3000, 4000, 5000 };
+	size_t n = ARRAY_SIZE(sats);
+	struct amount_sat *vals = effvals(tmpctx, sats, n);
+	bool chosen[ARRAY_SIZE(sats)];
+
+	/* Exact matches. */
+	assert(select_coins_bnb(vals, AMOUNT_SAT(10000), AMOUNT_SAT(0), chosen));
+	assert(chosen_total(sats, chosen, n) == 10000);
+	assert(select_coins_bnb(vals, AMOUNT_SAT(1000), AMOUNT_SAT(0), chosen));
+	assert(chosen_total(sats, chosen, n) == 1000);
+	assert(select_coins_bnb(vals, AMOUNT_SAT(15000), AMOUNT_SAT(0), chosen));
+	assert(chosen_total(sats, chosen, n) == 15000);
+
+	/* Not possible without going over. */
+	assert(!select_coins_bnb(vals, AMOUNT_SAT(10500), AMOUNT_SAT(0),
+				 chosen));
+	/* But fine if we'd rather not make change for 500. */
+	assert(select_coins_bnb(vals, AMOUNT_SAT(10500), AMOUNT_SAT(500),
+				chosen));
+	assert(chosen_total(sats, chosen, n) == 11000);
+
+	/* Not enough at all. */
+	assert(!select_coins_bnb(vals, AMOUNT_SAT(15001), AMOUNT_SAT(100),
+				 chosen));
+
+	/* Nothing to choose from. */
+	assert(!select_coins_bnb(tal_arr(tmpctx, struct amount_sat, 0),
+				 AMOUNT_SAT(1), AMOUNT_SAT(100), chosen));
+}
+
+int main(int argc, char *argv[])
+{
+	common_setup(argv[0]);
+
+	test_pool();
+	test_bnb();
+
+	common_shutdown();
+	return 0;
+}
@@ -40,6 +40,7 @@ void db_fatal(const char *fmt, ...)
 #include "db/exec.c"
 #include "db/utils.c"
 #include "wallet/db.c"
+#include "wallet/utxo_pool.c"
 
 #include <common/setup.h>
 #include <common/utils.h>
@@ -102,6 +103,15 @@ struct command_result *command_param_failed(void)
 struct command_result *command_still_pending(struct command *cmd)
 
 { fprintf(stderr, "command_still_pending called!\n"); abort(); }
+/* Generated stub for command_stream_success_ */
+struct command_result *command_stream_success_(struct command *cmd UNNEEDED,
+					       struct json_stream *response UNNEEDED,
+					       struct command_result *(*more)(struct command *cmd UNNEEDED,
+									      struct json_stream *response UNNEEDED,
+									      void *arg) UNNEEDED,
+					       void *arg UNNEEDED)
+
+{ fprintf(stderr, "command_stream_success_ called!\n"); abort(); }
 /* Generated stub for command_success */
 struct command_result *command_success(struct command *cmd UNNEEDED,
 				       struct json_stream *response)
@@ -230,6 +240,13 @@ bool invoices_delete_description(struct invoices *invoices UNNEEDED,
 void invoices_delete_expired(struct invoices *invoices UNNEEDED,
 			     u64 max_expiry_time UNNEEDED)
 { fprintf(stderr, "invoices_delete_expired called!\n"); abort(); }
+/* Generated stub for invoices_delete_older */
+u64 invoices_delete_older(struct invoices *invoices UNNEEDED,
+			  enum invoice_status state UNNEEDED,
+			  u64 max_time UNNEEDED,
+			  u32 limit UNNEEDED,
+			  u64 *remaining UNNEEDED)
+{ fprintf(stderr, "invoices_delete_older called!\n"); abort(); }
 /* Generated stub for invoices_find_by_label */
 bool invoices_find_by_label(struct invoices *invoices UNNEEDED,
 			    struct invoice *pinvoice UNNEEDED,
@@ -252,7 +269,10 @@ struct invoice_details *invoices_get_details(const tal_t *ctx UNNEEDED,
 { fprintf(stderr, "invoices_get_details called!\n"); abort(); }
 /* Generated stub for invoices_iterate */
 bool invoices_iterate(struct invoices *invoices UNNEEDED,
-		      struct invoice_iterator *it UNNEEDED)
+		      struct invoice_iterator *it UNNEEDED,
+		      const enum wait_index *listindex UNNEEDED,
+		      u64 liststart UNNEEDED,
+		      const u32 *listlimit UNNEEDED)
 { fprintf(stderr, "invoices_iterate called!\n"); abort(); }
 /* Generated stub for invoices_iterator_deref */
 const struct invoice_details *invoices_iterator_deref(
@@ -261,7 +281,7 @@ const struct invoice_details *invoices_iterator_deref(
 { fprintf(stderr, "invoices_iterator_deref called!\n"); abort(); }
 /* Generated stub for invoices_new */
 struct invoices *invoices_new(const tal_t *ctx UNNEEDED,
-			      struct db *db UNNEEDED,
+			      struct wallet *wallet UNNEEDED,
 			      struct timers *timers UNNEEDED)
 { fprintf(stderr, "invoices_new called!\n"); abort(); }
 /* Generated stub for invoices_resolve */
@@ -403,11 +423,13 @@ void json_add_u64(struct json_stream *result UNNEEDED, const char *fieldname UNN
 { fprintf(stderr, "json_add_u64 called!\n"); abort(); }
 /* Generated stub for json_add_uncommitted_channel */
 void json_add_uncommitted_channel(struct json_stream *response UNNEEDED,
-				  const struct uncommitted_channel *uc UNNEEDED)
+				  const struct uncommitted_channel *uc UNNEEDED,
+				  const struct peer *peer UNNEEDED)
 { fprintf(stderr, "json_add_uncommitted_channel called!\n"); abort(); }
 /* Generated stub for json_add_unsaved_channel */
 void json_add_unsaved_channel(struct json_stream *response UNNEEDED,
-			      const struct channel *channel UNNEEDED)
+			      const struct channel *channel UNNEEDED,
+			      const struct peer *peer UNNEEDED)
 { fprintf(stderr, "json_add_unsaved_channel called!\n"); abort(); }
 /* Generated stub for json_array_end */
 void json_array_end(struct json_stream *js UNNEEDED)
@@ -470,6 +492,18 @@ bool json_tok_streq(const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
 void kill_uncommitted_channel(struct uncommitted_channel *uc UNNEEDED,
 			      const char *why UNNEEDED)
 { fprintf(stderr, "kill_uncommitted_channel called!\n"); abort(); }
+/* Generated stub for load_indexes */
+void load_indexes(struct db *db UNNEEDED, struct indexes *indexes UNNEEDED)
+{ fprintf(stderr, "load_indexes called!\n"); abort(); }
+/* Generated stub for metrics_htlc_in_state */
+void metrics_htlc_in_state(struct metrics *metrics UNNEEDED,
+			   const struct htlc_in *hin UNNEEDED,
+			   enum htlc_state newstate UNNEEDED)
+{ fprintf(stderr, "metrics_htlc_in_state called!\n"); abort(); }
+/* Generated stub for metrics_htlc_out_state */
+void metrics_htlc_out_state(struct metrics *metrics UNNEEDED,
+			    enum htlc_state newstate UNNEEDED)
+{ fprintf(stderr, "metrics_htlc_out_state called!\n"); abort(); }
 /* Generated stub for new_channel_mvt_invoice_hin */
 struct channel_coin_mvt *new_channel_mvt_invoice_hin(const tal_t *ctx UNNEEDED,
 						     struct htlc_in *hin UNNEEDED,
@@ -596,6 +630,13 @@ struct command_result *param_channel_id(struct command *cmd UNNEEDED,
 					const jsmntok_t *tok UNNEEDED,
 					struct channel_id **cid UNNEEDED)
 { fprintf(stderr, "param_channel_id called!\n"); abort(); }
+/* Generated stub for param_index */
+struct command_result *param_index(struct command *cmd UNNEEDED,
+				   const char *name UNNEEDED,
+				   const char *buffer UNNEEDED,
+				   const jsmntok_t *tok UNNEEDED,
+				   enum wait_index **index UNNEEDED)
+{ fprintf(stderr, "param_index called!\n"); abort(); }
 /* Generated stub for param_loglevel */
 struct command_result *param_loglevel(struct command *cmd UNNEEDED,
 				      const char *name UNNEEDED,
@@ -627,6 +668,11 @@ struct command_result *param_short_channel_id(struct command *cmd UNNEEDED,
 					      const jsmntok_t *tok UNNEEDED,
 					      struct short_channel_id **scid UNNEEDED)
 { fprintf(stderr, "param_short_channel_id called!\n"); abort(); }
+/* Generated stub for param_u32 */
+struct command_result *param_u32(struct command *cmd UNNEEDED, const char *name UNNEEDED,
+				 const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
+				 uint32_t **num UNNEEDED)
+{ fprintf(stderr, "param_u32 called!\n"); abort(); }
 /* Generated stub for param_u64 */
 struct command_result *param_u64(struct command *cmd UNNEEDED, const char *name UNNEEDED,
 				 const char *buffer UNNEEDED, const jsmntok_t *tok UNNEEDED,
@@ -863,6 +909,12 @@ void try_reconnect(const tal_t *ctx UNNEEDED,
 		   struct peer *peer UNNEEDED,
 		   const struct wireaddr_internal *addrhint UNNEEDED)
 { fprintf(stderr, "try_reconnect called!\n"); abort(); }
+/* Generated stub for txowatch_set_script */
+void txowatch_set_script(struct txowatch *w UNNEEDED, const u8 *script TAKES UNNEEDED)
+{ fprintf(stderr, "txowatch_set_script called!\n"); abort(); }
+/* Generated stub for txwatch_set_script */
+void txwatch_set_script(struct txwatch *w UNNEEDED, const u8 *script TAKES UNNEEDED)
+{ fprintf(stderr, "txwatch_set_script called!\n"); abort(); }
 /* Generated stub for watch_txid */
 struct txwatch *watch_txid(const tal_t *ctx UNNEEDED,
 			   struct chain_topology *topo UNNEEDED,
@@ -912,6 +964,25 @@ u8 *wire_sync_read(const tal_t *ctx UNNEEDED, int fd UNNEEDED)
 void plugin_hook_db_sync(struct db *db UNNEEDED)
 {
 }
+void plugin_hook_db_record(struct db_stmt *stmt UNNEEDED)
+{
+}
+u64 wait_index_increment(struct lightningd *ld UNNEEDED,
+			 enum wait_subsystem subsystem UNNEEDED,
+			 enum wait_index index UNNEEDED,
+			 ...)
+{
+	static u64 n;
+	return ++n;
+}
+u64 wait_index_increase(struct lightningd *ld UNNEEDED,
+			enum wait_subsystem subsystem UNNEEDED,
+			enum wait_index index UNNEEDED,
+			u64 num UNNEEDED,
+			...)
+{
+	return 0;
+}
 bool fromwire_hsmd_get_channel_basepoints_reply(const void *p UNNEEDED,
 					       struct basepoints *basepoints,
 					       struct pubkey *funding_pubkey)
@@ -987,6 +1058,8 @@ static struct wallet *create_test_wallet(struct lightningd *ld, const tal_t *ctx
 	tal_add_destructor2(w, cleanup_test_wallet, filename);
 
 	list_head_init(&w->unstored_payments);
+	w->utxo_pool = utxo_pool_new(w);
+	w->utxoset_last_prune = 0;
 	w->ld = ld;
 	ld->wallet = w;
 
@@ -1931,6 +2004,9 @@ int main(int argc, const char *argv[])
 	/* Only elements in ld we should access */
 	list_head_init(&ld->peers);
 	ld->rr_counter = 0;
+#if DEVELOPER
+	ld->dev_no_utxoset_batch = false;
+#endif
 	node_id_from_hexstr("02a1633cafcc01ebfb6d78e39f687a1f0995c62fc95f51ead10a02ee0be551b5dc", 66, &ld->id);
 	/* Accessed in peer destructor sanity check */
 	htlc_in_map_init(&ld->htlcs_in);
@@ -2,19 +2,27 @@
 #include <bitcoin/script.h>
 #include <ccan/crypto/siphash24/siphash24.h>
 #include <ccan/mem/mem.h>
+#include <common/bloomfilter.h>
 #include <common/memleak.h>
 #include <common/pseudorand.h>
+#include <common/utils.h>
 #include <wallet/txfilter.h>
 #include <wallet/wallet.h>
 
-static size_t scriptpubkey_hash(const u8 *out)
+/* The prefilter wants all 64 bits, even where size_t is 32 bits. */
+static u64 script_hash64(const u8 *script, size_t len)
 {
 	struct siphash24_ctx ctx;
 	siphash24_init(&ctx, siphash_seed());
-	siphash24_update(&ctx, out, tal_bytelen(out));
+	siphash24_update(&ctx, script, len);
 	return siphash24_done(&ctx);
 }
 
+static size_t scriptpubkey_hash(const u8 *out)
+{
+	return script_hash64(out, tal_bytelen(out));
+}
+
 static const u8 *scriptpubkey_keyof(const u8 *out)
 {
 	return out;
@@ -29,6 +37,10 @@ HTABLE_DEFINE_TYPE(u8, scriptpubkey_keyof, scriptpubkey_hash, scriptpubkey_eq, s
 
 struct txfilter {
 	struct scriptpubkeyset scriptpubkeyset;
+	/* Almost every output we see isn't ours: this rules them out
+	 * without touching the (large) scriptpubkeyset. */
+	struct bloomfilter *prefilter;
+	struct bloomfilter_stats stats;
 };
 
 static size_t outpoint_hash(const struct bitcoin_outpoint *out)
@@ -61,15 +73,54 @@ struct txfilter *txfilter_new(const tal_t *ctx)
 {
 	struct txfilter *filter = tal(ctx, struct txfilter);
 	scriptpubkeyset_init(&filter->scriptpubkeyset);
+	filter->prefilter = bloomfilter_new(filter,
+					    bloomfilter_rebuild_capacity(0));
+	memset(&filter->stats, 0, sizeof(filter->stats));
 	tal_add_destructor(filter, destroy_txfilter);
 	return filter;
 }
 
+/* Filter is full: make a new one, with room to grow. */
+static void txfilter_rebuild_prefilter(struct txfilter *filter)
+{
+	struct scriptpubkeyset_iter it;
+	const u8 *script;
+	size_t count = scriptpubkeyset_count(&filter->scriptpubkeyset);
+
+	tal_free(filter->prefilter);
+	filter->prefilter = bloomfilter_new(filter,
+					    bloomfilter_rebuild_capacity(count));
+	for (script = scriptpubkeyset_first(&filter->scriptpubkeyset, &it);
+	     script;
+	     script = scriptpubkeyset_next(&filter->scriptpubkeyset, &it))
+		bloomfilter_add(filter->prefilter,
+			       script_hash64(script, tal_bytelen(script)));
+}
+
 void txfilter_add_scriptpubkey(struct txfilter *filter, const u8 *script TAKES)
 {
-	scriptpubkeyset_add(
-	    &filter->scriptpubkeyset,
-	    notleak(tal_dup_talarr(filter, u8, script)));
+	const u8 *s = notleak(tal_dup_talarr(filter, u8, script));
+
+	scriptpubkeyset_add(&filter->scriptpubkeyset, s);
+	if (bloomfilter_full(filter->prefilter))
+		txfilter_rebuild_prefilter(filter);
+	else
+		bloomfilter_add(filter->prefilter,
+			       script_hash64(s, tal_bytelen(s)));
+}
+
+const u8 **txfilter_scriptpubkeys(const tal_t *ctx,
+				 const struct txfilter *filter)
+{
+	struct scriptpubkeyset_iter it;
+	const u8 *script;
+	const u8 **scripts = tal_arr(ctx, const u8 *, 0);
+
+	for (script = scriptpubkeyset_first(&filter->scriptpubkeyset, &it);
+	     script;
+	     script = scriptpubkeyset_next(&filter->scriptpubkeyset, &it))
+		tal_arr_expand(&scripts, script);
+	return scripts;
 }
 
 void txfilter_add_derkey(struct txfilter *filter,
@@ -85,20 +136,42 @@ void txfilter_add_derkey(struct txfilter *filter,
 }
 
 
-bool txfilter_match(const struct txfilter *filter, const struct bitcoin_tx *tx)
+bool txfilter_match_script(struct txfilter *filter,
+			   const u8 *script, size_t script_len)
 {
-	for (size_t i = 0; i < tx->wtx->num_outputs; i++) {
-		const u8 *oscript = bitcoin_tx_output_get_script(tmpctx, tx, i);
+	const u8 *oscript;
+
+	if (!script)
+		return false;
+
+	/* Only copy the script if it might be one of ours */
+	if (!bloomfilter_check(filter->prefilter, &filter->stats,
+			       script_hash64(script, script_len)))
+		return false;
+
+	oscript = tal_dup_arr(tmpctx, u8, script, script_len, 0);
+	if (!scriptpubkeyset_get(&filter->scriptpubkeyset, oscript))
+		return false;
+	filter->stats.matched++;
+	return true;
+}
 
-		if (!oscript)
-			continue;
+bool txfilter_match(struct txfilter *filter, const struct bitcoin_tx *tx)
+{
+	for (size_t i = 0; i < tx->wtx->num_outputs; i++) {
+		const struct wally_tx_output *out = &tx->wtx->outputs[i];
 
-		if (scriptpubkeyset_get(&filter->scriptpubkeyset, oscript))
+		if (txfilter_match_script(filter, out->script, out->script_len))
 			return true;
 	}
 	return false;
 }
 
+const struct bloomfilter_stats *txfilter_stats(const struct txfilter *filter)
+{
+	return &filter->stats;
+}
+
 void outpointfilter_add(struct outpointfilter *of,
 			const struct bitcoin_outpoint *outpoint)
 {
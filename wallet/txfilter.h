@@ -4,6 +4,7 @@
 #include <bitcoin/pubkey.h>
 #include <bitcoin/tx.h>
 
+struct bloomfilter_stats;
 struct txfilter;
 
 /**
@@ -30,13 +31,33 @@ void txfilter_add_derkey(struct txfilter *filter,
 /**
  * txfilter_match -- Check whether the tx matches the filter
  */
-bool txfilter_match(const struct txfilter *filter, const struct bitcoin_tx *tx);
+bool txfilter_match(struct txfilter *filter, const struct bitcoin_tx *tx);
+
+/**
+ * txfilter_match_script -- Check whether one output script matches the
+ * filter (@script need not be a tal object).
+ */
+bool txfilter_match_script(struct txfilter *filter,
+			   const u8 *script, size_t script_len);
+
+/**
+ * txfilter_stats -- How many outputs txfilter_match has ruled out cheaply
+ */
+const struct bloomfilter_stats *txfilter_stats(const struct txfilter *filter);
 
 /**
  * txfilter_add_scriptpubkey -- Add a serialized scriptpubkey to the filter
  */
 void txfilter_add_scriptpubkey(struct txfilter *filter, const u8 *script TAKES);
 
+/**
+ * txfilter_scriptpubkeys -- All the scriptpubkeys in the filter
+ *
+ * The entries belong to the filter, not the returned array.
+ */
+const u8 **txfilter_scriptpubkeys(const tal_t *ctx,
+				 const struct txfilter *filter);
+
 /**
  * outpointfilter_new -- Create a new outpointfilter
  */
@@ -0,0 +1,259 @@
+#include "config.h"
+#include <ccan/asort/asort.h>
+#include <ccan/cast/cast.h>
+#include <ccan/crypto/siphash24/siphash24.h>
+#include <ccan/htable/htable_type.h>
+#include <common/memleak.h>
+#include <common/pseudorand.h>
+#include <common/utils.h>
+#include <wallet/utxo_pool.h>
+
+/* Give up on branch-and-bound after this many steps (as Bitcoin Core does) */
+#define BNB_MAX_TRIES 100000
+
+/* Keyed by txid, so we can find all a tx's outputs when it confirms. */
+static const struct bitcoin_txid *utxo_txid_keyof(const struct utxo *utxo)
+{
+	return &utxo->outpoint.txid;
+}
+
+static size_t txid_hash(const struct bitcoin_txid *txid)
+{
+	return siphash24(siphash_seed(), txid, sizeof(*txid));
+}
+
+static bool utxo_txid_eq(const struct utxo *utxo,
+			 const struct bitcoin_txid *txid)
+{
+	return bitcoin_txid_eq(&utxo->outpoint.txid, txid);
+}
+
+HTABLE_DEFINE_TYPE(struct utxo, utxo_txid_keyof, txid_hash, utxo_txid_eq,
+		   utxo_txid_map);
+
+struct utxo_pool {
+	struct utxo_txid_map map;
+	/* Lazily built, freed whenever the set of outputs changes. */
+	struct utxo **by_value;
+};
+
+static void destroy_utxo_pool(struct utxo_pool *pool)
+{
+	utxo_txid_map_clear(&pool->map);
+}
+
+#if DEVELOPER
+static void memleak_help_utxo_pool(struct htable *memtable,
+				   struct utxo_pool *pool)
+{
+	memleak_scan_htable(memtable, &pool->map.raw);
+}
+#endif /* DEVELOPER */
+
+struct utxo_pool *utxo_pool_new(const tal_t *ctx)
+{
+	struct utxo_pool *pool = tal(ctx, struct utxo_pool);
+
+	utxo_txid_map_init(&pool->map);
+	pool->by_value = NULL;
+	tal_add_destructor(pool, destroy_utxo_pool);
+	memleak_add_helper(pool, memleak_help_utxo_pool);
+	return pool;
+}
+
+static struct utxo *utxo_pool_find(const struct utxo_pool *pool,
+				   const struct bitcoin_outpoint *outpoint,
+				   struct utxo_txid_map_iter *it)
+{
+	struct utxo *u;
+
+	for (u = utxo_txid_map_getfirst(&pool->map, &outpoint->txid, it);
+	     u;
+	     u = utxo_txid_map_getnext(&pool->map, &outpoint->txid, it)) {
+		if (u->outpoint.n == outpoint->n)
+			return u;
+	}
+	return NULL;
+}
+
+struct utxo *utxo_pool_get(const struct utxo_pool *pool,
+			   const struct bitcoin_outpoint *outpoint)
+{
+	struct utxo_txid_map_iter it;
+
+	return utxo_pool_find(pool, outpoint, &it);
+}
+
+void utxo_pool_del(struct utxo_pool *pool,
+		   const struct bitcoin_outpoint *outpoint)
+{
+	struct utxo_txid_map_iter it;
+	struct utxo *u = utxo_pool_find(pool, outpoint, &it);
+
+	if (!u)
+		return;
+	utxo_txid_map_delval(&pool->map, &it);
+	tal_free(u);
+	pool->by_value = tal_free(pool->by_value);
+}
+
+void utxo_pool_set(struct utxo_pool *pool, const struct utxo *utxo)
+{
+	utxo_pool_del(pool, &utxo->outpoint);
+	if (utxo->status == OUTPUT_STATE_SPENT)
+		return;
+
+	utxo_txid_map_add(&pool->map, utxo_dup(pool, utxo));
+	pool->by_value = tal_free(pool->by_value);
+}
+
+void utxo_pool_confirm_tx(struct utxo_pool *pool,
+			  const struct bitcoin_txid *txid,
+			  u32 blockheight)
+{
+	struct utxo_txid_map_iter it;
+	struct utxo *u;
+
+	for (u = utxo_txid_map_getfirst(&pool->map, txid, &it);
+	     u;
+	     u = utxo_txid_map_getnext(&pool->map, txid, &it)) {
+		/* blockheight is const for everyone else */
+		u32 *height = tal(u, u32);
+
+		*height = blockheight;
+		tal_free(u->blockheight);
+		u->blockheight = height;
+	}
+}
+
+void utxo_pool_unconfirm_above(struct utxo_pool *pool, u32 height)
+{
+	struct utxo_txid_map_iter it;
+	struct utxo *u;
+
+	for (u = utxo_txid_map_first(&pool->map, &it);
+	     u;
+	     u = utxo_txid_map_next(&pool->map, &it)) {
+		if (u->blockheight && *u->blockheight > height)
+			u->blockheight = tal_free(u->blockheight);
+	}
+}
+
+static int cmp_value_desc(struct utxo *const *a, struct utxo *const *b,
+			  void *unused)
+{
+	if (amount_sat_greater((*a)->amount, (*b)->amount))
+		return -1;
+	if (amount_sat_less((*a)->amount, (*b)->amount))
+		return 1;
+	return 0;
+}
+
+struct utxo **utxo_pool_by_value(struct utxo_pool *pool)
+{
+	struct utxo_txid_map_iter it;
+	struct utxo *u;
+
+	if (pool->by_value)
+		return pool->by_value;
+
+	pool->by_value = tal_arr(pool, struct utxo *, 0);
+	for (u = utxo_txid_map_first(&pool->map, &it);
+	     u;
+	     u = utxo_txid_map_next(&pool->map, &it))
+		tal_arr_expand(&pool->by_value, u);
+	asort(pool->by_value, tal_count(pool->by_value), cmp_value_desc, NULL);
+	return pool->by_value;
+}
+
+static int cmp_effval_desc(const size_t *a, const size_t *b,
+			   struct amount_sat *effvals)
+{
+	if (amount_sat_greater(effvals[*a], effvals[*b]))
+		return -1;
+	if (amount_sat_less(effvals[*a], effvals[*b]))
+		return 1;
+	return 0;
+}
+
+bool select_coins_bnb(const struct amount_sat *effvals,
+		      struct amount_sat target,
+		      struct amount_sat cost_of_change,
+		      bool *chosen)
+{
+	size_t n = tal_count(effvals), depth;
+	size_t *order = tal_arr(tmpctx, size_t, n);
+	bool *in = tal_arrz(tmpctx, bool, n);
+	struct amount_sat curr, avail, best_excess, upper;
+	bool found = false;
+
+	if (!amount_sat_add(&upper, target, cost_of_change))
+		return false;
+
+	/* Try the largest first: we reach (or overshoot) sooner. */
+	avail = AMOUNT_SAT(0);
+	for (size_t i = 0; i < n; i++) {
+		order[i] = i;
+		if (!amount_sat_add(&avail, avail, effvals[i]))
+			return false;
+	}
+	asort(order, n, cmp_effval_desc,
+	      cast_const(struct amount_sat *, effvals));
+
+	memset(chosen, 0, n * sizeof(*chosen));
+	curr = AMOUNT_SAT(0);
+	best_excess = AMOUNT_SAT(0);
+	depth = 0;
+	for (size_t tries = 0; tries < BNB_MAX_TRIES; tries++) {
+		struct amount_sat reach, excess;
+		bool backtrack;
+
+		/* Can't reach target down this branch, or already too much? */
+		if (!amount_sat_add(&reach, curr, avail))
+			abort();
+		if (amount_sat_less(reach, target)
+		    || amount_sat_greater(curr, upper))
+			backtrack = true;
+		else if (amount_sat_sub(&excess, curr, target)) {
+			/* A solution: adding more can only make it worse. */
+			if (!found || amount_sat_less(excess, best_excess)) {
+				found = true;
+				best_excess = excess;
+				for (size_t i = 0; i < n; i++)
+					chosen[order[i]] = i < depth && in[i];
+				if (amount_sat_eq(excess, AMOUNT_SAT(0)))
+					break;
+			}
+			backtrack = true;
+		} else
+			backtrack = false;
+
+		if (!backtrack) {
+			/* Include the next one. */
+			in[depth] = true;
+			if (!amount_sat_add(&curr, curr, effvals[order[depth]])
+			    || !amount_sat_sub(&avail, avail,
+					       effvals[order[depth]]))
+				abort();
+			depth++;
+			continue;
+		}
+
+		/* Undo trailing exclusions, back to the last inclusion. */
+		while (depth > 0 && !in[depth - 1]) {
+			depth--;
+			if (!amount_sat_add(&avail, avail,
+					    effvals[order[depth]]))
+				abort();
+		}
+		if (depth == 0)
+			break;
+
+		/* Now try without that one. */
+		in[depth - 1] = false;
+		if (!amount_sat_sub(&curr, curr, effvals[order[depth - 1]]))
+			abort();
+	}
+
+	return found;
+}
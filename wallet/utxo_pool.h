@@ -0,0 +1,69 @@
+#ifndef LIGHTNING_WALLET_UTXO_POOL_H
+#define LIGHTNING_WALLET_UTXO_POOL_H
+#include "config.h"
+#include <common/amount.h>
+#include <common/utxo.h>
+
+/**
+ * utxo_pool -- An in-memory copy of every unspent output we own
+ *
+ * The wallet keeps this in step with the `outputs` table as it writes to
+ * it, so coin selection never has to query (and parse) the whole table.
+ * Spent outputs are dropped from the pool: nothing selects those.
+ */
+struct utxo_pool;
+
+struct utxo_pool *utxo_pool_new(const tal_t *ctx);
+
+/**
+ * utxo_pool_set -- Add a copy of @utxo, replacing any we had.
+ *
+ * If @utxo is spent, this just removes it.
+ */
+void utxo_pool_set(struct utxo_pool *pool, const struct utxo *utxo);
+
+/* Forget about this output (e.g. it was spent) */
+void utxo_pool_del(struct utxo_pool *pool,
+		   const struct bitcoin_outpoint *outpoint);
+
+/* Our copy of this output, or NULL.  You may alter status/reserved_til. */
+struct utxo *utxo_pool_get(const struct utxo_pool *pool,
+			   const struct bitcoin_outpoint *outpoint);
+
+/* Mirrors wallet_confirm_tx(): all outputs of @txid are now in a block */
+void utxo_pool_confirm_tx(struct utxo_pool *pool,
+			  const struct bitcoin_txid *txid,
+			  u32 blockheight);
+
+/* Mirrors blocks above @height being removed: their outputs are
+ * unconfirmed again. */
+void utxo_pool_unconfirm_above(struct utxo_pool *pool, u32 height);
+
+/**
+ * utxo_pool_by_value -- Every output in the pool, largest first.
+ *
+ * This index is kept until outputs are added or removed.  Don't free it.
+ */
+struct utxo **utxo_pool_by_value(struct utxo_pool *pool);
+
+/**
+ * select_coins_bnb -- Branch-and-bound search for a changeless selection.
+ * @effvals: tal array of each candidate's value, less the fee to spend it.
+ * @target: what the selection must provide (the amount, plus the fee
+ *	    without any inputs).
+ * @cost_of_change: how much over @target we would still rather burn than
+ *		    make change.
+ * @chosen: set to which of @effvals to use.
+ *
+ * This is the search Bitcoin Core uses (Murch's "An Evaluation of Coin
+ * Selection Strategies"): we explore including and excluding each candidate
+ * in turn, abandoning any branch which overshoots or can't reach @target,
+ * and keep the selection which overshoots least.  The search is bounded, so
+ * it can fail even if a solution exists: then the caller should fall back
+ * to another strategy.
+ */
+bool select_coins_bnb(const struct amount_sat *effvals,
+		      struct amount_sat target,
+		      struct amount_sat cost_of_change,
+		      bool *chosen);
+#endif /* LIGHTNING_WALLET_UTXO_POOL_H */
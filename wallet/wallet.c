@@ -7,6 +7,7 @@
 #include <common/blockheight_states.h>
 #include <common/fee_states.h>
 #include <common/onionreply.h>
+#include <common/pseudorand.h>
 #include <common/type_to_string.h>
 #include <db/bindings.h>
 #include <db/common.h>
@@ -15,11 +16,13 @@
 #include <lightningd/chaintopology.h>
 #include <lightningd/channel.h>
 #include <lightningd/coin_mvts.h>
+#include <lightningd/lightningd.h>
 #include <lightningd/notification.h>
 #include <lightningd/peer_control.h>
 #include <onchaind/onchaind_wiregen.h>
 #include <wallet/invoices.h>
 #include <wallet/txfilter.h>
+#include <wallet/utxo_pool.h>
 #include <wallet/wallet.h>
 #include <wally_bip32.h>
 
@@ -30,6 +33,12 @@
  * to prune? */
 #define UTXO_PRUNE_DEPTH 144
 
+/* We prune the UTXO set one range of this many blocks at a time. */
+#define UTXO_PRUNE_INTERVAL 16
+
+/* Rows per multi-row INSERT into utxoset (see utxoset_insert_batch) */
+#define UTXOSET_INSERT_BATCH 16
+
 /* 12 hours is usually enough reservation time */
 #define RESERVATION_INC (6 * 12)
 
@@ -70,8 +79,12 @@ static void outpointfilters_init(struct wallet *w)
 	struct bitcoin_outpoint outpoint;
 
 	w->owned_outpoints = outpointfilter_new(w);
-	for (size_t i = 0; i < tal_count(utxos); i++)
+	/* While we have them all, fill the pool of unspent ones too. */
+	w->utxo_pool = utxo_pool_new(w);
+	for (size_t i = 0; i < tal_count(utxos); i++) {
 		outpointfilter_add(w->owned_outpoints, &utxos[i]->outpoint);
+		utxo_pool_set(w->utxo_pool, utxos[i]);
+	}
 
 	tal_free(utxos);
 
@@ -97,16 +110,33 @@ struct wallet *wallet_new(struct lightningd *ld, struct timers *timers,
 	wallet->log = new_log(wallet, ld->log_book, NULL, "wallet");
 	wallet->bip32_base = tal_steal(wallet, bip32_base);
 	wallet->keyscan_gap = 50;
+	wallet->utxoset_last_prune = 0;
 	list_head_init(&wallet->unstored_payments);
 	wallet->db = db_setup(wallet, ld, wallet->bip32_base);
 
 	db_begin_transaction(wallet->db);
-	wallet->invoices = invoices_new(wallet, wallet->db, timers);
+
+	/* Invoice expiry can bump indexes, so load them first. */
+	load_indexes(wallet->db, ld->indexes);
+	wallet->invoices = invoices_new(wallet, wallet, timers);
 	outpointfilters_init(wallet);
 	db_commit_transaction(wallet->db);
 	return wallet;
 }
 
+/* Write-through to the utxo_pool: reload our copy of this output from the
+ * db.  Only for the rarer changes, where the db fills in the details. */
+static void wallet_utxo_pool_refresh(struct wallet *w,
+				     const struct bitcoin_outpoint *outpoint)
+{
+	struct utxo *utxo = wallet_utxo_get(tmpctx, w, outpoint);
+
+	if (utxo)
+		utxo_pool_set(w->utxo_pool, utxo);
+	else
+		utxo_pool_del(w->utxo_pool, outpoint);
+}
+
 /**
  * wallet_add_utxo - Register an UTXO which we (partially) own
  *
@@ -186,6 +216,8 @@ static bool wallet_add_utxo(struct wallet *w, struct utxo *utxo,
 
 	db_bind_int(stmt, 13, utxo->is_in_coinbase);
 	db_exec_prepared_v2(take(stmt));
+
+	wallet_utxo_pool_refresh(w, &utxo->outpoint);
 	return true;
 }
 
@@ -276,6 +308,9 @@ bool wallet_update_output_status(struct wallet *w,
 	db_exec_prepared_v2(stmt);
 	changes = db_count_changes(stmt);
 	tal_free(stmt);
+
+	if (changes > 0)
+		wallet_utxo_pool_refresh(w, outpoint);
 	return changes > 0;
 }
 
@@ -418,9 +453,10 @@ struct utxo *wallet_utxo_get(const tal_t *ctx, struct wallet *w,
 	return utxo;
 }
 
-static void db_set_utxo(struct db *db, const struct utxo *utxo)
+static void db_set_utxo(struct wallet *w, const struct utxo *utxo)
 {
 	struct db_stmt *stmt;
+	struct utxo *pooled;
 
 	if (utxo->status == OUTPUT_STATE_RESERVED)
 		assert(utxo->reserved_til);
@@ -428,13 +464,19 @@ static void db_set_utxo(struct db *db, const struct utxo *utxo)
 		assert(!utxo->reserved_til);
 
 	stmt = db_prepare_v2(
-		db, SQL("UPDATE outputs SET status=?, reserved_til=? "
-			"WHERE prev_out_tx=? AND prev_out_index=?"));
+		w->db, SQL("UPDATE outputs SET status=?, reserved_til=? "
+			   "WHERE prev_out_tx=? AND prev_out_index=?"));
 	db_bind_int(stmt, 0, output_status_in_db(utxo->status));
 	db_bind_int(stmt, 1, utxo->reserved_til);
 	db_bind_txid(stmt, 2, &utxo->outpoint.txid);
 	db_bind_int(stmt, 3, utxo->outpoint.n);
 	db_exec_prepared_v2(take(stmt));
+
+	pooled = utxo_pool_get(w->utxo_pool, &utxo->outpoint);
+	if (pooled) {
+		pooled->status = utxo->status;
+		pooled->reserved_til = utxo->reserved_til;
+	}
 }
 
 bool wallet_reserve_utxo(struct wallet *w, struct utxo *utxo,
@@ -459,7 +501,7 @@ bool wallet_reserve_utxo(struct wallet *w, struct utxo *utxo,
 
 	utxo->status = OUTPUT_STATE_RESERVED;
 
-	db_set_utxo(w->db, utxo);
+	db_set_utxo(w, utxo);
 
 	return true;
 }
@@ -479,7 +521,7 @@ void wallet_unreserve_utxo(struct wallet *w, struct utxo *utxo,
 	} else
 		utxo->reserved_til -= unreserve;
 
-	db_set_utxo(w->db, utxo);
+	db_set_utxo(w, utxo);
 }
 
 static bool excluded(const struct utxo **excludes,
@@ -523,8 +565,13 @@ static bool deep_enough(u32 maxheight, const struct utxo *utxo,
 	return *utxo->blockheight <= maxheight;
 }
 
-/* FIXME: Make this wallet_find_utxos, and branch and bound and I've
- * left that to @niftynei to do, who actually read the paper! */
+static bool selectable(const struct utxo *utxo,
+		       u32 maxheight, u32 current_blockheight)
+{
+	return !utxo_is_reserved(utxo, current_blockheight)
+		&& deep_enough(maxheight, utxo, current_blockheight);
+}
+
 struct utxo *wallet_find_utxo(const tal_t *ctx, struct wallet *w,
 			      unsigned current_blockheight,
 			      struct amount_sat *amount_hint,
@@ -532,49 +579,66 @@ struct utxo *wallet_find_utxo(const tal_t *ctx, struct wallet *w,
 			      u32 maxheight,
 			      const struct utxo **excludes)
 {
-	struct db_stmt *stmt;
-	struct utxo *utxo;
-
-	stmt = db_prepare_v2(w->db, SQL("SELECT"
-					"  prev_out_tx"
-					", prev_out_index"
-					", value"
-					", type"
-					", status"
-					", keyindex"
-					", channel_id"
-					", peer_id"
-					", commitment_point"
-					", option_anchor_outputs"
-					", confirmation_height"
-					", spend_height"
-					", scriptpubkey "
-					", reserved_til"
-					", csv_lock"
-					", is_in_coinbase"
-					" FROM outputs"
-					" WHERE status = ?"
-					" OR (status = ? AND reserved_til <= ?)"
-					"ORDER BY RANDOM();"));
-	db_bind_int(stmt, 0, output_status_in_db(OUTPUT_STATE_AVAILABLE));
-	db_bind_int(stmt, 1, output_status_in_db(OUTPUT_STATE_RESERVED));
-	db_bind_u64(stmt, 2, current_blockheight);
+	struct utxo **pool = utxo_pool_by_value(w->utxo_pool);
+	struct utxo **candidates = tal_arr(tmpctx, struct utxo *, 0);
 
 	/* FIXME: Use feerate + estimate of input cost to establish
 	 * range for amount_hint */
+	for (size_t i = 0; i < tal_count(pool); i++) {
+		if (selectable(pool[i], maxheight, current_blockheight)
+		    && !excluded(excludes, pool[i]))
+			tal_arr_expand(&candidates, pool[i]);
+	}
 
-	db_query_prepared(stmt);
+	if (tal_count(candidates) == 0)
+		return NULL;
+	return utxo_dup(ctx, candidates[pseudorand(tal_count(candidates))]);
+}
+
+struct utxo **wallet_find_utxos_changeless(const tal_t *ctx,
+					   struct wallet *w,
+					   unsigned current_blockheight,
+					   struct amount_sat target,
+					   struct amount_sat cost_of_change,
+					   unsigned feerate_per_kw,
+					   size_t min_witness_weight,
+					   u32 maxheight)
+{
+	struct utxo **pool = utxo_pool_by_value(w->utxo_pool);
+	struct utxo **candidates = tal_arr(tmpctx, struct utxo *, 0);
+	struct amount_sat *effvals = tal_arr(tmpctx, struct amount_sat, 0);
+	struct utxo **selected;
+	bool *chosen;
+
+	for (size_t i = 0; i < tal_count(pool); i++) {
+		struct amount_sat fee, effval;
 
-	utxo = NULL;
-	while (!utxo && db_step(stmt)) {
-		utxo = wallet_stmt2output(ctx, stmt);
-		if (excluded(excludes, utxo)
-		    || !deep_enough(maxheight, utxo, current_blockheight))
-			utxo = tal_free(utxo);
+		if (!selectable(pool[i], maxheight, current_blockheight))
+			continue;
+
+		/* Ones which don't pay for themselves are no use. */
+		fee = amount_tx_fee(feerate_per_kw,
+				    utxo_spend_weight(pool[i],
+						      min_witness_weight));
+		if (!amount_sat_sub(&effval, pool[i]->amount, fee)
+		    || amount_sat_eq(effval, AMOUNT_SAT(0)))
+			continue;
 
+		tal_arr_expand(&candidates, pool[i]);
+		tal_arr_expand(&effvals, effval);
 	}
-	tal_free(stmt);
-	return utxo;
+
+	chosen = tal_arr(tmpctx, bool, tal_count(candidates));
+	if (!select_coins_bnb(effvals, target, cost_of_change, chosen))
+		return NULL;
+
+	selected = tal_arr(ctx, struct utxo *, 0);
+	for (size_t i = 0; i < tal_count(candidates); i++) {
+		if (chosen[i])
+			tal_arr_expand(&selected,
+				       utxo_dup(selected, candidates[i]));
+	}
+	return selected;
 }
 
 bool wallet_add_onchaind_utxo(struct wallet *w,
@@ -643,6 +707,8 @@ bool wallet_add_onchaind_utxo(struct wallet *w,
 	db_bind_int(stmt, 13, csv_lock);
 
 	db_exec_prepared_v2(take(stmt));
+
+	wallet_utxo_pool_refresh(w, outpoint);
 	return true;
 }
 
@@ -1653,6 +1719,60 @@ bool wallet_init_channels(struct wallet *w)
 	return wallet_channels_load_active(w);
 }
 
+struct closed_channel *wallet_closed_channels_load(const tal_t *ctx,
+						   struct wallet *w)
+{
+	struct db_stmt *stmt;
+	struct closed_channel *chans = tal_arr(ctx, struct closed_channel, 0);
+
+	stmt = db_prepare_v2(w->db, SQL("SELECT"
+					"  id"
+					", scid"
+					", full_channel_id"
+					", funding_tx_id"
+					", funding_tx_outnum"
+					", funder"
+					", closer"
+					", channel_flags"
+					", funding_satoshi"
+					", msatoshi_local"
+					", msatoshi_to_us_min"
+					", msatoshi_to_us_max"
+					", state_change_reason"
+					" FROM channels"
+					" WHERE state = ?"
+					" ORDER BY id;"));
+	db_bind_int(stmt, 0, CLOSED);
+	db_query_prepared(stmt);
+
+	while (db_step(stmt)) {
+		struct closed_channel cc;
+
+		cc.dbid = db_col_u64(stmt, "id");
+		if (!db_col_is_null(stmt, "scid")) {
+			cc.scid = tal(chans, struct short_channel_id);
+			db_col_scid(stmt, "scid", cc.scid);
+		} else
+			cc.scid = NULL;
+		db_col_channel_id(stmt, "full_channel_id", &cc.cid);
+		db_col_sha256d(stmt, "funding_tx_id", &cc.funding.txid.shad);
+		cc.funding.n = db_col_int(stmt, "funding_tx_outnum");
+		cc.opener = db_col_int(stmt, "funder");
+		cc.closer = db_col_int(stmt, "closer");
+		cc.channel_flags = db_col_int(stmt, "channel_flags");
+		db_col_amount_sat(stmt, "funding_satoshi", &cc.funding_sats);
+		db_col_amount_msat(stmt, "msatoshi_local", &cc.our_msat);
+		db_col_amount_msat(stmt, "msatoshi_to_us_min",
+				   &cc.msat_to_us_min);
+		db_col_amount_msat(stmt, "msatoshi_to_us_max",
+				   &cc.msat_to_us_max);
+		cc.state_change_cause = db_col_int(stmt, "state_change_reason");
+		tal_arr_expand(&chans, cc);
+	}
+	tal_free(stmt);
+	return chans;
+}
+
 static enum channel_state_bucket get_state_channel_db(const char *dir, const char *typ)
 {
 	enum channel_state_bucket channel_state = IN_OFFERED;
@@ -2236,6 +2356,12 @@ void wallet_channel_close(struct wallet *w, u64 wallet_id)
 	db_bind_u64(stmt, 0, wallet_id);
 	db_exec_prepared_v2(take(stmt));
 
+	/* ... and any which were already archived */
+	stmt = db_prepare_v2(w->db, SQL("DELETE FROM channel_htlcs_archive "
+					"WHERE channel_id=?"));
+	db_bind_u64(stmt, 0, wallet_id);
+	db_exec_prepared_v2(take(stmt));
+
 	/* Delete entries from `htlc_sigs` */
 	stmt = db_prepare_v2(w->db, SQL("DELETE FROM htlc_sigs "
 					"WHERE channelid=?"));
@@ -2306,6 +2432,8 @@ void wallet_confirm_tx(struct wallet *w,
 	db_bind_sha256d(stmt, 1, &txid->shad);
 
 	db_exec_prepared_v2(take(stmt));
+
+	utxo_pool_confirm_tx(w->utxo_pool, txid, confirmation_height);
 }
 
 int wallet_extract_owned_outputs(struct wallet *w, const struct wally_tx *wtx,
@@ -2920,10 +3048,22 @@ void wallet_invoice_delete_expired(struct wallet *wallet, u64 e)
 {
 	invoices_delete_expired(wallet->invoices, e);
 }
+u64 wallet_invoice_delete_older(struct wallet *wallet,
+				enum invoice_status state,
+				u64 max_time, u32 limit,
+				u64 *remaining)
+{
+	return invoices_delete_older(wallet->invoices, state,
+				     max_time, limit, remaining);
+}
 bool wallet_invoice_iterate(struct wallet *wallet,
-			    struct invoice_iterator *it)
+			    struct invoice_iterator *it,
+			    const enum wait_index *listindex,
+			    u64 liststart,
+			    const u32 *listlimit)
 {
-	return invoices_iterate(wallet->invoices, it);
+	return invoices_iterate(wallet->invoices, it,
+				listindex, liststart, listlimit);
 }
 const struct invoice_details *
 wallet_invoice_iterator_deref(const tal_t *ctx, struct wallet *wallet,
@@ -2968,14 +3108,22 @@ struct htlc_stub *wallet_htlc_stubs(const tal_t *ctx, struct wallet *wallet,
 	struct sha256 payment_hash;
 	struct db_stmt *stmt;
 
+	/* Old commitments can contain HTLCs which have since been archived */
 	stmt = db_prepare_v2(wallet->db,
 			     SQL("SELECT channel_id, direction, cltv_expiry, "
 				 "channel_htlc_id, payment_hash "
-				 "FROM channel_htlcs WHERE channel_id = ? AND min_commit_num <= ? AND ((max_commit_num IS NULL) OR max_commit_num >= ?);"));
+				 "FROM channel_htlcs WHERE channel_id = ? AND min_commit_num <= ? AND ((max_commit_num IS NULL) OR max_commit_num >= ?)"
+				 " UNION ALL "
+				 "SELECT channel_id, direction, cltv_expiry, "
+				 "channel_htlc_id, payment_hash "
+				 "FROM channel_htlcs_archive WHERE channel_id = ? AND min_commit_num <= ? AND max_commit_num >= ?;"));
 
 	db_bind_u64(stmt, 0, chan->dbid);
 	db_bind_u64(stmt, 1, commit_num);
 	db_bind_u64(stmt, 2, commit_num);
+	db_bind_u64(stmt, 3, chan->dbid);
+	db_bind_u64(stmt, 4, commit_num);
+	db_bind_u64(stmt, 5, commit_num);
 	db_query_prepared(stmt);
 
 	stubs = tal_arr(ctx, struct htlc_stub, 0);
@@ -2998,6 +3146,74 @@ struct htlc_stub *wallet_htlc_stubs(const tal_t *ctx, struct wallet *wallet,
 	return stubs;
 }
 
+size_t wallet_htlcs_archive(struct wallet *wallet, u32 limit)
+{
+	struct db_stmt *stmt;
+	size_t count = 0;
+	u64 maxid = 0;
+
+	/* Find the oldest @limit resolved HTLCs.  Their state never
+	 * changes again, so everything up to the last one is ours. */
+	stmt = db_prepare_v2(wallet->db, SQL("SELECT id"
+					     " FROM channel_htlcs"
+					     " WHERE hstate IN (?, ?)"
+					     " ORDER BY id"
+					     " LIMIT ?;"));
+	db_bind_int(stmt, 0, RCVD_REMOVE_ACK_REVOCATION);
+	db_bind_int(stmt, 1, SENT_REMOVE_ACK_REVOCATION);
+	db_bind_int(stmt, 2, limit);
+	db_query_prepared(stmt);
+	while (db_step(stmt)) {
+		maxid = db_col_u64(stmt, "id");
+		count++;
+	}
+	tal_free(stmt);
+
+	if (count == 0)
+		return 0;
+
+	stmt = db_prepare_v2(wallet->db,
+			     SQL("INSERT INTO channel_htlcs_archive ("
+				 "  id"
+				 ", channel_id"
+				 ", channel_htlc_id"
+				 ", direction"
+				 ", msatoshi"
+				 ", cltv_expiry"
+				 ", payment_hash"
+				 ", hstate"
+				 ", min_commit_num"
+				 ", max_commit_num"
+				 ") SELECT"
+				 "  id"
+				 ", channel_id"
+				 ", channel_htlc_id"
+				 ", direction"
+				 ", msatoshi"
+				 ", cltv_expiry"
+				 ", payment_hash"
+				 ", hstate"
+				 ", min_commit_num"
+				 ", max_commit_num"
+				 " FROM channel_htlcs"
+				 " WHERE hstate IN (?, ?) AND id <= ?"
+				 " ORDER BY id;"));
+	db_bind_int(stmt, 0, RCVD_REMOVE_ACK_REVOCATION);
+	db_bind_int(stmt, 1, SENT_REMOVE_ACK_REVOCATION);
+	db_bind_u64(stmt, 2, maxid);
+	db_exec_prepared_v2(take(stmt));
+
+	stmt = db_prepare_v2(wallet->db,
+			     SQL("DELETE FROM channel_htlcs"
+				 " WHERE hstate IN (?, ?) AND id <= ?;"));
+	db_bind_int(stmt, 0, RCVD_REMOVE_ACK_REVOCATION);
+	db_bind_int(stmt, 1, SENT_REMOVE_ACK_REVOCATION);
+	db_bind_u64(stmt, 2, maxid);
+	db_exec_prepared_v2(take(stmt));
+
+	return count;
+}
+
 void wallet_local_htlc_out_delete(struct wallet *wallet,
 				  struct channel *chan,
 				  const struct sha256 *payment_hash,
@@ -3037,6 +3253,24 @@ static void destroy_unstored_payment(struct wallet_payment *payment)
 	list_del(&payment->list);
 }
 
+/* Bump a sendpays index (and tell `wait`).  status can be NULL. */
+static u64 sendpay_index_inc(struct wallet *wallet,
+			     enum wait_index index,
+			     const enum wallet_payment_status *status,
+			     const struct sha256 *payment_hash,
+			     u64 partid, u64 groupid)
+{
+	return wait_index_increment(wallet->ld,
+				    WAIT_SUBSYSTEM_SENDPAY,
+				    index,
+				    "status", status ? payment_status_to_string(*status) : NULL,
+				    "=partid", partid ? tal_fmt(tmpctx, "%"PRIu64, partid) : NULL,
+				    "=groupid", tal_fmt(tmpctx, "%"PRIu64, groupid),
+				    "payment_hash",
+				    type_to_string(tmpctx, struct sha256, payment_hash),
+				    NULL);
+}
+
 void wallet_payment_setup(struct wallet *wallet, struct wallet_payment *payment)
 {
 	assert(!find_unstored_payment(wallet, &payment->payment_hash,
@@ -3076,6 +3310,12 @@ void wallet_payment_store(struct wallet *wallet,
         /* Don't attempt to add the same payment twice */
 	assert(!payment->id);
 
+	/* The created_index is the id. */
+	payment->id = sendpay_index_inc(wallet, WAIT_INDEX_CREATED,
+					&payment->status,
+					&payment->payment_hash,
+					payment->partid, payment->groupid);
+
 	stmt = db_prepare_v2(
 		wallet->db,
 		SQL("INSERT INTO payments ("
@@ -3094,8 +3334,9 @@ void wallet_payment_store(struct wallet *wallet,
 		    "  partid,"
 		    "  local_invreq_id,"
 		    "  groupid,"
-		    "  paydescription"
-		    ") VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);"));
+		    "  paydescription,"
+		    "  id"
+		    ") VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);"));
 
 	db_bind_int(stmt, 0, payment->status);
 	db_bind_sha256(stmt, 1, &payment->payment_hash);
@@ -3149,10 +3390,8 @@ void wallet_payment_store(struct wallet *wallet,
 	else
 		db_bind_null(stmt, 15);
 
-	db_exec_prepared_v2(stmt);
-	payment->id = db_last_insert_id_v2(stmt);
-	assert(payment->id > 0);
-	tal_free(stmt);
+	db_bind_u64(stmt, 16, payment->id);
+	db_exec_prepared_v2(take(stmt));
 
 	if (taken(payment)) {
 		tal_free(payment);
@@ -3185,6 +3424,40 @@ void wallet_payment_delete(struct wallet *wallet,
 			   const u64 *partid)
 {
 	struct db_stmt *stmt;
+	struct deleted_payment {
+		enum wallet_payment_status status;
+		u64 partid, groupid;
+	} *deleted = tal_arr(tmpctx, struct deleted_payment, 0);
+
+	/* Find what we're deleting, so we can tell `wait` about each one */
+	if (groupid) {
+		assert(partid);
+		stmt = db_prepare_v2(wallet->db,
+				     SQL("SELECT status, partid, groupid"
+					 " FROM payments"
+					 " WHERE payment_hash = ?"
+					 "   AND groupid = ?"
+					 "   AND partid = ?"));
+		db_bind_u64(stmt, 1, *groupid);
+		db_bind_u64(stmt, 2, *partid);
+	} else {
+		assert(!partid);
+		stmt = db_prepare_v2(wallet->db,
+				     SQL("SELECT status, partid, groupid"
+					 " FROM payments"
+					 " WHERE payment_hash = ?"));
+	}
+	db_bind_sha256(stmt, 0, payment_hash);
+	db_query_prepared(stmt);
+	while (db_step(stmt)) {
+		struct deleted_payment d;
+		d.status = db_col_int(stmt, "status");
+		d.partid = db_col_u64(stmt, "partid");
+		d.groupid = db_col_u64(stmt, "groupid");
+		tal_arr_expand(&deleted, d);
+	}
+	tal_free(stmt);
+
 	if (groupid) {
 		assert(partid);
 		stmt = db_prepare_v2(wallet->db,
@@ -3202,6 +3475,64 @@ void wallet_payment_delete(struct wallet *wallet,
 	}
 	db_bind_sha256(stmt, 0, payment_hash);
 	db_exec_prepared_v2(take(stmt));
+
+	for (size_t i = 0; i < tal_count(deleted); i++) {
+		sendpay_index_inc(wallet, WAIT_INDEX_DELETED,
+				  &deleted[i].status, payment_hash,
+				  deleted[i].partid, deleted[i].groupid);
+	}
+}
+
+u64 wallet_payment_delete_older(struct wallet *wallet,
+				enum wallet_payment_status status,
+				u64 max_time, u32 limit,
+				u64 *remaining)
+{
+	struct db_stmt *stmt;
+	u64 deleted;
+
+	assert(status != PAYMENT_PENDING);
+	stmt = db_prepare_v2(wallet->db,
+			     SQL("DELETE FROM payments"
+				 " WHERE id IN (SELECT id FROM payments"
+				 "               WHERE status = ?"
+				 "                 AND timestamp <= ?"
+				 "               ORDER BY id"
+				 "               LIMIT ?)"));
+	db_bind_int(stmt, 0, wallet_payment_status_in_db(status));
+	db_bind_u64(stmt, 1, max_time);
+	db_bind_int(stmt, 2, limit);
+	db_exec_prepared_v2(stmt);
+	deleted = db_count_changes(stmt);
+	tal_free(stmt);
+
+	wait_index_increase(wallet->ld,
+			    WAIT_SUBSYSTEM_SENDPAY,
+			    WAIT_INDEX_DELETED,
+			    deleted,
+			    "status", payment_status_to_string(status),
+			    "=count", tal_fmt(tmpctx, "%"PRIu64, deleted),
+			    NULL);
+
+	/* If we didn't hit the limit, this is the last call: count what's
+	 * left, once.  Otherwise just what the caller still has to delete. */
+	if (deleted < limit)
+		stmt = db_prepare_v2(wallet->db,
+				     SQL("SELECT COUNT(*) FROM payments"));
+	else {
+		stmt = db_prepare_v2(wallet->db,
+				     SQL("SELECT COUNT(*) FROM payments"
+					 " WHERE status = ?"
+					 "   AND timestamp <= ?"));
+		db_bind_int(stmt, 0, wallet_payment_status_in_db(status));
+		db_bind_u64(stmt, 1, max_time);
+	}
+	db_query_prepared(stmt);
+	db_step(stmt);
+	*remaining = db_col_u64(stmt, "COUNT(*)");
+	tal_free(stmt);
+
+	return deleted;
 }
 
 static struct wallet_payment *wallet_stmt2payment(const tal_t *ctx,
@@ -3209,6 +3540,7 @@ static struct wallet_payment *wallet_stmt2payment(const tal_t *ctx,
 {
 	struct wallet_payment *payment = tal(ctx, struct wallet_payment);
 	payment->id = db_col_u64(stmt, "id");
+	payment->updated_index = db_col_u64(stmt, "updated_index");
 	payment->status = db_col_int(stmt, "status");
 
 	if (!db_col_is_null(stmt, "destination")) {
@@ -3334,6 +3666,7 @@ wallet_payment_by_hash(const tal_t *ctx, struct wallet *wallet,
 					     ", local_invreq_id"
 					     ", groupid"
 					     ", completed_at"
+					     ", updated_index"
 					     " FROM payments"
 					     " WHERE payment_hash = ?"
 					     " AND partid = ? AND groupid=?"));
@@ -3371,7 +3704,7 @@ void wallet_payment_set_status(struct wallet *wallet,
 	}
 
 	stmt = db_prepare_v2(wallet->db,
-			     SQL("UPDATE payments SET status=?, completed_at=? "
+			     SQL("UPDATE payments SET status=?, completed_at=?, updated_index=? "
 				 "WHERE payment_hash=? AND partid=? AND groupid=?"));
 
 	db_bind_int(stmt, 0, wallet_payment_status_in_db(newstatus));
@@ -3380,9 +3713,13 @@ void wallet_payment_set_status(struct wallet *wallet,
 	} else {
 		db_bind_null(stmt, 1);
 	}
-	db_bind_sha256(stmt, 2, payment_hash);
-	db_bind_u64(stmt, 3, partid);
-	db_bind_u64(stmt, 4, groupid);
+	db_bind_u64(stmt, 2,
+		    sendpay_index_inc(wallet, WAIT_INDEX_UPDATED,
+				      &newstatus, payment_hash,
+				      partid, groupid));
+	db_bind_sha256(stmt, 3, payment_hash);
+	db_bind_u64(stmt, 4, partid);
+	db_bind_u64(stmt, 5, groupid);
 	db_exec_prepared_v2(take(stmt));
 
 	if (preimage) {
@@ -3545,7 +3882,10 @@ void wallet_payment_set_failinfo(struct wallet *wallet,
 const struct wallet_payment **
 wallet_payment_list(const tal_t *ctx,
 		    struct wallet *wallet,
-		    const struct sha256 *payment_hash)
+		    const struct sha256 *payment_hash,
+		    const enum wait_index *listindex,
+		    u64 liststart,
+		    const u32 *listlimit)
 {
 	const struct wallet_payment **payments;
 	struct db_stmt *stmt;
@@ -3555,6 +3895,8 @@ wallet_payment_list(const tal_t *ctx,
 	payments = tal_arr(ctx, const struct wallet_payment *, 0);
 
 	if (payment_hash) {
+		/* Index-based listing doesn't filter by payment_hash */
+		assert(!listindex);
 		stmt = db_prepare_v2(wallet->db, SQL("SELECT"
 						     "  id"
 						     ", status"
@@ -3576,12 +3918,13 @@ wallet_payment_list(const tal_t *ctx,
 						     ", local_invreq_id"
 						     ", groupid"
 						     ", completed_at"
+						     ", updated_index"
 						     " FROM payments"
 						     " WHERE"
 						     "  payment_hash = ?"
 						     " ORDER BY id;"));
 		db_bind_sha256(stmt, 0, payment_hash);
-	} else {
+	} else if (!listindex) {
 		stmt = db_prepare_v2(wallet->db, SQL("SELECT"
 						     "  id"
 						     ", status"
@@ -3603,8 +3946,68 @@ wallet_payment_list(const tal_t *ctx,
 						     ", local_invreq_id"
 						     ", groupid"
 						     ", completed_at"
+						     ", updated_index"
 						     " FROM payments"
 						     " ORDER BY id;"));
+	} else if (*listindex == WAIT_INDEX_CREATED) {
+		stmt = db_prepare_v2(wallet->db, SQL("SELECT"
+						     "  id"
+						     ", status"
+						     ", destination"
+						     ", msatoshi"
+						     ", payment_hash"
+						     ", timestamp"
+						     ", payment_preimage"
+						     ", path_secrets"
+						     ", route_nodes"
+						     ", route_channels"
+						     ", msatoshi_sent"
+						     ", description"
+						     ", bolt11"
+						     ", paydescription"
+						     ", failonionreply"
+						     ", total_msat"
+						     ", partid"
+						     ", local_invreq_id"
+						     ", groupid"
+						     ", completed_at"
+						     ", updated_index"
+						     " FROM payments"
+						     " WHERE id >= ?"
+						     " ORDER BY id"
+						     " LIMIT ?;"));
+		db_bind_u64(stmt, 0, liststart);
+		db_bind_int(stmt, 1, listlimit ? *listlimit : INT_MAX);
+	} else {
+		assert(*listindex == WAIT_INDEX_UPDATED);
+		stmt = db_prepare_v2(wallet->db, SQL("SELECT"
+						     "  id"
+						     ", status"
+						     ", destination"
+						     ", msatoshi"
+						     ", payment_hash"
+						     ", timestamp"
+						     ", payment_preimage"
+						     ", path_secrets"
+						     ", route_nodes"
+						     ", route_channels"
+						     ", msatoshi_sent"
+						     ", description"
+						     ", bolt11"
+						     ", paydescription"
+						     ", failonionreply"
+						     ", total_msat"
+						     ", partid"
+						     ", local_invreq_id"
+						     ", groupid"
+						     ", completed_at"
+						     ", updated_index"
+						     " FROM payments"
+						     " WHERE updated_index >= ?"
+						     " ORDER BY updated_index"
+						     " LIMIT ?;"));
+		db_bind_u64(stmt, 0, liststart);
+		db_bind_int(stmt, 1, listlimit ? *listlimit : INT_MAX);
 	}
 	db_query_prepared(stmt);
 
@@ -3614,6 +4017,10 @@ wallet_payment_list(const tal_t *ctx,
 	}
 	tal_free(stmt);
 
+	/* Unstored payments have no index, so can't be paginated. */
+	if (listindex)
+		return payments;
+
 	/* Now attach payments not yet in db. */
 	list_for_each(&wallet->unstored_payments, p, list) {
 		if (payment_hash && !sha256_eq(&p->payment_hash, payment_hash))
@@ -3657,6 +4064,7 @@ wallet_payments_by_invoice_request(const tal_t *ctx,
 					     ", local_invreq_id"
 					     ", groupid"
 					     ", completed_at"
+					     ", updated_index"
 					     " FROM payments"
 					     " WHERE local_invreq_id = ?;"));
 	db_bind_sha256(stmt, 0, local_invreq_id);
@@ -3763,13 +4171,35 @@ bool wallet_sanity_check(struct wallet *w)
 	return true;
 }
 
+/* So we can benchmark the difference batching makes. */
+static bool utxoset_no_batch(const struct wallet *w)
+{
+#if DEVELOPER
+	return w->ld->dev_no_utxoset_batch;
+#else
+	return false;
+#endif
+}
+
 /**
  * wallet_utxoset_prune -- Remove spent UTXO entries that are old
+ *
+ * Rather than two statements for every block, we only prune once
+ * UTXO_PRUNE_INTERVAL blocks have passed, removing everything spent in the
+ * range since the last time.  Entries thus linger up to UTXO_PRUNE_INTERVAL
+ * blocks longer than UTXO_PRUNE_DEPTH (more, if the blocks in between
+ * were only headers), which is harmless.
  */
 static void wallet_utxoset_prune(struct wallet *w, const u32 blockheight)
 {
 	struct db_stmt *stmt;
 
+	/* We don't see every height: header-only blocks never get here. */
+	if (blockheight < w->utxoset_last_prune + UTXO_PRUNE_INTERVAL
+	    && !utxoset_no_batch(w))
+		return;
+	w->utxoset_last_prune = blockheight;
+
 	stmt = db_prepare_v2(
 	    w->db,
 	    SQL("SELECT txid, outnum FROM utxoset WHERE spendheight < ?"));
@@ -3815,6 +4245,8 @@ void wallet_block_remove(struct wallet *w, struct block *b)
 		db_prepare_v2(w->db, SQL("DELETE FROM blocks WHERE hash = ?"));
 	db_bind_sha256d(stmt, 0, &b->blkid.shad);
 	db_exec_prepared_v2(take(stmt));
+	/* The db unsets confirmation_height for us, via the foreign key. */
+	utxo_pool_unconfirm_above(w->utxo_pool, b->height - 1);
 
 	/* Make sure that all descendants of the block are also deleted */
 	stmt = db_prepare_v2(w->db,
@@ -3831,6 +4263,7 @@ void wallet_blocks_rollback(struct wallet *w, u32 height)
 							"WHERE height > ?"));
 	db_bind_int(stmt, 0, height);
 	db_exec_prepared_v2(take(stmt));
+	utxo_pool_unconfirm_above(w->utxo_pool, height);
 }
 
 bool wallet_outpoint_spend(struct wallet *w, const tal_t *ctx, const u32 blockheight,
@@ -3851,6 +4284,7 @@ bool wallet_outpoint_spend(struct wallet *w, const tal_t *ctx, const u32 blockhe
 		db_bind_int(stmt, 3, outpoint->n);
 
 		db_exec_prepared_v2(take(stmt));
+		utxo_pool_del(w->utxo_pool, outpoint);
 
 		our_spend = true;
 	} else
@@ -3871,11 +4305,53 @@ bool wallet_outpoint_spend(struct wallet *w, const tal_t *ctx, const u32 blockhe
 	return our_spend;
 }
 
-void wallet_utxoset_add(struct wallet *w,
-			const struct bitcoin_outpoint *outpoint,
-			const u32 blockheight,
-			const u32 txindex, const u8 *scriptpubkey,
-			struct amount_sat sat)
+/* Insert UTXOSET_INSERT_BATCH rows in one statement. */
+static void utxoset_insert_batch(struct wallet *w, u32 blockheight,
+				 struct filteredblock_outpoint **outpoints)
+{
+	struct db_stmt *stmt;
+
+	stmt = db_prepare_v2(w->db, SQL("INSERT INTO utxoset ("
+					" txid,"
+					" outnum,"
+					" blockheight,"
+					" spendheight,"
+					" txindex,"
+					" scriptpubkey,"
+					" satoshis"
+					") VALUES"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?),"
+					" (?, ?, ?, NULL, ?, ?, ?);"));
+	for (size_t i = 0; i < UTXOSET_INSERT_BATCH; i++) {
+		const struct filteredblock_outpoint *o = outpoints[i];
+		int col = i * 6;
+
+		db_bind_txid(stmt, col, &o->outpoint.txid);
+		db_bind_int(stmt, col + 1, o->outpoint.n);
+		db_bind_int(stmt, col + 2, blockheight);
+		db_bind_int(stmt, col + 3, o->txindex);
+		db_bind_talarr(stmt, col + 4, o->scriptPubKey);
+		db_bind_amount_sat(stmt, col + 5, &o->amount);
+	}
+	db_exec_prepared_v2(take(stmt));
+}
+
+static void utxoset_insert(struct wallet *w, u32 blockheight,
+			   const struct filteredblock_outpoint *o)
 {
 	struct db_stmt *stmt;
 
@@ -3888,16 +4364,30 @@ void wallet_utxoset_add(struct wallet *w,
 					" scriptpubkey,"
 					" satoshis"
 					") VALUES(?, ?, ?, ?, ?, ?, ?);"));
-	db_bind_txid(stmt, 0, &outpoint->txid);
-	db_bind_int(stmt, 1, outpoint->n);
+	db_bind_txid(stmt, 0, &o->outpoint.txid);
+	db_bind_int(stmt, 1, o->outpoint.n);
 	db_bind_int(stmt, 2, blockheight);
 	db_bind_null(stmt, 3);
-	db_bind_int(stmt, 4, txindex);
-	db_bind_talarr(stmt, 5, scriptpubkey);
-	db_bind_amount_sat(stmt, 6, &sat);
+	db_bind_int(stmt, 4, o->txindex);
+	db_bind_talarr(stmt, 5, o->scriptPubKey);
+	db_bind_amount_sat(stmt, 6, &o->amount);
 	db_exec_prepared_v2(take(stmt));
+}
 
-	outpointfilter_add(w->utxoset_outpoints, outpoint);
+void wallet_utxoset_add_many(struct wallet *w, const u32 blockheight,
+			     struct filteredblock_outpoint **outpoints)
+{
+	size_t i = 0, n = tal_count(outpoints);
+
+	if (!utxoset_no_batch(w)) {
+		for (; i + UTXOSET_INSERT_BATCH <= n; i += UTXOSET_INSERT_BATCH)
+			utxoset_insert_batch(w, blockheight, outpoints + i);
+	}
+	for (; i < n; i++)
+		utxoset_insert(w, blockheight, outpoints[i]);
+
+	for (i = 0; i < n; i++)
+		outpointfilter_add(w->utxoset_outpoints, &outpoints[i]->outpoint);
 }
 
 void wallet_filteredblock_add(struct wallet *w, const struct filteredblock *fb)
@@ -3914,29 +4404,7 @@ void wallet_filteredblock_add(struct wallet *w, const struct filteredblock *fb)
 	db_bind_sha256d(stmt, 2, &fb->prev_hash.shad);
 	db_exec_prepared_v2(take(stmt));
 
-	for (size_t i = 0; i < tal_count(fb->outpoints); i++) {
-		struct filteredblock_outpoint *o = fb->outpoints[i];
-		stmt =
-		    db_prepare_v2(w->db, SQL("INSERT INTO utxoset ("
-					     " txid,"
-					     " outnum,"
-					     " blockheight,"
-					     " spendheight,"
-					     " txindex,"
-					     " scriptpubkey,"
-					     " satoshis"
-					     ") VALUES(?, ?, ?, ?, ?, ?, ?);"));
-		db_bind_txid(stmt, 0, &o->outpoint.txid);
-		db_bind_int(stmt, 1, o->outpoint.n);
-		db_bind_int(stmt, 2, fb->height);
-		db_bind_null(stmt, 3);
-		db_bind_int(stmt, 4, o->txindex);
-		db_bind_talarr(stmt, 5, o->scriptPubKey);
-		db_bind_amount_sat(stmt, 6, &o->amount);
-		db_exec_prepared_v2(take(stmt));
-
-		outpointfilter_add(w->utxoset_outpoints, &o->outpoint);
-	}
+	wallet_utxoset_add_many(w, fb->height, fb->outpoints);
 }
 
 bool wallet_have_block(struct wallet *w, u32 blockheight)
@@ -4050,6 +4518,24 @@ wallet_utxoset_get_created(const tal_t *ctx, struct wallet *w,
 	return db_scids(ctx, stmt);
 }
 
+const u8 **wallet_utxoset_unspent_scripts(const tal_t *ctx, struct wallet *w)
+{
+	struct db_stmt *stmt;
+	const u8 **scripts = tal_arr(ctx, const u8 *, 0);
+
+	stmt = db_prepare_v2(w->db, SQL("SELECT"
+					" scriptpubkey "
+					"FROM utxoset "
+					"WHERE spendheight IS NULL"));
+	db_query_prepared(stmt);
+	while (db_step(stmt)) {
+		const u8 *script = db_col_arr(scripts, stmt, "scriptpubkey", u8);
+		tal_arr_expand(&scripts, script);
+	}
+	tal_free(stmt);
+	return scripts;
+}
+
 void wallet_transaction_add(struct wallet *w, const struct wally_tx *tx,
 			    const u32 blockheight, const u32 txindex)
 {
@@ -4367,6 +4853,32 @@ struct channeltx *wallet_channeltxs_get(struct wallet *w, const tal_t *ctx,
 	return res;
 }
 
+/* Bump a forwards index (and tell `wait`).  Pointer args can be NULL. */
+static u64 forward_index_inc(struct wallet *w,
+			     enum wait_index index,
+			     enum forward_status state,
+			     const struct short_channel_id *in_channel,
+			     const u64 *in_htlc_id,
+			     const struct amount_msat *in_msat,
+			     const struct short_channel_id *out_channel)
+{
+	return wait_index_increment(w->ld,
+				    WAIT_SUBSYSTEM_FORWARD,
+				    index,
+				    "status", forward_status_name(state),
+				    "in_channel",
+				    in_channel ? short_channel_id_to_str(tmpctx, in_channel) : NULL,
+				    "=in_htlc_id",
+				    in_htlc_id ? tal_fmt(tmpctx, "%"PRIu64, *in_htlc_id) : NULL,
+				    "=in_msat",
+				    in_msat ? tal_fmt(tmpctx, "%"PRIu64,
+						      in_msat->millisatoshis) /* Raw: JSON */
+				    : NULL,
+				    "out_channel",
+				    out_channel ? short_channel_id_to_str(tmpctx, out_channel) : NULL,
+				    NULL);
+}
+
 static bool wallet_forwarded_payment_update(struct wallet *w,
 					    const struct htlc_in *in,
 					    const struct htlc_out *out,
@@ -4425,9 +4937,162 @@ static bool wallet_forwarded_payment_update(struct wallet *w,
 	changed = db_count_changes(stmt) != 0;
 	tal_free(stmt);
 
+	/* Only bump updated_index if there was something to update. */
+	if (changed) {
+		stmt = db_prepare_v2(w->db,
+				     SQL("UPDATE forwards SET"
+					 "  updated_index=?"
+					 " WHERE in_htlc_id=? AND in_channel_scid=?"));
+		db_bind_u64(stmt, 0,
+			    forward_index_inc(w, WAIT_INDEX_UPDATED, state,
+					      channel_scid_or_local_alias(in->key.channel),
+					      &in->key.id, &in->msat,
+					      out ? channel_scid_or_local_alias(out->key.channel) : NULL));
+		db_bind_u64(stmt, 1, in->key.id);
+		db_bind_scid(stmt, 2, channel_scid_or_local_alias(in->key.channel));
+		db_exec_prepared_v2(take(stmt));
+	}
+
 	return changed;
 }
 
+/* Is this forward already in the db?  If so, what state, and which
+ * out channel (all-zero if unknown)? */
+static bool wallet_forward_prev_state(struct wallet *w,
+				      const struct htlc_in *in,
+				      enum forward_status *state,
+				      struct short_channel_id *scid_out)
+{
+	struct db_stmt *stmt;
+	bool found;
+
+	stmt = db_prepare_v2(w->db,
+			     SQL("SELECT state, out_channel_scid FROM forwards"
+				 " WHERE in_htlc_id=? AND in_channel_scid=?"));
+	db_bind_u64(stmt, 0, in->key.id);
+	db_bind_scid(stmt, 1, channel_scid_or_local_alias(in->key.channel));
+	db_query_prepared(stmt);
+	found = db_step(stmt);
+	if (found) {
+		*state = db_col_int(stmt, "state");
+		if (db_col_is_null(stmt, "out_channel_scid"))
+			memset(scid_out, 0, sizeof(*scid_out));
+		else
+			db_col_scid(stmt, "out_channel_scid", scid_out);
+	}
+	tal_free(stmt);
+	return found;
+}
+
+/* Add a newly-resolved forward to its rollup bucket(s) */
+static void wallet_forward_rollup_add(struct wallet *w,
+				      struct timeabs when,
+				      const struct short_channel_id *scid_in,
+				      const struct short_channel_id *scid_out,
+				      struct amount_msat msat_in,
+				      const struct amount_msat *msat_out,
+				      enum forward_status state,
+				      enum onion_wire failcode)
+{
+	struct db_stmt *stmt;
+	struct amount_msat in = AMOUNT_MSAT(0), out = AMOUNT_MSAT(0),
+		fee = AMOUNT_MSAT(0);
+	u64 bucket = when.ts.tv_sec / FORWARD_ROLLUP_SECONDS * FORWARD_ROLLUP_SECONDS;
+	bool changed;
+
+	if (state == FORWARD_SETTLED) {
+		in = msat_in;
+		if (msat_out) {
+			out = *msat_out;
+			if (!amount_msat_sub(&fee, in, out))
+				fee = AMOUNT_MSAT(0);
+		}
+	}
+
+	stmt = db_prepare_v2(w->db,
+			     SQL("UPDATE forward_rollups SET"
+				 "  settled = settled + ?"
+				 ", failed = failed + ?"
+				 ", local_failed = local_failed + ?"
+				 ", in_msatoshi = in_msatoshi + ?"
+				 ", out_msatoshi = out_msatoshi + ?"
+				 ", fee_msatoshi = fee_msatoshi + ?"
+				 " WHERE bucket_time = ?"
+				 " AND in_channel_scid = ?"
+				 " AND out_channel_scid = ?"));
+	db_bind_int(stmt, 0, state == FORWARD_SETTLED);
+	db_bind_int(stmt, 1, state == FORWARD_FAILED);
+	db_bind_int(stmt, 2, state == FORWARD_LOCAL_FAILED);
+	db_bind_amount_msat(stmt, 3, &in);
+	db_bind_amount_msat(stmt, 4, &out);
+	db_bind_amount_msat(stmt, 5, &fee);
+	db_bind_u64(stmt, 6, bucket);
+	db_bind_scid(stmt, 7, scid_in);
+	db_bind_scid(stmt, 8, scid_out);
+	db_exec_prepared_v2(stmt);
+	changed = db_count_changes(stmt) != 0;
+	tal_free(stmt);
+
+	if (!changed) {
+		stmt = db_prepare_v2(w->db,
+				     SQL("INSERT INTO forward_rollups ("
+					 "  bucket_time"
+					 ", in_channel_scid"
+					 ", out_channel_scid"
+					 ", settled"
+					 ", failed"
+					 ", local_failed"
+					 ", in_msatoshi"
+					 ", out_msatoshi"
+					 ", fee_msatoshi"
+					 ") VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);"));
+		db_bind_u64(stmt, 0, bucket);
+		db_bind_scid(stmt, 1, scid_in);
+		db_bind_scid(stmt, 2, scid_out);
+		db_bind_int(stmt, 3, state == FORWARD_SETTLED);
+		db_bind_int(stmt, 4, state == FORWARD_FAILED);
+		db_bind_int(stmt, 5, state == FORWARD_LOCAL_FAILED);
+		db_bind_amount_msat(stmt, 6, &in);
+		db_bind_amount_msat(stmt, 7, &out);
+		db_bind_amount_msat(stmt, 8, &fee);
+		db_exec_prepared_v2(take(stmt));
+	}
+
+	if (failcode == 0)
+		return;
+
+	stmt = db_prepare_v2(w->db,
+			     SQL("UPDATE forward_rollup_failures SET"
+				 "  num = num + 1"
+				 " WHERE bucket_time = ?"
+				 " AND in_channel_scid = ?"
+				 " AND out_channel_scid = ?"
+				 " AND failcode = ?"));
+	db_bind_u64(stmt, 0, bucket);
+	db_bind_scid(stmt, 1, scid_in);
+	db_bind_scid(stmt, 2, scid_out);
+	db_bind_int(stmt, 3, (int)failcode);
+	db_exec_prepared_v2(stmt);
+	changed = db_count_changes(stmt) != 0;
+	tal_free(stmt);
+
+	if (!changed) {
+		stmt = db_prepare_v2(w->db,
+				     SQL("INSERT INTO forward_rollup_failures ("
+					 "  bucket_time"
+					 ", in_channel_scid"
+					 ", out_channel_scid"
+					 ", failcode"
+					 ", num"
+					 ") VALUES (?, ?, ?, ?, 1);"));
+		db_bind_u64(stmt, 0, bucket);
+		db_bind_scid(stmt, 1, scid_in);
+		db_bind_scid(stmt, 2, scid_out);
+		db_bind_int(stmt, 3, (int)failcode);
+		db_exec_prepared_v2(take(stmt));
+	}
+}
+
 void wallet_forwarded_payment_add(struct wallet *w, const struct htlc_in *in,
 				  enum forward_style forward_style,
 				  const struct short_channel_id *scid_out,
@@ -4437,6 +5102,8 @@ void wallet_forwarded_payment_add(struct wallet *w, const struct htlc_in *in,
 {
 	struct db_stmt *stmt;
 	struct timeabs *resolved_time;
+	struct short_channel_id rollup_out;
+	bool rollup = false;
 
 	if (state == FORWARD_SETTLED || state == FORWARD_FAILED) {
 		resolved_time = tal(tmpctx, struct timeabs);
@@ -4445,6 +5112,21 @@ void wallet_forwarded_payment_add(struct wallet *w, const struct htlc_in *in,
 		resolved_time = NULL;
 	}
 
+	/* Only roll up the first time it's resolved: we can be told
+	 * more than once. */
+	if (state != FORWARD_OFFERED) {
+		enum forward_status prev;
+		if (wallet_forward_prev_state(w, in, &prev, &rollup_out))
+			rollup = (prev == FORWARD_OFFERED);
+		else {
+			rollup = true;
+			if (scid_out)
+				rollup_out = *scid_out;
+			else
+				memset(&rollup_out, 0, sizeof(rollup_out));
+		}
+	}
+
 	if (wallet_forwarded_payment_update(w, in, out, state, failcode, resolved_time, forward_style))
 		goto notify;
 
@@ -4461,7 +5143,8 @@ void wallet_forwarded_payment_add(struct wallet *w, const struct htlc_in *in,
 				 ", resolved_time"
 				 ", failcode"
 				 ", forward_style"
-				 ") VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);"));
+				 ", created_index"
+				 ") VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);"));
 	db_bind_u64(stmt, 0, in->key.id);
 
 	/* FORWARD_LOCAL_FAILED may occur before we get htlc_out */
@@ -4512,9 +5195,20 @@ void wallet_forwarded_payment_add(struct wallet *w, const struct htlc_in *in,
 	else
 		db_bind_int(stmt, 10, forward_style_in_db(forward_style));
 
+	db_bind_u64(stmt, 11,
+		    forward_index_inc(w, WAIT_INDEX_CREATED, state,
+				      channel_scid_or_local_alias(in->key.channel),
+				      &in->key.id, &in->msat, scid_out));
 	db_exec_prepared_v2(take(stmt));
 
 notify:
+	if (rollup)
+		wallet_forward_rollup_add(w,
+					  resolved_time ? *resolved_time : time_now(),
+					  channel_scid_or_local_alias(in->key.channel),
+					  &rollup_out, in->msat,
+					  out ? &out->msat : NULL,
+					  state, failcode);
 	notify_forward_event(w->ld, in, scid_out, out ? &out->msat : NULL,
 			     state, failcode, resolved_time, forward_style);
 }
@@ -4525,19 +5219,20 @@ struct amount_msat wallet_total_forward_fees(struct wallet *w)
 	struct amount_msat total, deleted;
 	bool res;
 
+	/* Rollups aren't deleted, so this is one row per bucket, not
+	 * per forward. */
 	stmt = db_prepare_v2(w->db, SQL("SELECT"
-					" CAST(COALESCE(SUM(in_msatoshi - out_msatoshi), 0) AS BIGINT)"
-					" FROM forwards "
-					"WHERE state = ?;"));
-	db_bind_int(stmt, 0, wallet_forward_status_in_db(FORWARD_SETTLED));
+					" CAST(COALESCE(SUM(fee_msatoshi), 0) AS BIGINT)"
+					" FROM forward_rollups;"));
 	db_query_prepared(stmt);
 
 	res = db_step(stmt);
 	assert(res);
 
-	db_col_amount_msat(stmt, "CAST(COALESCE(SUM(in_msatoshi - out_msatoshi), 0) AS BIGINT)", &total);
+	db_col_amount_msat(stmt, "CAST(COALESCE(SUM(fee_msatoshi), 0) AS BIGINT)", &total);
 	tal_free(stmt);
 
+	/* Forwards deleted before we had rollups */
 	deleted = amount_msat(db_get_intvar(w->db, "deleted_forward_fees", 0));
 	if (!amount_msat_add(&total, total, deleted))
 		db_fatal("Adding forward fees %s + %s overflowed",
@@ -4571,7 +5266,10 @@ const struct forwarding *wallet_forwarded_payments_get(struct wallet *w,
 						       const tal_t *ctx,
 						       enum forward_status status,
 						       const struct short_channel_id *chan_in,
-						       const struct short_channel_id *chan_out)
+						       const struct short_channel_id *chan_out,
+						       const enum wait_index *listindex,
+						       u64 liststart,
+						       const u32 *listlimit)
 {
 	struct forwarding *results = tal_arr(ctx, struct forwarding, 0);
 	size_t count = 0;
@@ -4580,24 +5278,77 @@ const struct forwarding *wallet_forwarded_payments_get(struct wallet *w,
 	// placeholder for any parameter, the value doesn't matter because it's discarded by sql
 	const int any = -1;
 
-	stmt = db_prepare_v2(
-	    w->db,
-	    SQL("SELECT"
-		"  state"
-		", in_msatoshi"
-		", out_msatoshi"
-		", in_channel_scid"
-		", out_channel_scid"
-		", in_htlc_id"
-		", out_htlc_id"
-		", received_time"
-		", resolved_time"
-		", failcode "
-		", forward_style "
-		"FROM forwards "
-		"WHERE (1 = ? OR state = ?) AND "
-		"(1 = ? OR in_channel_scid = ?) AND "
-		"(1 = ? OR out_channel_scid = ?)"));
+	if (!listindex) {
+		stmt = db_prepare_v2(
+		    w->db,
+		    SQL("SELECT"
+			"  state"
+			", in_msatoshi"
+			", out_msatoshi"
+			", in_channel_scid"
+			", out_channel_scid"
+			", in_htlc_id"
+			", out_htlc_id"
+			", received_time"
+			", resolved_time"
+			", failcode "
+			", forward_style "
+			", created_index "
+			", updated_index "
+			"FROM forwards "
+			"WHERE (1 = ? OR state = ?) AND "
+			"(1 = ? OR in_channel_scid = ?) AND "
+			"(1 = ? OR out_channel_scid = ?)"));
+	} else if (*listindex == WAIT_INDEX_CREATED) {
+		stmt = db_prepare_v2(
+		    w->db,
+		    SQL("SELECT"
+			"  state"
+			", in_msatoshi"
+			", out_msatoshi"
+			", in_channel_scid"
+			", out_channel_scid"
+			", in_htlc_id"
+			", out_htlc_id"
+			", received_time"
+			", resolved_time"
+			", failcode "
+			", forward_style "
+			", created_index "
+			", updated_index "
+			"FROM forwards "
+			"WHERE (1 = ? OR state = ?) AND "
+			"(1 = ? OR in_channel_scid = ?) AND "
+			"(1 = ? OR out_channel_scid = ?) AND "
+			"created_index >= ? "
+			"ORDER BY created_index "
+			"LIMIT ?"));
+	} else {
+		assert(*listindex == WAIT_INDEX_UPDATED);
+		stmt = db_prepare_v2(
+		    w->db,
+		    SQL("SELECT"
+			"  state"
+			", in_msatoshi"
+			", out_msatoshi"
+			", in_channel_scid"
+			", out_channel_scid"
+			", in_htlc_id"
+			", out_htlc_id"
+			", received_time"
+			", resolved_time"
+			", failcode "
+			", forward_style "
+			", created_index "
+			", updated_index "
+			"FROM forwards "
+			"WHERE (1 = ? OR state = ?) AND "
+			"(1 = ? OR in_channel_scid = ?) AND "
+			"(1 = ? OR out_channel_scid = ?) AND "
+			"updated_index >= ? "
+			"ORDER BY updated_index "
+			"LIMIT ?"));
+	}
 
 	if (status == FORWARD_ANY) {
 		// any status
@@ -4629,6 +5380,11 @@ const struct forwarding *wallet_forwarded_payments_get(struct wallet *w,
 		db_bind_int(stmt, 5, any);
 	}
 
+	if (listindex) {
+		db_bind_u64(stmt, 6, liststart);
+		db_bind_int(stmt, 7, listlimit ? *listlimit : INT_MAX);
+	}
+
 	db_query_prepared(stmt);
 
 	for (count=0; db_step(stmt); count++) {
@@ -4703,11 +5459,140 @@ const struct forwarding *wallet_forwarded_payments_get(struct wallet *w,
 			cur->forward_style
 				= forward_style_in_db(db_col_int(stmt, "forward_style"));
 		}
+		cur->created_index = db_col_u64(stmt, "created_index");
+		cur->updated_index = db_col_u64(stmt, "updated_index");
 	}
 	tal_free(stmt);
 	return results;
 }
 
+/* Binds the filters common to both rollup queries */
+static void bind_rollup_filters(struct db_stmt *stmt,
+				const struct short_channel_id *chan_in,
+				const struct short_channel_id *chan_out,
+				u64 start,
+				const u64 *end)
+{
+	db_bind_u64(stmt, 0, start);
+	db_bind_int(stmt, 1, end == NULL);
+	db_bind_u64(stmt, 2, end ? *end : 0);
+	db_bind_int(stmt, 3, chan_in == NULL);
+	if (chan_in)
+		db_bind_scid(stmt, 4, chan_in);
+	else
+		db_bind_null(stmt, 4);
+	db_bind_int(stmt, 5, chan_out == NULL);
+	if (chan_out)
+		db_bind_scid(stmt, 6, chan_out);
+	else
+		db_bind_null(stmt, 6);
+}
+
+static bool rollup_key_eq(const struct forward_rollup *r,
+			  u64 bucket_time,
+			  const struct short_channel_id *chan_in,
+			  const struct short_channel_id *chan_out)
+{
+	return r->bucket_time == bucket_time
+		&& short_channel_id_eq(&r->channel_in, chan_in)
+		&& short_channel_id_eq(&r->channel_out, chan_out);
+}
+
+const struct forward_rollup *wallet_forward_rollups_get(struct wallet *w,
+							 const tal_t *ctx,
+							 const struct short_channel_id *chan_in,
+							 const struct short_channel_id *chan_out,
+							 u64 start,
+							 const u64 *end)
+{
+	struct forward_rollup *rollups = tal_arr(ctx, struct forward_rollup, 0);
+	struct db_stmt *stmt;
+	size_t n;
+
+	stmt = db_prepare_v2(w->db,
+			     SQL("SELECT"
+				 "  bucket_time"
+				 ", in_channel_scid"
+				 ", out_channel_scid"
+				 ", settled"
+				 ", failed"
+				 ", local_failed"
+				 ", in_msatoshi"
+				 ", out_msatoshi"
+				 ", fee_msatoshi"
+				 " FROM forward_rollups"
+				 " WHERE bucket_time >= ?"
+				 " AND (1 = ? OR bucket_time < ?)"
+				 " AND (1 = ? OR in_channel_scid = ?)"
+				 " AND (1 = ? OR out_channel_scid = ?)"
+				 " ORDER BY bucket_time, in_channel_scid, out_channel_scid"));
+	bind_rollup_filters(stmt, chan_in, chan_out, start, end);
+	db_query_prepared(stmt);
+	while (db_step(stmt)) {
+		struct forward_rollup *r;
+
+		tal_resize(&rollups, tal_count(rollups) + 1);
+		r = &rollups[tal_count(rollups) - 1];
+		r->bucket_time = db_col_u64(stmt, "bucket_time");
+		db_col_scid(stmt, "in_channel_scid", &r->channel_in);
+		db_col_scid(stmt, "out_channel_scid", &r->channel_out);
+		r->settled = db_col_u64(stmt, "settled");
+		r->failed = db_col_u64(stmt, "failed");
+		r->local_failed = db_col_u64(stmt, "local_failed");
+		db_col_amount_msat(stmt, "in_msatoshi", &r->msat_in);
+		db_col_amount_msat(stmt, "out_msatoshi", &r->msat_out);
+		db_col_amount_msat(stmt, "fee_msatoshi", &r->fee);
+		r->failures = tal_arr(rollups, struct forward_rollup_failure, 0);
+	}
+	tal_free(stmt);
+
+	/* Same order, so we can merge as we go. */
+	stmt = db_prepare_v2(w->db,
+			     SQL("SELECT"
+				 "  bucket_time"
+				 ", in_channel_scid"
+				 ", out_channel_scid"
+				 ", failcode"
+				 ", num"
+				 " FROM forward_rollup_failures"
+				 " WHERE bucket_time >= ?"
+				 " AND (1 = ? OR bucket_time < ?)"
+				 " AND (1 = ? OR in_channel_scid = ?)"
+				 " AND (1 = ? OR out_channel_scid = ?)"
+				 " ORDER BY bucket_time, in_channel_scid, out_channel_scid, failcode"));
+	bind_rollup_filters(stmt, chan_in, chan_out, start, end);
+	db_query_prepared(stmt);
+	n = 0;
+	while (db_step(stmt)) {
+		struct short_channel_id scid_in, scid_out;
+		struct forward_rollup_failure f;
+		u64 bucket_time = db_col_u64(stmt, "bucket_time");
+
+		db_col_scid(stmt, "in_channel_scid", &scid_in);
+		db_col_scid(stmt, "out_channel_scid", &scid_out);
+		f.failcode = db_col_int(stmt, "failcode");
+		f.count = db_col_u64(stmt, "num");
+
+		while (n < tal_count(rollups)
+		       && !rollup_key_eq(&rollups[n], bucket_time,
+					 &scid_in, &scid_out))
+			n++;
+		/* They're always added together, so this shouldn't happen */
+		if (n == tal_count(rollups)) {
+			log_broken(w->log, "forward_rollup_failures without"
+				   " matching forward_rollups for %s->%s at %"PRIu64,
+				   short_channel_id_to_str(tmpctx, &scid_in),
+				   short_channel_id_to_str(tmpctx, &scid_out),
+				   bucket_time);
+			break;
+		}
+		tal_arr_expand(&rollups[n].failures, f);
+	}
+	tal_free(stmt);
+
+	return rollups;
+}
+
 bool wallet_forward_delete(struct wallet *w,
 			   const struct short_channel_id *chan_in,
 			   const u64 *htlc_id,
@@ -4716,43 +5601,8 @@ bool wallet_forward_delete(struct wallet *w,
 	struct db_stmt *stmt;
 	bool changed;
 
-	/* When deleting settled ones, we have to add to deleted_forward_fees! */
-	if (state == FORWARD_SETTLED) {
-		/* Of course, it might not be settled: don't add if they're wrong! */
-		if (htlc_id) {
-			stmt = db_prepare_v2(w->db, SQL("SELECT"
-							" CAST(COALESCE(SUM(in_msatoshi - out_msatoshi), 0) AS BIGINT)"
-							" FROM forwards "
-							" WHERE in_channel_scid = ?"
-							" AND in_htlc_id = ?"
-							" AND state = ?;"));
-			db_bind_scid(stmt, 0, chan_in);
-			db_bind_u64(stmt, 1, *htlc_id);
-			db_bind_int(stmt, 2, wallet_forward_status_in_db(FORWARD_SETTLED));
-		} else {
-			stmt = db_prepare_v2(w->db, SQL("SELECT"
-							" CAST(COALESCE(SUM(in_msatoshi - out_msatoshi), 0) AS BIGINT)"
-							" FROM forwards "
-							" WHERE in_channel_scid = ?"
-							" AND in_htlc_id IS NULL"
-							" AND state = ?;"));
-			db_bind_scid(stmt, 0, chan_in);
-			db_bind_int(stmt, 1, wallet_forward_status_in_db(FORWARD_SETTLED));
-		}
-		db_query_prepared(stmt);
-
-		if (db_step(stmt)) {
-			struct amount_msat deleted;
-
-			db_col_amount_msat(stmt, "CAST(COALESCE(SUM(in_msatoshi - out_msatoshi), 0) AS BIGINT)", &deleted);
-			deleted.millisatoshis += /* Raw: db access */
-				db_get_intvar(w->db, "deleted_forward_fees", 0);
-			db_set_intvar(w->db, "deleted_forward_fees",
-				      deleted.millisatoshis); /* Raw: db access */
-		}
-		tal_free(stmt);
-	}
-
+	/* No need to adjust deleted_forward_fees: the fees are still in
+	 * forward_rollups. */
 	if (htlc_id) {
 		stmt = db_prepare_v2(w->db,
 				     SQL("DELETE FROM forwards"
@@ -4773,11 +5623,78 @@ bool wallet_forward_delete(struct wallet *w,
 	}
 	db_exec_prepared_v2(stmt);
 	changed = db_count_changes(stmt) != 0;
+
+	/* Without an htlc_id, there may be more than one. */
+	for (size_t i = 0; i < db_count_changes(stmt); i++)
+		forward_index_inc(w, WAIT_INDEX_DELETED, state,
+				  chan_in, htlc_id, NULL, NULL);
 	tal_free(stmt);
 
 	return changed;
 }
 
+u64 wallet_forward_delete_older(struct wallet *w,
+				enum forward_status state,
+				u64 max_time, u32 limit,
+				u64 *remaining)
+{
+	struct db_stmt *stmt;
+	struct timeabs t;
+	u64 deleted;
+
+	assert(state != FORWARD_OFFERED && state != FORWARD_ANY);
+
+	/* resolved_time is stored in nanoseconds: don't overflow that. */
+	t.ts.tv_sec = min_u64(max_time, INT64_MAX / 1000000000 - 1);
+	t.ts.tv_nsec = 999999999;
+
+	/* Forwards without a resolved_time (from old nodes) are never
+	 * selected.  As with wallet_forward_delete, the fees remain in
+	 * forward_rollups.  created_index is unique (forwards_created_idx),
+	 * unlike (in_channel_scid, in_htlc_id) for very old forwards. */
+	stmt = db_prepare_v2(w->db,
+			     SQL("DELETE FROM forwards"
+				 " WHERE created_index IN"
+				 "  (SELECT created_index FROM forwards"
+				 "    WHERE state = ?"
+				 "      AND resolved_time <= ?"
+				 "    ORDER BY created_index"
+				 "    LIMIT ?)"));
+	db_bind_int(stmt, 0, wallet_forward_status_in_db(state));
+	db_bind_timeabs(stmt, 1, t);
+	db_bind_int(stmt, 2, limit);
+	db_exec_prepared_v2(stmt);
+	deleted = db_count_changes(stmt);
+	tal_free(stmt);
+
+	wait_index_increase(w->ld,
+			    WAIT_SUBSYSTEM_FORWARD,
+			    WAIT_INDEX_DELETED,
+			    deleted,
+			    "status", forward_status_name(state),
+			    "=count", tal_fmt(tmpctx, "%"PRIu64, deleted),
+			    NULL);
+
+	/* If we didn't hit the limit, this is the last call: count what's
+	 * left, once.  Otherwise just what the caller still has to delete. */
+	if (deleted < limit)
+		stmt = db_prepare_v2(w->db, SQL("SELECT COUNT(*) FROM forwards"));
+	else {
+		stmt = db_prepare_v2(w->db,
+				     SQL("SELECT COUNT(*) FROM forwards"
+					 " WHERE state = ?"
+					 "   AND resolved_time <= ?"));
+		db_bind_int(stmt, 0, wallet_forward_status_in_db(state));
+		db_bind_timeabs(stmt, 1, t);
+	}
+	db_query_prepared(stmt);
+	db_step(stmt);
+	*remaining = db_col_u64(stmt, "COUNT(*)");
+	tal_free(stmt);
+
+	return deleted;
+}
+
 struct wallet_transaction *wallet_transactions_get(struct wallet *w, const tal_t *ctx)
 {
 	struct db_stmt *stmt;
@@ -5454,6 +6371,15 @@ struct wallet_htlc_iter *wallet_htlcs_first(const tal_t *ctx,
 
 		i->stmt = db_prepare_v2(w->db,
 					SQL("SELECT h.channel_htlc_id"
+					    ", h.cltv_expiry"
+					    ", h.direction"
+					    ", h.msatoshi"
+					    ", h.payment_hash"
+					    ", h.hstate"
+					    " FROM channel_htlcs_archive h"
+					    " WHERE channel_id = ?"
+					    " UNION ALL"
+					    " SELECT h.channel_htlc_id"
 					    ", h.cltv_expiry"
 					    ", h.direction"
 					    ", h.msatoshi"
@@ -5462,10 +6388,22 @@ struct wallet_htlc_iter *wallet_htlcs_first(const tal_t *ctx,
 					    " FROM channel_htlcs h"
 					    " WHERE channel_id = ?"));
 		db_bind_u64(i->stmt, 0, chan->dbid);
+		db_bind_u64(i->stmt, 1, chan->dbid);
 	} else {
 		i->scid.u64 = 0;
 		i->stmt = db_prepare_v2(w->db,
 					SQL("SELECT channels.scid"
+					    ", channels.alias_local"
+					    ", h.channel_htlc_id"
+					    ", h.cltv_expiry"
+					    ", h.direction"
+					    ", h.msatoshi"
+					    ", h.payment_hash"
+					    ", h.hstate"
+					    " FROM channel_htlcs_archive h"
+					    " JOIN channels ON channels.id = h.channel_id"
+					    " UNION ALL"
+					    " SELECT channels.scid"
 					    ", channels.alias_local"
 					    ", h.channel_htlc_id"
 					    ", h.cltv_expiry"
@@ -10,6 +10,7 @@
 #include <lightningd/bitcoind.h>
 #include <lightningd/log.h>
 #include <lightningd/peer_htlcs.h>
+#include <lightningd/wait.h>
 
 struct amount_msat;
 struct invoices;
@@ -20,6 +21,7 @@ struct node_id;
 struct oneshot;
 struct peer;
 struct timers;
+struct utxo_pool;
 enum channel_state;
 enum state_change;
 
@@ -40,6 +42,12 @@ struct wallet {
 	 * the blockchain. This is currently all P2WSH outputs */
 	struct outpointfilter *utxoset_outpoints;
 
+	/* Every output of ours which isn't spent, for coin selection. */
+	struct utxo_pool *utxo_pool;
+
+	/* Blockheight we last pruned the utxoset at. */
+	u32 utxoset_last_prune;
+
 	/* How many keys should we look ahead at most? */
 	u64 keyscan_gap;
 };
@@ -283,6 +291,30 @@ struct forwarding {
 	struct timeabs received_time;
 	/* May not be present if the HTLC was not resolved yet. */
 	struct timeabs *resolved_time;
+	/* For `wait` and paginated listforwards (updated is 0 if never) */
+	u64 created_index, updated_index;
+};
+
+/* Resolved forwards are also summed into per-channel buckets this long,
+ * which outlive delforward. */
+#define FORWARD_ROLLUP_SECONDS 3600
+
+struct forward_rollup_failure {
+	enum onion_wire failcode;
+	u64 count;
+};
+
+struct forward_rollup {
+	/* Start of the bucket, in seconds since the epoch. */
+	u64 bucket_time;
+	/* channel_out is all-zero if unknown. */
+	struct short_channel_id channel_in, channel_out;
+	/* How many resolved, in each final state. */
+	u64 settled, failed, local_failed;
+	/* Totals over the settled ones. */
+	struct amount_msat msat_in, msat_out, fee;
+	/* Failures which had a failcode (remote failures usually don't). */
+	struct forward_rollup_failure *failures;
 };
 
 /* A database backed shachain struct. The datastructure is
@@ -327,6 +359,20 @@ static inline enum wallet_payment_status wallet_payment_status_in_db(enum wallet
 	fatal("%s: %u is invalid", __func__, w);
 }
 
+static inline const char *payment_status_to_string(const enum wallet_payment_status status)
+{
+	switch (status) {
+	case PAYMENT_COMPLETE:
+		return "complete";
+	case PAYMENT_FAILED:
+		return "failed";
+	case PAYMENT_PENDING:
+		return "pending";
+	}
+	//This should never happen
+	abort();
+}
+
 /* Outgoing payments. A simple persisted representation
  * of a payment we initiated. This can be used by
  * a UI (alongside invoices) to display the balance history.
@@ -334,7 +380,10 @@ static inline enum wallet_payment_status wallet_payment_status_in_db(enum wallet
 struct wallet_payment {
 	/* If it's in unstored_payments */
 	struct list_node list;
+	/* Database id, also the created_index (0 if not stored yet) */
 	u64 id;
+	/* Non-zero once it's been updated */
+	u64 updated_index;
 	u32 timestamp;
 	u32 *completed_at;
 
@@ -490,6 +539,30 @@ struct utxo *wallet_find_utxo(const tal_t *ctx, struct wallet *w,
 			      u32 maxheight,
 			      const struct utxo **excludes);
 
+/**
+ * wallet_find_utxos_changeless - Select UTXOs which need no change output.
+ * @ctx: tal context
+ * @w: wallet
+ * @current_blockheight: current chain length.
+ * @target: the amount needed, plus the fee for the tx without these inputs.
+ * @cost_of_change: how far above @target we can go, rather than add change.
+ * @feerate_per_kw: feerate we are using.
+ * @min_witness_weight: as for utxo_spend_weight().
+ * @maxheight: zero (if caller doesn't care) or maximum blockheight to accept.
+ *
+ * Uses branch-and-bound over the unspent outputs: returns NULL if it
+ * doesn't find a selection worth between @target and @target +
+ * @cost_of_change once each input pays its own fee.  Does not reserve them!
+ */
+struct utxo **wallet_find_utxos_changeless(const tal_t *ctx,
+					   struct wallet *w,
+					   unsigned current_blockheight,
+					   struct amount_sat target,
+					   struct amount_sat cost_of_change,
+					   unsigned feerate_per_kw,
+					   size_t min_witness_weight,
+					   u32 maxheight);
+
 /**
  * wallet_add_onchaind_utxo - Add a UTXO with spending info from onchaind.
  *
@@ -647,6 +720,33 @@ void wallet_peer_delete(struct wallet *w, u64 peer_dbid);
  */
 bool wallet_init_channels(struct wallet *w);
 
+/* What's left of a channel in the db once it's CLOSED: these are not loaded
+ * at startup, only when someone asks. */
+struct closed_channel {
+	u64 dbid;
+	struct channel_id cid;
+	/* NULL if it never got one */
+	struct short_channel_id *scid;
+	struct bitcoin_outpoint funding;
+	enum side opener;
+	/* NUM_SIDES if unknown */
+	enum side closer;
+	u8 channel_flags;
+	struct amount_sat funding_sats;
+	struct amount_msat our_msat, msat_to_us_min, msat_to_us_max;
+	enum state_change state_change_cause;
+};
+
+/**
+ * wallet_closed_channels_load -- Load all closed channels from the db
+ * @ctx: tal context to allocate return from
+ * @w: wallet to load from
+ *
+ * Returns a tal_arr, in order of channel creation.
+ */
+struct closed_channel *wallet_closed_channels_load(const tal_t *ctx,
+						   struct wallet *w);
+
 /**
  * wallet_channel_stats_incr_* - Increase channel statistics.
  *
@@ -814,6 +914,15 @@ static inline enum invoice_status invoice_status_in_db(enum invoice_status s)
 	fatal("%s: %u is invalid", __func__, s);
 }
 
+static inline const char *invoice_status_str(enum invoice_status state)
+{
+	if (state == PAID)
+		return "paid";
+	if (state == EXPIRED)
+		return "expired";
+	return "unpaid";
+}
+
 /* The information about an invoice */
 struct invoice_details {
 	/* Current invoice state */
@@ -843,6 +952,8 @@ struct invoice_details {
 	u8 *features;
 	/* The offer this refers to, if any. */
 	struct sha256 *local_offer_id;
+	/* Index values for `wait` (updated is 0 if never) */
+	u64 created_index, updated_index;
 };
 
 /* An object that handles iteration over the set of invoices */
@@ -955,24 +1066,47 @@ bool wallet_invoice_delete_description(struct wallet *wallet,
 void wallet_invoice_delete_expired(struct wallet *wallet,
 				   u64 max_expiry_time);
 
+/**
+ * wallet_invoice_delete_older - Delete old paid or expired invoices
+ *
+ * @wallet - the wallet to delete invoices from.
+ * @state - PAID or EXPIRED.
+ * @max_time - the latest paid_at (or expires_at) time to delete.
+ * @limit - the maximum number of invoices to delete.
+ * @remaining - set to the number of invoices left afterwards (if @limit
+ *   were deleted, only those matching @state and @max_time).
+ *
+ * Returns the number of invoices deleted.
+ */
+u64 wallet_invoice_delete_older(struct wallet *wallet,
+				enum invoice_status state,
+				u64 max_time, u32 limit,
+				u64 *remaining);
+
 
 /**
  * wallet_invoice_iterate - Iterate over all existing invoices
  *
  * @wallet - the wallet whose invoices are to be iterated over.
  * @iterator - the iterator object to use.
+ * @listindex - what index to order by (or NULL for all, by created_index)
+ * @liststart - first index to return (if @listindex)
+ * @listlimit - limit on number of entries to return (if @listindex, or NULL)
  *
  * Return false at end-of-sequence, true if still iterating.
  * Usage:
  *
  *   struct invoice_iterator it;
  *   memset(&it, 0, sizeof(it))
- *   while (wallet_invoice_iterate(wallet, &it)) {
+ *   while (wallet_invoice_iterate(wallet, &it, NULL, 0, NULL)) {
  *       ...
  *   }
  */
 bool wallet_invoice_iterate(struct wallet *wallet,
-			    struct invoice_iterator *it);
+			    struct invoice_iterator *it,
+			    const enum wait_index *listindex,
+			    u64 liststart,
+			    const u32 *listlimit);
 
 /**
  * wallet_invoice_iterator_deref - Read the details of the
@@ -1101,6 +1235,33 @@ void wallet_payment_delete(struct wallet *wallet,
 			   const u64 *groupid,
 			   const u64 *partid);
 
+/**
+ * wallet_payment_delete_older - Remove old completed or failed payments
+ *
+ * Removes up to @limit payments with @status created at or before
+ * @max_time (a UNIX time), in a single statement.  Sets @remaining to
+ * the number of payments left (just those matching, if @limit were
+ * removed), and returns the number removed.
+ */
+u64 wallet_payment_delete_older(struct wallet *wallet,
+				enum wallet_payment_status status,
+				u64 max_time, u32 limit,
+				u64 *remaining);
+
+/**
+ * wallet_htlcs_archive - Move resolved HTLCs out of channel_htlcs
+ * @wallet: the wallet
+ * @limit: the maximum number of HTLCs to move.
+ *
+ * Fully-resolved HTLCs are never loaded again, but we need to keep
+ * them in case an old commitment transaction is broadcast.  This moves
+ * the oldest @limit of them into channel_htlcs_archive, so the table
+ * (and indexes) we use for live HTLCs stays small.
+ *
+ * Returns the number moved.
+ */
+size_t wallet_htlcs_archive(struct wallet *wallet, u32 limit);
+
 /**
  * wallet_local_htlc_out_delete - Remove a local outgoing failed HTLC
  *
@@ -1187,10 +1348,18 @@ void wallet_payment_set_failinfo(struct wallet *wallet,
  * wallet_payment_list - Retrieve a list of payments
  *
  * payment_hash: optional filter for only this payment hash.
+ * listindex: optional index to order by (and filter by liststart/listlimit)
+ * liststart: first index to return (if @listindex)
+ * listlimit: optional limit on number of entries (if @listindex)
+ *
+ * Payments not yet stored in the db are only returned if @listindex is NULL.
  */
 const struct wallet_payment **wallet_payment_list(const tal_t *ctx,
 						  struct wallet *wallet,
-						  const struct sha256 *payment_hash)
+						  const struct sha256 *payment_hash,
+						  const enum wait_index *listindex,
+						  u64 liststart,
+						  const u32 *listlimit)
 	NON_NULL_ARGS(2);
 
 
@@ -1254,11 +1423,16 @@ bool wallet_outpoint_spend(struct wallet *w, const tal_t *ctx,
 struct outpoint *wallet_outpoint_for_scid(struct wallet *w, tal_t *ctx,
 					  const struct short_channel_id *scid);
 
-void wallet_utxoset_add(struct wallet *w,
-			const struct bitcoin_outpoint *outpoint,
-			const u32 blockheight,
-			const u32 txindex, const u8 *scriptpubkey,
-			struct amount_sat sat);
+/**
+ * wallet_utxoset_add_many - add a block's P2WSH outputs to the UTXO set
+ * @w: the wallet
+ * @blockheight: the block they were created in
+ * @outpoints: tal array of outputs
+ *
+ * These are written in multi-row statements, rather than one per output.
+ */
+void wallet_utxoset_add_many(struct wallet *w, const u32 blockheight,
+			     struct filteredblock_outpoint **outpoints);
 
 /**
  * Retrieve all UTXO entries that were spent by the given blockheight.
@@ -1281,6 +1455,14 @@ wallet_utxoset_get_spent(const tal_t *ctx, struct wallet *w, u32 blockheight);
 const struct short_channel_id *
 wallet_utxoset_get_created(const tal_t *ctx, struct wallet *w, u32 blockheight);
 
+/**
+ * Retrieve the scriptPubKeys of all unspent UTXO entries.
+ *
+ * With block filters, this is what we need to look for to notice any being
+ * spent.
+ */
+const u8 **wallet_utxoset_unspent_scripts(const tal_t *ctx, struct wallet *w);
+
 void wallet_transaction_add(struct wallet *w, const struct wally_tx *tx,
 			    const u32 blockheight, const u32 txindex);
 
@@ -1383,7 +1565,21 @@ const struct forwarding *wallet_forwarded_payments_get(struct wallet *w,
 						       const tal_t *ctx,
 						       enum forward_status state,
 						       const struct short_channel_id *chan_in,
-						       const struct short_channel_id *chan_out);
+						       const struct short_channel_id *chan_out,
+						       const enum wait_index *listindex,
+						       u64 liststart,
+						       const u32 *listlimit);
+
+/**
+ * Retrieve the forward rollups whose buckets start in [start, end),
+ * optionally filtering by channels.
+ */
+const struct forward_rollup *wallet_forward_rollups_get(struct wallet *w,
+							 const tal_t *ctx,
+							 const struct short_channel_id *chan_in,
+							 const struct short_channel_id *chan_out,
+							 u64 start,
+							 const u64 *end);
 
 /**
  * Delete a particular forward entry
@@ -1394,6 +1590,17 @@ bool wallet_forward_delete(struct wallet *w,
 			   const u64 *htlc_id,
 			   enum forward_status state);
 
+/**
+ * Delete up to @limit forwards in @state resolved at or before @max_time
+ * (a UNIX time), in a single statement.  Sets @remaining to the number
+ * of forwards left (just those matching, if @limit were deleted).
+ * Returns the number deleted.
+ */
+u64 wallet_forward_delete_older(struct wallet *w,
+				enum forward_status state,
+				u64 max_time, u32 limit,
+				u64 *remaining);
+
 /**
  * Load remote_ann_node_sig and remote_ann_bitcoin_sig
  *
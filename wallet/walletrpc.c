@@ -248,7 +248,8 @@ static void json_add_utxo(struct json_stream *response,
 	json_add_amount_sat_compat(response, utxo->amount,
 				   "value", "amount_msat");
 
-	if (utxo->is_p2sh) {
+	/* Key derivation is expensive: only if they want it. */
+	if (utxo->is_p2sh && json_stream_wants(response, "redeemscript")) {
 		struct pubkey key;
 		bip32_pubkey(wallet->bip32_base, &key, utxo->keyindex);
 
@@ -257,17 +258,19 @@ static void json_add_utxo(struct json_stream *response,
 	}
 
 	json_add_hex_talarr(response, "scriptpubkey", utxo->scriptPubkey);
-	out = encode_scriptpubkey_to_addr(tmpctx, chainparams,
-					  utxo->scriptPubkey);
-	if (!out)
-		log_broken(wallet->log,
-			   "Could not encode utxo %s%s!",
-			   type_to_string(tmpctx,
-					  struct bitcoin_outpoint,
-					  &utxo->outpoint),
-			   utxo->close_info ? " (has close_info)" : "");
-	else
-		json_add_string(response, "address", out);
+	if (json_stream_wants(response, "address")) {
+		out = encode_scriptpubkey_to_addr(tmpctx, chainparams,
+						  utxo->scriptPubkey);
+		if (!out)
+			log_broken(wallet->log,
+				   "Could not encode utxo %s%s!",
+				   type_to_string(tmpctx,
+						  struct bitcoin_outpoint,
+						  &utxo->outpoint),
+				   utxo->close_info ? " (has close_info)" : "");
+		else
+			json_add_string(response, "address", out);
+	}
 
 	if (utxo->spendheight)
 		json_add_string(response, "status", "spent");
@@ -322,19 +325,25 @@ static struct command_result *json_listfunds(struct command *cmd,
 
 	response = json_stream_success(cmd);
 
-	utxos = wallet_get_utxos(cmd, cmd->ld->wallet, OUTPUT_STATE_AVAILABLE);
-	reserved_utxos = wallet_get_utxos(cmd, cmd->ld->wallet, OUTPUT_STATE_RESERVED);
+	/* Don't load every utxo from the db if they're filtered out. */
+	if (json_stream_wants(response, "outputs")) {
+		utxos = wallet_get_utxos(cmd, cmd->ld->wallet,
+					 OUTPUT_STATE_AVAILABLE);
+		reserved_utxos = wallet_get_utxos(cmd, cmd->ld->wallet,
+						  OUTPUT_STATE_RESERVED);
 
-	json_array_start(response, "outputs");
-	json_add_utxos(response, cmd->ld->wallet, utxos);
-	json_add_utxos(response, cmd->ld->wallet, reserved_utxos);
+		json_array_start(response, "outputs");
+		json_add_utxos(response, cmd->ld->wallet, utxos);
+		json_add_utxos(response, cmd->ld->wallet, reserved_utxos);
 
-	if (*spent) {
-		spent_utxos = wallet_get_utxos(cmd, cmd->ld->wallet, OUTPUT_STATE_SPENT);
-		json_add_utxos(response, cmd->ld->wallet, spent_utxos);
-	}
+		if (*spent) {
+			spent_utxos = wallet_get_utxos(cmd, cmd->ld->wallet,
+						       OUTPUT_STATE_SPENT);
+			json_add_utxos(response, cmd->ld->wallet, spent_utxos);
+		}
 
-	json_array_end(response);
+		json_array_end(response);
+	}
 
 	/* Add funds that are allocated to channels */
 	json_array_start(response, "channels");
@@ -522,7 +531,9 @@ static void json_transaction_details(struct json_stream *response,
 		json_add_u32(response, "version", wtx->version);
 
 		json_array_start(response, "inputs");
-		for (size_t i = 0; i < wtx->num_inputs; i++) {
+		for (size_t i = 0;
+		     i < wtx->num_inputs && json_stream_wants(response, NULL);
+		     i++) {
 			struct bitcoin_txid prevtxid;
 			struct wally_tx_input *in = &wtx->inputs[i];
 			bitcoin_tx_input_get_txid(tx->tx, i, &prevtxid);
@@ -545,7 +556,9 @@ static void json_transaction_details(struct json_stream *response,
 		json_array_end(response);
 
 		json_array_start(response, "outputs");
-		for (size_t i = 0; i < wtx->num_outputs; i++) {
+		for (size_t i = 0;
+		     i < wtx->num_outputs && json_stream_wants(response, NULL);
+		     i++) {
 			struct wally_tx_output *out = &wtx->outputs[i];
 			struct amount_asset amt = bitcoin_tx_output_get_amount(tx->tx, i);
 			struct amount_sat sat;
@@ -590,14 +603,16 @@ static struct command_result *json_listtransactions(struct command *cmd,
 	if (!param(cmd, buffer, params, NULL))
 		return command_param_failed();
 
-	txs = wallet_transactions_get(cmd->ld->wallet, cmd);
-
 	response = json_stream_success(cmd);
-	json_array_start(response, "transactions");
-	for (size_t i = 0; i < tal_count(txs); i++)
-		json_transaction_details(response, &txs[i]);
+	/* Loading (and parsing) every tx is expensive: skip if filtered out */
+	if (json_stream_wants(response, "transactions")) {
+		txs = wallet_transactions_get(cmd->ld->wallet, cmd);
 
-	json_array_end(response);
+		json_array_start(response, "transactions");
+		for (size_t i = 0; i < tal_count(txs); i++)
+			json_transaction_details(response, &txs[i]);
+		json_array_end(response);
+	}
 	return command_success(cmd, response);
 }
 